@@ -142,7 +142,25 @@ int anetTcpKeepAlive(char *err, int fd)
     return ANET_OK;
 }
 
-static int anetCreateSocket(char *err, int domain)
+// Have the kernel timestamp received data, see SO_TIMESTAMPNS in socket(7)
+int anetSetRecvTimestamps(char *err, int fd)
+{
+#ifdef SO_TIMESTAMPNS
+    int yes = 1;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, (void*) &yes, sizeof(yes)) == -1) {
+        anetSetError(err, "setsockopt SO_TIMESTAMPNS: %s", strerror(errno));
+        return ANET_ERR;
+    }
+    return ANET_OK;
+#else
+    (void) fd;
+    anetSetError(err, "receive timestamps not supported");
+    return ANET_ERR;
+#endif
+}
+
+static int anetCreateSocket(char *err, int domain, int type)
 {
     int s, on = 1;
     if (!max_fds) {
@@ -156,7 +174,7 @@ static int anetCreateSocket(char *err, int domain)
         anetSetError(err, "approaching RLIMIT: %s", strerror(errno));
         return ANET_ERR;
     }
-    if ((s = socket(domain, SOCK_STREAM, 0)) == -1) {
+    if ((s = socket(domain, type, 0)) == -1) {
         anetSetError(err, "creating socket: %s", strerror(errno));
         return ANET_ERR;
     }
@@ -198,7 +216,7 @@ static int anetTcpGenericConnect(char *err, char *addr, char *service, int flags
     }
 
     for (p = gai_result; p != NULL; p = p->ai_next) {
-        if ((s = anetCreateSocket(err, p->ai_family)) == ANET_ERR)
+        if ((s = anetCreateSocket(err, p->ai_family, SOCK_STREAM)) == ANET_ERR)
             continue;
 
         if (flags & ANET_CONNECT_NONBLOCK) {
@@ -266,7 +284,7 @@ int anetTcpNonBlockConnectAddr(char *err, struct addrinfo *p)
 {
     int s;
 
-    if ((s = anetCreateSocket(err, p->ai_family)) == ANET_ERR)
+    if ((s = anetCreateSocket(err, p->ai_family, SOCK_STREAM)) == ANET_ERR)
         return ANET_ERR;
 
     if (anetNonBlock(err,s) != ANET_OK) {
@@ -364,7 +382,7 @@ int anetTcpServer(char *err, char *service, char *bindaddr, int *fds, int nfds)
     }
 
     for (p = gai_result; p != NULL && i < nfds; p = p->ai_next) {
-        if ((s = anetCreateSocket(err, p->ai_family)) == ANET_ERR)
+        if ((s = anetCreateSocket(err, p->ai_family, SOCK_STREAM)) == ANET_ERR)
             continue;
 
         if (anetListen(err, s, p->ai_addr, p->ai_addrlen) == ANET_ERR) {
@@ -381,6 +399,80 @@ int anetTcpServer(char *err, char *service, char *bindaddr, int *fds, int nfds)
     return (i > 0 ? i : ANET_ERR);
 }
 
+/* Bind a datagram socket to bindaddr:service. If bindaddr is a multicast
+ * group, the socket also joins it on the default interface; SO_REUSEADDR
+ * lets several local consumers bind the same group and port. */
+int anetUdpServer(char *err, char *service, char *bindaddr)
+{
+    int s;
+    struct addrinfo gai_hints;
+    struct addrinfo *gai_result;
+    int gai_error;
+
+    gai_hints.ai_family = AF_UNSPEC;
+    gai_hints.ai_socktype = SOCK_DGRAM;
+    gai_hints.ai_protocol = 0;
+    gai_hints.ai_flags = AI_PASSIVE;
+    gai_hints.ai_addrlen = 0;
+    gai_hints.ai_addr = NULL;
+    gai_hints.ai_canonname = NULL;
+    gai_hints.ai_next = NULL;
+
+    gai_error = getaddrinfo(bindaddr, service, &gai_hints, &gai_result);
+    if (gai_error != 0) {
+        anetSetError(err, "can't resolve %s: %s", bindaddr ? bindaddr : "*", gai_strerror(gai_error));
+        return ANET_ERR;
+    }
+
+    if ((s = anetCreateSocket(err, gai_result->ai_family, SOCK_DGRAM)) == ANET_ERR) {
+        freeaddrinfo(gai_result);
+        return ANET_ERR;
+    }
+
+    if (bind(s, gai_result->ai_addr, gai_result->ai_addrlen) == -1) {
+        anetSetError(err, "bind: %s", strerror(errno));
+        goto error;
+    }
+
+    if (gai_result->ai_family == AF_INET) {
+        struct sockaddr_in *sin = (struct sockaddr_in *) gai_result->ai_addr;
+        if (IN_MULTICAST(ntohl(sin->sin_addr.s_addr))) {
+            struct ip_mreq mreq;
+            mreq.imr_multiaddr = sin->sin_addr;
+            mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+            if (setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1) {
+                anetSetError(err, "setsockopt IP_ADD_MEMBERSHIP: %s", strerror(errno));
+                goto error;
+            }
+        }
+    } else if (gai_result->ai_family == AF_INET6) {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) gai_result->ai_addr;
+        if (IN6_IS_ADDR_MULTICAST(&sin6->sin6_addr)) {
+            struct ipv6_mreq mreq;
+            mreq.ipv6mr_multiaddr = sin6->sin6_addr;
+            mreq.ipv6mr_interface = sin6->sin6_scope_id;
+            if (setsockopt(s, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq, sizeof(mreq)) == -1) {
+                anetSetError(err, "setsockopt IPV6_JOIN_GROUP: %s", strerror(errno));
+                goto error;
+            }
+        }
+    }
+
+    freeaddrinfo(gai_result);
+    return s;
+
+error:
+    freeaddrinfo(gai_result);
+    anetCloseSocket(s);
+    return ANET_ERR;
+}
+
+/* Unbound datagram socket for sending */
+int anetUdpSocket(char *err, int domain)
+{
+    return anetCreateSocket(err, domain, SOCK_DGRAM);
+}
+
 int anetGenericAccept(char *err, int s, struct sockaddr *sa, socklen_t *len)
 {
     int fd;
@@ -72,12 +72,15 @@ int anetTcpNonBlockConnectAddr(char *err, struct addrinfo *p);
 int anetGetaddrinfo(char *err, char *addr, char *service, struct addrinfo **gai_result);
 int anetRead(int fd, char *buf, int count);
 int anetTcpServer(char *err, char *service, char *bindaddr, int *fds, int nfds);
+int anetUdpServer(char *err, char *service, char *bindaddr);
+int anetUdpSocket(char *err, int domain);
 int anetGenericAccept(char *err, int s, struct sockaddr *sa, socklen_t *len);
 int anetWrite(int fd, char *buf, int count);
 int anetNonBlock(char *err, int fd);
 int anetTcpNoDelay(char *err, int fd);
 int anetTcpKeepAlive(char *err, int fd);
 int anetSetSendBuffer(char *err, int fd, int buffsize);
+int anetSetRecvTimestamps(char *err, int fd);
 void anetCloseSocket(int fd);
 
 #endif
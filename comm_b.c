@@ -25,18 +25,22 @@
 #include "readsb.h"
 #include "ais_charset.h"
 
-typedef int (*CommBDecoderFn)(struct modesMessage *, bool);
-
-static int decodeEmptyResponse(struct modesMessage *mm, bool store);
-static int decodeBDS10(struct modesMessage *mm, bool store);
-static int decodeBDS17(struct modesMessage *mm, bool store);
-static int decodeBDS20(struct modesMessage *mm, bool store);
-static int decodeBDS30(struct modesMessage *mm, bool store);
-static int decodeBDS40(struct modesMessage *mm, bool store);
-static int decodeBDS50(struct modesMessage *mm, bool store);
-static int decodeBDS60(struct modesMessage *mm, bool store);
-
-static CommBDecoderFn comm_b_decoders[] = {
+// Each decoder scores mm->MB as its format. If the score is positive, it
+// also leaves the format and what it decoded in out, with every valid bit
+// of that format set or cleared; out is scratch, nothing else in it is
+// touched. storeCommB() copies the winner's fields into the message.
+typedef int (*CommBDecoderFn)(struct modesMessage *, struct modesMessage *);
+
+static int decodeEmptyResponse(struct modesMessage *mm, struct modesMessage *out);
+static int decodeBDS10(struct modesMessage *mm, struct modesMessage *out);
+static int decodeBDS17(struct modesMessage *mm, struct modesMessage *out);
+static int decodeBDS20(struct modesMessage *mm, struct modesMessage *out);
+static int decodeBDS30(struct modesMessage *mm, struct modesMessage *out);
+static int decodeBDS40(struct modesMessage *mm, struct modesMessage *out);
+static int decodeBDS50(struct modesMessage *mm, struct modesMessage *out);
+static int decodeBDS60(struct modesMessage *mm, struct modesMessage *out);
+
+static const CommBDecoderFn comm_b_decoders[] = {
     &decodeEmptyResponse,
     &decodeBDS10,
     &decodeBDS20,
@@ -47,6 +51,120 @@ static CommBDecoderFn comm_b_decoders[] = {
     &decodeBDS60
 };
 
+// A bit per entry of comm_b_decoders that could score the message. Each
+// test is one the decoder itself fails on with a score of 0, so leaving
+// the others out doesn't change the winner, just saves calling them.
+static unsigned commBCandidates(unsigned char *msg) {
+    unsigned candidates = 0;
+
+    switch (msg[0]) {
+        case 0x00:
+            candidates |= 1 << 0; // empty response
+            break;
+        case 0x10:
+            candidates |= 1 << 1;
+            break;
+        case 0x20:
+            candidates |= 1 << 2;
+            break;
+        case 0x30:
+            candidates |= 1 << 3;
+            break;
+    }
+
+    // BDS1,7 reserved bits
+    if (getbits(msg, 25, 56) == 0) {
+        candidates |= 1 << 4;
+    }
+
+    // BDS4,0 reserved bits, and at least one status bit
+    if (getbits(msg, 40, 47) == 0 && getbits(msg, 52, 53) == 0
+            && (getbit(msg, 1) || getbit(msg, 14) || getbit(msg, 27) || getbit(msg, 48) || getbit(msg, 54))) {
+        candidates |= 1 << 5;
+    }
+
+    // BDS5,0 roll, track, GS and TAS status bits
+    if (getbit(msg, 1) && getbit(msg, 12) && getbit(msg, 24) && getbit(msg, 46)) {
+        candidates |= 1 << 6;
+    }
+
+    // BDS6,0 heading, IAS, Mach and a vertical rate status bit
+    if (getbit(msg, 1) && getbit(msg, 13) && getbit(msg, 24) && (getbit(msg, 35) || getbit(msg, 46))) {
+        candidates |= 1 << 7;
+    }
+
+    return candidates;
+}
+
+static void storeCommB(struct modesMessage *mm, const struct modesMessage *r) {
+    mm->commb_format = r->commb_format;
+
+    switch (r->commb_format) {
+        case COMMB_AIRCRAFT_IDENT:
+            if (r->callsign_valid) {
+                memcpy(mm->callsign, r->callsign, sizeof(mm->callsign));
+                mm->callsign_valid = 1;
+            }
+            break;
+
+        case COMMB_VERTICAL_INTENT:
+            modesMessageSections(mm, MM_NAV);
+            mm->nav = r->nav;
+            break;
+
+        case COMMB_TRACK_TURN:
+            if (r->roll_valid) {
+                mm->roll_valid = 1;
+                mm->roll = r->roll;
+            }
+            if (r->heading_valid) {
+                mm->heading_valid = 1;
+                mm->heading = r->heading;
+                mm->heading_type = r->heading_type;
+            }
+            if (r->gs_valid) {
+                mm->gs_valid = 1;
+                mm->gs = r->gs;
+            }
+            if (r->track_rate_valid) {
+                mm->track_rate_valid = 1;
+                mm->track_rate = r->track_rate;
+            }
+            if (r->tas_valid) {
+                mm->tas_valid = 1;
+                mm->tas = r->tas;
+            }
+            break;
+
+        case COMMB_HEADING_SPEED:
+            if (r->heading_valid) {
+                mm->heading_valid = 1;
+                mm->heading = r->heading;
+                mm->heading_type = r->heading_type;
+            }
+            if (r->ias_valid) {
+                mm->ias_valid = 1;
+                mm->ias = r->ias;
+            }
+            if (r->mach_valid) {
+                mm->mach_valid = 1;
+                mm->mach = r->mach;
+            }
+            if (r->baro_rate_valid) {
+                mm->baro_rate_valid = 1;
+                mm->baro_rate = r->baro_rate;
+            }
+            if (r->geom_rate_valid) {
+                mm->geom_rate_valid = 1;
+                mm->geom_rate = r->geom_rate;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
 void decodeCommB(struct modesMessage *mm) {
     mm->commb_format = COMMB_UNKNOWN;
 
@@ -57,49 +175,52 @@ void decodeCommB(struct modesMessage *mm) {
         return;
     }
 
-    // This is a bit hairy as we don't know what the requested register was
+    // This is a bit hairy as we don't know what the requested register was.
+    // Each candidate decodes into scratch as it scores, the best one so far
+    // is kept aside, so the winner doesn't need decoding a second time.
+    unsigned candidates = commBCandidates(mm->MB);
+    struct modesMessage scratch[2];
+    struct modesMessage *best = NULL;
+    struct modesMessage *out = &scratch[0];
     int bestScore = 0;
-    CommBDecoderFn bestDecoder = NULL;
     int ambiguous = 0;
 
-    for (unsigned i = 0; i < (sizeof (comm_b_decoders) / sizeof (comm_b_decoders[0])); ++i) {
-        int score = comm_b_decoders[i](mm, false);
+    for (; candidates; candidates &= candidates - 1) {
+        int score = comm_b_decoders[__builtin_ctz(candidates)](mm, out);
         if (score > bestScore) {
             bestScore = score;
-            bestDecoder = comm_b_decoders[i];
+            best = out;
+            out = (out == &scratch[0]) ? &scratch[1] : &scratch[0];
             ambiguous = 0;
         } else if (score == bestScore) {
             ambiguous = 1;
         }
     }
 
-    if (bestDecoder) {
+    if (best) {
         if (ambiguous) {
             mm->commb_format = COMMB_AMBIGUOUS;
         } else {
-            // decode it
-            bestDecoder(mm, true);
+            storeCommB(mm, best);
         }
     }
 }
 
-static int decodeEmptyResponse(struct modesMessage *mm, bool store) {
+static int decodeEmptyResponse(struct modesMessage *mm, struct modesMessage *out) {
     for (unsigned i = 0; i < 7; ++i) {
         if (mm->MB[i] != 0) {
             return 0;
         }
     }
 
-    if (store) {
-        mm->commb_format = COMMB_EMPTY_RESPONSE;
-    }
+    out->commb_format = COMMB_EMPTY_RESPONSE;
 
     return 56;
 }
 
 // BDS1,0 Datalink capabilities
 
-static int decodeBDS10(struct modesMessage *mm, bool store) {
+static int decodeBDS10(struct modesMessage *mm, struct modesMessage *out) {
     unsigned char *msg = mm->MB;
 
     // BDS identifier
@@ -114,16 +235,14 @@ static int decodeBDS10(struct modesMessage *mm, bool store) {
 
     // Looks plausible.
 
-    if (store) {
-        mm->commb_format = COMMB_DATALINK_CAPS;
-    }
+    out->commb_format = COMMB_DATALINK_CAPS;
 
     return 56;
 }
 
 // BDS1,7 Common usage GICB capability report
 
-static int decodeBDS17(struct modesMessage *mm, bool store) {
+static int decodeBDS17(struct modesMessage *mm, struct modesMessage *out) {
     unsigned char *msg = mm->MB;
 
     // reserved bits
@@ -195,16 +314,14 @@ static int decodeBDS17(struct modesMessage *mm, bool store) {
         score -= 6;
     }
 
-    if (store) {
-        mm->commb_format = COMMB_GICB_CAPS;
-    }
+    out->commb_format = COMMB_GICB_CAPS;
 
     return score;
 }
 
 // BDS2,0 Aircraft identification
 
-static int decodeBDS20(struct modesMessage *mm, bool store) {
+static int decodeBDS20(struct modesMessage *mm, struct modesMessage *out) {
     char callsign[sizeof(mm->callsign)];
     unsigned char *msg = mm->MB;
 
@@ -238,20 +355,16 @@ static int decodeBDS20(struct modesMessage *mm, bool store) {
         }
     }
 
-    if (store) {
-        mm->commb_format = COMMB_AIRCRAFT_IDENT;
-        if (valid) {
-            memcpy(mm->callsign, callsign, sizeof(mm->callsign));
-            mm->callsign_valid = 1;
-        }
-    }
+    out->commb_format = COMMB_AIRCRAFT_IDENT;
+    out->callsign_valid = valid;
+    memcpy(out->callsign, callsign, sizeof(out->callsign));
 
     return score;
 }
 
 // BDS3,0 ACAS RA
 
-static int decodeBDS30(struct modesMessage *mm, bool store) {
+static int decodeBDS30(struct modesMessage *mm, struct modesMessage *out) {
     unsigned char *msg = mm->MB;
 
     // BDS identifier
@@ -259,9 +372,7 @@ static int decodeBDS30(struct modesMessage *mm, bool store) {
         return 0;
     }
 
-    if (store) {
-        mm->commb_format = COMMB_ACAS_RA;
-    }
+    out->commb_format = COMMB_ACAS_RA;
 
     // just accept it.
     return 56;
@@ -269,7 +380,7 @@ static int decodeBDS30(struct modesMessage *mm, bool store) {
 
 // BDS4,0 Selected vertical intention
 
-static int decodeBDS40(struct modesMessage *mm, bool store) {
+static int decodeBDS40(struct modesMessage *mm, struct modesMessage *out) {
     unsigned char *msg = mm->MB;
 
     unsigned mcp_valid = getbit(msg, 1);
@@ -381,53 +492,52 @@ static int decodeBDS40(struct modesMessage *mm, bool store) {
         }
     }
 
-    if (store) {
-        mm->commb_format = COMMB_VERTICAL_INTENT;
+    out->commb_format = COMMB_VERTICAL_INTENT;
+    memset(&out->nav, 0, sizeof(out->nav));
 
-        if (mcp_valid) {
-            mm->nav.mcp_altitude_valid = 1;
-            mm->nav.mcp_altitude = mcp_alt;
-        }
+    if (mcp_valid) {
+        out->nav.mcp_altitude_valid = 1;
+        out->nav.mcp_altitude = mcp_alt;
+    }
 
-        if (fms_valid) {
-            mm->nav.fms_altitude_valid = 1;
-            mm->nav.fms_altitude = fms_alt;
-        }
+    if (fms_valid) {
+        out->nav.fms_altitude_valid = 1;
+        out->nav.fms_altitude = fms_alt;
+    }
 
-        if (baro_valid) {
-            mm->nav.qnh_valid = 1;
-            mm->nav.qnh = baro_setting;
-        }
+    if (baro_valid) {
+        out->nav.qnh_valid = 1;
+        out->nav.qnh = baro_setting;
+    }
 
-        if (mode_valid) {
-            mm->nav.modes_valid = 1;
-            mm->nav.modes =
-                    ((mode_raw & 4) ? NAV_MODE_VNAV : 0) |
-                    ((mode_raw & 2) ? NAV_MODE_ALT_HOLD : 0) |
-                    ((mode_raw & 1) ? NAV_MODE_APPROACH : 0);
-        }
+    if (mode_valid) {
+        out->nav.modes_valid = 1;
+        out->nav.modes =
+                ((mode_raw & 4) ? NAV_MODE_VNAV : 0) |
+                ((mode_raw & 2) ? NAV_MODE_ALT_HOLD : 0) |
+                ((mode_raw & 1) ? NAV_MODE_APPROACH : 0);
+    }
 
-        if (source_valid) {
-            switch (source_raw) {
-                case 0:
-                    mm->nav.altitude_source = NAV_ALT_UNKNOWN;
-                    break;
-                case 1:
-                    mm->nav.altitude_source = NAV_ALT_AIRCRAFT;
-                    break;
-                case 2:
-                    mm->nav.altitude_source = NAV_ALT_MCP;
-                    break;
-                case 3:
-                    mm->nav.altitude_source = NAV_ALT_FMS;
-                    break;
-                default:
-                    mm->nav.altitude_source = NAV_ALT_INVALID;
-                    break;
-            }
-        } else {
-            mm->nav.altitude_source = NAV_ALT_INVALID;
+    if (source_valid) {
+        switch (source_raw) {
+            case 0:
+                out->nav.altitude_source = NAV_ALT_UNKNOWN;
+                break;
+            case 1:
+                out->nav.altitude_source = NAV_ALT_AIRCRAFT;
+                break;
+            case 2:
+                out->nav.altitude_source = NAV_ALT_MCP;
+                break;
+            case 3:
+                out->nav.altitude_source = NAV_ALT_FMS;
+                break;
+            default:
+                out->nav.altitude_source = NAV_ALT_INVALID;
+                break;
         }
+    } else {
+        out->nav.altitude_source = NAV_ALT_INVALID;
     }
 
     return score;
@@ -435,7 +545,7 @@ static int decodeBDS40(struct modesMessage *mm, bool store) {
 
 // BDS5,0 Track and turn report
 
-static int decodeBDS50(struct modesMessage *mm, bool store) {
+static int decodeBDS50(struct modesMessage *mm, struct modesMessage *out) {
     unsigned char *msg = mm->MB;
 
     unsigned roll_valid = getbit(msg, 1);
@@ -558,42 +668,25 @@ static int decodeBDS50(struct modesMessage *mm, bool store) {
         }
     }
 
-    if (store) {
-        mm->commb_format = COMMB_TRACK_TURN;
-
-        if (roll_valid) {
-            mm->roll_valid = 1;
-            mm->roll = roll;
-        }
-
-        if (track_valid) {
-            mm->heading_valid = 1;
-            mm->heading = track;
-            mm->heading_type = HEADING_GROUND_TRACK;
-        }
-
-        if (gs_valid) {
-            mm->gs_valid = 1;
-            mm->gs.v0 = mm->gs.v2 = mm->gs.selected = gs;
-        }
-
-        if (track_rate_valid) {
-            mm->track_rate_valid = 1;
-            mm->track_rate = track_rate;
-        }
-
-        if (tas_valid) {
-            mm->tas_valid = 1;
-            mm->tas = tas;
-        }
-    }
+    out->commb_format = COMMB_TRACK_TURN;
+    out->roll_valid = roll_valid;
+    out->roll = roll;
+    out->heading_valid = track_valid;
+    out->heading = track;
+    out->heading_type = HEADING_GROUND_TRACK;
+    out->gs_valid = gs_valid;
+    out->gs.v0 = out->gs.v2 = out->gs.selected = gs;
+    out->track_rate_valid = track_rate_valid;
+    out->track_rate = track_rate;
+    out->tas_valid = tas_valid;
+    out->tas = tas;
 
     return score;
 }
 
 // BDS6,0 Heading and speed report
 
-static int decodeBDS60(struct modesMessage *mm, bool store) {
+static int decodeBDS60(struct modesMessage *mm, struct modesMessage *out) {
     unsigned char *msg = mm->MB;
 
     unsigned heading_valid = getbit(msg, 1);
@@ -708,37 +801,20 @@ static int decodeBDS60(struct modesMessage *mm, bool store) {
         }
     }
 
-    if (store) {
-        mm->commb_format = COMMB_HEADING_SPEED;
-
-        if (heading_valid) {
-            mm->heading_valid = 1;
-            mm->heading = heading;
-            mm->heading_type = HEADING_MAGNETIC;
-        }
-
-        if (ias_valid) {
-            mm->ias_valid = 1;
-            mm->ias = ias;
-        }
-
-        if (mach_valid) {
-            mm->mach_valid = 1;
-            mm->mach = mach;
-        }
-
-        if (baro_rate_valid) {
-            mm->baro_rate_valid = 1;
-            mm->baro_rate = baro_rate;
-        }
-
-        if (inertial_rate_valid) {
-            // INS-derived data is treated as a "geometric rate" / "geometric altitude"
-            // elsewhere, so do the same here.
-            mm->geom_rate_valid = 1;
-            mm->geom_rate = inertial_rate;
-        }
-    }
+    out->commb_format = COMMB_HEADING_SPEED;
+    out->heading_valid = heading_valid;
+    out->heading = heading;
+    out->heading_type = HEADING_MAGNETIC;
+    out->ias_valid = ias_valid;
+    out->ias = ias;
+    out->mach_valid = mach_valid;
+    out->mach = mach;
+    out->baro_rate_valid = baro_rate_valid;
+    out->baro_rate = baro_rate;
+    // INS-derived data is treated as a "geometric rate" / "geometric altitude"
+    // elsewhere, so do the same here.
+    out->geom_rate_valid = inertial_rate_valid;
+    out->geom_rate = inertial_rate;
 
     return score;
 }
@@ -422,38 +422,471 @@ static void convert_sc16q11_generic(void *iq_data,
     }
 }
 
+// Vector kernels.
+//
+// These do the same work as the float paths above, 8 samples at a time:
+// load and scale I/Q, DC block, magnitude, and the mean level/power sums,
+// all without leaving registers. The DC block is a one-pole IIR filter
+//
+//   z[n] = a * x[n] + b * z[n-1]
+//
+// which is evaluated across a vector as a prefix scan: y[n] = a * x[n],
+// then y[n] += b^k * y[n-k] for k = 1, 2, 4 (lanes shifted in as zero),
+// and finally z[n] = y[n] + b^(n+1) * z[-1].
+//
+// Samples left over at the end of a buffer go through convert_tail.
+
+static inline void convert_tail(input_format_t format,
+        bool filter_dc,
+        const uint8_t *in,
+        uint16_t *mag_data,
+        unsigned nsamples,
+        struct converter_state *state,
+        float *z1_I,
+        float *z1_Q,
+        float *sum_level,
+        float *sum_power) {
+    unsigned i;
+    float fI, fQ, magsq;
+
+    for (i = 0; i < nsamples; ++i) {
+        if (format == INPUT_UC8) {
+            fI = (in[0] - 127.5f) / 127.5f;
+            fQ = (in[1] - 127.5f) / 127.5f;
+            in += 2;
+        } else {
+            int16_t I = (int16_t) (in[0] | (in[1] << 8));
+            int16_t Q = (int16_t) (in[2] | (in[3] << 8));
+            float scale = (format == INPUT_SC16 ? 32768.0f : 2048.0f);
+            fI = I / scale;
+            fQ = Q / scale;
+            in += 4;
+        }
+
+        if (filter_dc) {
+            *z1_I = fI * state->dc_a + *z1_I * state->dc_b;
+            *z1_Q = fQ * state->dc_a + *z1_Q * state->dc_b;
+            fI -= *z1_I;
+            fQ -= *z1_Q;
+        }
+
+        magsq = fI * fI + fQ * fQ;
+        if (magsq > 1)
+            magsq = 1;
+
+        float mag = sqrtf(magsq);
+        *sum_power += magsq;
+        *sum_level += mag;
+        *mag_data++ = (uint16_t) (mag * 65535.0f + 0.5f);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// AVX2 kernels are built for AVX2+FMA whatever the compiler flags are,
+// and only used if the CPU supports them (see cpu_has_avx2)
+
+#define CONVERT_AVX2
+
+#include <immintrin.h>
+
+#define AVX2_INLINE static inline __attribute__ ((always_inline, target("avx2,fma")))
+
+static bool cpu_has_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+struct avx2_dc {
+    __m256 a;
+    __m256 b1, b2, b4;
+    __m256 bpow; // b^1 .. b^8
+};
+
+AVX2_INLINE void avx2_dc_init(struct avx2_dc *dc, float a, float b) {
+    float b2 = b * b, b4 = b2 * b2;
+
+    dc->a = _mm256_set1_ps(a);
+    dc->b1 = _mm256_set1_ps(b);
+    dc->b2 = _mm256_set1_ps(b2);
+    dc->b4 = _mm256_set1_ps(b4);
+    dc->bpow = _mm256_setr_ps(b, b2, b2 * b, b4, b4 * b, b4 * b2, b4 * b2 * b, b4 * b4);
+}
+
+// x minus the DC estimate; *z1 holds the last filter output in every lane
+AVX2_INLINE __m256 avx2_dc_block(const struct avx2_dc *dc, __m256 x, __m256 *z1) {
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 y = _mm256_mul_ps(x, dc->a);
+
+    // shift lanes up by 1, 2, 4
+    __m256 s1 = _mm256_permutevar8x32_ps(y, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+    y = _mm256_fmadd_ps(dc->b1, _mm256_blend_ps(s1, zero, 0x01), y);
+    __m256 s2 = _mm256_permutevar8x32_ps(y, _mm256_setr_epi32(0, 0, 0, 1, 2, 3, 4, 5));
+    y = _mm256_fmadd_ps(dc->b2, _mm256_blend_ps(s2, zero, 0x03), y);
+    y = _mm256_fmadd_ps(dc->b4, _mm256_permute2f128_ps(y, y, 0x08), y);
+
+    __m256 z = _mm256_fmadd_ps(dc->bpow, *z1, y);
+    *z1 = _mm256_permutevar8x32_ps(z, _mm256_set1_epi32(7));
+    return _mm256_sub_ps(x, z);
+}
+
+// 8 samples of I/Q, scaled to [-1, 1)
+AVX2_INLINE void avx2_load(input_format_t format, const uint8_t *in, __m256 *fI, __m256 *fQ) {
+    if (format == INPUT_UC8) {
+        const __m256 offset = _mm256_set1_ps(127.5f);
+        const __m256 scale = _mm256_set1_ps(1.0f / 127.5f);
+        __m256i w = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) in));
+        __m256i I = _mm256_and_si256(w, _mm256_set1_epi32(0xFFFF));
+        __m256i Q = _mm256_srli_epi32(w, 16);
+        *fI = _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(I), offset), scale);
+        *fQ = _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(Q), offset), scale);
+    } else {
+        const __m256 scale = _mm256_set1_ps(format == INPUT_SC16 ? 1.0f / 32768.0f : 1.0f / 2048.0f);
+        __m256i v = _mm256_loadu_si256((const __m256i *) in);
+        __m256i I = _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+        __m256i Q = _mm256_srai_epi32(v, 16);
+        *fI = _mm256_mul_ps(_mm256_cvtepi32_ps(I), scale);
+        *fQ = _mm256_mul_ps(_mm256_cvtepi32_ps(Q), scale);
+    }
+}
+
+AVX2_INLINE void avx2_magnitude(__m256 fI, __m256 fQ, uint16_t *out, __m256 *sum_level, __m256 *sum_power) {
+    __m256 magsq = _mm256_fmadd_ps(fI, fI, _mm256_mul_ps(fQ, fQ));
+    magsq = _mm256_min_ps(magsq, _mm256_set1_ps(1.0f));
+
+    __m256 mag = _mm256_sqrt_ps(magsq);
+    *sum_power = _mm256_add_ps(*sum_power, magsq);
+    *sum_level = _mm256_add_ps(*sum_level, mag);
+
+    __m256i m = _mm256_cvttps_epi32(_mm256_fmadd_ps(mag, _mm256_set1_ps(65535.0f), _mm256_set1_ps(0.5f)));
+    m = _mm256_packus_epi32(m, m);
+    m = _mm256_permute4x64_epi64(m, _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i *) out, _mm256_castsi256_si128(m));
+}
+
+AVX2_INLINE float avx2_sum(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+AVX2_INLINE void avx2_convert(input_format_t format,
+        bool filter_dc,
+        void *iq_data,
+        uint16_t *mag_data,
+        unsigned nsamples,
+        struct converter_state *state,
+        double *out_mean_level,
+        double *out_mean_power) {
+    const unsigned sample_bytes = (format == INPUT_UC8 ? 2 : 4);
+    const uint8_t *in = iq_data;
+    struct avx2_dc dc;
+    __m256 z1_I = _mm256_setzero_ps(), z1_Q = _mm256_setzero_ps();
+    __m256 sum_level = _mm256_setzero_ps(), sum_power = _mm256_setzero_ps();
+    __m256 fI, fQ;
+    unsigned i;
+
+    if (filter_dc) {
+        avx2_dc_init(&dc, state->dc_a, state->dc_b);
+        z1_I = _mm256_set1_ps(state->z1_I);
+        z1_Q = _mm256_set1_ps(state->z1_Q);
+    }
+
+    for (i = 0; i < (nsamples >> 3); ++i) {
+        avx2_load(format, in, &fI, &fQ);
+        if (filter_dc) {
+            fI = avx2_dc_block(&dc, fI, &z1_I);
+            fQ = avx2_dc_block(&dc, fQ, &z1_Q);
+        }
+        avx2_magnitude(fI, fQ, mag_data, &sum_level, &sum_power);
+
+        in += 8 * sample_bytes;
+        mag_data += 8;
+    }
+
+    float level = avx2_sum(sum_level);
+    float power = avx2_sum(sum_power);
+    float tail_I = _mm256_cvtss_f32(z1_I);
+    float tail_Q = _mm256_cvtss_f32(z1_Q);
+
+    convert_tail(format, filter_dc, in, mag_data, nsamples & 7, state, &tail_I, &tail_Q, &level, &power);
+
+    if (filter_dc) {
+        state->z1_I = tail_I;
+        state->z1_Q = tail_Q;
+    }
+
+    if (out_mean_level) {
+        *out_mean_level = level / nsamples;
+    }
+
+    if (out_mean_power) {
+        *out_mean_power = power / nsamples;
+    }
+}
+
+#define AVX2_CONVERTER(name, format, filter_dc) \
+    __attribute__ ((target("avx2,fma")))                                  \
+    static void name(void *iq_data, uint16_t *mag_data, unsigned nsamples, \
+            struct converter_state *state,                                 \
+            double *out_mean_level, double *out_mean_power) {              \
+        avx2_convert(format, filter_dc, iq_data, mag_data, nsamples,       \
+                state, out_mean_level, out_mean_power);                    \
+    }
+
+AVX2_CONVERTER(convert_uc8_avx2_nodc, INPUT_UC8, false)
+AVX2_CONVERTER(convert_uc8_avx2, INPUT_UC8, true)
+AVX2_CONVERTER(convert_sc16_avx2_nodc, INPUT_SC16, false)
+AVX2_CONVERTER(convert_sc16_avx2, INPUT_SC16, true)
+AVX2_CONVERTER(convert_sc16q11_avx2_nodc, INPUT_SC16Q11, false)
+AVX2_CONVERTER(convert_sc16q11_avx2, INPUT_SC16Q11, true)
+
+#undef AVX2_CONVERTER
+
+#endif /* x86 */
+
+#if defined(__ARM_NEON) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+
+// NEON is part of the baseline on the targets that define __ARM_NEON,
+// so these are selected at compile time rather than at runtime
+
+#define CONVERT_NEON
+
+#include <arm_neon.h>
+
+struct neon_dc {
+    float32x4_t a;
+    float32x4_t b1, b2;
+    float32x4_t bpow; // b^1 .. b^4
+};
+
+static inline void neon_dc_init(struct neon_dc *dc, float a, float b) {
+    const float bpow[4] = { b, b * b, b * b * b, b * b * b * b };
+
+    dc->a = vdupq_n_f32(a);
+    dc->b1 = vdupq_n_f32(b);
+    dc->b2 = vdupq_n_f32(b * b);
+    dc->bpow = vld1q_f32(bpow);
+}
+
+static inline float32x4_t neon_dc_block(const struct neon_dc *dc, float32x4_t x, float32x4_t *z1) {
+    const float32x4_t zero = vdupq_n_f32(0);
+    float32x4_t y = vmulq_f32(x, dc->a);
+
+    // shift lanes up by 1, 2
+    y = vmlaq_f32(y, dc->b1, vextq_f32(zero, y, 3));
+    y = vmlaq_f32(y, dc->b2, vextq_f32(zero, y, 2));
+
+    float32x4_t z = vmlaq_f32(y, dc->bpow, *z1);
+    *z1 = vdupq_n_f32(vgetq_lane_f32(z, 3));
+    return vsubq_f32(x, z);
+}
+
+static inline float32x4_t neon_sqrt(float32x4_t x) {
+#if defined(__aarch64__)
+    return vsqrtq_f32(x);
+#else
+    // ARMv7 has no vector square root. Refine the 8-bit reciprocal square
+    // root estimate with two Newton-Raphson steps; the relative error is
+    // then a few float ulps (< 1e-6), well under one LSB of the output.
+    float32x4_t e = vrsqrteq_f32(x);
+    e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(x, e), e));
+    e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(x, e), e));
+    // rsqrt(0) is infinite, so zero those lanes explicitly
+    return vbslq_f32(vcgtq_f32(x, vdupq_n_f32(0)), vmulq_f32(x, e), vdupq_n_f32(0));
+#endif
+}
+
+static inline uint16x4_t neon_magnitude(float32x4_t fI, float32x4_t fQ, float32x4_t *sum_level, float32x4_t *sum_power) {
+    float32x4_t magsq = vmlaq_f32(vmulq_f32(fQ, fQ), fI, fI);
+    magsq = vminq_f32(magsq, vdupq_n_f32(1.0f));
+
+    float32x4_t mag = neon_sqrt(magsq);
+    *sum_power = vaddq_f32(*sum_power, magsq);
+    *sum_level = vaddq_f32(*sum_level, mag);
+
+    return vmovn_u32(vcvtq_u32_f32(vmlaq_f32(vdupq_n_f32(0.5f), mag, vdupq_n_f32(65535.0f))));
+}
+
+// 8 samples of I/Q, scaled to [-1, 1), as two halves of 4
+static inline void neon_load(input_format_t format, const uint8_t *in, float32x4_t fI[2], float32x4_t fQ[2]) {
+    if (format == INPUT_UC8) {
+        const float32x4_t offset = vdupq_n_f32(127.5f);
+        const float32x4_t scale = vdupq_n_f32(1.0f / 127.5f);
+        uint8x8x2_t v = vld2_u8(in);
+        uint16x8_t I = vmovl_u8(v.val[0]);
+        uint16x8_t Q = vmovl_u8(v.val[1]);
+        fI[0] = vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(I))), offset), scale);
+        fI[1] = vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(I))), offset), scale);
+        fQ[0] = vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(Q))), offset), scale);
+        fQ[1] = vmulq_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(Q))), offset), scale);
+    } else {
+        const float32x4_t scale = vdupq_n_f32(format == INPUT_SC16 ? 1.0f / 32768.0f : 1.0f / 2048.0f);
+        int16x8x2_t v = vld2q_s16((const int16_t *) in);
+        fI[0] = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v.val[0]))), scale);
+        fI[1] = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v.val[0]))), scale);
+        fQ[0] = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v.val[1]))), scale);
+        fQ[1] = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v.val[1]))), scale);
+    }
+}
+
+static inline float neon_sum(float32x4_t v) {
+    float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+static inline void neon_convert(input_format_t format,
+        bool filter_dc,
+        void *iq_data,
+        uint16_t *mag_data,
+        unsigned nsamples,
+        struct converter_state *state,
+        double *out_mean_level,
+        double *out_mean_power) {
+    const unsigned sample_bytes = (format == INPUT_UC8 ? 2 : 4);
+    const uint8_t *in = iq_data;
+    struct neon_dc dc;
+    float32x4_t z1_I = vdupq_n_f32(0), z1_Q = vdupq_n_f32(0);
+    float32x4_t sum_level = vdupq_n_f32(0), sum_power = vdupq_n_f32(0);
+    float32x4_t fI[2], fQ[2];
+    unsigned i;
+
+    if (filter_dc) {
+        neon_dc_init(&dc, state->dc_a, state->dc_b);
+        z1_I = vdupq_n_f32(state->z1_I);
+        z1_Q = vdupq_n_f32(state->z1_Q);
+    }
+
+    for (i = 0; i < (nsamples >> 3); ++i) {
+        neon_load(format, in, fI, fQ);
+        if (filter_dc) {
+            fI[0] = neon_dc_block(&dc, fI[0], &z1_I);
+            fI[1] = neon_dc_block(&dc, fI[1], &z1_I);
+            fQ[0] = neon_dc_block(&dc, fQ[0], &z1_Q);
+            fQ[1] = neon_dc_block(&dc, fQ[1], &z1_Q);
+        }
+        uint16x4_t lo = neon_magnitude(fI[0], fQ[0], &sum_level, &sum_power);
+        uint16x4_t hi = neon_magnitude(fI[1], fQ[1], &sum_level, &sum_power);
+        vst1q_u16(mag_data, vcombine_u16(lo, hi));
+
+        in += 8 * sample_bytes;
+        mag_data += 8;
+    }
+
+    float level = neon_sum(sum_level);
+    float power = neon_sum(sum_power);
+    float tail_I = vgetq_lane_f32(z1_I, 0);
+    float tail_Q = vgetq_lane_f32(z1_Q, 0);
+
+    convert_tail(format, filter_dc, in, mag_data, nsamples & 7, state, &tail_I, &tail_Q, &level, &power);
+
+    if (filter_dc) {
+        state->z1_I = tail_I;
+        state->z1_Q = tail_Q;
+    }
+
+    if (out_mean_level) {
+        *out_mean_level = level / nsamples;
+    }
+
+    if (out_mean_power) {
+        *out_mean_power = power / nsamples;
+    }
+}
+
+#define NEON_CONVERTER(name, format, filter_dc) \
+    static void name(void *iq_data, uint16_t *mag_data, unsigned nsamples, \
+            struct converter_state *state,                                 \
+            double *out_mean_level, double *out_mean_power) {              \
+        neon_convert(format, filter_dc, iq_data, mag_data, nsamples,       \
+                state, out_mean_level, out_mean_power);                    \
+    }
+
+NEON_CONVERTER(convert_uc8_neon_nodc, INPUT_UC8, false)
+NEON_CONVERTER(convert_uc8_neon, INPUT_UC8, true)
+NEON_CONVERTER(convert_sc16_neon_nodc, INPUT_SC16, false)
+NEON_CONVERTER(convert_sc16_neon, INPUT_SC16, true)
+NEON_CONVERTER(convert_sc16q11_neon_nodc, INPUT_SC16Q11, false)
+NEON_CONVERTER(convert_sc16q11_neon, INPUT_SC16Q11, true)
+
+#undef NEON_CONVERTER
+
+#endif /* __ARM_NEON */
+
 static struct {
     input_format_t format;
     int can_filter_dc;
     iq_convert_fn fn;
     const char *description;
     bool(*init)();
+    bool(*supported)(); // NULL if always usable
 } converters_table[] = {
     // In order of preference
-    { INPUT_UC8, 0, convert_uc8_nodc, "UC8, integer/table path", init_uc8_lookup},
-    { INPUT_UC8, 1, convert_uc8_generic, "UC8, float path", NULL},
-    { INPUT_SC16, 0, convert_sc16_nodc, "SC16, float path, no DC", NULL},
-    { INPUT_SC16, 1, convert_sc16_generic, "SC16, float path", NULL},
+#if defined(CONVERT_AVX2)
+    { INPUT_UC8, 0, convert_uc8_avx2_nodc, "UC8, AVX2 path, no DC", NULL, cpu_has_avx2},
+    { INPUT_UC8, 1, convert_uc8_avx2, "UC8, AVX2 path", NULL, cpu_has_avx2},
+    { INPUT_SC16, 0, convert_sc16_avx2_nodc, "SC16, AVX2 path, no DC", NULL, cpu_has_avx2},
+    { INPUT_SC16, 1, convert_sc16_avx2, "SC16, AVX2 path", NULL, cpu_has_avx2},
+    { INPUT_SC16Q11, 0, convert_sc16q11_avx2_nodc, "SC16Q11, AVX2 path, no DC", NULL, cpu_has_avx2},
+    { INPUT_SC16Q11, 1, convert_sc16q11_avx2, "SC16Q11, AVX2 path", NULL, cpu_has_avx2},
+#endif
+#if defined(CONVERT_NEON)
+    { INPUT_UC8, 0, convert_uc8_neon_nodc, "UC8, NEON path, no DC", NULL, NULL},
+    { INPUT_UC8, 1, convert_uc8_neon, "UC8, NEON path", NULL, NULL},
+    { INPUT_SC16, 0, convert_sc16_neon_nodc, "SC16, NEON path, no DC", NULL, NULL},
+    { INPUT_SC16, 1, convert_sc16_neon, "SC16, NEON path", NULL, NULL},
+    { INPUT_SC16Q11, 0, convert_sc16q11_neon_nodc, "SC16Q11, NEON path, no DC", NULL, NULL},
+    { INPUT_SC16Q11, 1, convert_sc16q11_neon, "SC16Q11, NEON path", NULL, NULL},
+#endif
+    { INPUT_UC8, 0, convert_uc8_nodc, "UC8, integer/table path", init_uc8_lookup, NULL},
+    { INPUT_UC8, 1, convert_uc8_generic, "UC8, float path", NULL, NULL},
+    { INPUT_SC16, 0, convert_sc16_nodc, "SC16, float path, no DC", NULL, NULL},
+    { INPUT_SC16, 1, convert_sc16_generic, "SC16, float path", NULL, NULL},
 #if defined(SC16Q11_TABLE_BITS)
-    { INPUT_SC16Q11, 0, convert_sc16q11_table, "SC16Q11, integer/table path", init_sc16q11_lookup},
+    { INPUT_SC16Q11, 0, convert_sc16q11_table, "SC16Q11, integer/table path", init_sc16q11_lookup, NULL},
 #else
-    { INPUT_SC16Q11, 0, convert_sc16q11_nodc, "SC16Q11, float path, no DC", NULL},
+    { INPUT_SC16Q11, 0, convert_sc16q11_nodc, "SC16Q11, float path, no DC", NULL, NULL},
 #endif
-    { INPUT_SC16Q11, 1, convert_sc16q11_generic, "SC16Q11, float path", NULL},
-    { 0, 0, NULL, NULL, NULL}
+    { INPUT_SC16Q11, 1, convert_sc16q11_generic, "SC16Q11, float path", NULL, NULL},
+    { 0, 0, NULL, NULL, NULL, NULL}
 };
 
+static bool converter_usable(unsigned i) {
+    return !converters_table[i].supported || converters_table[i].supported();
+}
+
+const char *converter_variant(unsigned index,
+        input_format_t *format,
+        int *can_filter_dc,
+        bool *usable) {
+    unsigned i;
+
+    for (i = 0; converters_table[i].fn && i < index; ++i)
+        ;
+
+    if (!converters_table[i].fn)
+        return NULL;
+
+    *format = converters_table[i].format;
+    *can_filter_dc = converters_table[i].can_filter_dc;
+    *usable = converter_usable(i);
+    return converters_table[i].description;
+}
+
 iq_convert_fn init_converter(input_format_t format,
         double sample_rate,
         int filter_dc,
         struct converter_state **out_state) {
-    int i;
+    unsigned i;
 
     for (i = 0; converters_table[i].fn; ++i) {
         if (converters_table[i].format != format)
             continue;
         if (filter_dc && !converters_table[i].can_filter_dc)
             continue;
+        if (!converter_usable(i))
+            continue;
         break;
     }
 
@@ -463,6 +896,28 @@ iq_convert_fn init_converter(input_format_t format,
         return NULL;
     }
 
+    return init_converter_variant(i, sample_rate, filter_dc, out_state);
+}
+
+iq_convert_fn init_converter_variant(unsigned i,
+        double sample_rate,
+        int filter_dc,
+        struct converter_state **out_state) {
+    unsigned count;
+
+    for (count = 0; converters_table[count].fn; ++count)
+        ;
+
+    if (i >= count || !converter_usable(i)) {
+        fprintf(stderr, "converter variant %u is not available\n", i);
+        return NULL;
+    }
+
+    if (filter_dc && !converters_table[i].can_filter_dc) {
+        fprintf(stderr, "converter variant %u can't filter DC\n", i);
+        return NULL;
+    }
+
     if (converters_table[i].init) {
         if (!converters_table[i].init())
             return NULL;
@@ -493,7 +948,9 @@ iq_convert_fn init_converter(input_format_t format,
 void cleanup_converter(struct converter_state *state) {
     free(state);
     free(uc8_lookup);
+    uc8_lookup = NULL;
 #if defined(SC16Q11_TABLE_BITS)
     free(sc16q11_lookup);
+    sc16q11_lookup = NULL;
 #endif
 }
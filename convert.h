@@ -43,6 +43,19 @@ iq_convert_fn init_converter (input_format_t format,
                               int filter_dc,
                               struct converter_state **out_state);
 
+// Converter implementations in order of preference, for benchmarks.
+// Returns the description of variant 'index', or NULL past the end;
+// *usable is false if this CPU can't run it.
+const char *converter_variant (unsigned index,
+                               input_format_t *format,
+                               int *can_filter_dc,
+                               bool *usable);
+
+iq_convert_fn init_converter_variant (unsigned index,
+                                      double sample_rate,
+                                      int filter_dc,
+                                      struct converter_state **out_state);
+
 void cleanup_converter (struct converter_state *state);
 
 #endif
@@ -28,6 +28,191 @@
 #include <gd.h>
 #endif
 
+//
+// Pass a demodulated message on to the next layer, or keep it for later
+// if the buffer is being demodulated ahead of time on another thread
+//
+void demodPassMessage(struct mag_buf *mag, struct modesMessage *mm) {
+    struct demod_batch *batch = mag->batch;
+
+    if (!batch) {
+        useModesMessage(mm);
+        return;
+    }
+
+    if (batch->count == batch->size) {
+        unsigned size = batch->size ? batch->size * 2 : 64;
+        struct modesMessage *msgs = realloc(batch->msgs, size * sizeof (struct modesMessage));
+        if (!msgs) {
+            fprintf(stderr, "Out of memory collecting demodulated messages.\n");
+            return;
+        }
+        batch->msgs = msgs;
+        batch->size = size;
+    }
+
+    copyModesMessage(&batch->msgs[batch->count++], mm);
+}
+
+//
+// Run the demodulators for the configured sample rate over a buffer
+//
+void demodulateBuffer(struct mag_buf *mag) {
+    if (Modes.sample_rate == 2400000.0) {
+        demodulate2400(mag);
+        if (Modes.mode_ac) {
+            demodulate2400AC(mag);
+        }
+    } else {
+        demodulateHiRate(mag);
+    }
+}
+
+//
+// Start a new candidate in a batch, or return NULL if out of memory
+//
+struct demod_candidate *demodNewCandidate(struct demod_batch *batch, uint32_t pos) {
+    struct demod_candidate *cand;
+
+    if (batch->ncandidates == batch->candidates_size) {
+        unsigned size = batch->candidates_size ? batch->candidates_size * 2 : 256;
+        struct demod_candidate *candidates = realloc(batch->candidates, size * sizeof (struct demod_candidate));
+        if (!candidates) {
+            fprintf(stderr, "Out of memory collecting demodulated messages.\n");
+            return NULL;
+        }
+        batch->candidates = candidates;
+        batch->candidates_size = size;
+    }
+
+    cand = &batch->candidates[batch->ncandidates++];
+    cand->pos = pos;
+    cand->reject_next = pos + 1;
+    cand->nphases = 0;
+    return cand;
+}
+
+//
+// Add a demodulated phase to a candidate. Its signal power is measured over
+// signal_len samples from m, but only if the phase might be accepted.
+//
+struct demod_phase *demodAddPhase(struct demod_candidate *cand, unsigned char *msg, int validbits, const uint16_t *m, unsigned signal_len) {
+    struct demod_phase *ph = &cand->phases[cand->nphases++];
+
+    memcpy(ph->msg, msg, sizeof (ph->msg));
+    ph->unknown_score = scoreModesMessageUnfiltered(msg, validbits, &ph->addr, &ph->known_score);
+    ph->scaled_signal_power = 0;
+    ph->signal_len = signal_len;
+
+    if (ph->known_score >= 0 || ph->unknown_score >= 0) {
+        for (unsigned k = 0; k < signal_len; ++k) {
+            uint32_t mag = m[k];
+            ph->scaled_signal_power += mag * mag;
+        }
+    }
+
+    return ph;
+}
+
+//
+// Use a buffer that was demodulated ahead of time. This is the part of
+// the Mode S demodulators that depends on the ICAO filter: the candidates
+// are scored and decoded in sample order, skipping those inside an accepted
+// message just as the demodulator would have, so what is accepted is the
+// same however many threads there are. The batch may have been ready for a
+// while, so system timestamps are rebased on the buffer's sysTimestamp,
+// set when it was handed over.
+//
+void demodUseBatch(struct mag_buf *mag) {
+    struct demod_batch *batch = mag->batch;
+    struct stats *st = &Modes.stats_current;
+    struct modesMessage mm;
+    uint64_t sum_scaled_signal_power = 0;
+    uint32_t next = 0;
+
+    add_stats(&batch->stats, st, st);
+
+    for (unsigned i = 0; i < batch->ncandidates; ++i) {
+        struct demod_candidate *cand = &batch->candidates[i];
+        struct demod_phase *best = NULL;
+        int bestscore = -2;
+
+        if (cand->pos < next)
+            continue; // the demodulator would have skipped it
+
+        next = cand->reject_next;
+        if (!cand->nphases)
+            continue;
+
+        st->demod_preambles++;
+        for (unsigned p = 0; p < cand->nphases; ++p) {
+            struct demod_phase *ph = &cand->phases[p];
+            int score = ph->unknown_score;
+
+            if (ph->known_score != score && icaoFilterTest(ph->addr))
+                score = ph->known_score;
+            if (score > bestscore) {
+                best = ph;
+                bestscore = score;
+            }
+        }
+
+        if (bestscore < 0) {
+            if (bestscore == -1)
+                st->demod_rejected_unknown_icao++;
+            else
+                st->demod_rejected_bad++;
+            continue;
+        }
+
+        resetModesMessage(&mm);
+        mm.timestampMsg = best->timestampMsg;
+        mm.sysTimestampMsg = mag->sysTimestamp + receiveclock_ms_elapsed(mag->sampleTimestamp, mm.timestampMsg);
+        mm.score = bestscore;
+
+        {
+            int result = decodeModesMessage(&mm, best->msg);
+            if (result < 0) {
+                if (result == -1)
+                    st->demod_rejected_unknown_icao++;
+                else
+                    st->demod_rejected_bad++;
+                next = best->reject_next;
+                continue;
+            }
+        }
+
+        {
+            double signal_power = best->scaled_signal_power / 65535.0 / 65535.0;
+
+            mm.signalLevel = signal_power / best->signal_len;
+            st->demod_accepted[mm.correctedbits]++;
+            st->signal_power_sum += signal_power;
+            st->signal_power_count += best->signal_len;
+            sum_scaled_signal_power += best->scaled_signal_power;
+
+            if (mm.signalLevel > st->peak_signal_power)
+                st->peak_signal_power = mm.signalLevel;
+            if (mm.signalLevel > 0.50119)
+                st->strong_signal_count++; // signal power above -3dBFS
+        }
+
+        next = best->accept_next;
+        useModesMessage(&mm);
+    }
+
+    // the reader thread counted all of the buffer as noise
+    st->noise_power_sum -= sum_scaled_signal_power / 65535.0 / 65535.0;
+
+    // Mode A/C
+    for (unsigned i = 0; i < batch->count; ++i) {
+        struct modesMessage *msg = &batch->msgs[i];
+
+        msg->sysTimestampMsg = mag->sysTimestamp + receiveclock_ms_elapsed(mag->sampleTimestamp, msg->timestampMsg);
+        useModesMessage(msg);
+    }
+}
+
 // 2.4MHz sampling rate version
 //
 // When sampling at 2.4MHz we have exactly 6 samples per 5 symbols.
@@ -70,7 +255,6 @@ static inline int slice_phase4(uint16_t *m) {
 // try to demodulate some Mode S messages.
 //
 void demodulate2400(struct mag_buf *mag) {
-    static struct modesMessage zeroMessage;
     struct modesMessage mm;
     unsigned char msg1[MODES_LONG_MSG_BYTES], msg2[MODES_LONG_MSG_BYTES], *msg;
     uint32_t j;
@@ -91,6 +275,7 @@ void demodulate2400(struct mag_buf *mag) {
         uint32_t base_signal, base_noise;
         int try_phase;
         int msglen;
+        struct demod_candidate *cand = NULL;
 
         // Look for a message starting at around sample 0 with phase offset 3..7
 
@@ -171,8 +356,14 @@ void demodulate2400(struct mag_buf *mag) {
             continue;
         }
 
+        // When demodulating ahead of time, every phase is kept for
+        // demodUseBatch() to score, and nothing is skipped
+        if (mag->batch && !(cand = demodNewCandidate(mag->batch, j)))
+            continue;
+
         // try all phases
-        Modes.stats_current.demod_preambles++;
+        if (!cand)
+            mag->stats->demod_preambles++;
         bestmsg = NULL;
         bestscore = -2;
         bestphase = -1;
@@ -285,6 +476,17 @@ void demodulate2400(struct mag_buf *mag) {
                 }
             }
 
+            if (cand) {
+                struct demod_phase *ph;
+
+                msglen = modesMessageLenByType(msg[0] >> 3);
+                ph = demodAddPhase(cand, msg, i * 8, &m[j + 19], msglen * 12 / 5);
+                ph->timestampMsg = mag->sampleTimestamp + j * 5 + (8 + 56) * 12 + try_phase;
+                ph->reject_next = j + 1;
+                ph->accept_next = j + msglen * 12 / 5 + 1;
+                continue;
+            }
+
             // Score the mode S message and see if it's any good.
             score = scoreModesMessage(msg, i * 8);
             if (score > bestscore) {
@@ -300,19 +502,22 @@ void demodulate2400(struct mag_buf *mag) {
             }
         }
 
+        if (cand)
+            continue;
+
         // Do we have a candidate?
         if (bestscore < 0) {
             if (bestscore == -1)
-                Modes.stats_current.demod_rejected_unknown_icao++;
+                mag->stats->demod_rejected_unknown_icao++;
             else
-                Modes.stats_current.demod_rejected_bad++;
+                mag->stats->demod_rejected_bad++;
             continue; // nope.
         }
 
         msglen = modesMessageLenByType(bestmsg[0] >> 3);
 
         // Set initial mm structure details
-        mm = zeroMessage;
+        resetModesMessage(&mm);
 
         // For consistency with how the Beast / Radarcape does it,
         // we report the timestamp at the end of bit 56 (even if
@@ -329,12 +534,12 @@ void demodulate2400(struct mag_buf *mag) {
             int result = decodeModesMessage(&mm, bestmsg);
             if (result < 0) {
                 if (result == -1)
-                    Modes.stats_current.demod_rejected_unknown_icao++;
+                    mag->stats->demod_rejected_unknown_icao++;
                 else
-                    Modes.stats_current.demod_rejected_bad++;
+                    mag->stats->demod_rejected_bad++;
                 continue;
             } else {
-                Modes.stats_current.demod_accepted[mm.correctedbits]++;
+                mag->stats->demod_accepted[mm.correctedbits]++;
             }
         }
 
@@ -352,14 +557,14 @@ void demodulate2400(struct mag_buf *mag) {
 
             signal_power = scaled_signal_power / 65535.0 / 65535.0;
             mm.signalLevel = signal_power / signal_len;
-            Modes.stats_current.signal_power_sum += signal_power;
-            Modes.stats_current.signal_power_count += signal_len;
+            mag->stats->signal_power_sum += signal_power;
+            mag->stats->signal_power_count += signal_len;
             sum_scaled_signal_power += scaled_signal_power;
 
-            if (mm.signalLevel > Modes.stats_current.peak_signal_power)
-                Modes.stats_current.peak_signal_power = mm.signalLevel;
+            if (mm.signalLevel > mag->stats->peak_signal_power)
+                mag->stats->peak_signal_power = mm.signalLevel;
             if (mm.signalLevel > 0.50119)
-                Modes.stats_current.strong_signal_count++; // signal power above -3dBFS
+                mag->stats->strong_signal_count++; // signal power above -3dBFS
         }
 
         // Skip over the message:
@@ -371,14 +576,14 @@ void demodulate2400(struct mag_buf *mag) {
         j += msglen * 12 / 5;
 
         // Pass data to the next layer
-        useModesMessage(&mm);
+        demodPassMessage(mag, &mm);
     }
 
     /* update noise power */
     {
         double sum_signal_power = sum_scaled_signal_power / 65535.0 / 65535.0;
-        Modes.stats_current.noise_power_sum += (mag->mean_power * mag->length - sum_signal_power);
-        Modes.stats_current.noise_power_count += mag->length;
+        mag->stats->noise_power_sum += (mag->mean_power * mag->length - sum_signal_power);
+        mag->stats->noise_power_count += mag->length;
     }
 }
 
@@ -654,9 +859,9 @@ void demodulate2400AC(struct mag_buf *mag) {
         decodeModeAMessage(&mm, modeac);
 
         // Pass data to the next layer
-        useModesMessage(&mm);
+        demodPassMessage(mag, &mm);
 
         f1_sample += (20 * 87 / 25);
-        Modes.stats_current.demod_modeac++;
+        mag->stats->demod_modeac++;
     }
 }
@@ -28,7 +28,17 @@
 
 struct mag_buf;
 
+struct modesMessage;
+struct demod_batch;
+struct demod_candidate;
+struct demod_phase;
+
 void demodulate2400 (struct mag_buf *mag);
 void demodulate2400AC (struct mag_buf *mag);
+void demodulateBuffer (struct mag_buf *mag);
+void demodPassMessage (struct mag_buf *mag, struct modesMessage *mm);
+struct demod_candidate *demodNewCandidate (struct demod_batch *batch, uint32_t pos);
+struct demod_phase *demodAddPhase (struct demod_candidate *cand, unsigned char *msg, int validbits, const uint16_t *m, unsigned signal_len);
+void demodUseBatch (struct mag_buf *mag);
 
 #endif
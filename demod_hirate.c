@@ -0,0 +1,428 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// demod_hirate.c: oversampled Mode S demodulator.
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "readsb.h"
+
+// Even integer sampling rate version (e.g. 6, 8 or 12MHz)
+//
+// At N MHz each Mode S bit is N samples wide and each half bit ("chip") is
+// exactly N/2 samples, so unlike the 2.4MHz demodulator there is no
+// fractional phase to track. For every sample we first compute the energy
+// of a chip starting there (a running sum of N/2 magnitudes); everything
+// after that is chip energies at fixed offsets:
+//
+//  - the preamble template is the chip pattern below, turned into the
+//    sample offsets of its 4 pulses and 12 quiet chips for the chosen rate
+//    when the demodulator is set up;
+//  - a data bit is 1 if its first chip has more energy than its second.
+//
+// The preamble search tests 8 start positions at once (with AVX2 when the
+// CPU has it). Only positions that pass that cheap signal/noise test get
+// the full treatment.
+
+static const char preamble_chips[] = "1010000101000000";
+
+#define PREAMBLE_PULSES 4
+#define PREAMBLE_QUIET 12
+
+typedef unsigned (*preamble_scan_fn)(const uint32_t *energy, unsigned j);
+
+static struct {
+    unsigned sps; // samples per bit (= per microsecond)
+    unsigned chip; // samples per chip
+    unsigned pulse[PREAMBLE_PULSES]; // sample offsets of the preamble pulses
+    unsigned quiet[PREAMBLE_QUIET]; // sample offsets of the quiet preamble chips
+    preamble_scan_fn scan;
+} hirate;
+
+// Chip energy starting at each sample. Per thread, as ifile may
+// demodulate on several threads.
+static _Thread_local uint32_t *hirate_energy;
+
+static uint32_t *energy_buffer() {
+    if (!hirate_energy) {
+        hirate_energy = calloc(MODES_MAG_BUF_SAMPLES + Modes.trailing_samples, sizeof (uint32_t));
+        if (!hirate_energy)
+            fprintf(stderr, "Out of memory allocating demodulator buffer.\n");
+    }
+    return hirate_energy;
+}
+
+// Parse a sample rate in MHz and set Modes.sample_rate
+
+bool demodSetSampleRate(const char *mhz) {
+    char *end;
+    double rate = strtod(mhz, &end);
+
+    if (*end == 0 && rate == 2.4) {
+        Modes.sample_rate = 2400000.0;
+        return true;
+    }
+
+    if (*end != 0 || rate != (int) rate || (int) rate % 2 ||
+            rate < DEMOD_HIRATE_MIN_MHZ || rate > DEMOD_HIRATE_MAX_MHZ) {
+        fprintf(stderr, "Sample rate '%s' not supported (use 2.4, or an even number of MHz from %d to %d)\n",
+                mhz, DEMOD_HIRATE_MIN_MHZ, DEMOD_HIRATE_MAX_MHZ);
+        return false;
+    }
+
+    Modes.sample_rate = rate * 1e6;
+    return true;
+}
+
+// Bitmask of positions j..j+7 where the preamble pulses carry more than
+// 1.5 times the mean energy of the quiet chips (about 3.5dB SNR, the same
+// threshold as demod_2400.c). Sums of 4 and 12 chips, so that is
+// high / 4 > 1.5 * low / 12, i.e. 2 * high > low.
+
+static unsigned scan_generic(const uint32_t *energy, unsigned j) {
+    unsigned mask = 0;
+
+    for (unsigned b = 0; b < 8; ++b) {
+        const uint32_t *e = &energy[j + b];
+        uint32_t high = 0, low = 0;
+        int k;
+
+        for (k = 0; k < PREAMBLE_PULSES; ++k)
+            high += e[hirate.pulse[k]];
+        for (k = 0; k < PREAMBLE_QUIET; ++k)
+            low += e[hirate.quiet[k]];
+
+        if (high * 2 > low)
+            mask |= (1 << b);
+    }
+
+    return mask;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#define DEMOD_AVX2
+
+#include <immintrin.h>
+
+static bool cpu_has_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__ ((target("avx2")))
+static unsigned scan_avx2(const uint32_t *energy, unsigned j) {
+    const uint32_t *e = &energy[j];
+    __m256i high = _mm256_setzero_si256();
+    __m256i low = _mm256_setzero_si256();
+    int k;
+
+    for (k = 0; k < PREAMBLE_PULSES; ++k)
+        high = _mm256_add_epi32(high, _mm256_loadu_si256((const __m256i *) (e + hirate.pulse[k])));
+    for (k = 0; k < PREAMBLE_QUIET; ++k)
+        low = _mm256_add_epi32(low, _mm256_loadu_si256((const __m256i *) (e + hirate.quiet[k])));
+
+    // chip energies are at most 10 * 65535, so no overflow or sign issues here
+    __m256i pass = _mm256_cmpgt_epi32(_mm256_slli_epi32(high, 1), low);
+    return (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(pass));
+}
+
+#endif
+
+bool demodHiRateInit(void) {
+    unsigned i, pulses = 0, quiet = 0;
+
+    hirate.sps = (unsigned) (Modes.sample_rate / 1e6);
+    hirate.chip = hirate.sps / 2;
+
+    for (i = 0; preamble_chips[i]; ++i) {
+        if (preamble_chips[i] == '1')
+            hirate.pulse[pulses++] = i * hirate.chip;
+        else
+            hirate.quiet[quiet++] = i * hirate.chip;
+    }
+
+    if (!energy_buffer())
+        return false;
+
+    hirate.scan = scan_generic;
+#ifdef DEMOD_AVX2
+    if (cpu_has_avx2())
+        hirate.scan = scan_avx2;
+#endif
+
+    return true;
+}
+
+// Frees the calling thread's buffer
+void demodHiRateCleanup(void) {
+    free(hirate_energy);
+    hirate_energy = NULL;
+}
+
+// Zero-sum correlation against the preamble template, for picking the
+// best alignment among neighbouring candidates
+static inline int64_t preamble_correlation(const uint32_t *e) {
+    int64_t high = 0, low = 0;
+    int k;
+
+    for (k = 0; k < PREAMBLE_PULSES; ++k)
+        high += e[hirate.pulse[k]];
+    for (k = 0; k < PREAMBLE_QUIET; ++k)
+        low += e[hirate.quiet[k]];
+
+    return 3 * high - low;
+}
+
+//
+// Try to demodulate a message with a preamble at or just after sample j.
+// Returns the sample to continue searching from. When demodulating ahead
+// of time, every phase is kept for demodUseBatch() to score, and nothing
+// is skipped.
+//
+static unsigned demodulate_candidate(struct mag_buf *mag, const uint32_t *e, unsigned j, uint64_t *sum_scaled_signal_power) {
+    struct modesMessage mm;
+    unsigned char msg1[MODES_LONG_MSG_BYTES], msg2[MODES_LONG_MSG_BYTES], *msg;
+    const unsigned sps = hirate.sps, chip = hirate.chip;
+    uint16_t *m = mag->data;
+
+    unsigned char *bestmsg;
+    int bestscore, bestphase;
+    unsigned start, k;
+    int msglen;
+    struct demod_candidate *cand = NULL;
+
+    if (mag->batch && !(cand = demodNewCandidate(mag->batch, j)))
+        return j + 1;
+
+    // find the best alignment within a chip
+    start = j;
+    int64_t bestcorr = preamble_correlation(&e[j]);
+    for (k = 1; k < chip; ++k) {
+        int64_t corr = preamble_correlation(&e[j + k]);
+        if (corr > bestcorr) {
+            bestcorr = corr;
+            start = j + k;
+        }
+    }
+
+    // Check that the quiet chips are actually quiet
+    uint32_t high = 0;
+    for (k = 0; k < PREAMBLE_PULSES; ++k)
+        high += e[start + hirate.pulse[k]];
+    high /= PREAMBLE_PULSES;
+
+    for (k = 0; k < PREAMBLE_QUIET; ++k) {
+        if (e[start + hirate.quiet[k]] >= high) {
+            if (cand) {
+                cand->reject_next = start + 1;
+                return j + 1;
+            }
+            return start + 1;
+        }
+    }
+
+    // try the alignments either side as well
+    if (cand)
+        cand->reject_next = start + 1;
+    else
+        mag->stats->demod_preambles++;
+    msg = msg1;
+    bestmsg = NULL;
+    bestscore = -2;
+    bestphase = 0;
+    for (int try_phase = -1; try_phase <= 1; ++try_phase) {
+        int i, score, bytelen;
+
+        if (try_phase < 0 && start == 0)
+            continue;
+
+        // data starts after 16 preamble chips
+        const uint32_t *data = &e[start + try_phase + 16 * chip];
+
+        bytelen = MODES_LONG_MSG_BYTES;
+        for (i = 0; i < bytelen; ++i) {
+            uint8_t theByte = 0;
+
+            for (int bit = 0; bit < 8; ++bit) {
+                const uint32_t *b = &data[(i * 8 + bit) * sps];
+                theByte = (theByte << 1) | (b[0] > b[chip] ? 1 : 0);
+            }
+
+            msg[i] = theByte;
+            if (i == 0) {
+                switch (msg[0] >> 3) {
+                    case 0: case 4: case 5: case 11:
+                        bytelen = MODES_SHORT_MSG_BYTES;
+                        break;
+
+                    case 16: case 17: case 18: case 20: case 21: case 24:
+                        break;
+
+                    default:
+                        bytelen = 1; // unknown DF, give up immediately
+                        break;
+                }
+            }
+        }
+
+        if (cand) {
+            struct demod_phase *ph;
+
+            msglen = modesMessageLenByType(msg[0] >> 3);
+            ph = demodAddPhase(cand, msg, i * 8, &m[start + try_phase + 16 * chip], msglen * sps);
+            ph->timestampMsg = mag->sampleTimestamp + (uint64_t) (start + try_phase) * 12 / sps + (8 + 56) * 12;
+            ph->reject_next = start + try_phase + 1;
+            ph->accept_next = start + try_phase + msglen * sps;
+            continue;
+        }
+
+        // Score the mode S message and see if it's any good.
+        score = scoreModesMessage(msg, i * 8);
+        if (score > bestscore) {
+            bestmsg = msg;
+            bestscore = score;
+            bestphase = try_phase;
+            msg = (msg == msg1) ? msg2 : msg1;
+        }
+    }
+
+    if (cand)
+        return j + 1;
+
+    // Do we have a candidate?
+    if (bestscore < 0) {
+        if (bestscore == -1)
+            mag->stats->demod_rejected_unknown_icao++;
+        else
+            mag->stats->demod_rejected_bad++;
+        return start + 1;
+    }
+
+    start += bestphase;
+    msglen = modesMessageLenByType(bestmsg[0] >> 3);
+
+    // Set initial mm structure details
+    resetModesMessage(&mm);
+
+    // Timestamp at the end of bit 56, as in demod_2400.c
+    mm.timestampMsg = mag->sampleTimestamp + (uint64_t) start * 12 / sps + (8 + 56) * 12;
+
+    // compute message receive time as block-start-time + difference in the 12MHz clock
+    mm.sysTimestampMsg = mag->sysTimestamp + receiveclock_ms_elapsed(mag->sampleTimestamp, mm.timestampMsg);
+
+    mm.score = bestscore;
+
+    // Decode the received message
+    {
+        int result = decodeModesMessage(&mm, bestmsg);
+        if (result < 0) {
+            if (result == -1)
+                mag->stats->demod_rejected_unknown_icao++;
+            else
+                mag->stats->demod_rejected_bad++;
+            return start + 1;
+        } else {
+            mag->stats->demod_accepted[mm.correctedbits]++;
+        }
+    }
+
+    // measure signal power
+    {
+        double signal_power;
+        uint64_t scaled_signal_power = 0;
+        unsigned signal_len = msglen * sps;
+        uint16_t *p = &m[start + 16 * chip];
+
+        for (k = 0; k < signal_len; ++k) {
+            uint32_t mag = p[k];
+            scaled_signal_power += mag * mag;
+        }
+
+        signal_power = scaled_signal_power / 65535.0 / 65535.0;
+        mm.signalLevel = signal_power / signal_len;
+        mag->stats->signal_power_sum += signal_power;
+        mag->stats->signal_power_count += signal_len;
+        *sum_scaled_signal_power += scaled_signal_power;
+
+        if (mm.signalLevel > mag->stats->peak_signal_power)
+            mag->stats->peak_signal_power = mm.signalLevel;
+        if (mm.signalLevel > 0.50119)
+            mag->stats->strong_signal_count++; // signal power above -3dBFS
+    }
+
+    // Pass data to the next layer
+    demodPassMessage(mag, &mm);
+
+    // Skip to 8 bits before the end of the message, see demod_2400.c
+    return start + msglen * sps;
+}
+
+//
+// Given 'mlen' magnitude samples in 'm', sampled at an even number of MHz,
+// try to demodulate some Mode S messages.
+//
+void demodulateHiRate(struct mag_buf *mag) {
+    uint16_t *m = mag->data;
+    uint32_t mlen = mag->length;
+    uint32_t *e = energy_buffer();
+    uint64_t sum_scaled_signal_power = 0;
+    unsigned j, next;
+
+    if (!e)
+        return;
+
+    // chip energies, over the trailing samples too so that
+    // messages near the end of the buffer can be decoded
+    {
+        unsigned n, total = mlen + Modes.trailing_samples - hirate.chip;
+        uint32_t sum = 0;
+
+        for (n = 0; n < hirate.chip; ++n)
+            sum += m[n];
+        for (n = 0; n < total; ++n) {
+            e[n] = sum;
+            sum = sum + m[n + hirate.chip] - m[n];
+        }
+    }
+
+    next = 0;
+    for (j = 0; j < mlen; j += 8) {
+        if (j < next)
+            j = next;
+        if (j >= mlen)
+            break;
+
+        unsigned mask = hirate.scan(e, j);
+        while (mask) {
+            unsigned pos = j + __builtin_ctz(mask);
+            mask &= mask - 1;
+
+            if (pos >= mlen)
+                break;
+            if (pos < next)
+                continue;
+
+            next = demodulate_candidate(mag, e, pos, &sum_scaled_signal_power);
+        }
+    }
+
+    /* update noise power */
+    {
+        double sum_signal_power = sum_scaled_signal_power / 65535.0 / 65535.0;
+        mag->stats->noise_power_sum += (mag->mean_power * mag->length - sum_signal_power);
+        mag->stats->noise_power_count += mag->length;
+    }
+}
@@ -0,0 +1,36 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// demod_hirate.h: oversampled Mode S demodulator prototypes.
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DUMP1090_DEMOD_HIRATE_H
+#define DUMP1090_DEMOD_HIRATE_H
+
+#include <stdbool.h>
+
+// Supported rates are even multiples of 1MHz in this range
+#define DEMOD_HIRATE_MIN_MHZ 4
+#define DEMOD_HIRATE_MAX_MHZ 20
+
+struct mag_buf;
+
+bool demodSetSampleRate (const char *mhz);
+bool demodHiRateInit (void);
+void demodHiRateCleanup (void);
+void demodulateHiRate (struct mag_buf *mag);
+
+#endif
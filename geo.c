@@ -0,0 +1,126 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// geo.c - Great circle distance and range checks
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This code is based on a detached fork of dump1090-fa.
+//
+// Copyright (c) 2014,2015 Oliver Jowett <oliver@mutability.co.uk>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <math.h>
+
+#include "geo.h"
+
+void geoSetRef(struct geo_ref *ref, double lat, double lon) {
+    ref->lat = lat;
+    ref->lon = lon;
+    ref->lat_rad = lat * M_PI / 180.0;
+    ref->lon_rad = lon * M_PI / 180.0;
+    ref->sin_lat = sin(ref->lat_rad);
+    ref->cos_lat = cos(ref->lat_rad);
+    ref->abs_tan_lat = (ref->cos_lat > 0) ? fabs(ref->sin_lat / ref->cos_lat) : HUGE_VAL;
+}
+
+// Distance between points on a spherical earth.
+// This has up to 0.5% error because the earth isn't actually spherical
+// (but we don't use it in situations where that matters)
+
+double greatcircle(double lat0, double lon0, double lat1, double lon1) {
+    double dlat, dlon;
+
+    lat0 = lat0 * M_PI / 180.0;
+    lon0 = lon0 * M_PI / 180.0;
+    lat1 = lat1 * M_PI / 180.0;
+    lon1 = lon1 * M_PI / 180.0;
+
+    dlat = fabs(lat1 - lat0);
+    dlon = fabs(lon1 - lon0);
+
+    // use haversine for small distances for better numerical stability
+    if (dlat < 0.001 && dlon < 0.001) {
+        double a = sin(dlat / 2) * sin(dlat / 2) + cos(lat0) * cos(lat1) * sin(dlon / 2) * sin(dlon / 2);
+        return GEO_EARTH_RADIUS * 2 * atan2(sqrt(a), sqrt(1.0 - a));
+    }
+
+    // spherical law of cosines
+    return GEO_EARTH_RADIUS * acos(sin(lat0) * sin(lat1) + cos(lat0) * cos(lat1) * cos(dlon));
+}
+
+// Longitude difference in radians, wrapped to [-pi, pi]
+static inline double delta_lon(const struct geo_ref *ref, double lon) {
+    double dlon = lon - ref->lon;
+    if (dlon > 180.0)
+        dlon -= 360.0;
+    else if (dlon < -180.0)
+        dlon += 360.0;
+    return dlon * M_PI / 180.0;
+}
+
+double geoDistance(const struct geo_ref *ref, double lat, double lon) {
+    double lat1 = lat * M_PI / 180.0;
+    double sdlat = sin((lat1 - ref->lat_rad) / 2);
+    double sdlon = sin(delta_lon(ref, lon) / 2);
+    double a = sdlat * sdlat + ref->cos_lat * cos(lat1) * sdlon * sdlon;
+
+    if (a > 1.0)
+        a = 1.0;
+    return GEO_EARTH_RADIUS * 2 * asin(sqrt(a));
+}
+
+// Equirectangular projection around the reference:
+//   x = dlon * cos(lat0), y = dlat, d = R * sqrt(x^2 + y^2)
+//
+// Compared with haversine the relative error is bounded by
+//   e = |tan(lat0)| * |dlat| / 2            (scale of the parallels changes with dlat)
+//     + (1 + tan^2(lat0)) * dlat^2 / 2      (second order term of the above)
+//     + (dlat^2 + dlon^2) / 12              (curvature of the great circle)
+// for |dlat|, |dlon| <= GEO_FAST_MAX_ANGLE and |lat0| <= 80 degrees
+// (verified numerically by geotests). We report twice that as the bound to
+// leave room for rounding. Typical values: 10km apart at 50N gives 0.1%,
+// 300km apart at 50N gives 6%.
+
+double geoFastDistance(const struct geo_ref *ref, double lat, double lon, double *rel_error) {
+    double dlat = (lat - ref->lat) * M_PI / 180.0;
+    double dlon = delta_lon(ref, lon);
+
+    if (fabs(dlat) > GEO_FAST_MAX_ANGLE || fabs(dlon) > GEO_FAST_MAX_ANGLE || ref->abs_tan_lat > GEO_FAST_MAX_TAN) {
+        *rel_error = 0;
+        return geoDistance(ref, lat, lon);
+    }
+
+    double x = dlon * ref->cos_lat;
+    double t = ref->abs_tan_lat;
+
+    *rel_error = 2 * (t * fabs(dlat) / 2 + (1 + t * t) * dlat * dlat / 2 + (dlat * dlat + dlon * dlon) / 12);
+    return GEO_EARTH_RADIUS * sqrt(x * x + dlat * dlat);
+}
+
+int geoWithinRange(const struct geo_ref *ref, double lat, double lon, double range) {
+    double rel_error;
+    double distance = geoFastDistance(ref, lat, lon, &rel_error);
+
+    // 1m of absolute slack covers rounding for nearly coincident points
+    double margin = distance * rel_error + 1.0;
+
+    if (distance + margin <= range)
+        return 1;
+    if (distance - margin > range)
+        return 0;
+
+    // too close to call, use the exact distance
+    return geoDistance(ref, lat, lon) <= range;
+}
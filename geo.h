@@ -0,0 +1,68 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// geo.h - Great circle distance and range check prototypes
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This code is based on a detached fork of dump1090-fa.
+//
+// Copyright (c) 2014,2015 Oliver Jowett <oliver@mutability.co.uk>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DUMP1090_GEO_H
+#define DUMP1090_GEO_H
+
+#define GEO_EARTH_RADIUS 6371e3 // metres, spherical earth
+
+// The local tangent-plane (equirectangular) approximation is only used when
+// both angular offsets are below GEO_FAST_MAX_ANGLE (radians, ~640km) and the
+// reference latitude is below 80 degrees (tan(80) = 5.67). Everything else
+// falls back to the exact haversine distance.
+#define GEO_FAST_MAX_ANGLE 0.1
+#define GEO_FAST_MAX_TAN 5.67
+
+// A reference position with its trigonometry precomputed.
+// Used for the receiver location and the last known position of an aircraft,
+// which are checked against many new positions before they change.
+struct geo_ref
+{
+  double lat; // degrees
+  double lon; // degrees
+  double lat_rad;
+  double lon_rad;
+  double sin_lat;
+  double cos_lat;
+  double abs_tan_lat; // |tan(lat)|, drives the error bound of the fast path
+};
+
+void geoSetRef (struct geo_ref *ref, double lat, double lon);
+
+// Distance between points on a spherical earth, in metres.
+double greatcircle (double lat0, double lon0, double lat1, double lon1);
+
+// Exact (haversine) distance from a reference position, in metres.
+double geoDistance (const struct geo_ref *ref, double lat, double lon);
+
+// Equirectangular distance from a reference position, in metres, and the
+// bound on its relative error against geoDistance(). Outside the domain of
+// the approximation this returns the exact distance with a zero bound.
+double geoFastDistance (const struct geo_ref *ref, double lat, double lon, double *rel_error);
+
+// Returns non-zero if (lat, lon) is within range metres of the reference.
+// Uses the fast approximation and only computes the exact distance when
+// the result is within the error bound of the threshold.
+int geoWithinRange (const struct geo_ref *ref, double lat, double lon, double range);
+
+#endif
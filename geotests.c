@@ -0,0 +1,334 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// geotests.c - tests for distance and range checks
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "readsb.h"
+
+#define GEO_TEST_SAMPLES 1000000
+#define GRID_TEST_AIRCRAFT 20000
+#define GRID_TEST_QUERIES 2000
+
+struct _Modes Modes;
+
+void receiverPositionChanged(float lat, float lon, float alt) {
+    MODES_NOTUSED(lat);
+    MODES_NOTUSED(lon);
+    MODES_NOTUSED(alt);
+}
+
+static double uniform(double lo, double hi) {
+    return lo + (hi - lo) * rand() / (RAND_MAX + 1.0);
+}
+
+// Random offset in degrees, spread over several orders of magnitude
+// so that both nearby and distant points are covered.
+static double offset(double max_rad) {
+    static const double scale[] = { 1.0, 0.1, 0.01, 0.001 };
+    return uniform(-max_rad, max_rad) * scale[rand() % 4] * 180.0 / M_PI;
+}
+
+// Known distances, checked against both exact implementations
+static const struct {
+    double lat0, lon0, lat1, lon1;
+    double distance; // metres
+} geoKnownTests[] = {
+    { 51.4775, -0.4614, 40.6398, -73.7789, 5539443.5 }, // LHR - JFK
+    { 52.3086, 4.7639, 52.3086, 4.7639, 0.0 },
+    { 0.0, 179.9, 0.0, -179.9, 22239.0 }, // across the antimeridian
+    { 60.0, 10.0, 60.0, 11.0, 55596.9 },
+    { -33.9461, 151.1772, -37.6733, 144.8433, 705394.2 }, // SYD - MEL
+};
+
+static int testGeoKnown() {
+    int ok = 1;
+    unsigned i;
+    for (i = 0; i < sizeof (geoKnownTests) / sizeof (geoKnownTests[0]); ++i) {
+        struct geo_ref ref;
+        geoSetRef(&ref, geoKnownTests[i].lat0, geoKnownTests[i].lon0);
+
+        double gc = greatcircle(geoKnownTests[i].lat0, geoKnownTests[i].lon0, geoKnownTests[i].lat1, geoKnownTests[i].lon1);
+        double gd = geoDistance(&ref, geoKnownTests[i].lat1, geoKnownTests[i].lon1);
+        double tolerance = geoKnownTests[i].distance * 1e-5 + 1.0;
+
+        if (fabs(gc - geoKnownTests[i].distance) > tolerance || fabs(gd - geoKnownTests[i].distance) > tolerance) {
+            ok = 0;
+            fprintf(stderr, "testGeoKnown[%u]:  FAIL: greatcircle %.1f geoDistance %.1f (expected %.1f)\n",
+                    i, gc, gd, geoKnownTests[i].distance);
+        } else {
+            fprintf(stderr, "testGeoKnown[%u]:  PASS\n", i);
+        }
+    }
+
+    return ok;
+}
+
+// The fast path must stay within its reported error bound
+static int testGeoFastBound() {
+    double worst = 0;
+    int i;
+
+    srand(1);
+    for (i = 0; i < GEO_TEST_SAMPLES; ++i) {
+        struct geo_ref ref;
+        double lat0 = uniform(-80, 80);
+        double lon0 = uniform(-180, 180);
+        double lat1 = lat0 + offset(GEO_FAST_MAX_ANGLE);
+        double lon1 = lon0 + offset(GEO_FAST_MAX_ANGLE);
+        double rel_error;
+
+        if (lon1 > 180)
+            lon1 -= 360;
+        else if (lon1 < -180)
+            lon1 += 360;
+
+        geoSetRef(&ref, lat0, lon0);
+        double fast = geoFastDistance(&ref, lat1, lon1, &rel_error);
+        double exact = geoDistance(&ref, lat1, lon1);
+
+        if (exact < 1.0)
+            continue;
+
+        double used = fabs(fast - exact) / (exact * rel_error + 1e-3);
+        if (used > worst)
+            worst = used;
+
+        if (used > 1.0) {
+            fprintf(stderr, "testGeoFastBound:  FAIL: %.6f,%.6f -> %.6f,%.6f fast %.3f exact %.3f bound %.6f%%\n",
+                    lat0, lon0, lat1, lon1, fast, exact, rel_error * 100);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "testGeoFastBound:  PASS (worst case used %.1f%% of the bound)\n", worst * 100);
+    return 1;
+}
+
+// Range checks must give the same answer as comparing the exact distance
+static int testGeoWithinRange() {
+    int i;
+
+    srand(2);
+    for (i = 0; i < GEO_TEST_SAMPLES; ++i) {
+        struct geo_ref ref;
+        double lat0 = uniform(-89, 89);
+        double lon0 = uniform(-180, 180);
+        double lat1 = lat0 + offset(2 * GEO_FAST_MAX_ANGLE);
+        double lon1 = lon0 + offset(2 * GEO_FAST_MAX_ANGLE);
+
+        if (lat1 > 90 || lat1 < -90)
+            continue;
+
+        geoSetRef(&ref, lat0, lon0);
+        double exact = geoDistance(&ref, lat1, lon1);
+        // ranges straddling the actual distance
+        double range = exact * uniform(0.9, 1.1);
+
+        if (geoWithinRange(&ref, lat1, lon1, range) != (exact <= range)) {
+            fprintf(stderr, "testGeoWithinRange:  FAIL: %.6f,%.6f -> %.6f,%.6f range %.3f exact %.3f\n",
+                    lat0, lon0, lat1, lon1, range, exact);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "testGeoWithinRange:  PASS\n");
+    return 1;
+}
+
+// Random latitude, longitude favouring the poles and the antimeridian
+static double gridLat() {
+    switch (rand() % 3) {
+    case 0:
+        return uniform(80, 90);
+    case 1:
+        return uniform(-90, -80);
+    default:
+        return uniform(-90, 90);
+    }
+}
+
+static double gridLon() {
+    switch (rand() % 3) {
+    case 0:
+        return uniform(175, 180);
+    case 1:
+        return uniform(-180, -175);
+    default:
+        return uniform(-180, 180);
+    }
+}
+
+static struct aircraft *gridAircraft[GRID_TEST_AIRCRAFT];
+static char gridFound[GRID_TEST_AIRCRAFT];
+static struct aircraft *gridOut[GRID_TEST_AIRCRAFT];
+
+// Position the aircraft the way SBS input does
+static struct aircraft *gridPosition(uint32_t addr, uint64_t now) {
+    struct modesMessage mm = { 0 };
+
+    mm.addr = addr;
+    mm.addrtype = ADDR_UNKNOWN;
+    mm.sbs_in = 1;
+    mm.remote = 1;
+    mm.source = SOURCE_MLAT;
+    mm.sysTimestampMsg = now;
+    mm.decoded_lat = gridLat();
+    mm.decoded_lon = gridLon();
+    return trackUpdateFromMessage(&mm);
+}
+
+// Fill the grid: some positions have expired by the time of the queries
+// and some aircraft have moved to another cell since their first one.
+static void gridFill() {
+    uint64_t now = 1577836800000ULL;
+    int i;
+
+    for (i = 0; i < GRID_TEST_AIRCRAFT; ++i)
+        gridAircraft[i] = gridPosition(i + 1, i < GRID_TEST_AIRCRAFT / 10 ? now - 120000 : now);
+    for (i = 0; i < GRID_TEST_AIRCRAFT; i += 4)
+        gridPosition(i + 1, now);
+}
+
+// Compare a query result against matching every aircraft
+static int gridCompare(const char *name, int n, int max, int (*match)(struct aircraft *, const double *), const double *q) {
+    int expected = 0;
+    int i;
+
+    if (n > max) {
+        fprintf(stderr, "%s:  FAIL: %d aircraft found, %d expected at most\n", name, n, max);
+        return 0;
+    }
+
+    for (i = 0; i < GRID_TEST_AIRCRAFT; ++i)
+        gridFound[i] = 0;
+    for (i = 0; i < n; ++i) {
+        uint32_t k = gridOut[i]->addr - 1;
+        if (gridFound[k]++ || !trackDataValid(&gridOut[i]->position_valid) || !match(gridOut[i], q)) {
+            fprintf(stderr, "%s:  FAIL: aircraft %06x at %.4f,%.4f should not be found\n",
+                    name, gridOut[i]->addr, gridOut[i]->lat, gridOut[i]->lon);
+            return 0;
+        }
+    }
+
+    for (i = 0; i < GRID_TEST_AIRCRAFT; ++i) {
+        struct aircraft *a = gridAircraft[i];
+        if (!trackDataValid(&a->position_valid) || !match(a, q))
+            continue;
+        expected++;
+        if (!gridFound[i]) {
+            fprintf(stderr, "%s:  FAIL: aircraft %06x at %.4f,%.4f not found\n",
+                    name, a->addr, a->lat, a->lon);
+            return 0;
+        }
+    }
+
+    return expected == n;
+}
+
+// q is south, west, north, east
+static int gridMatchBox(struct aircraft *a, const double *q) {
+    if (a->lat < q[0] || a->lat > q[2])
+        return 0;
+    if (q[1] <= q[3])
+        return a->lon >= q[1] && a->lon <= q[3];
+    return a->lon >= q[1] || a->lon <= q[3];
+}
+
+// Box queries must find exactly the aircraft a scan of all of them finds,
+// including boxes crossing the antimeridian and reaching the poles
+static int testTrackQueryBox() {
+    int i;
+
+    srand(3);
+    gridFill();
+
+    for (i = 0; i < GRID_TEST_QUERIES; ++i) {
+        double q[4];
+        int n;
+
+        q[0] = gridLat();
+        q[2] = fmin(90, q[0] + uniform(0, 20));
+        q[1] = gridLon();
+        q[3] = gridLon();
+        if (i % 4 == 0) {
+            // narrow, possibly crossing the antimeridian
+            q[3] = q[1] + uniform(0, 10);
+            if (q[3] > 180)
+                q[3] -= 360;
+        } else if (i % 100 == 1) {
+            q[1] = -180;
+            q[3] = 180;
+        }
+
+        n = trackQueryBox(q[0], q[1], q[2], q[3], gridOut, GRID_TEST_AIRCRAFT);
+        if (trackQueryBox(q[0], q[1], q[2], q[3], NULL, 0) != n || !gridCompare("testTrackQueryBox", n, GRID_TEST_AIRCRAFT, gridMatchBox, q)) {
+            fprintf(stderr, "testTrackQueryBox:  FAIL: %.4f,%.4f %.4f,%.4f\n", q[0], q[1], q[2], q[3]);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "testTrackQueryBox:  PASS\n");
+    return 1;
+}
+
+// q is lat, lon, range
+static int gridMatchRadius(struct aircraft *a, const double *q) {
+    struct geo_ref ref;
+    geoSetRef(&ref, q[0], q[1]);
+    return geoWithinRange(&ref, a->lat, a->lon, q[2]);
+}
+
+// Same for ranges around a position: the longitude span widens as
+// 1 / cos(latitude) and covers every longitude once a pole is in range
+static int testTrackQueryRadius() {
+    static const double ranges[] = { 1000, 20000, 100000, 500000, 2000000 };
+    int i;
+
+    srand(4);
+
+    for (i = 0; i < GRID_TEST_QUERIES; ++i) {
+        double q[3];
+        int n;
+
+        q[0] = gridLat();
+        q[1] = gridLon();
+        q[2] = ranges[i % 5] * uniform(0.5, 1.5);
+
+        n = trackQueryRadius(q[0], q[1], q[2], gridOut, GRID_TEST_AIRCRAFT);
+        if (trackQueryRadius(q[0], q[1], q[2], NULL, 0) != n || !gridCompare("testTrackQueryRadius", n, GRID_TEST_AIRCRAFT, gridMatchRadius, q)) {
+            fprintf(stderr, "testTrackQueryRadius:  FAIL: %.4f,%.4f range %.0f\n", q[0], q[1], q[2]);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "testTrackQueryRadius:  PASS\n");
+    return 1;
+}
+
+int main(int __attribute__ ((unused)) argc, char __attribute__ ((unused)) **argv) {
+    int ok = 1;
+    ok = testGeoKnown() && ok;
+    ok = testGeoFastBound() && ok;
+    ok = testGeoWithinRange() && ok;
+    ok = testTrackQueryBox() && ok;
+    ok = testTrackQueryRadius() && ok;
+    return ok ? 0 : 1;
+}
@@ -68,6 +68,8 @@ static struct argp_option options[] =
         {"write-json", OptJsonDir, "<dir>", 0, "Periodically write json output to <dir> (for external webserver)", 1},
         {"write-json-every", OptJsonTime, "<t>", 0, "Write json output every t seconds (default 1)", 1},
         {"json-location-accuracy", OptJsonLocAcc , "<n>", 0, "Accuracy of receiver location in json metadata: 0=no location, 1=approximate, 2=exact", 1},
+        {"write-json-tiles", OptJsonTiles, "<deg>", 0, "Also write the aircraft as tiles of <deg> degrees to <dir>/tiles (default: off)", 1},
+        {"state-file", OptStateFile, "<path>", 0, "Save tracked aircraft to <path> periodically and on exit, restore them on startup", 1},
 #endif
 #endif
     {0,0,0,0, "Network options:", 2},
@@ -83,13 +85,19 @@ static struct argp_option options[] =
     {"net-sbs-port", OptNetSbsPorts, "<ports>", 0, "TCP BaseStation output listen ports (default: 30003)", 2},
     {"net-sbs-in-port", OptNetSbsInPorts, "<ports>", 0, "TCP BaseStation input listen ports (default: 0)", 2},
     {"net-bi-port", OptNetBiPorts, "<ports>", 0, "TCP Beast input listen ports  (default: 30004,30104)", 2},
+    {"net-bo-udp", OptNetBoUdp, "<host:port,...>", 0, "Send Beast output as UDP datagrams to these unicast or multicast destinations (default: none)", 2},
+    {"net-bi-udp", OptNetBiUdp, "<[address:]port>", 0, "Receive Beast UDP datagrams on port, joining address if it is a multicast group (default: none)", 2},
+    {"net-shm-bus", OptNetShmBus, "<name>", 0, "Publish frames and aircraft updates to local consumers through shared memory /dev/shm/<name> (default: none)", 2},
     {"net-vrs-port", OptNetVRSPorts, "<ports>", 0, "TCP VRS json output listen ports (default: 0)", 2},
+    {"net-http-port", OptNetHttpPorts, "<ports>", 0, "HTTP server listen ports, serving the JSON data and the web interface (default: 0)", 2},
+    {"net-http-root", OptNetHttpRoot, "<dir>", 0, "Web interface files for the HTTP server (default: none, data only)", 2},
     {"net-beast-reduce-out-port", OptNetBeastReducePorts, "<ports>", 0, "TCP BeastReduce output listen ports (default: 0)", 2},
     {"net-beast-reduce-interval", OptNetBeastReduceInterval, "<seconds>", 0, "BeastReduce position update interval, longer means less data (default: 0.125, valid range: 0.000 - 14.999)", 2},
+    {"net-beast-reduce-intervals", OptNetBeastReduceIntervals, "<pos,alt,vel,ident>", 0, "BeastReduce per-field update intervals in seconds, updates come faster while turning or climbing (default: interval for pos and alt, 4x interval for vel and ident)", 2},
     {"net-ro-size", OptNetRoSize, "<size>", 0, "TCP output flush size (maximum amount of internally buffered data before writing to network) (default: 1200)", 2},
     {"net-ro-interval", OptNetRoIntervall, "<rate>", 0, "TCP output flush interval in seconds (maximum interval between two network writes of accumulated data)(default: 0.05)", 2},
     {"net-connector", OptNetConnector, "<ip,port,protocol>", 0, "Establish connection, can be specified multiple times (e.g. 127.0.0.1,23004,beast_out) Protocols: beast_out, beast_in, raw_out, raw_in, sbs_out, vrs_out", 2},
-    {"net-connector-delay", OptNetConnectorDelay, "<seconds>", 0, "Outbound re-connection delay (default: 30)", 2},
+    {"net-connector-delay", OptNetConnectorDelay, "<seconds>", 0, "Maximum outbound re-connection delay, retries back off up to it (default: 30)", 2},
     {"net-heartbeat", OptNetHeartbeat, "<rate>", 0, "TCP heartbeat rate in seconds (default: 60 sec; 0 to disable)", 2},
     {"net-buffer", OptNetBuffer, "<n>", 0, "TCP buffer size 64Kb * (2^n) (default: n=2, 256Kb)", 2},
     {"net-verbatim", OptNetVerbatim, 0, 0, "Forward messages unchanged", 2},
@@ -107,6 +115,7 @@ static struct argp_option options[] =
     {"bladerf-fpga", OptBladeFpgaDir, "<path>", 0, "Use alternative FPGA bitstream ('' to disable FPGA load)", 4},
     {"bladerf-decimation", OptBladeDecim, "<N>", 0, "Assume FPGA decimates by a factor of N", 4},
     {"bladerf-bandwidth", OptBladeBw, "<hz>", 0, "Set LPF bandwidth ('bypass' to bypass the LPF)", 4},
+    {"sample-rate", OptSampleRate, "<MHz>", 0, "Set sample rate: 2.4 (default) or an even number of MHz from 4 to 20", 4},
 #endif
     {0,0,0,0, "Modes-S Beast options:", 5},
     {0,0,0, OPTION_DOC, "use with --device-type modesbeast", 5},
@@ -129,11 +138,14 @@ static struct argp_option options[] =
     {"ifile", OptIfileName, "<path>", 0, "Read samples from given file ('-' for stdin)", 7},
     {"iformat", OptIfileFormat, "<type>", 0, "Set sample format (UC8, SC16, SC16Q11)", 7},
     {"throttle", OptIfileThrottle, 0, 0, "Process samples at the original capture speed", 7},
+    {"ifile-threads", OptIfileThreads, "<n>", 0, "Demodulate an unthrottled file with n threads (default: 1)", 7},
+    {"sample-rate", OptSampleRate, "<MHz>", 0, "Sample rate of the file: 2.4 (default) or an even number of MHz from 4 to 20", 7},
 #ifdef ENABLE_PLUTOSDR
         {0,0,0,0, "ADALM-Pluto SDR options:", 8},
         {0,0,0, OPTION_DOC, "use with --device-type plutosdr", 8},
     {"pluto-uri", OptPlutoUri, "<USB uri>", 0, "Create USB context from this URI.(eg. usb:1.2.5)", 8},
     {"pluto-network", OptPlutoNetwork, "<hostname or IP>", 0, "Hostname or IP to create networks context. (default pluto.local)", 8},
+    {"sample-rate", OptSampleRate, "<MHz>", 0, "Set sample rate: 2.4 (default) or an even number of MHz from 4 to 20", 8},
 #endif
 #endif
     {0,0,0,0, "Help options:", 100},
@@ -0,0 +1,401 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// history.c: aircraft position history store
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "readsb.h"
+
+#define HISTORY_HEADER_SIZE 16
+#define HISTORY_CHUNK_HEADER_SIZE 16
+#define HISTORY_SAMPLE_MAX 26 // worst case encoded size of one aircraft
+
+struct history_sample {
+    uint32_t addr;
+    int32_t lat; // 1e-5 degrees
+    int32_t lon;
+    int32_t alt; // feet
+    int32_t gs; // 0.1 knots
+    uint8_t flags;
+};
+
+struct history_chunk {
+    uint64_t now;
+    int count;
+    struct history_sample *samples;
+};
+
+// What the file last said about an aircraft, to encode the next deltas
+struct history_last {
+    uint32_t key; // addr | HISTORY_LAST_USED, 0 if the slot is free
+    int32_t lat;
+    int32_t lon;
+    int32_t alt;
+    int32_t gs;
+};
+
+#define HISTORY_LAST_USED 0x80000000
+
+static struct history_chunk ring[HISTORY_SIZE];
+static int ring_next; // slot the next chunk goes to
+static int ring_count;
+
+static int file_chunks; // chunks in history.bin, -1 if it must be rewritten
+
+static struct history_last *last_table;
+static uint32_t last_size; // a power of two
+static uint32_t last_used;
+
+static struct history_last **encode_last; // per aircraft of the chunk being encoded
+static int encode_last_size;
+
+//
+//=========================================================================
+//
+// Per aircraft encoder state, an open addressing hash table. It is only
+// ever cleared as a whole, when history.bin starts over.
+//
+static void lastReset(void) {
+    if (last_table)
+        memset(last_table, 0, last_size * sizeof (*last_table));
+    last_used = 0;
+}
+
+// Make room for n more aircraft, so that lastFind() won't move entries
+static void lastReserve(uint32_t n) {
+    struct history_last *old = last_table;
+    uint32_t old_size = last_size;
+    uint32_t i;
+
+    if (2 * (last_used + n) <= last_size)
+        return;
+
+    if (!last_size)
+        last_size = 1024;
+    while (2 * (last_used + n) > last_size)
+        last_size *= 2;
+
+    last_table = calloc(last_size, sizeof (*last_table));
+    if (!last_table) {
+        fprintf(stderr, "history: out of memory\n");
+        exit(1);
+    }
+
+    for (uint32_t j = 0; j < old_size; j++) {
+        if (!old[j].key)
+            continue;
+        for (i = old[j].key * 2654435761U & (last_size - 1); last_table[i].key; i = (i + 1) & (last_size - 1))
+            ;
+        last_table[i] = old[j];
+    }
+    free(old);
+}
+
+// Find or add addr, there must be room reserved for it
+static struct history_last *lastFind(uint32_t addr, int *created) {
+    uint32_t key = addr | HISTORY_LAST_USED;
+    uint32_t i;
+
+    for (i = key * 2654435761U & (last_size - 1); last_table[i].key; i = (i + 1) & (last_size - 1)) {
+        if (last_table[i].key == key) {
+            *created = 0;
+            return &last_table[i];
+        }
+    }
+
+    memset(&last_table[i], 0, sizeof (last_table[i]));
+    last_table[i].key = key;
+    last_used++;
+    *created = 1;
+    return &last_table[i];
+}
+
+//
+//=========================================================================
+//
+// Encoding
+//
+static inline unsigned char *putVarint(unsigned char *p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static inline unsigned char *putSigned(unsigned char *p, int32_t v) {
+    return putVarint(p, ((uint32_t) v << 1) ^ (uint32_t) (v >> 31));
+}
+
+static inline unsigned char *putU32(unsigned char *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+static unsigned char *encodeHeader(unsigned char *p) {
+    memcpy(p, HISTORY_MAGIC, 4);
+    p[4] = HISTORY_VERSION;
+    p[5] = p[6] = p[7] = 0;
+    p = putU32(p + 8, HISTORY_INTERVAL);
+    return putU32(p, HISTORY_SIZE);
+}
+
+static size_t chunkBound(const struct history_chunk *c) {
+    return HISTORY_CHUNK_HEADER_SIZE + (size_t) c->count * HISTORY_SAMPLE_MAX;
+}
+
+// Encode c at p, continuing the deltas of everything encoded since the
+// last lastReset(). Returns the end of the chunk.
+static unsigned char *encodeChunk(unsigned char *p, const struct history_chunk *c) {
+    unsigned char *start = p;
+    uint32_t prev_addr = 0;
+    int i;
+
+    if (c->count > encode_last_size) {
+        encode_last_size = c->count + 256;
+        free(encode_last);
+        encode_last = malloc(encode_last_size * sizeof (*encode_last));
+        if (!encode_last) {
+            fprintf(stderr, "history: out of memory\n");
+            exit(1);
+        }
+    }
+
+    p = putU32(p + 4, c->now);
+    p = putU32(p, c->now >> 32);
+    p = putU32(p, c->count);
+
+    for (i = 0; i < c->count; i++) {
+        p = putVarint(p, c->samples[i].addr - prev_addr);
+        prev_addr = c->samples[i].addr;
+    }
+
+    lastReserve(c->count);
+    for (i = 0; i < c->count; i++) {
+        int created;
+        encode_last[i] = lastFind(c->samples[i].addr, &created);
+        *p++ = c->samples[i].flags | (created ? HISTORY_KEY : 0);
+    }
+
+    for (i = 0; i < c->count; i++) {
+        p = putSigned(p, c->samples[i].lat - encode_last[i]->lat);
+        encode_last[i]->lat = c->samples[i].lat;
+    }
+
+    for (i = 0; i < c->count; i++) {
+        p = putSigned(p, c->samples[i].lon - encode_last[i]->lon);
+        encode_last[i]->lon = c->samples[i].lon;
+    }
+
+    for (i = 0; i < c->count; i++) {
+        if (!(c->samples[i].flags & HISTORY_ALTITUDE))
+            continue;
+        p = putSigned(p, c->samples[i].alt - encode_last[i]->alt);
+        encode_last[i]->alt = c->samples[i].alt;
+    }
+
+    for (i = 0; i < c->count; i++) {
+        if (!(c->samples[i].flags & HISTORY_GS))
+            continue;
+        p = putSigned(p, c->samples[i].gs - encode_last[i]->gs);
+        encode_last[i]->gs = c->samples[i].gs;
+    }
+
+    putU32(start, p - start - 4);
+    return p;
+}
+
+//
+//=========================================================================
+//
+// history.bin
+//
+
+// Replace history.bin with the header and every chunk in memory
+static void rewriteFile(void) {
+    struct char_buffer cb;
+    size_t size = HISTORY_HEADER_SIZE;
+    unsigned char *p;
+    int i, slot;
+
+    for (i = 0; i < HISTORY_SIZE; i++)
+        size += chunkBound(&ring[i]);
+
+    if (!(cb.buffer = malloc(size))) {
+        fprintf(stderr, "history: out of memory\n");
+        exit(1);
+    }
+
+    lastReset();
+    p = encodeHeader((unsigned char *) cb.buffer);
+    slot = (ring_next - ring_count + HISTORY_SIZE) % HISTORY_SIZE;
+    for (i = 0; i < ring_count; i++) {
+        p = encodeChunk(p, &ring[slot]);
+        slot = (slot + 1) % HISTORY_SIZE;
+    }
+
+    cb.len = p - (unsigned char *) cb.buffer;
+    writeJsonToFile(HISTORY_FILE, cb); // frees the buffer
+    file_chunks = ring_count;
+}
+
+// Append the newest chunk to history.bin
+static void appendFile(const struct history_chunk *c) {
+    char path[PATH_MAX];
+    unsigned char *buf;
+    ssize_t len, done = 0;
+    int fd;
+
+    if (!(buf = malloc(chunkBound(c)))) {
+        fprintf(stderr, "history: out of memory\n");
+        exit(1);
+    }
+    len = encodeChunk(buf, c) - buf;
+
+    snprintf(path, PATH_MAX, "%s/%s", Modes.json_dir, HISTORY_FILE);
+    if ((fd = open(path, O_WRONLY | O_APPEND)) >= 0) {
+        while (done < len) {
+            ssize_t n = write(fd, buf + done, len - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            done += n;
+        }
+        close(fd);
+    }
+    free(buf);
+
+    // A short write leaves a cut off chunk, which readers take as the end
+    // of the file. Start over next time.
+    if (done == len)
+        file_chunks++;
+    else
+        file_chunks = -1;
+}
+
+//
+//=========================================================================
+//
+// Sampling
+//
+static int compareSamples(const void *a, const void *b) {
+    uint32_t x = ((const struct history_sample *) a)->addr;
+    uint32_t y = ((const struct history_sample *) b)->addr;
+    return (x > y) - (x < y);
+}
+
+// Sample every aircraft aircraft.json would list with a position
+static void sampleAircraft(struct history_chunk *c, uint64_t now) {
+    struct aircraft *a;
+    int n = 0;
+
+    _messageNow = now;
+
+    for (int j = 0; j < AIRCRAFTS_BUCKETS; j++)
+        for (a = Modes.aircrafts[j]; a; a = a->next)
+            n++;
+
+    c->now = now;
+    c->count = 0;
+    c->samples = n ? malloc(n * sizeof (*c->samples)) : NULL;
+    if (n && !c->samples) {
+        fprintf(stderr, "history: out of memory\n");
+        exit(1);
+    }
+
+    for (int j = 0; j < AIRCRAFTS_BUCKETS; j++) {
+        for (a = Modes.aircrafts[j]; a; a = a->next) {
+            struct history_sample *s;
+
+            if (a->messages < 2 || (now - a->seen) > 90E3 || !trackDataValid(&a->position_valid))
+                continue;
+
+            s = &c->samples[c->count++];
+            s->addr = a->addr;
+            s->lat = lrint(a->lat * 1e5);
+            s->lon = lrint(a->lon * 1e5);
+            s->alt = 0;
+            s->gs = 0;
+            s->flags = 0;
+
+            if (trackDataValid(&a->airground_valid) && a->airground_valid.source >= SOURCE_MODE_S_CHECKED && a->airground == AG_GROUND) {
+                s->flags |= HISTORY_GROUND;
+            } else if (trackDataValid(&a->altitude_baro_valid) && a->altitude_baro_reliable >= 3) {
+                s->flags |= HISTORY_ALTITUDE;
+                s->alt = a->altitude_baro;
+            }
+
+            if (trackDataValid(&a->gs_valid)) {
+                s->flags |= HISTORY_GS;
+                s->gs = lrint(a->gs * 10);
+            }
+        }
+    }
+
+    if (c->count)
+        qsort(c->samples, c->count, sizeof (*c->samples), compareSamples);
+}
+
+//
+//=========================================================================
+//
+void historyInit(void) {
+    historyCleanup();
+    rewriteFile();
+}
+
+void historyUpdate(uint64_t now) {
+    struct history_chunk *c = &ring[ring_next];
+
+    free(c->samples);
+    sampleAircraft(c, now);
+
+    ring_next = (ring_next + 1) % HISTORY_SIZE;
+    if (ring_count < HISTORY_SIZE)
+        ring_count++;
+
+    if (file_chunks < 0 || file_chunks >= 2 * HISTORY_SIZE)
+        rewriteFile();
+    else
+        appendFile(c);
+}
+
+int historyCount(void) {
+    return ring_count;
+}
+
+void historyCleanup(void) {
+    for (int i = 0; i < HISTORY_SIZE; i++) {
+        free(ring[i].samples);
+        ring[i].samples = NULL;
+        ring[i].count = 0;
+    }
+    ring_next = ring_count = 0;
+    file_chunks = 0;
+
+    free(last_table);
+    last_table = NULL;
+    last_size = last_used = 0;
+
+    free(encode_last);
+    encode_last = NULL;
+    encode_last_size = 0;
+}
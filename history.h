@@ -0,0 +1,73 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// history.h: aircraft position history store
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef READSB_HISTORY_H
+#define READSB_HISTORY_H
+
+// Every HISTORY_INTERVAL the position, altitude and ground speed of all
+// aircraft with a current position are sampled into one chunk. The last
+// HISTORY_SIZE chunks are kept in memory, and json_dir/history.bin holds
+// them for the web interface, which loads the whole history with a single
+// request.
+//
+// New chunks are appended to history.bin. Once it holds twice the ring,
+// it is rewritten (atomically, via rename) from the chunks in memory, so
+// it never grows past 2 * HISTORY_SIZE chunks.
+//
+// history.bin, all integers little endian:
+//
+//   header    "RSBH", u8 version (1), 3 bytes reserved,
+//             u32 sample interval in ms, u32 chunks the reader should use
+//             (the newest ones, older chunks only set up deltas)
+//   chunk     u32 length of the rest of the chunk, u64 time in ms,
+//             u32 aircraft count n, then n values of each column in turn:
+//     addr    varint, address (bit 24 set for non-ICAO) minus the previous
+//             one in this chunk, addresses ascending
+//     flags   u8, HISTORY_KEY / HISTORY_ALTITUDE / HISTORY_GROUND / HISTORY_GS
+//     lat     zigzag varint, 1e-5 degrees
+//     lon     zigzag varint, 1e-5 degrees
+//     alt     zigzag varint, feet; only for aircraft with HISTORY_ALTITUDE
+//     gs      zigzag varint, 0.1 knots; only for aircraft with HISTORY_GS
+//
+// lat, lon, alt and gs are deltas from the aircraft's previous values in
+// the file. HISTORY_KEY resets those to 0, it is set on the first sample
+// of an aircraft in the file. A chunk that was cut short (the file was
+// read while being appended to) ends the file.
+
+#define HISTORY_MAGIC "RSBH"
+#define HISTORY_VERSION 1
+#define HISTORY_FILE "history.bin"
+
+#define HISTORY_KEY 1 // deltas are from 0
+#define HISTORY_ALTITUDE 2 // barometric altitude present
+#define HISTORY_GROUND 4 // on the ground, no altitude
+#define HISTORY_GS 8 // ground speed present
+
+// Start a new, empty history.bin in json_dir
+void historyInit(void);
+
+// Sample all aircraft as of now and store the chunk
+void historyUpdate(uint64_t now);
+
+// Number of chunks in memory, what the web interface will find
+int historyCount(void);
+
+void historyCleanup(void);
+
+#endif
@@ -0,0 +1,1018 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// http.c: embedded HTTP server
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "readsb.h"
+
+#define HTTP_JSON_MEMBERS 64 // fields of an aircraft object, appendAircraftJson writes 44 at most
+
+// A response body, shared by all connections it is queued on
+struct http_doc {
+    int refs;
+    size_t len;
+    char *data;
+};
+
+// A part of a response waiting for room in the SendQ: a document, or
+// the rest of a file
+struct http_part {
+    struct http_doc *doc;
+    size_t offset;
+    int fd;
+    off_t left;
+};
+
+// Per connection state, hung off the client
+struct http_conn {
+    struct http_part parts[HTTP_MAX_PARTS];
+    int first; // oldest queued part
+    int nparts;
+    int close_after; // close once everything queued is sent
+    int sse; // the connection is an event stream
+    uint64_t last_active;
+};
+
+struct http_request {
+    int head; // HEAD, no body
+    int http10;
+    int keep_alive;
+    int data; // a /data/ resource, open to other origins
+    const char *if_none_match;
+    const char *query; // after the '?' of the target, NULL if none
+};
+
+// A JSON document in memory: rendered here at most every json_interval,
+// or taken from the documents net_io keeps rendered
+struct http_cache {
+    const char *path;
+    struct char_buffer (*generate)(void); // NULL to use cachedJson()
+    json_cached_t cached;
+    struct http_doc *doc;
+    uint64_t updated; // when it was rendered, or the version taken
+    char etag[20];
+};
+
+static struct http_cache caches[] = {
+    { "/data/aircraft.json", generateAircraftJson, 0, NULL, 0, ""},
+    { "/data/receiver.json", NULL, JSON_RECEIVER, NULL, 0, ""},
+    { "/data/stats.json", NULL, JSON_STATS, NULL, 0, ""},
+};
+
+// What the event streams last said about an aircraft
+struct sse_aircraft {
+    struct sse_aircraft *next;
+    uint32_t addr;
+    uint32_t generation; // of the last refresh that listed it
+    char *json;
+    int len;
+    int size;
+};
+
+static struct sse_aircraft *sse_table[AIRCRAFTS_BUCKETS];
+static uint32_t sse_generation;
+static uint64_t sse_now; // time of the last refresh
+static uint32_t sse_messages;
+static uint64_t sse_next; // next delta
+static int sse_clients;
+
+static const struct {
+    const char *ext;
+    const char *type;
+} mime_types[] = {
+    { "html", "text/html; charset=utf-8"},
+    { "js", "application/javascript"},
+    { "css", "text/css"},
+    { "json", "application/json"},
+    { "map", "application/json"},
+    { "png", "image/png"},
+    { "jpg", "image/jpeg"},
+    { "gif", "image/gif"},
+    { "svg", "image/svg+xml"},
+    { "ico", "image/x-icon"},
+    { "woff", "font/woff"},
+    { "woff2", "font/woff2"},
+    { "txt", "text/plain; charset=utf-8"},
+    { NULL, NULL}
+};
+
+//
+//=========================================================================
+//
+// Documents and growable buffers
+//
+static struct http_doc *docCreate(struct char_buffer cb) {
+    struct http_doc *d = malloc(sizeof (*d));
+
+    if (!d || !cb.buffer) {
+        fprintf(stderr, "HTTP server: out of memory\n");
+        exit(1);
+    }
+    d->refs = 1;
+    d->len = cb.len;
+    d->data = cb.buffer;
+    return d;
+}
+
+static struct http_doc *docCopy(const char *data, size_t len) {
+    struct char_buffer cb;
+
+    cb.buffer = malloc(len ? len : 1);
+    cb.len = len;
+    if (cb.buffer)
+        memcpy(cb.buffer, data, len);
+    return docCreate(cb);
+}
+
+static void docRelease(struct http_doc *d) {
+    if (--d->refs)
+        return;
+    free(d->data);
+    free(d);
+}
+
+static void bufAppend(struct char_buffer *b, size_t *size, const char *data, size_t len) {
+    if (b->len + len > *size) {
+        while (b->len + len > *size)
+            *size = *size ? 2 * *size : 64 * 1024;
+        if (!(b->buffer = realloc(b->buffer, *size))) {
+            fprintf(stderr, "HTTP server: out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(b->buffer + b->len, data, len);
+    b->len += len;
+}
+
+static uint64_t fnv1a(const char *p, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while (len--) {
+        h ^= (unsigned char) *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+//
+//=========================================================================
+//
+// Response queue
+//
+static struct http_conn *httpConn(struct client *c) {
+    if (!c->http) {
+        if (!(c->http = calloc(1, sizeof (*c->http)))) {
+            fprintf(stderr, "HTTP server: out of memory\n");
+            exit(1);
+        }
+        c->http->last_active = mstime();
+    }
+    return c->http;
+}
+
+static struct http_part *queuePart(struct http_conn *h) {
+    struct http_part *part;
+
+    if (h->nparts == HTTP_MAX_PARTS)
+        return NULL;
+    part = &h->parts[(h->first + h->nparts++) % HTTP_MAX_PARTS];
+    memset(part, 0, sizeof (*part));
+    part->fd = -1;
+    return part;
+}
+
+// Queue a reference to d. Returns 0 if the queue is full.
+static int queueDoc(struct http_conn *h, struct http_doc *d) {
+    struct http_part *part = queuePart(h);
+
+    if (!part)
+        return 0;
+    part->doc = d;
+    d->refs++;
+    return 1;
+}
+
+static void queueCopy(struct http_conn *h, const char *data, size_t len) {
+    struct http_doc *d = docCopy(data, len);
+
+    queueDoc(h, d);
+    docRelease(d);
+}
+
+static void queueFile(struct http_conn *h, int fd, off_t size) {
+    struct http_part *part = queuePart(h);
+
+    if (!part) {
+        close(fd);
+        return;
+    }
+    part->fd = fd;
+    part->left = size;
+}
+
+static void partRelease(struct http_part *part) {
+    if (part->doc)
+        docRelease(part->doc);
+    else if (part->fd >= 0)
+        close(part->fd);
+    part->doc = NULL;
+    part->fd = -1;
+}
+
+// Move queued parts into the SendQ as far as it has room.
+// Returns -1 if a file could not be read to the end.
+static int httpFill(struct client *c) {
+    struct http_conn *h = c->http;
+
+    while (h->nparts && c->sendq_len < c->sendq_max) {
+        struct http_part *part = &h->parts[h->first];
+        char *dst = (char *) c->sendq + c->sendq_len;
+        size_t room = c->sendq_max - c->sendq_len;
+
+        if (part->doc) {
+            size_t n = part->doc->len - part->offset;
+            if (n > room)
+                n = room;
+            memcpy(dst, part->doc->data + part->offset, n);
+            part->offset += n;
+            c->sendq_len += n;
+            if (part->offset < part->doc->len)
+                continue;
+        } else {
+            ssize_t n = read(part->fd, dst, (off_t) room < part->left ? (off_t) room : part->left);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return -1; // the file shrank, the Content-Length can't be kept
+            c->sendq_len += n;
+            part->left -= n;
+            if (part->left)
+                continue;
+        }
+
+        partRelease(part);
+        h->first = (h->first + 1) % HTTP_MAX_PARTS;
+        h->nparts--;
+    }
+
+    return 0;
+}
+
+// Send as much of the queued responses as the socket takes, and close
+// the connection once done if asked to. The client may get closed.
+static void httpPump(struct client *c, uint64_t now) {
+    struct http_conn *h = c->http;
+
+    for (;;) {
+        int before;
+
+        if (httpFill(c) < 0) {
+            fprintf(stderr, "HTTP server: Read error, disconnecting: %s port %s\n", c->host, c->port);
+            modesCloseClient(c);
+            return;
+        }
+        if (!c->sendq_len)
+            break;
+
+        before = c->sendq_len;
+        flushClient(c, now);
+        if (!c->service)
+            return;
+        if (c->sendq_len == before)
+            break; // the socket is full
+        h->last_active = now;
+    }
+
+    if (h->close_after && !h->nparts && !c->sendq_len)
+        modesCloseClient(c);
+}
+
+//
+//=========================================================================
+//
+// Responses
+//
+static const char *statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Internal Server Error";
+    }
+}
+
+static const char *mimeType(const char *path) {
+    const char *ext = strrchr(path, '.');
+
+    if (ext && !strchr(ext, '/')) {
+        for (int i = 0; mime_types[i].ext; i++) {
+            if (!strcasecmp(ext + 1, mime_types[i].ext))
+                return mime_types[i].type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+// Queue the status line and headers. A negative length is a body that
+// runs until the connection is closed, the caller closes it when done.
+static void queueHeader(struct http_conn *h, struct http_request *r, int status, const char *type, long long length, const char *etag) {
+    char buf[1024], date[64];
+    char *p = buf, *end = buf + sizeof (buf);
+    time_t t = time(NULL);
+    struct tm tm;
+
+    gmtime_r(&t, &tm);
+    strftime(date, sizeof (date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+    p += snprintf(p, end - p, "HTTP/1.1 %d %s\r\nServer: readsb/%s\r\nDate: %s\r\n",
+            status, statusText(status), MODES_READSB_VERSION, date);
+    if (type)
+        p += snprintf(p, end - p, "Content-Type: %s\r\n", type);
+    if (length >= 0 && status != 304)
+        p += snprintf(p, end - p, "Content-Length: %lld\r\n", length);
+    if (etag)
+        p += snprintf(p, end - p, "ETag: %s\r\n", etag);
+    if (status == 405)
+        p += snprintf(p, end - p, "Allow: GET, HEAD\r\n");
+    p += snprintf(p, end - p, "Cache-Control: no-cache\r\n");
+    if (r->data)
+        p += snprintf(p, end - p, "Access-Control-Allow-Origin: *\r\n");
+
+    if (length < 0) {
+        p += snprintf(p, end - p, "Connection: close\r\n");
+    } else if (!r->keep_alive) {
+        p += snprintf(p, end - p, "Connection: close\r\n");
+        h->close_after = 1;
+    } else if (r->http10) {
+        p += snprintf(p, end - p, "Connection: keep-alive\r\n");
+    }
+    p += snprintf(p, end - p, "\r\n");
+
+    queueCopy(h, buf, p - buf);
+}
+
+static void respondError(struct http_conn *h, struct http_request *r, int status) {
+    char body[64];
+    int len = snprintf(body, sizeof (body), "%d %s\n", status, statusText(status));
+
+    queueHeader(h, r, status, "text/plain; charset=utf-8", len, NULL);
+    if (!r->head)
+        queueCopy(h, body, len);
+}
+
+static int etagMatches(struct http_request *r, const char *etag) {
+    return r->if_none_match && (!strcmp(r->if_none_match, "*") || strstr(r->if_none_match, etag));
+}
+
+static void respondCached(struct http_conn *h, struct http_request *r, struct http_cache *cache, uint64_t now) {
+    struct http_doc *doc = NULL;
+
+    if (cache->generate) {
+        if (!cache->doc || now >= cache->updated + Modes.json_interval) {
+            doc = docCreate(cache->generate());
+            cache->updated = now;
+        }
+    } else {
+        const struct json_cache *j = cachedJson(cache->cached);
+
+        if (!cache->doc || cache->updated != j->version) {
+            doc = docCopy(j->cb.buffer, j->cb.len);
+            cache->updated = j->version;
+        }
+    }
+
+    if (doc) {
+        if (cache->doc)
+            docRelease(cache->doc);
+        cache->doc = doc;
+        snprintf(cache->etag, sizeof (cache->etag), "\"%016llx\"",
+                (unsigned long long) fnv1a(doc->data, doc->len));
+    }
+
+    if (etagMatches(r, cache->etag)) {
+        queueHeader(h, r, 304, NULL, 0, cache->etag);
+        return;
+    }
+
+    queueHeader(h, r, 200, "application/json", cache->doc->len, cache->etag);
+    if (!r->head)
+        queueDoc(h, cache->doc);
+}
+
+static void respondFile(struct http_conn *h, struct http_request *r, const char *dir, const char *path) {
+    char file[PATH_MAX], etag[64];
+    struct stat st;
+    int fd;
+
+    snprintf(file, sizeof (file), "%s%s%s", dir, path, path[strlen(path) - 1] == '/' ? "index.html" : "");
+    if ((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0) {
+        respondError(h, r, 404);
+        return;
+    }
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        respondError(h, r, 404);
+        return;
+    }
+
+    snprintf(etag, sizeof (etag), "\"%llx.%lx-%llx\"", (unsigned long long) st.st_mtim.tv_sec,
+            (unsigned long) st.st_mtim.tv_nsec, (unsigned long long) st.st_size);
+    if (etagMatches(r, etag)) {
+        close(fd);
+        queueHeader(h, r, 304, NULL, 0, etag);
+        return;
+    }
+
+    queueHeader(h, r, 200, mimeType(file), st.st_size, etag);
+    if (r->head || !st.st_size)
+        close(fd);
+    else
+        queueFile(h, fd, st.st_size);
+}
+
+//
+//=========================================================================
+//
+// Event streams
+//
+static struct sse_aircraft *sseFind(uint32_t addr) {
+    struct sse_aircraft *s;
+
+    for (s = sse_table[addr % AIRCRAFTS_BUCKETS]; s; s = s->next) {
+        if (s->addr == addr)
+            return s;
+    }
+
+    if (!(s = calloc(1, sizeof (*s)))) {
+        fprintf(stderr, "HTTP server: out of memory\n");
+        exit(1);
+    }
+    s->addr = addr;
+    s->next = sse_table[addr % AIRCRAFTS_BUCKETS];
+    sse_table[addr % AIRCRAFTS_BUCKETS] = s;
+    return s;
+}
+
+struct json_member {
+    const char *key;
+    int key_len;
+    const char *value;
+    int value_len;
+};
+
+static const char *jsonSkipString(const char *p, const char *end) {
+    for (p++; p < end && *p != '"'; p++) {
+        if (*p == '\\')
+            p++;
+    }
+    return p < end ? p + 1 : end;
+}
+
+static const char *jsonSkipValue(const char *p, const char *end) {
+    int depth = 0;
+
+    while (p < end) {
+        if (*p == '"') {
+            p = jsonSkipString(p, end);
+            continue;
+        }
+        if (*p == '[' || *p == '{') {
+            depth++;
+        } else if (*p == ']' || *p == '}') {
+            if (!depth)
+                return p;
+            depth--;
+        } else if (*p == ',' && !depth) {
+            return p;
+        }
+        p++;
+    }
+    return p;
+}
+
+// Split an object as appendAircraftJson writes it (no whitespace) into
+// its members
+static int jsonMembers(const char *p, const char *end, struct json_member *m) {
+    int n = 0;
+
+    if (p == end || *p++ != '{')
+        return 0;
+
+    while (p < end && *p == '"' && n < HTTP_JSON_MEMBERS) {
+        m[n].key = p;
+        p = jsonSkipString(p, end);
+        m[n].key_len = p - m[n].key;
+        if (p < end && *p == ':')
+            p++;
+        m[n].value = p;
+        p = jsonSkipValue(p, end);
+        m[n].value_len = p - m[n].value;
+        n++;
+        if (p < end && *p == ',')
+            p++;
+    }
+    return n;
+}
+
+// Append the fields of cur that differ from old, and null for those
+// that went away. The first field, "hex", is always there.
+static void appendDelta(struct char_buffer *b, size_t *size, struct sse_aircraft *old, const char *cur, int cur_len) {
+    struct json_member om[HTTP_JSON_MEMBERS], nm[HTTP_JSON_MEMBERS];
+    int on = jsonMembers(old->json, old->json + old->len, om);
+    int nn = jsonMembers(cur, cur + cur_len, nm);
+    int i, j;
+
+    for (i = 0; i < nn; i++) {
+        for (j = 0; j < on; j++) {
+            if (om[j].key_len == nm[i].key_len && !memcmp(om[j].key, nm[i].key, nm[i].key_len))
+                break;
+        }
+        if (i && j < on && om[j].value_len == nm[i].value_len && !memcmp(om[j].value, nm[i].value, nm[i].value_len))
+            continue;
+
+        bufAppend(b, size, i ? "," : "{", 1);
+        bufAppend(b, size, nm[i].key, nm[i].key_len + 1 + nm[i].value_len); // "key":value
+    }
+
+    for (j = 0; j < on; j++) {
+        for (i = 0; i < nn; i++) {
+            if (om[j].key_len == nm[i].key_len && !memcmp(om[j].key, nm[i].key, nm[i].key_len))
+                break;
+        }
+        if (i < nn)
+            continue;
+
+        bufAppend(b, size, ",", 1);
+        bufAppend(b, size, om[j].key, om[j].key_len);
+        bufAppend(b, size, ":null", 5);
+    }
+
+    bufAppend(b, size, "}", 1);
+}
+
+// Render every aircraft, update what the streams know and return the
+// delta event from the previous refresh
+static struct http_doc *sseRefresh(uint64_t now) {
+    struct char_buffer b = {NULL, 0};
+    size_t size = 0;
+    char buf[AIRCRAFT_JSON_MAX];
+    const char *sep = "";
+    struct aircraft *a;
+    int len;
+
+    _messageNow = now;
+    sse_generation++;
+    sse_now = now;
+    sse_messages = Modes.stats_current.messages_total + Modes.stats_alltime.messages_total;
+
+    len = snprintf(buf, sizeof (buf), "event: delta\ndata: {\"now\":%.1f,\"messages\":%u,\"aircraft\":[",
+            now / 1000.0, sse_messages);
+    bufAppend(&b, &size, buf, len);
+
+    for (int j = 0; j < AIRCRAFTS_BUCKETS; j++) {
+        for (a = Modes.aircrafts[j]; a; a = a->next) {
+            struct sse_aircraft *s;
+
+            if (!includeAircraftJson(a, now))
+                continue;
+
+            len = appendAircraftJson(buf, a, now) - buf;
+            s = sseFind(a->addr);
+            s->generation = sse_generation;
+
+            if (s->len == len && !memcmp(s->json, buf, len))
+                continue;
+
+            bufAppend(&b, &size, sep, strlen(sep));
+            sep = ",";
+            if (s->json)
+                appendDelta(&b, &size, s, buf, len);
+            else
+                bufAppend(&b, &size, buf, len);
+
+            if (len > s->size) {
+                s->size = len + 64;
+                if (!(s->json = realloc(s->json, s->size))) {
+                    fprintf(stderr, "HTTP server: out of memory\n");
+                    exit(1);
+                }
+            }
+            memcpy(s->json, buf, len);
+            s->len = len;
+        }
+    }
+
+    bufAppend(&b, &size, "],\"gone\":[", 10);
+    sep = "";
+    for (int j = 0; j < AIRCRAFTS_BUCKETS; j++) {
+        struct sse_aircraft **prev = &sse_table[j], *s;
+
+        while ((s = *prev)) {
+            if (s->generation == sse_generation) {
+                prev = &s->next;
+                continue;
+            }
+
+            len = snprintf(buf, sizeof (buf), "%s\"%s%06x\"", sep,
+                    (s->addr & MODES_NON_ICAO_ADDRESS) ? "~" : "", s->addr & 0xFFFFFF);
+            bufAppend(&b, &size, buf, len);
+            sep = ",";
+
+            *prev = s->next;
+            free(s->json);
+            free(s);
+        }
+    }
+    bufAppend(&b, &size, "]}\n\n", 4);
+
+    return docCreate(b);
+}
+
+// The first event of a stream: everything the streams know
+static struct http_doc *sseSnapshot(void) {
+    struct char_buffer b = {NULL, 0};
+    size_t size = 0;
+    char buf[256];
+    const char *sep = "";
+    int len;
+
+    len = snprintf(buf, sizeof (buf), "retry: %d\nevent: snapshot\ndata: {\"now\":%.1f,\"messages\":%u,\"aircraft\":[",
+            HTTP_SSE_RETRY, sse_now / 1000.0, sse_messages);
+    bufAppend(&b, &size, buf, len);
+
+    for (int j = 0; j < AIRCRAFTS_BUCKETS; j++) {
+        for (struct sse_aircraft *s = sse_table[j]; s; s = s->next) {
+            bufAppend(&b, &size, sep, strlen(sep));
+            bufAppend(&b, &size, s->json, s->len);
+            sep = ",";
+        }
+    }
+    bufAppend(&b, &size, "]}\n\n", 4);
+
+    return docCreate(b);
+}
+
+static void respondStream(struct http_conn *h, struct http_request *r, uint64_t now) {
+    struct http_doc *d;
+
+    queueHeader(h, r, 200, "text/event-stream", -1, NULL);
+    if (r->head) {
+        h->close_after = 1;
+        return;
+    }
+
+    // With no other stream running, what we know may be long out of date
+    if (!sse_clients && now >= sse_now + Modes.json_interval) {
+        docRelease(sseRefresh(now));
+        sse_next = now + Modes.json_interval;
+    }
+
+    d = sseSnapshot();
+    queueDoc(h, d);
+    docRelease(d);
+
+    h->sse = 1;
+    sse_clients++;
+}
+
+static void sseBroadcast(uint64_t now) {
+    struct http_doc *d = sseRefresh(now);
+    struct client *c;
+
+    for (c = Modes.http_out.service->clients; c; c = c->next) {
+        if (!c->service || !c->http || !c->http->sse)
+            continue;
+
+        if (!queueDoc(c->http, d)) {
+            fprintf(stderr, "HTTP server: Event stream fell behind, disconnecting: %s port %s\n", c->host, c->port);
+            modesCloseClient(c);
+        }
+    }
+
+    docRelease(d);
+}
+
+//
+//=========================================================================
+//
+// Requests
+//
+static int hexValue(int c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Strip the query, decode %XX in place and refuse anything that could
+// leave the served directory. Returns 0 for a bad target.
+static int decodeTarget(char *path) {
+    char *in, *out = path;
+
+    if (path[0] != '/')
+        return 0;
+
+    for (in = path; *in && *in != '?' && *in != '#'; in++) {
+        if (*in == '%') {
+            int hi = hexValue(in[1]);
+            int lo = hi < 0 ? -1 : hexValue(in[2]);
+            if (lo < 0 || (hi == 0 && lo == 0))
+                return 0;
+            *out++ = hi << 4 | lo;
+            in += 2;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = 0;
+
+    for (char *p = path; (p = strstr(p, "/..")); p += 3) {
+        if (p[3] == '/' || p[3] == 0)
+            return 0;
+    }
+    return 1;
+}
+
+// Send a document rendered for this request alone
+static void respondDoc(struct http_conn *h, struct http_request *r, struct http_doc *doc) {
+    char etag[24];
+
+    snprintf(etag, sizeof (etag), "\"%016llx\"", (unsigned long long) fnv1a(doc->data, doc->len));
+    if (etagMatches(r, etag)) {
+        queueHeader(h, r, 304, NULL, 0, etag);
+    } else {
+        queueHeader(h, r, 200, "application/json", doc->len, etag);
+        if (!r->head)
+            queueDoc(h, doc);
+    }
+    docRelease(doc);
+}
+
+// /data/traces/<hex>.json, rendered from the tracker on every request
+static void respondTrace(struct http_conn *h, struct http_request *r, const char *name, uint64_t now) {
+    struct aircraft *a;
+    uint32_t addr = 0;
+    int i;
+
+    if (*name == '~') {
+        addr = MODES_NON_ICAO_ADDRESS;
+        name++;
+    }
+    for (i = 0; i < 6 && hexValue(name[i]) >= 0; i++)
+        addr |= hexValue(name[i]) << (4 * (5 - i));
+
+    if (i < 6 || strcmp(name + 6, ".json") || !(a = trackFindAircraft(addr)) || !a->trace) {
+        respondError(h, r, 404);
+        return;
+    }
+
+    _messageNow = now;
+    respondDoc(h, r, docCreate(traceJson(a, now)));
+}
+
+static double wrapLon(double lon) {
+    return lon - 360 * floor((lon + 180) / 360);
+}
+
+// /data/aircraft.json?box=south,west,north,east: only the aircraft in a
+// map view. Longitudes may run past 180 like the view does, or west may be
+// greater than east across the antimeridian. Returns 0 without a box
+// parameter, -1 for a bad one.
+static int queryBox(const char *query, double *box) {
+    const char *p = query;
+
+    while (p && strncmp(p, "box=", 4)) {
+        if ((p = strchr(p, '&')))
+            p++;
+    }
+    if (!p)
+        return 0;
+    if (sscanf(p + 4, "%lf,%lf,%lf,%lf", &box[0], &box[1], &box[2], &box[3]) != 4
+            || !(box[0] >= -90 && box[0] <= box[2] && box[2] <= 90 && isfinite(box[1]) && isfinite(box[3])))
+        return -1;
+    if (box[3] < box[1])
+        box[3] += 360;
+
+    if (box[3] - box[1] >= 360) {
+        box[1] = -180;
+        box[3] = 180;
+    } else {
+        box[1] = wrapLon(box[1]);
+        box[3] = wrapLon(box[3]);
+    }
+    return 1;
+}
+
+// READ_MODE_ASCII handler, called with a request head ("\r\n\r\n" cut off)
+static int httpHandleRequest(struct client *c, char *req, int remote) {
+    struct http_conn *h = httpConn(c);
+    struct http_request r = {0, 0, 1, 0, NULL, NULL};
+    char *line, *next, *target, *version, *value;
+    double box[4];
+    int boxed;
+    uint64_t now = mstime();
+
+    MODES_NOTUSED(remote);
+    h->last_active = now;
+
+    // Requests pipelined behind a stream, a closing response or more than
+    // we queue are left unanswered; the client sends them again after
+    // the connection is closed.
+    if (h->sse || h->close_after)
+        return 0;
+    if (h->nparts > HTTP_MAX_PARTS - 2) {
+        h->close_after = 1;
+        return 0;
+    }
+
+    while (*req == '\r' || *req == '\n')
+        req++;
+    if ((next = strstr(req, "\r\n"))) {
+        *next = 0;
+        next += 2;
+    }
+
+    if (!(target = strchr(req, ' ')) || !(version = strchr(target + 1, ' '))) {
+        r.keep_alive = 0;
+        respondError(h, &r, 400);
+        return 0;
+    }
+    *target++ = 0;
+    *version++ = 0;
+
+    if (!strcmp(version, "HTTP/1.0")) {
+        r.http10 = 1;
+        r.keep_alive = 0;
+    } else if (strcmp(version, "HTTP/1.1")) {
+        r.keep_alive = 0;
+        respondError(h, &r, strncmp(version, "HTTP/", 5) ? 400 : 505);
+        return 0;
+    }
+
+    for (line = next; line && *line; line = next) {
+        if ((next = strstr(line, "\r\n"))) {
+            *next = 0;
+            next += 2;
+        }
+        if (!(value = strchr(line, ':')))
+            continue;
+        *value++ = 0;
+        while (*value == ' ' || *value == '\t')
+            value++;
+
+        if (!strcasecmp(line, "Connection")) {
+            if (strcasestr(value, "close"))
+                r.keep_alive = 0;
+            else if (strcasestr(value, "keep-alive"))
+                r.keep_alive = 1;
+        } else if (!strcasecmp(line, "If-None-Match")) {
+            r.if_none_match = value;
+        } else if ((!strcasecmp(line, "Content-Length") && atoll(value) > 0) || !strcasecmp(line, "Transfer-Encoding")) {
+            r.keep_alive = 0; // request bodies aren't read, don't take the next request from one
+        }
+    }
+
+    if (!strcmp(req, "HEAD")) {
+        r.head = 1;
+    } else if (strcmp(req, "GET")) {
+        respondError(h, &r, 405);
+        return 0;
+    }
+
+    if ((r.query = strchr(target, '?')))
+        r.query++;
+    if (!decodeTarget(target)) {
+        respondError(h, &r, 400);
+        return 0;
+    }
+    r.data = !strncmp(target, "/data/", 6);
+
+    if (r.query && !strcmp(target, "/data/aircraft.json") && (boxed = queryBox(r.query, box))) {
+        if (boxed < 0)
+            respondError(h, &r, 400);
+        else
+            respondDoc(h, &r, docCreate(generateAircraftJsonBox(box[0], box[1], box[2], box[3])));
+        return 0;
+    }
+
+    if (!strcmp(target, "/data/aircraft.sse")) {
+        respondStream(h, &r, now);
+        return 0;
+    }
+
+    if (!strncmp(target, "/data/" TRACE_DIR "/", 7 + strlen(TRACE_DIR))) {
+        respondTrace(h, &r, target + 7 + strlen(TRACE_DIR), now);
+        return 0;
+    }
+
+    for (size_t i = 0; i < sizeof (caches) / sizeof (caches[0]); i++) {
+        if (!strcmp(target, caches[i].path)) {
+            respondCached(h, &r, &caches[i], now);
+            return 0;
+        }
+    }
+
+    if (r.data && Modes.json_dir)
+        respondFile(h, &r, Modes.json_dir, target + 5);
+    else if (!r.data && Modes.net_http_root)
+        respondFile(h, &r, Modes.net_http_root, target);
+    else
+        respondError(h, &r, 404);
+
+    return 0;
+}
+
+//
+//=========================================================================
+//
+void httpInit(void) {
+    struct net_service *s;
+
+    s = serviceInit("HTTP server", &Modes.http_out, NULL, READ_MODE_ASCII, "\r\n\r\n", httpHandleRequest);
+    serviceListen(s, Modes.net_bind_address, Modes.net_http_ports);
+}
+
+void httpPeriodicWork(uint64_t now) {
+    struct net_service *s = Modes.http_out.service;
+    struct client *c;
+
+    if (!s || !s->connections)
+        return;
+
+    if (sse_clients && now >= sse_next) {
+        sseBroadcast(now);
+        sse_next = now + Modes.json_interval;
+    }
+
+    for (c = s->clients; c; c = c->next) {
+        struct http_conn *h;
+
+        if (!c->service)
+            continue;
+
+        h = httpConn(c);
+        if (h->nparts || c->sendq_len || h->close_after) {
+            httpPump(c, now);
+        } else if (!h->sse && now > h->last_active + HTTP_IDLE_TIMEOUT) {
+            if (Modes.debug & MODES_DEBUG_NET)
+                fprintf(stderr, "%s: Idle connection closed: %s port %s\n", s->descr, c->host, c->port);
+            modesCloseClient(c);
+        }
+    }
+}
+
+void httpClientClosed(struct client *c) {
+    struct http_conn *h = c->http;
+
+    while (h->nparts) {
+        partRelease(&h->parts[h->first]);
+        h->first = (h->first + 1) % HTTP_MAX_PARTS;
+        h->nparts--;
+    }
+    if (h->sse)
+        sse_clients--;
+
+    free(h);
+    c->http = NULL;
+}
+
+void httpCleanup(void) {
+    for (size_t i = 0; i < sizeof (caches) / sizeof (caches[0]); i++) {
+        if (caches[i].doc)
+            docRelease(caches[i].doc);
+        caches[i].doc = NULL;
+    }
+
+    for (int j = 0; j < AIRCRAFTS_BUCKETS; j++) {
+        struct sse_aircraft *s = sse_table[j], *next;
+
+        while (s) {
+            next = s->next;
+            free(s->json);
+            free(s);
+            s = next;
+        }
+        sse_table[j] = NULL;
+    }
+    sse_now = sse_next = 0;
+}
@@ -0,0 +1,69 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// http.h: embedded HTTP server
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef READSB_HTTP_H
+#define READSB_HTTP_H
+
+// An HTTP/1.1 server running on the network event loop, for the web
+// interface. It serves:
+//
+//   /data/aircraft.json, /data/receiver.json, /data/stats.json
+//             rendered in memory and shared by all clients, aircraft.json
+//             for up to json_interval, the others until the stats window
+//             or receiver details change (see cachedJson()), with an
+//             ETag so unchanged documents cost a 304
+//   /data/aircraft.json?box=south,west,north,east
+//             only the aircraft positioned in a map view, rendered per
+//             request from the tracker's grid
+//   /data/traces/<hex>.json
+//             the trace of one aircraft, see trace.h
+//   /data/aircraft.sse
+//             a Server-Sent Events stream: one "snapshot" event with the
+//             aircraft.json document, then every json_interval a "delta"
+//             event, see below
+//   /data/*   other files from json_dir, like history.bin
+//   /*        the web interface from --net-http-root
+//
+// A delta event is one line of JSON:
+//
+//   {"now":..,"messages":..,"aircraft":[..],"gone":["hex",..]}
+//
+// "aircraft" holds the complete object for aircraft the client doesn't
+// know yet, and for the others "hex" plus only the fields that changed;
+// a field that went away is sent as null. "gone" lists aircraft that
+// dropped out of aircraft.json.
+
+#define HTTP_IDLE_TIMEOUT 60000 // close keep-alive connections idle this long
+#define HTTP_SSE_RETRY 3000 // ms the browser waits before reconnecting a stream
+#define HTTP_MAX_PARTS 16 // queued response parts per connection
+
+struct client;
+
+// Set up the HTTP service on --net-http-port
+void httpInit(void);
+
+// Stream deltas, send queued responses and drop idle connections
+void httpPeriodicWork(uint64_t now);
+
+// Release the HTTP state of a client being closed
+void httpClientClosed(struct client *c);
+
+void httpCleanup(void);
+
+#endif
@@ -23,9 +23,6 @@
 
 #include "readsb.h"
 
-// hash table size, must be a power of two:
-#define ICAO_FILTER_SIZE 4096
-
 // Millis between filter expiry flips:
 #define MODES_ICAO_FILTER_TTL 60000
 
@@ -159,3 +156,41 @@ void icaoFilterExpire() {
         next_flip = now + MODES_ICAO_FILTER_TTL;
     }
 }
+
+static int compare_addr(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+// Collect the addresses held in both tables, without duplicates.
+// out must have room for 2 * ICAO_FILTER_SIZE addresses.
+unsigned icaoFilterCollect(uint32_t *out) {
+    unsigned n = 0;
+
+    for (unsigned i = 0; i < ICAO_FILTER_SIZE; ++i) {
+        if (icao_filter_a[i])
+            out[n++] = icao_filter_a[i];
+        if (icao_filter_b[i])
+            out[n++] = icao_filter_b[i];
+    }
+
+    qsort(out, n, sizeof (uint32_t), compare_addr);
+
+    unsigned unique = 0;
+    for (unsigned i = 0; i < n; ++i) {
+        if (!unique || out[unique - 1] != out[i])
+            out[unique++] = out[i];
+    }
+    return unique;
+}
+
+// Re-add addresses collected before a restart, if they would not have
+// expired in the meantime.
+void icaoFilterRestore(const uint32_t *addrs, unsigned count, uint64_t age) {
+    if (age >= MODES_ICAO_FILTER_TTL)
+        return;
+
+    for (unsigned i = 0; i < count; ++i)
+        icaoFilterAdd(addrs[i]);
+}
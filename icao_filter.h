@@ -24,6 +24,9 @@
 #ifndef DUMP1090_ICAO_FILTER_H
 #define DUMP1090_ICAO_FILTER_H
 
+// hash table size, must be a power of two:
+#define ICAO_FILTER_SIZE 4096
+
 // Call once:
 void icaoFilterInit ();
 
@@ -42,4 +45,12 @@ uint32_t icaoFilterTestFuzzy (uint32_t partial);
 // old entries.
 void icaoFilterExpire ();
 
+// Copy the addresses currently in the filter to out, returns the count.
+// out must have room for 2 * ICAO_FILTER_SIZE addresses.
+unsigned icaoFilterCollect (uint32_t *out);
+
+// Add previously collected addresses back after a restart,
+// age is the time since they were collected in milliseconds.
+void icaoFilterRestore (const uint32_t *addrs, unsigned count, uint64_t age);
+
 #endif
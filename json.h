@@ -0,0 +1,131 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// json.h: formatters for the JSON outputs
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef READSB_JSON_H
+#define READSB_JSON_H
+
+// Each formatter writes at p without a terminating NUL and returns the new
+// end. There is no end pointer: the caller makes sure the buffer has room
+// for the widest output, which the JSON_*_MAX values below give. The
+// output is the same as printf's for the corresponding conversion.
+
+#define JSON_LEN(s) (sizeof ("" s) - 1)
+#define JSON_INT_MAX 11 // "-2147483648"
+#define JSON_LONG_MAX 20 // "-9223372036854775808"
+#define JSON_HEX_MAX 8 // a 32 bit value
+#define JSON_FIXED_MAX(decimals) (17 + (decimals)) // see jsonFixed()
+#define JSON_STRING_MAX(len) (2 + 6 * (len)) // quoted, every char escaped
+
+// A string literal, typically a precomputed ",\"key\":"
+#define jsonLiteral(p, s) (memcpy((p), "" s, JSON_LEN(s)), (p) + JSON_LEN(s))
+
+// %llu
+static inline char *jsonUnsigned(char *p, uint64_t v) {
+    char digits[20];
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+// %lld
+static inline char *jsonInt(char *p, int64_t v) {
+    if (v < 0) {
+        *p++ = '-';
+        return jsonUnsigned(p, 0 - (uint64_t) v);
+    }
+    return jsonUnsigned(p, v);
+}
+
+// %0*x, or %0*X with upper set
+static inline char *jsonHex(char *p, uint32_t v, int width, int upper) {
+    const char *hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    int n = 1;
+
+    while (n < 8 && (v >> (4 * n)))
+        n++;
+    if (n < width)
+        n = width;
+
+    for (int i = n - 1; i >= 0; i--, v >>= 4)
+        p[i] = hex[v & 15];
+    return p + n;
+}
+
+// %.*f for up to 6 decimals. printf rounds the exact binary value, scaling
+// first can be off by a fraction of an ulp, so values that land too close
+// to a rounding boundary, or too large for the check to hold, go through
+// printf. Values that aren't finite or are 1e15 and above come out as
+// null, which keeps JSON_FIXED_MAX a bound.
+static inline char *jsonFixed(char *p, double v, int decimals) {
+    static const double scales[] = { 1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6 };
+    double scaled = fabs(v) * scales[decimals];
+
+    if (!isfinite(v) || fabs(v) >= 1e15)
+        return jsonLiteral(p, "null");
+    if (scaled >= 1e9 || fabs(scaled - floor(scaled) - 0.5) < 1e-6)
+        return p + sprintf(p, "%.*f", decimals, v);
+
+    uint64_t fixed = (uint64_t) nearbyint(scaled);
+    uint64_t unit = (uint64_t) scales[decimals];
+    unsigned fraction = fixed % unit;
+
+    if (signbit(v))
+        *p++ = '-';
+    p = jsonUnsigned(p, fixed / unit);
+    if (!decimals)
+        return p;
+
+    *p++ = '.';
+    for (int i = decimals - 1; i >= 0; i--, fraction /= 10)
+        p[i] = '0' + fraction % 10;
+    return p + decimals;
+}
+
+// A quoted string, with " and \ escaped and everything outside printable
+// ASCII as \u00XX. At most len chars of s are used.
+static inline char *jsonString(char *p, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+
+    *p++ = '"';
+    for (; len && *s; s++, len--) {
+        unsigned char ch = *s;
+
+        if (ch == '"' || ch == '\\') {
+            *p++ = '\\';
+            *p++ = ch;
+        } else if (ch < 32 || ch > 127) {
+            p = jsonLiteral(p, "\\u00");
+            *p++ = hex[ch >> 4];
+            *p++ = hex[ch & 15];
+        } else {
+            *p++ = ch;
+        }
+    }
+    *p++ = '"';
+    return p;
+}
+
+#endif
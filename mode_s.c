@@ -64,11 +64,6 @@
 //
 //
 
-/* A timestamp that indicates the data is synthetic, created from a
- * multilateration result
- */
-#define MAGIC_MLAT_TIMESTAMP 0xFF004D4C4154ULL
-
 //=========================================================================
 //
 // Given the Downlink Format (DF) of the message, return the message length in bits.
@@ -308,11 +303,19 @@ static int correct_aa_field(uint32_t *addr, struct errorinfo *ei) {
 
 static unsigned char all_zeros[14] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
-int scoreModesMessage(unsigned char *msg, int validbits) {
+//
+// Score a message as scoreModesMessage() does, but without looking at the
+// ICAO filter: the score is *known_score if *addr is in the filter and the
+// return value if it is not. If the score does not depend on the filter,
+// *known_score is set to the return value.
+//
+int scoreModesMessageUnfiltered(unsigned char *msg, int validbits, uint32_t *addr, int *known_score) {
     int msgtype, msgbits, crc, iid;
-    uint32_t addr;
     struct errorinfo *ei;
 
+    *addr = 0;
+    *known_score = -2;
+
     if (validbits < 56)
         return -2;
 
@@ -340,12 +343,14 @@ int scoreModesMessage(unsigned char *msg, int validbits) {
         case 29: // Comm-D (ELM)
         case 30: // Comm-D (ELM)
         case 31: // Comm-D (ELM)
-            return icaoFilterTest(crc) ? 1000 : -1;
+            *addr = crc;
+            *known_score = 1000;
+            return -1;
 
         case 11: // All-call reply
             iid = crc & 0x7f;
             crc = crc & 0xffff80;
-            addr = getbits(msg, 9, 32);
+            *addr = getbits(msg, 9, 32);
 
             ei = modesChecksumDiagnose(crc, msgbits);
             if (!ei)
@@ -358,19 +363,15 @@ int scoreModesMessage(unsigned char *msg, int validbits) {
                 return -2; // can't correct errors
 
             // fix any errors in the address field
-            correct_aa_field(&addr, ei);
+            correct_aa_field(addr, ei);
 
             // validate address
             if (iid == 0) {
-                if (icaoFilterTest(addr))
-                    return 1600 / (ei->errors + 1);
-                else
-                    return 750 / (ei->errors + 1);
+                *known_score = 1600 / (ei->errors + 1);
+                return 750 / (ei->errors + 1);
             } else {
-                if (icaoFilterTest(addr))
-                    return 1000 / (ei->errors + 1);
-                else
-                    return -1;
+                *known_score = 1000 / (ei->errors + 1);
+                return -1;
             }
 
         case 17: // Extended squitter
@@ -380,18 +381,16 @@ int scoreModesMessage(unsigned char *msg, int validbits) {
                 return -2; // can't correct errors
 
             // fix any errors in the address field
-            addr = getbits(msg, 9, 32);
-            correct_aa_field(&addr, ei);
+            *addr = getbits(msg, 9, 32);
+            correct_aa_field(addr, ei);
 
-            if (icaoFilterTest(addr))
-                return 1800 / (ei->errors + 1);
-            else
-                return 1400 / (ei->errors + 1);
+            *known_score = 1800 / (ei->errors + 1);
+            return 1400 / (ei->errors + 1);
 
         case 20: // Comm-B, altitude reply
         case 21: // Comm-B, identity reply
-            if (icaoFilterTest(crc))
-                return 1000; // Address/Parity
+            *addr = crc;
+            *known_score = 1000; // Address/Parity
 
 #if 0
             // This doesn't seem useful, as we mistake a lot of CRC errors
@@ -408,6 +407,16 @@ int scoreModesMessage(unsigned char *msg, int validbits) {
     }
 }
 
+int scoreModesMessage(unsigned char *msg, int validbits) {
+    uint32_t addr;
+    int known_score;
+    int score = scoreModesMessageUnfiltered(msg, validbits, &addr, &known_score);
+
+    if (known_score != score && icaoFilterTest(addr))
+        return known_score;
+    return score;
+}
+
 //
 //=========================================================================
 //
@@ -666,7 +675,7 @@ int decodeModesMessage(struct modesMessage *mm, unsigned char *msg) {
     // MB (messsage, Comm-B)
     if (mm->msgtype == 20 || mm->msgtype == 21) {
         memcpy(mm->MB, &msg[4], 7);
-        decodeCommB(mm);
+        mm->fields_pending = 1;
     }
 
     // MD (message, Comm-D)
@@ -791,7 +800,7 @@ static void setIMF(struct modesMessage *mm) {
     }
 }
 
-static void decodeESAirborneVelocity(struct modesMessage *mm, int check_imf) {
+static void decodeESAirborneVelocity(struct modesMessage *mm) {
     // Airborne Velocity Message
     unsigned char *me = mm->ME;
 
@@ -802,13 +811,12 @@ static void decodeESAirborneVelocity(struct modesMessage *mm, int check_imf) {
     if (mm->mesub < 1 || mm->mesub > 4)
         return;
 
-    // 9: IMF or Intent Change
-    if (check_imf && getbit(me, 9))
-        setIMF(mm);
+    // 9: IMF or Intent Change, see esIMF()
 
     // 10: reserved
 
     // 11-13: NACv (NUCr in v0, maps directly to NACv in v2)
+    modesMessageSections(mm, MM_ACCURACY);
     mm->accuracy.nac_v_valid = 1;
     mm->accuracy.nac_v = getbits(me, 11, 13);
 
@@ -899,7 +907,7 @@ static void decodeESAirborneVelocity(struct modesMessage *mm, int check_imf) {
     }
 }
 
-static void decodeESSurfacePosition(struct modesMessage *mm, int check_imf) {
+static void decodeESSurfacePosition(struct modesMessage *mm) {
     // Surface position and movement
     unsigned char *me = mm->ME;
 
@@ -923,9 +931,7 @@ static void decodeESSurfacePosition(struct modesMessage *mm, int check_imf) {
         mm->heading_type = HEADING_TRACK_OR_HEADING;
     }
 
-    // 21: IMF or T flag
-    if (check_imf && getbit(me, 21))
-        setIMF(mm);
+    // 21: IMF or T flag, see esIMF()
 
     // 22: F flag (odd/even)
     mm->cpr_odd = getbit(me, 22);
@@ -961,13 +967,11 @@ static void decodeESAirbornePosition(struct modesMessage *mm, int check_imf) {
             break;
     }
 
-    // 8: IMF or NIC supplement-B
+    // 8: IMF (see esIMF()) or NIC supplement-B
 
-    if (check_imf) {
-        if (getbit(me, 8))
-            setIMF(mm);
-    } else {
+    if (!check_imf) {
         // NIC-B (v2) or SAF (v0/v1)
+        modesMessageSections(mm, MM_ACCURACY);
         mm->accuracy.nic_b_valid = 1;
         mm->accuracy.nic_b = getbit(me, 8);
     }
@@ -995,7 +999,7 @@ static void decodeESAirbornePosition(struct modesMessage *mm, int check_imf) {
             //   400648 (BAE ATP) - Atlantic Airlines
             // altitude == 0, longitude == 0, type == 15 and zeros in latitude LSB.
             // Can alternate with valid reports having type == 14
-            Modes.stats_current.cpr_filtered++;
+            mm->cpr_filtered = 1;
         } else {
             // Otherwise, assume it's valid.
             mm->cpr_valid = 1;
@@ -1035,7 +1039,7 @@ static void decodeESTestMessage(struct modesMessage *mm) {
     }
 }
 
-static void decodeESAircraftStatus(struct modesMessage *mm, int check_imf) {
+static void decodeESAircraftStatus(struct modesMessage *mm) {
     // Extended Squitter Aircraft Status
     unsigned char *me = mm->ME;
 
@@ -1050,19 +1054,15 @@ static void decodeESAircraftStatus(struct modesMessage *mm, int check_imf) {
             mm->squawk_valid = 1;
             mm->squawk = decodeID13Field(ID13Field);
         }
-
-        if (check_imf && getbit(me, 56))
-            setIMF(mm);
     }
 }
 
-static void decodeESTargetStatus(struct modesMessage *mm, int check_imf) {
+static void decodeESTargetStatus(struct modesMessage *mm) {
     unsigned char *me = mm->ME;
 
     mm->mesub = getbits(me, 6, 7); // an unusual message: only 2 bits of subtype
 
-    if (check_imf && getbit(me, 51))
-        setIMF(mm);
+    modesMessageSections(mm, MM_ACCURACY | MM_NAV);
 
     if (mm->mesub == 0 && getbit(me, 11) == 0) { // Target state and status, V1
         // 8-9: vertical source
@@ -1250,14 +1250,14 @@ static void decodeESTargetStatus(struct modesMessage *mm, int check_imf) {
     }
 }
 
-static void decodeESOperationalStatus(struct modesMessage *mm, int check_imf) {
+static void decodeESOperationalStatus(struct modesMessage *mm) {
     unsigned char *me = mm->ME;
 
     mm->mesub = getbits(me, 6, 8);
 
     // Aircraft Operational Status
-    if (check_imf && getbit(me, 56))
-        setIMF(mm);
+
+    modesMessageSections(mm, MM_ACCURACY | MM_OPSTATUS);
 
     if (mm->mesub == 0 || mm->mesub == 1) {
         mm->opstatus.valid = 1;
@@ -1370,11 +1370,46 @@ static void decodeESOperationalStatus(struct modesMessage *mm, int check_imf) {
     }
 }
 
+// The IMF bit of a DF18 message, where the ME type has one
+static int esIMF(struct modesMessage *mm) {
+    unsigned char *me = mm->ME;
+
+    switch (mm->metype) {
+        case 19: { // only velocity subtypes 1-4
+            unsigned mesub = getbits(me, 6, 8);
+            return mesub >= 1 && mesub <= 4 && getbit(me, 9);
+        }
+
+        case 5: case 6: case 7: case 8:
+            return getbit(me, 21);
+
+        case 0:
+        case 9: case 10: case 11: case 12: case 13: case 14: case 15: case 16: case 17: case 18:
+        case 20: case 21: case 22:
+            return getbit(me, 8);
+
+        case 28: // only emergency status
+            return getbits(me, 6, 8) == 1 && getbit(me, 56);
+
+        case 29:
+            return getbit(me, 51);
+
+        case 31:
+            return getbit(me, 56);
+
+        default:
+            return 0;
+    }
+}
+
+// The part of an extended squitter needed before the fields: the ME type,
+// and for DF18 the address type and source
 static void decodeExtendedSquitter(struct modesMessage *mm) {
     unsigned char *me = mm->ME;
-    unsigned metype = mm->metype = getbits(me, 1, 5);
     unsigned check_imf = 0;
 
+    mm->metype = getbits(me, 1, 5);
+
     // Check CF on DF18 to work out the format of the ES and whether we need to look for an IMF bit
     if (mm->msgtype == 18) {
         switch (mm->CF) {
@@ -1427,17 +1462,27 @@ static void decodeExtendedSquitter(struct modesMessage *mm) {
         }
     }
 
-    switch (metype) {
+    if (check_imf && esIMF(mm))
+        setIMF(mm);
+
+    mm->fields_pending = 1;
+}
+
+static void decodeESFields(struct modesMessage *mm) {
+    // DF18 fine TIS-B and ADS-R use bit 8 of airborne positions as the IMF
+    int check_imf = (mm->msgtype == 18 && (mm->CF == 2 || mm->CF == 6));
+
+    switch (mm->metype) {
         case 1: case 2: case 3: case 4:
             decodeESIdentAndCategory(mm);
             break;
 
         case 19:
-            decodeESAirborneVelocity(mm, check_imf);
+            decodeESAirborneVelocity(mm);
             break;
 
         case 5: case 6: case 7: case 8:
-            decodeESSurfacePosition(mm, check_imf);
+            decodeESSurfacePosition(mm);
             break;
 
         case 0: // Airborne position, baro altitude only
@@ -1454,18 +1499,18 @@ static void decodeExtendedSquitter(struct modesMessage *mm) {
             break;
 
         case 28:
-            decodeESAircraftStatus(mm, check_imf);
+            decodeESAircraftStatus(mm);
             break;
 
         case 29:
-            decodeESTargetStatus(mm, check_imf);
+            decodeESTargetStatus(mm);
             break;
 
         case 30: // Aircraft Operational Coordination
             break;
 
         case 31:
-            decodeESOperationalStatus(mm, check_imf);
+            decodeESOperationalStatus(mm);
             break;
 
         default:
@@ -1473,6 +1518,21 @@ static void decodeExtendedSquitter(struct modesMessage *mm) {
     }
 }
 
+//
+// Decode the extended squitter or Comm-B fields of a message, if
+// decodeModesMessage() left them for later. Safe to call more than once.
+//
+void decodeModesMessageFields(struct modesMessage *mm) {
+    if (!mm->fields_pending)
+        return;
+
+    mm->fields_pending = 0;
+    if (mm->msgtype == 20 || mm->msgtype == 21)
+        decodeCommB(mm);
+    else
+        decodeESFields(mm);
+}
+
 static const char *df_names[33] = {
     /* 0 */ "Short Air-Air Surveillance",
     /* 1 */ NULL,
@@ -1783,6 +1843,9 @@ void displayModesMessage(struct modesMessage *mm) {
         return; // Enough for --onlyaddr mode
     }
 
+    decodeModesMessageFields(mm);
+    modesMessageSections(mm, MM_ACCURACY | MM_OPSTATUS | MM_NAV); // shown as empty if not decoded
+
     // Show the raw message.
     if (Modes.mlat && mm->timestampMsg) {
         printf("@%012" PRIX64, mm->timestampMsg);
@@ -2173,6 +2236,12 @@ void useModesMessage(struct modesMessage *mm) {
             modesQueueOutput(mm, a);
         }
     }
+
+    // Only known once the fields are decoded
+    if (mm->cpr_filtered)
+        Modes.stats_current.cpr_filtered++;
+    if (mm->fields_pending)
+        Modes.stats_current.messages_header_only++;
 }
 
 //
@@ -32,7 +32,9 @@
 //
 int modesMessageLenByType (int type);
 int scoreModesMessage (unsigned char *msg, int validbits);
+int scoreModesMessageUnfiltered (unsigned char *msg, int validbits, uint32_t *addr, int *known_score);
 int decodeModesMessage (struct modesMessage *mm, unsigned char *msg);
+void decodeModesMessageFields (struct modesMessage *mm);
 void displayModesMessage (struct modesMessage *mm);
 void useModesMessage (struct modesMessage *mm);
 
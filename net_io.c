@@ -63,8 +63,11 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <poll.h>
+#include <dirent.h>
 #include <pthread.h>
 
+#include "shm_bus.h"
+
 //
 // ============================= Networking =============================
 //
@@ -91,10 +94,20 @@ static void writeFATSVEvent(struct modesMessage *mm, struct aircraft *a);
 static void writeFATSVPositionUpdate(float lat, float lon, float alt);
 
 static void autoset_modeac();
+static uint64_t clientReceiveTime(struct client *c);
+static void clientClockUpdate(struct client *c, uint64_t timestamp);
+static double clientClockDrift(struct client *c);
 static int hexDigitVal(int c);
-static void *pthreadGetaddrinfo(void *param);
-
-static void flushClient(struct client *c, uint64_t now);
+static struct resolve_request *resolverSubmit(const char *host, const char *port);
+static int resolverFinished(struct resolve_request *req, struct addrinfo **result, int *error);
+static void resolverCancel(struct resolve_request *req);
+static struct client *connectorPollResult(struct net_connector *con, short revents);
+
+// Shed priority of the frames being written, see modesQueueOutput
+static shed_priority_t write_priority = SHED_HIGH;
+// Shared memory bus for local consumers, if --net-shm-bus is given
+static struct shm_bus_writer *shm_bus;
+static char *readBeastFrames(struct client *c, char *som, char *eod, int remote);
 //
 //=========================================================================
 //
@@ -131,7 +144,8 @@ struct net_service *serviceInit(const char *descr, struct net_writer *writer, he
 
     if (service->writer) {
         if (!service->writer->data) {
-            if (!(service->writer->data = malloc(MODES_OUT_BUF_SIZE))) {
+            if (!(service->writer->data = malloc(MODES_OUT_BUF_SIZE)) ||
+                    !(service->writer->frames = malloc(MODES_OUT_FRAMES * sizeof (struct write_frame)))) {
                 fprintf(stderr, "Out of memory allocating output buffer for service %s\n", descr);
                 exit(1);
             }
@@ -139,6 +153,7 @@ struct net_service *serviceInit(const char *descr, struct net_writer *writer, he
 
         service->writer->service = service;
         service->writer->dataUsed = 0;
+        service->writer->nframes = 0;
         service->writer->lastWrite = mstime();
         service->writer->send_heartbeat = hb;
     }
@@ -148,8 +163,17 @@ struct net_service *serviceInit(const char *descr, struct net_writer *writer, he
 
 // Create a client attached to the given service using the provided socket FD
 struct client *createSocketClient(struct net_service *service, int fd) {
+    struct client *c;
+
     anetSetSendBuffer(Modes.aneterr, fd, (MODES_NET_SNDBUF_SIZE << Modes.net_sndbuf_size));
-    return createGenericClient(service, fd);
+    c = createGenericClient(service, fd);
+
+    // Inputs stamp messages with the time the kernel received them,
+    // not with the time we got around to decoding them
+    if (service->read_handler && anetSetRecvTimestamps(Modes.aneterr, fd) == ANET_OK)
+        c->rx_timestamps = 1;
+
+    return c;
 }
 
 // Create a client attached to the given service using the provided FD (might not be a socket!)
@@ -199,20 +223,64 @@ struct client *createGenericClient(struct net_service *service, int fd) {
     return c;
 }
 
+// Schedule the next connection attempt after a failure.
+// The next address of the current lookup is tried right away; once all
+// of them failed we back off exponentially, from a tenth of
+// --net-connector-delay up to the full delay, with jitter so a lot of
+// connectors (or receivers) that lost the same server don't all come
+// back at the same moment.
+static void connectorRetry(struct net_connector *con) {
+    static unsigned int seed;
+    uint64_t delay = Modes.net_connector_delay / 10;
+
+    if (con->try_addr && con->try_addr->ai_next) {
+        con->next_reconnect = mstime() + 100;
+        return;
+    }
+
+    for (int i = 0; i < con->failures && delay < Modes.net_connector_delay; i++)
+        delay *= 2;
+    if (delay > Modes.net_connector_delay)
+        delay = Modes.net_connector_delay;
+    con->failures++;
+
+    if (!seed)
+        seed = (unsigned int) (mstime() ^ getpid());
+    con->try_addr = NULL;
+    con->next_reconnect = mstime() + delay / 2 + (uint64_t) rand_r(&seed) % (delay / 2 + 1);
+}
+
 // Timer callback checking periodically whether the push service lost its server
 // connection and requires a re-connect.
 void serviceReconnectCallback(uint64_t now) {
+    static struct pollfd *pfds;
+    static struct net_connector **polled;
+    static int pfds_size;
+    int npoll = 0;
+
     // Loop through the connectors, and
     //  - If it's not connected:
-    //    - If it's "connecting", check to see if the fd is ready
+    //    - If it's "connecting", add it to the list of fds to check
     //    - Otherwise, if enough time has passed, try reconnecting
+    // then check all pending connects with a single poll()
+
+    if (pfds_size < Modes.net_connectors_count) {
+        pfds_size = Modes.net_connectors_count;
+        if (!(pfds = realloc(pfds, pfds_size * sizeof (struct pollfd)))
+                || !(polled = realloc(polled, pfds_size * sizeof (struct net_connector *)))) {
+            fprintf(stderr, "Out of memory allocating connector poll list\n");
+            exit(1);
+        }
+    }
 
     for (int i = 0; i < Modes.net_connectors_count; i++) {
         struct net_connector *con = Modes.net_connectors[i];
         if (!con->connected) {
             if (con->connecting) {
-                // Check to see...
-                checkServiceConnected(con);
+                pfds[npoll].fd = con->fd;
+                pfds[npoll].events = POLLIN | POLLOUT;
+                pfds[npoll].revents = 0;
+                polled[npoll++] = con;
             } else {
                 if (con->next_reconnect <= now) {
                     serviceConnect(con);
@@ -220,28 +288,31 @@ void serviceReconnectCallback(uint64_t now) {
             }
         }
     }
-}
-
-struct client *checkServiceConnected(struct net_connector *con) {
-    int rv;
 
-    struct pollfd pfd = {con->fd, (POLLIN | POLLOUT), 0};
+    if (!npoll)
+        return;
 
-    rv = poll(&pfd, 1, 0);
+    if (poll(pfds, npoll, 0) == -1) {
+        fprintf(stderr, "serviceReconnectCallback: poll() error: %s\n", strerror(errno));
+        return;
+    }
 
-    if (rv == -1) {
-        // select() error, just return a NULL here, but log it
-        fprintf(stderr, "checkServiceConnected: select() error: %s\n", strerror(errno));
-        return NULL;
+    for (int i = 0; i < npoll; i++) {
+        connectorPollResult(polled[i], pfds[i].revents);
     }
+}
 
-    if (rv == 0) {
+// Finish a non-blocking connect given the poll() result for its fd.
+// Return the new client or NULL if the connection isn't there (yet).
+static struct client *connectorPollResult(struct net_connector *con, short revents) {
+    if (!revents) {
         // If we've exceeded our connect timeout, bail but try again.
         if (mstime() >= con->connect_timeout) {
             fprintf(stderr, "%s: Connection timed out: %s:%s port %s\n",
                     con->service->descr, con->address, con->port, con->resolved_addr);
             con->connecting = 0;
             anetCloseSocket(con->fd);
+            connectorRetry(con);
         }
         return NULL;
     }
@@ -254,6 +325,7 @@ struct client *checkServiceConnected(struct net_connector *con) {
         // Bad stuff going on, but clear this anyway
         con->connecting = 0;
         anetCloseSocket(con->fd);
+        connectorRetry(con);
         return NULL;
     }
 
@@ -263,6 +335,7 @@ struct client *checkServiceConnected(struct net_connector *con) {
                 con->service->descr, con->address, con->resolved_addr, con->port, optval, strerror(optval));
         con->connecting = 0;
         anetCloseSocket(con->fd);
+        connectorRetry(con);
         return NULL;
     }
 
@@ -275,6 +348,7 @@ struct client *checkServiceConnected(struct net_connector *con) {
         fprintf(stderr, "createSocketClient failed on fd %d to %s%s port %s\n",
                 con->fd, con->address, con->resolved_addr, con->port);
         anetCloseSocket(con->fd);
+        connectorRetry(con);
         return NULL;
     }
 
@@ -286,64 +360,79 @@ struct client *checkServiceConnected(struct net_connector *con) {
 
     con->connecting = 0;
     con->connected = 1;
+    con->established = mstime();
     c->con = con;
 
     return c;
 }
 
+struct client *checkServiceConnected(struct net_connector *con) {
+    int rv;
+
+    struct pollfd pfd = {con->fd, (POLLIN | POLLOUT), 0};
+
+    rv = poll(&pfd, 1, 0);
+
+    if (rv == -1) {
+        // select() error, just return a NULL here, but log it
+        fprintf(stderr, "checkServiceConnected: select() error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    return connectorPollResult(con, rv ? pfd.revents : 0);
+}
+
+// Pick up the result of a name resolution, if it's done.
+// Return 1 if there are addresses to try.
+static int connectorResolved(struct net_connector *con) {
+    struct addrinfo *result;
+    int error;
+
+    if (!resolverFinished(con->resolving, &result, &error)) {
+        con->next_reconnect = mstime() + 10;
+        return 0;
+    }
+    con->resolving = NULL;
+
+    if (error) {
+        fprintf(stderr, "%s: Name resolution for %s failed: %s\n", con->service->descr, con->address, gai_strerror(error));
+        connectorRetry(con);
+        return 0;
+    }
+
+    if (con->addr_info)
+        freeaddrinfo(con->addr_info);
+    con->addr_info = result;
+    con->addr_info_expires = mstime() + MODES_NET_RESOLVE_TTL;
+    con->try_addr = con->addr_info;
+    return 1;
+}
+
 // Initiate an outgoing connection.
 // Return the new client or NULL if the connection failed
 struct client *serviceConnect(struct net_connector *con) {
 
     int fd;
 
-    if (con->try_addr && con->try_addr->ai_next) {
+    if (con->resolving) {
+        // waiting for the resolver pool
+        if (!connectorResolved(con))
+            return NULL;
+    } else if (con->try_addr && con->try_addr->ai_next) {
         // iterate the address info
         con->try_addr = con->try_addr->ai_next;
+    } else if (con->addr_info && mstime() < con->addr_info_expires) {
+        // start over with the addresses we already have
+        con->try_addr = con->addr_info;
     } else {
         // get the address info
-        if (!con->gai_request_in_progress)  {
-            // launch a pthread for async getaddrinfo
-            con->try_addr = NULL;
-            if (con->addr_info) {
-                freeaddrinfo(con->addr_info);
-                con->addr_info = NULL;
-            }
-
-            if (pthread_create(&con->thread, NULL, pthreadGetaddrinfo, con)) {
-                con->next_reconnect = mstime() + 15000;
-                fprintf(stderr, "%s: pthread_create ERROR for %s port %s: %s\n", con->service->descr, con->address, con->port, strerror(errno));
-                return NULL;
-            }
-
-            con->gai_request_in_progress = 1;
-            con->next_reconnect = mstime() + 10;
+        con->try_addr = NULL;
+        if (!(con->resolving = resolverSubmit(con->address, con->port))) {
+            con->next_reconnect = mstime() + 15000;
             return NULL;
-        } else {
-
-            if (pthread_mutex_trylock(con->mutex)) {
-                // couldn't acquire lock, request not finished
-                con->next_reconnect = mstime() + 50;
-                return NULL;
-            }
-
-            if (pthread_join(con->thread, NULL)) {
-                fprintf(stderr, "%s: pthread_join ERROR for %s port %s: %s\n", con->service->descr, con->address, con->port, strerror(errno));
-                con->next_reconnect = mstime() + 15000;
-                return NULL;
-            }
-
-            con->gai_request_in_progress = 0;
-
-            if (con->gai_error) {
-                fprintf(stderr, "%s: Name resolution for %s failed: %s\n", con->service->descr, con->address, gai_strerror(con->gai_error));
-                con->next_reconnect = mstime() + Modes.net_connector_delay;
-                return NULL;
-            }
-
-            con->try_addr = con->addr_info;
-            // SUCCESS!
         }
+        con->next_reconnect = mstime() + 10;
+        return NULL;
     }
 
     getnameinfo(con->try_addr->ai_addr, con->try_addr->ai_addrlen,
@@ -359,12 +448,6 @@ struct client *serviceConnect(struct net_connector *con) {
         memcpy(con->resolved_addr, tmp, sizeof(con->resolved_addr));
     }
 
-    if (!con->try_addr->ai_next) {
-        con->next_reconnect = mstime() + Modes.net_connector_delay;
-    } else {
-        con->next_reconnect = mstime() + 100;
-    }
-
     if (Modes.debug & MODES_DEBUG_NET) {
         fprintf(stderr, "%s: Attempting connection to %s port %s ...\n", con->service->descr, con->address, con->port);
     }
@@ -373,22 +456,36 @@ struct client *serviceConnect(struct net_connector *con) {
     if (fd == ANET_ERR) {
         fprintf(stderr, "%s: Connection to %s%s port %s failed: %s\n",
                 con->service->descr, con->address, con->resolved_addr, con->port, Modes.aneterr);
+        connectorRetry(con);
         return NULL;
     }
 
     con->connecting = 1;
-    con->connect_timeout = mstime() + 10 * 1000;	// 10 sec TODO: Move to var
+    con->connect_timeout = mstime() + MODES_NET_CONNECT_TIMEOUT;
     con->fd = fd;
 
     if (anetTcpKeepAlive(Modes.aneterr, fd) != ANET_OK)
         fprintf(stderr, "%s: Unable to set keepalive: connection to %s port %s ...\n", con->service->descr, con->address, con->port);
     
     // Since this is a non-blocking connect, it will always return right away.
-    // We'll need to periodically check to see if it did, in fact, connect, but do it once here.
+    // serviceReconnectCallback checks whether it did, in fact, connect, but do it once here.
 
     return checkServiceConnected(con);
 }
 
+// Release what a connector holds on to, before freeing it
+void serviceConnectorCleanup(struct net_connector *con) {
+    if (con->resolving) {
+        resolverCancel(con->resolving);
+        con->resolving = NULL;
+    }
+    if (con->addr_info) {
+        freeaddrinfo(con->addr_info);
+        con->addr_info = NULL;
+    }
+    con->try_addr = NULL;
+}
+
 // Set up the given service to listen on an address/port.
 // _exits_ on failure!
 void serviceListen(struct net_service *service, char *bind_addr, char *bind_ports) {
@@ -455,6 +552,123 @@ struct net_service *makeFatsvOutputService(void) {
     return serviceInit("FATSV TCP output", &Modes.fatsv_out, NULL, READ_MODE_IGNORE, NULL, NULL);
 }
 
+// Split "host:port", "[v6addr]:port" or just "port" in place.
+// *host is set to NULL if there is no host part.
+static void splitHostPort(char *spec, char **host, char **port) {
+    char *colon;
+
+    if (spec[0] == '[' && (colon = strstr(spec, "]:"))) {
+        *colon = 0;
+        *host = spec + 1;
+        *port = colon + 2;
+    } else if ((colon = strrchr(spec, ':'))) {
+        *colon = 0;
+        *host = spec[0] ? spec : NULL;
+        *port = colon + 1;
+    } else {
+        *host = NULL;
+        *port = spec;
+    }
+}
+
+// Set up the given service to send datagrams to a comma-separated list
+// of host:port destinations, unicast or multicast. One sendmmsg() call
+// reaches all of them.
+// _exits_ on failure!
+static void udpOutputInit(struct net_service *service, const char *destinations) {
+    struct udp_output *out;
+    char *list = strdup(destinations), *save = NULL, *spec;
+    int family = AF_UNSPEC;
+
+    if (!list || !(out = calloc(1, sizeof (*out)))) {
+        fprintf(stderr, "Out of memory allocating %s\n", service->descr);
+        exit(1);
+    }
+
+    for (spec = strtok_r(list, ", ", &save); spec; spec = strtok_r(NULL, ", ", &save)) {
+        struct addrinfo *ai;
+        char *host, *port;
+
+        splitHostPort(spec, &host, &port);
+        if (!host || anetGetaddrinfo(Modes.aneterr, host, port, &ai) != 0) {
+            fprintf(stderr, "%s: bad destination %s: %s\n", service->descr, spec,
+                    host ? Modes.aneterr : "expected host:port");
+            exit(1);
+        }
+
+        if (family == AF_UNSPEC) {
+            family = ai->ai_family;
+        } else if (ai->ai_family != family) {
+            fprintf(stderr, "%s: can't mix IPv4 and IPv6 destinations (%s)\n", service->descr, spec);
+            exit(1);
+        }
+
+        out->dests = realloc(out->dests, (out->ndests + 1) * sizeof (*out->dests));
+        out->dest_lens = realloc(out->dest_lens, (out->ndests + 1) * sizeof (*out->dest_lens));
+        if (!out->dests || !out->dest_lens) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        memcpy(&out->dests[out->ndests], ai->ai_addr, ai->ai_addrlen);
+        out->dest_lens[out->ndests] = ai->ai_addrlen;
+        out->ndests++;
+
+        freeaddrinfo(ai);
+    }
+    free(list);
+
+    if (!out->ndests) {
+        fprintf(stderr, "%s: no destinations given\n", service->descr);
+        exit(1);
+    }
+
+    if ((out->fd = anetUdpSocket(Modes.aneterr, family)) == ANET_ERR) {
+        fprintf(stderr, "%s: %s\n", service->descr, Modes.aneterr);
+        exit(1);
+    }
+    anetNonBlock(Modes.aneterr, out->fd);
+    anetSetSendBuffer(Modes.aneterr, out->fd, (MODES_NET_SNDBUF_SIZE << Modes.net_sndbuf_size));
+
+    if (!(out->msgs = calloc(out->ndests, sizeof (*out->msgs)))) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    service->udp_out = out;
+}
+
+// Set up a Beast UDP input on "[address:]port".
+// _exits_ on failure!
+static void udpInputInit(struct net_service *service, const char *address) {
+    char *spec = strdup(address), *host, *port;
+    struct client *c;
+    int fd;
+
+    if (!spec) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    splitHostPort(spec, &host, &port);
+    if (!host)
+        host = Modes.net_bind_address;
+
+    if ((fd = anetUdpServer(Modes.aneterr, port, host)) == ANET_ERR) {
+        fprintf(stderr, "Error opening %s on %s: %s\n", service->descr, address, Modes.aneterr);
+        exit(1);
+    }
+
+    c = createGenericClient(service, fd);
+    if (!(c->udp = calloc(1, sizeof (struct udp_input)))) {
+        fprintf(stderr, "Out of memory allocating %s\n", service->descr);
+        exit(1);
+    }
+    strncpy(c->host, host ? host : "*", sizeof (c->host) - 1);
+    strncpy(c->port, port, sizeof (c->port) - 1);
+
+    free(spec);
+}
+
 void modesInitNet(void) {
     struct net_service *beast_out;
     struct net_service *beast_reduce_out;
@@ -480,12 +694,19 @@ void modesInitNet(void) {
     beast_reduce_out = serviceInit("BeastReduce TCP output", &Modes.beast_reduce_out, send_beast_heartbeat, READ_MODE_IGNORE, NULL, NULL);
     serviceListen(beast_reduce_out, Modes.net_bind_address, Modes.net_output_beast_reduce_ports);
 
+    if (Modes.net_output_beast_udp) {
+        struct net_service *beast_udp_out = serviceInit("Beast UDP output", &Modes.beast_udp_out, send_beast_heartbeat, READ_MODE_IGNORE, NULL, NULL);
+        udpOutputInit(beast_udp_out, Modes.net_output_beast_udp);
+    }
+
     vrs_out = serviceInit("VRS json output", &Modes.vrs_out, NULL, READ_MODE_IGNORE, NULL, NULL);
     serviceListen(vrs_out, Modes.net_bind_address, Modes.net_output_vrs_ports);
 
     sbs_out = serviceInit("Basestation TCP output", &Modes.sbs_out, send_sbs_heartbeat, READ_MODE_IGNORE, NULL, NULL);
     serviceListen(sbs_out, Modes.net_bind_address, Modes.net_output_sbs_ports);
 
+    httpInit();
+
     sbs_in = serviceInit("Basestation TCP input", NULL, NULL, READ_MODE_ASCII, "\n",  decodeSbsLine);
     serviceListen(sbs_in, Modes.net_bind_address, Modes.net_input_sbs_ports);
 
@@ -496,6 +717,18 @@ void modesInitNet(void) {
     beast_in = makeBeastInputService();
     serviceListen(beast_in, Modes.net_bind_address, Modes.net_input_beast_ports);
 
+    if (Modes.net_input_beast_udp) {
+        struct net_service *beast_udp_in = serviceInit("Beast UDP input", NULL, NULL, READ_MODE_BEAST, NULL, decodeBinMessage);
+        udpInputInit(beast_udp_in, Modes.net_input_beast_udp);
+    }
+
+    if (Modes.net_shm_bus) {
+        if (!(shm_bus = shmBusCreate(Modes.net_shm_bus, MODES_SHM_BUS_SIZE))) {
+            fprintf(stderr, "Shared memory bus %s: %s\n", Modes.net_shm_bus, strerror(errno));
+            exit(1);
+        }
+    }
+
     /* Beast input from local Modes-S Beast via USB */
     if (Modes.sdr_type == SDR_MODESBEAST || Modes.sdr_type == SDR_GNS) {
         createGenericClient(beast_in, Modes.beast_fd);
@@ -519,14 +752,6 @@ void modesInitNet(void) {
             con->service = sbs_out;
         else if (strcmp(con->protocol, "sbs_in") == 0)
             con->service = sbs_in;
-
-
-        con->mutex = malloc(sizeof(pthread_mutex_t));
-        if (!con->mutex || pthread_mutex_init(con->mutex, NULL)) {
-            fprintf(stderr, "Unable to initialize connector mutex!\n");
-            exit(1);
-        }
-        pthread_mutex_lock(con->mutex);
     }
     serviceReconnectCallback(now);
 }
@@ -591,7 +816,7 @@ static uint64_t modesAcceptClients(uint64_t now) {
 //
 // On error free the client, collect the structure, adjust maxfd if needed.
 //
-static void modesCloseClient(struct client *c) {
+void modesCloseClient(struct client *c) {
     if (!c->service) {
         fprintf(stderr, "warning: double close of net client\n");
         return;
@@ -602,15 +827,24 @@ static void modesCloseClient(struct client *c) {
         Modes.exit = 3;
     }    
     
+    if (c->shedding) {
+        fprintf(stderr, "%s: %s port %s had %u low, %u normal, %u high priority frames shed\n",
+                c->service->descr, c->host, c->port,
+                c->shed[SHED_LOW], c->shed[SHED_NORMAL], c->shed[SHED_HIGH]);
+    }
+
     anetCloseSocket(c->fd);
     c->service->connections--;
     if (c->con) {
         // Clean this up and set the next_reconnect timer for another try.
-        // If the connection had been established and the connect didn't fail,
-        // only wait a short time to reconnect
+        // If the connection had been up for a while, start over with a
+        // short backoff from the first address we know of.
         c->con->connecting = 0;
         c->con->connected = 0;
-        c->con->next_reconnect = mstime() + Modes.net_connector_delay / 10;
+        if (mstime() - c->con->established >= Modes.net_connector_delay)
+            c->con->failures = 0;
+        c->con->try_addr = NULL;
+        connectorRetry(c->con);
     }
 
     // mark it as inactive and ready to be freed
@@ -622,11 +856,15 @@ static void modesCloseClient(struct client *c) {
         free(c->sendq);
         c->sendq = NULL;
     }
+    free(c->udp);
+    c->udp = NULL;
+    if (c->http)
+        httpClientClosed(c);
 
     autoset_modeac();
 }
 
-static void flushClient(struct client *c, uint64_t now) {
+void flushClient(struct client *c, uint64_t now) {
 
     int towrite = c->sendq_len;
     char *psendq = c->sendq;
@@ -678,13 +916,110 @@ static void flushClient(struct client *c, uint64_t now) {
         c->last_flush = now;
     }
 
-    // If writing has failed for 5 seconds, disconnect.
-    if (c->last_flush + 5000 < now) {
+    // If writing has failed for a long time, disconnect.
+    if (c->last_flush + MODES_NET_STALL_TIMEOUT < now) {
         fprintf(stderr, "%s: Unable to send data, disconnecting: %s port %s (fd %d, SendQ %d)\n", c->service->descr, c->host, c->port, c->fd, c->sendq_len);
         modesCloseClient(c);
     }
 }
 
+//
+//=========================================================================
+//
+// Send the write buffer as one sequence-numbered datagram to every
+// destination of a datagram service
+//
+static void udpFlushWrites(struct net_writer *writer) {
+    struct udp_output *out = writer->service->udp_out;
+    unsigned char header[BEAST_UDP_HEADER_LEN] = {
+        0x1a, 'U', BEAST_UDP_VERSION, 0,
+        out->seq >> 24, out->seq >> 16, out->seq >> 8, out->seq
+    };
+    struct iovec iov[2] = {
+        { header, sizeof (header) },
+        { writer->data, writer->dataUsed }
+    };
+
+    for (int i = 0; i < out->ndests; ++i) {
+        struct msghdr *h = &out->msgs[i].msg_hdr;
+        h->msg_name = &out->dests[i];
+        h->msg_namelen = out->dest_lens[i];
+        h->msg_iov = iov;
+        h->msg_iovlen = 2;
+    }
+
+    // A datagram that can't be sent is lost; receivers see the gap in
+    // the sequence numbers.
+    if (sendmmsg(out->fd, out->msgs, out->ndests, 0) < 0) {
+        if (!out->failing && errno != EAGAIN && errno != EWOULDBLOCK) {
+            fprintf(stderr, "%s: Send Error: %s\n", writer->service->descr, strerror(errno));
+        }
+        out->failing = 1;
+    } else {
+        out->failing = 0;
+    }
+
+    out->seq++;
+}
+
+//
+//=========================================================================
+//
+// Append the write buffer to a client's SendQ. As the SendQ fills up,
+// low and then normal priority frames are shed so the rest still gets
+// through; the client is only dropped if a SHED_NEVER frame doesn't fit.
+// Returns 0 if the client was dropped.
+//
+static int queueToClient(struct client *c, struct net_writer *writer) {
+    char *sendq = c->sendq;
+    int fill = c->sendq_len + writer->dataUsed;
+    shed_priority_t keep;
+    int start = 0;
+
+    if (fill < c->sendq_max / 2) {
+        memcpy(sendq + c->sendq_len, writer->data, writer->dataUsed);
+        c->sendq_len = fill;
+        return 1;
+    }
+
+    keep = (fill < c->sendq_max * 3 / 4) ? SHED_NORMAL : SHED_HIGH;
+
+    for (int i = 0; i < writer->nframes; ++i) {
+        struct write_frame *f = &writer->frames[i];
+        int len = f->end - start;
+
+        if (f->priority == SHED_NEVER || (f->priority >= keep && c->sendq_len + len < c->sendq_max)) {
+            if (c->sendq_len + len >= c->sendq_max) {
+                // Too much data in client SendQ.  Drop client - SendQ exceeded.
+                fprintf(stderr, "%s: Dropped due to full SendQ: %s port %s (fd %d, SendQ %d, RecvQ %d)\n",
+                        c->service->descr, c->host, c->port,
+                        c->fd, c->sendq_len, c->buflen);
+                modesCloseClient(c);
+                return 0;
+            }
+            memcpy(sendq + c->sendq_len, (char *) writer->data + start, len);
+            c->sendq_len += len;
+        } else {
+            if (!c->shedding) {
+                fprintf(stderr, "%s: SendQ filling up, shedding output: %s port %s (fd %d, SendQ %d)\n",
+                        c->service->descr, c->host, c->port, c->fd, c->sendq_len);
+                c->shedding = 1;
+            }
+            c->shed[f->priority]++;
+            if (f->priority == SHED_LOW)
+                Modes.stats_current.shed_low++;
+            else if (f->priority == SHED_NORMAL)
+                Modes.stats_current.shed_normal++;
+            else
+                Modes.stats_current.shed_high++;
+        }
+
+        start = f->end;
+    }
+
+    return 1;
+}
+
 //
 //=========================================================================
 //
@@ -694,46 +1029,47 @@ static void flushWrites(struct net_writer *writer) {
     struct client *c;
     uint64_t now = mstime();
 
+    if (writer->service->udp_out) {
+        udpFlushWrites(writer);
+    }
+
     for (c = writer->service->clients; c; c = c->next) {
         if (!c->service)
             continue;
         if (c->service->writer == writer->service->writer) {
-            uintptr_t psendq_end = (uintptr_t)c->sendq + c->sendq_len; // Pointer to end of sendq
-
-            // Add the buffer to the client's SendQ
-            if ((c->sendq_len + writer->dataUsed) >= c->sendq_max) {
-                // Too much data in client SendQ.  Drop client - SendQ exceeded.
-                fprintf(stderr, "%s: Dropped due to full SendQ: %s port %s (fd %d, SendQ %d, RecvQ %d)\n",
-                        c->service->descr, c->host, c->port,
-                        c->fd, c->sendq_len, c->buflen);
-                modesCloseClient(c);
+            if (!queueToClient(c, writer))
                 continue;	// Go to the next client
-            }
-            // Append the data to the end of the queue, increment len
-            memcpy((void*)psendq_end, writer->data, writer->dataUsed);
-            c->sendq_len += writer->dataUsed;
             // Try flushing...
             flushClient(c, now);
         }
     }
     writer->dataUsed = 0;
+    writer->nframes = 0;
     writer->lastWrite = mstime();
     return;
 }
 
+// Would a write to this writer go anywhere?
+static inline int writerActive(struct net_writer *writer) {
+    return writer &&
+            writer->service &&
+            (writer->service->connections || writer->service->udp_out) &&
+            writer->data;
+}
+
 // Prepare to write up to 'len' bytes to the given net_writer.
 // Returns a pointer to write to, or NULL to skip this write.
 static void *prepareWrite(struct net_writer *writer, int len) {
-    if (!writer ||
-            !writer->service ||
-            !writer->service->connections ||
-            !writer->data)
+    if (!writerActive(writer))
         return NULL;
 
-    if (len > MODES_OUT_BUF_SIZE)
+    // datagram services flush before a frame would overflow the payload
+    int size = writer->service->udp_out ? BEAST_UDP_PAYLOAD : MODES_OUT_BUF_SIZE;
+
+    if (len > size)
         return NULL;
 
-    if (writer->dataUsed + len >= MODES_OUT_BUF_SIZE) {
+    if (writer->dataUsed + len >= size) {
         // Flush now to free some space
         flushWrites(writer);
     }
@@ -745,8 +1081,19 @@ static void *prepareWrite(struct net_writer *writer, int len) {
 // endptr should point one byte past the last byte written
 // to the buffer returned from prepareWrite.
 static void completeWrite(struct net_writer *writer, void *endptr) {
+    struct write_frame *last = writer->nframes ? &writer->frames[writer->nframes - 1] : NULL;
+
     writer->dataUsed = endptr - writer->data;
 
+    if (writer->nframes < MODES_OUT_FRAMES) {
+        last = &writer->frames[writer->nframes++];
+        last->priority = write_priority;
+    } else if (write_priority > last->priority) {
+        // out of frame slots: extend the last one, keeping the higher priority
+        last->priority = write_priority;
+    }
+    last->end = writer->dataUsed;
+
     if (writer->dataUsed >= Modes.net_output_flush_size) {
         flushWrites(writer);
     }
@@ -755,19 +1102,54 @@ static void completeWrite(struct net_writer *writer, void *endptr) {
 //
 //=========================================================================
 //
-// Write raw output in Beast Binary format with Timestamp to TCP clients
+// Every wire format of the message being queued, each rendered on first
+// use and then copied to every writer of that format: the listening
+// service and the connectors pushing the same protocol share one writer,
+// and beast_out, beast_udp_out and beast_reduce_out share one frame.
 //
-static void modesSendBeastOutput(struct modesMessage *mm, struct net_writer *writer) {
+struct message_render {
+    struct modesMessage *mm;
+    int beast_len; // -1 until rendered, 0 if there is no such frame
+    int raw_len;
+    char beast[2 + 2 * (7 + MODES_LONG_MSG_BYTES)];
+    char raw[13 + 2 * MODES_LONG_MSG_BYTES + 2];
+};
+
+// The two uppercase hex digits of every byte value, at twice its offset
+#define HEX_ROW(h) h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" \
+                   h "8" h "9" h "A" h "B" h "C" h "D" h "E" h "F"
+static const char hex_bytes[] =
+        HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3")
+        HEX_ROW("4") HEX_ROW("5") HEX_ROW("6") HEX_ROW("7")
+        HEX_ROW("8") HEX_ROW("9") HEX_ROW("A") HEX_ROW("B")
+        HEX_ROW("C") HEX_ROW("D") HEX_ROW("E") HEX_ROW("F");
+#undef HEX_ROW
+
+static inline char *printHexByte(char *p, unsigned char c) {
+    memcpy(p, hex_bytes + 2 * c, 2);
+    return p + 2;
+}
+
+// Queue an already rendered frame
+static void sendRendered(struct net_writer *writer, const char *data, int len) {
+    char *p = prepareWrite(writer, len);
+
+    if (!p)
+        return;
+
+    memcpy(p, data, len);
+    completeWrite(writer, p + len);
+}
+
+// Beast Binary format with timestamp and signal level, 0x1a escaped
+static int renderBeast(struct modesMessage *mm, char *p) {
     int msgLen = mm->msgbits / 8;
-    char *p = prepareWrite(writer, 2 + 2 * (7 + msgLen));
+    char *start = p;
     char ch;
     int j;
     int sig;
     unsigned char *msg = (Modes.net_verbatim ? mm->verbatim : mm->msg);
 
-    if (!p)
-        return;
-
     *p++ = 0x1a;
     if (msgLen == MODES_SHORT_MSG_BYTES) {
         *p++ = '2';
@@ -776,33 +1158,15 @@ static void modesSendBeastOutput(struct modesMessage *mm, struct net_writer *wri
     } else if (msgLen == MODEAC_MSG_BYTES) {
         *p++ = '1';
     } else {
-        return;
+        return 0;
     }
 
     /* timestamp, big-endian */
-    *p++ = (ch = (mm->timestampMsg >> 40));
-    if (0x1A == ch) {
-        *p++ = ch;
-    }
-    *p++ = (ch = (mm->timestampMsg >> 32));
-    if (0x1A == ch) {
-        *p++ = ch;
-    }
-    *p++ = (ch = (mm->timestampMsg >> 24));
-    if (0x1A == ch) {
-        *p++ = ch;
-    }
-    *p++ = (ch = (mm->timestampMsg >> 16));
-    if (0x1A == ch) {
-        *p++ = ch;
-    }
-    *p++ = (ch = (mm->timestampMsg >> 8));
-    if (0x1A == ch) {
-        *p++ = ch;
-    }
-    *p++ = (ch = (mm->timestampMsg));
-    if (0x1A == ch) {
-        *p++ = ch;
+    for (j = 40; j >= 0; j -= 8) {
+        *p++ = (ch = (mm->timestampMsg >> j));
+        if (0x1A == ch) {
+            *p++ = ch;
+        }
     }
 
     sig = round(sqrt(mm->signalLevel) * 255);
@@ -822,7 +1186,23 @@ static void modesSendBeastOutput(struct modesMessage *mm, struct net_writer *wri
         }
     }
 
-    completeWrite(writer, p);
+    return p - start;
+}
+
+//
+//=========================================================================
+//
+// Write raw output in Beast Binary format with Timestamp to TCP clients
+//
+static void modesSendBeastOutput(struct message_render *r, struct net_writer *writer) {
+    if (!writerActive(writer))
+        return;
+
+    if (r->beast_len < 0)
+        r->beast_len = renderBeast(r->mm, r->beast);
+
+    if (r->beast_len)
+        sendRendered(writer, r->beast, r->beast_len);
 }
 
 static void send_beast_heartbeat(struct net_service *service) {
@@ -840,48 +1220,43 @@ static void send_beast_heartbeat(struct net_service *service) {
     completeWrite(service->writer, data + sizeof (heartbeat_message));
 }
 
-//
-//=========================================================================
-//
-// Print the two hex digits to a string for a single byte.
-//
-static void printHexDigit(char *p, unsigned char c) {
-    const char hex_lookup[] = "0123456789ABCDEF";
-    p[0] = hex_lookup[(c >> 4) & 0x0F];
-    p[1] = hex_lookup[c & 0x0F];
-}
-
-//
-//=========================================================================
-//
-// Write raw output to TCP clients
-//
-static void modesSendRawOutput(struct modesMessage *mm) {
+// AVR format, or AVR-MLAT with a 12 digit timestamp when --mlat is set
+static int renderRaw(struct modesMessage *mm, char *p) {
     int msgLen = mm->msgbits / 8;
-    char *p = prepareWrite(&Modes.raw_out, msgLen * 2 + 15);
+    char *start = p;
     int j;
     unsigned char *msg = (Modes.net_verbatim ? mm->verbatim : mm->msg);
 
-    if (!p)
-        return;
-
     if (Modes.mlat && mm->timestampMsg) {
         /* timestamp, big-endian */
-        sprintf(p, "@%012" PRIX64,
-                mm->timestampMsg);
-        p += 13;
+        *p++ = '@';
+        for (j = 40; j >= 0; j -= 8)
+            p = printHexByte(p, mm->timestampMsg >> j);
     } else
         *p++ = '*';
 
-    for (j = 0; j < msgLen; j++) {
-        printHexDigit(p, msg[j]);
-        p += 2;
-    }
+    for (j = 0; j < msgLen; j++)
+        p = printHexByte(p, msg[j]);
 
     *p++ = ';';
     *p++ = '\n';
 
-    completeWrite(&Modes.raw_out, p);
+    return p - start;
+}
+
+//
+//=========================================================================
+//
+// Write raw output to TCP clients
+//
+static void modesSendRawOutput(struct message_render *r) {
+    if (!writerActive(&Modes.raw_out))
+        return;
+
+    if (r->raw_len < 0)
+        r->raw_len = renderRaw(r->mm, r->raw);
+
+    sendRendered(&Modes.raw_out, r->raw, r->raw_len);
 }
 
 static void send_raw_heartbeat(struct net_service *service) {
@@ -907,112 +1282,16 @@ static void send_raw_heartbeat(struct net_service *service) {
 //
 static int decodeSbsLine(struct client *c, char *line, int remote) {
     struct modesMessage mm;
-    static struct modesMessage zeroMessage;
-
-    char *p = line;
-    char *t[23]; // leave 0 indexed entry empty, place 22 tokens into array
 
     MODES_NOTUSED(remote);
-    MODES_NOTUSED(c);
-    mm = zeroMessage;
-
-    // Mark messages received over the internet as remote so that we don't try to
-    // pass them off as being received by this instance when forwarding them
-    mm.remote = 1;
-    mm.signalLevel = 0;
-    mm.sbs_in = 1;
-
-    // sample message from mlat-client basestation output
-    //MSG,3,1,1,4AC8B3,1,2019/12/10,19:10:46.320,2019/12/10,19:10:47.789,,36017,,,51.1001,10.1915,,,,,,
-    //
-    for (int i = 1; i < 23; i++) {
-        t[i] = strsep(&p, ",");
-        if (!p && i < 22)
-            return 0;
-    }
+    resetModesMessage(&mm);
 
-    // check field 1
-    if (!t[1] || strcmp(t[1], "MSG") != 0)
+    if (sbsDecode(line, &mm) < 0)
         return 0;
 
-    if (!t[2] || strlen(t[2]) != 1)
-        return 0; // decoder limited to type 3 messages for now
-
-    if (!t[5] || strlen(t[5]) != 6)
-        return 0; // icao must be 6 characters
-
-    char *icao = t[5];
-    unsigned char *chars = (unsigned char *) &(mm.addr);
-    for (int j = 0; j < 6; j += 2) {
-        int high = hexDigitVal(icao[j]);
-        int low = hexDigitVal(icao[j + 1]);
-
-        if (high == -1 || low == -1) return 0;
-        chars[2 - j / 2] = (high << 4) | low;
-    }
-    if (mm.addr == 0)
-        return 0;
-
-    //field 11, callsign
-    if (t[11] && strlen(t[11]) > 0) {
-        strncpy(mm.callsign, t[11], 9);
-        mm.callsign_valid = 1;
-        //fprintf(stderr, "call: %s, ", mm.callsign);
-    }
-    // field 12, altitude
-    if (t[12] && strlen(t[12]) > 0) {
-        mm.altitude_baro = atoi(t[12]);
-        if (mm.altitude_baro < -5000 || mm.altitude_baro > 100000)
-            return 0;
-        mm.altitude_baro_valid = 1;
-        mm.altitude_baro_unit = UNIT_FEET;
-        //fprintf(stderr, "alt: %d, ", mm.altitude_baro);
-    }
-    // field 13, groundspeed
-    if (t[13] && strlen(t[13]) > 0) {
-        mm.gs.v0 = strtod(t[13], NULL);
-        if (mm.gs.v0 > 0)
-            mm.gs_valid = 1;
-        //fprintf(stderr, "gs: %.1f, ", mm.gs.selected);
-    }
-    //field 14, heading
-    if (t[14] && strlen(t[14]) > 0) {
-        mm.heading_valid = 1;
-        mm.heading = strtod(t[14], NULL);
-        mm.heading_type = HEADING_GROUND_TRACK;
-        //fprintf(stderr, "track: %.1f, ", mm.heading);
-    }
-    // field 15 and 16, position
-    if (t[15] && strlen(t[15]) && t[16] && strlen(t[16])) {
-        mm.decoded_lat = strtod(t[15], NULL);
-        mm.decoded_lon = strtod(t[16], NULL);
-        //fprintf(stderr, "pos: (%.2f, %.2f), ", mm.decoded_lat, mm.decoded_lon);
-    }
-    // field 17 vertical rate, assume baro
-    if (t[17] && strlen(t[17]) > 0) {
-        mm.baro_rate = atoi(t[17]);
-        mm.baro_rate_valid = 1;
-        //fprintf(stderr, "vRate: %d, ", mm.baro_rate);
-    }
-    // field 18 vertical rate, assume baro
-    if (t[18] && strlen(t[18]) > 0) {
-        long int tmp = strtol(t[18], NULL, 10);
-        if (tmp > 0) {
-            mm.squawk = (tmp / 1000) * 16 * 16 * 16 + (tmp / 100 % 10) * 16 * 16 + (tmp / 10 % 10) * 16 + (tmp % 10);
-            mm.squawk_valid = 1;
-            //fprintf(stderr, "squawk: %04x %s, ", mm.squawk, t[18]);
-        }
-    }
-    // field 22 ground status
-    if (t[22] && strlen(t[22]) > 0 && atoi(t[22]) > 0) {
-        mm.airground = AG_GROUND;
-        //fprintf(stderr, "onground, ");
-    }
-
     // record reception time as the time we read it.
-    mm.sysTimestampMsg = mstime();
+    mm.sysTimestampMsg = clientReceiveTime(c);
 
-    //fprintf(stderr, "%d, %0.5f, %0.5f\n", mm.altitude_baro, mm.decoded_lat, mm.decoded_lon);
     useModesMessage(&mm);
 
     return 0;
@@ -1023,231 +1302,178 @@ static int decodeSbsLine(struct client *c, char *line, int remote) {
 // Write SBS output to TCP clients
 //
 static void modesSendSBSOutput(struct modesMessage *mm, struct aircraft *a) {
-    char *p;
     struct timespec now;
-    struct tm stTime_receive, stTime_now;
-    int msgType;
+    char *p;
 
     // For now, suppress non-ICAO addresses
     if (mm->addr & MODES_NON_ICAO_ADDRESS)
         return;
 
-    p = prepareWrite(&Modes.sbs_out, 200);
+    p = prepareWrite(&Modes.sbs_out, SBS_MAX_LINE);
     if (!p)
         return;
 
-    //
-    // SBS BS style output checked against the following reference
-    // http://www.homepages.mcb.net/bones/SBS/Article/Barebones42_Socket_Data.htm - seems comprehensive
-    //
-
-    // Decide on the basic SBS Message Type
-    switch (mm->msgtype) {
-        case 4:
-        case 20:
-            msgType = 5;
-            break;
-            break;
-
-        case 5:
-        case 21:
-            msgType = 6;
-            break;
-
-        case 0:
-        case 16:
-            msgType = 7;
-            break;
-
-        case 11:
-            msgType = 8;
-            break;
-
-        case 17:
-        case 18:
-            if (mm->metype >= 1 && mm->metype <= 4) {
-                msgType = 1;
-            } else if (mm->metype >= 5 && mm->metype <= 8) {
-                msgType = 2;
-            } else if (mm->metype >= 9 && mm->metype <= 18) {
-                msgType = 3;
-            } else if (mm->metype == 19) {
-                msgType = 4;
-            } else {
-                return;
-            }
-            break;
-
-        default:
-            return;
-    }
-
-    // Fields 1 to 6 : SBS message type and ICAO address of the aircraft and some other stuff
-    p += sprintf(p, "MSG,%d,1,1,%06X,1,", msgType, mm->addr);
+    decodeModesMessageFields(mm);
 
     // Find current system time
     clock_gettime(CLOCK_REALTIME, &now);
-    localtime_r(&now.tv_sec, &stTime_now);
-
-    // Find message reception time
-    time_t received = (time_t) (mm->sysTimestampMsg / 1000);
-    localtime_r(&received, &stTime_receive);
 
-    // Fields 7 & 8 are the message reception time and date
-    p += sprintf(p, "%04d/%02d/%02d,", (stTime_receive.tm_year + 1900), (stTime_receive.tm_mon + 1), stTime_receive.tm_mday);
-    p += sprintf(p, "%02d:%02d:%02d.%03u,", stTime_receive.tm_hour, stTime_receive.tm_min, stTime_receive.tm_sec, (unsigned) (mm->sysTimestampMsg % 1000));
+    p = sbsEncode(p, mm, a, (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000, Modes.use_gnss);
+    if (!p)
+        return;
 
-    // Fields 9 & 10 are the current time and date
-    p += sprintf(p, "%04d/%02d/%02d,", (stTime_now.tm_year + 1900), (stTime_now.tm_mon + 1), stTime_now.tm_mday);
-    p += sprintf(p, "%02d:%02d:%02d.%03u", stTime_now.tm_hour, stTime_now.tm_min, stTime_now.tm_sec, (unsigned) (now.tv_nsec / 1000000U));
+    completeWrite(&Modes.sbs_out, p);
+}
 
-    // Field 11 is the callsign (if we have it)
-    if (mm->callsign_valid) {
-        p += sprintf(p, ",%s", mm->callsign);
-    } else {
-        p += sprintf(p, ",");
-    }
+static void send_sbs_heartbeat(struct net_service *service) {
+    static char *heartbeat_message = "\r\n"; // is there a better one?
+    char *data;
+    int len = strlen(heartbeat_message);
 
-    // Field 12 is the altitude (if we have it)
-    if (Modes.use_gnss) {
-        if (mm->altitude_geom_valid) {
-            p += sprintf(p, ",%dH", mm->altitude_geom);
-        } else if (mm->altitude_baro_valid && trackDataValid(&a->geom_delta_valid)) {
-            p += sprintf(p, ",%dH", mm->altitude_baro + a->geom_delta);
-        } else if (mm->altitude_baro_valid) {
-            p += sprintf(p, ",%d", mm->altitude_baro);
-        } else {
-            p += sprintf(p, ",");
-        }
-    } else {
-        if (mm->altitude_baro_valid) {
-            p += sprintf(p, ",%d", mm->altitude_baro);
-        } else if (mm->altitude_geom_valid && trackDataValid(&a->geom_delta_valid)) {
-            p += sprintf(p, ",%d", mm->altitude_geom - a->geom_delta);
-        } else {
-            p += sprintf(p, ",");
-        }
-    }
+    if (!service->writer)
+        return;
 
-    // Field 13 is the ground Speed (if we have it)
-    if (mm->gs_valid) {
-        p += sprintf(p, ",%.0f", mm->gs.selected);
-    } else {
-        p += sprintf(p, ",");
-    }
+    data = prepareWrite(service->writer, len);
+    if (!data)
+        return;
 
-    // Field 14 is the ground Heading (if we have it)
-    if (mm->heading_valid && mm->heading_type == HEADING_GROUND_TRACK) {
-        p += sprintf(p, ",%.0f", mm->heading);
-    } else {
-        p += sprintf(p, ",");
-    }
+    memcpy(data, heartbeat_message, len);
+    completeWrite(service->writer, data + len);
+}
 
-    // Fields 15 and 16 are the Lat/Lon (if we have it)
-    if (mm->cpr_decoded) {
-        p += sprintf(p, ",%1.5f,%1.5f", mm->decoded_lat, mm->decoded_lon);
-    } else {
-        p += sprintf(p, ",,");
-    }
+//
+//=========================================================================
+//
+// Last surveillance reply forwarded per aircraft (hashed by address),
+// to spot repeats that carry no new information
+static struct {
+    uint32_t addr;
+    uint32_t hash;
+} surv_seen[4096];
 
-    // Field 17 is the VerticalRate (if we have it)
-    if (Modes.use_gnss) {
-        if (mm->geom_rate_valid) {
-            p += sprintf(p, ",%dH", mm->geom_rate);
-        } else if (mm->baro_rate_valid) {
-            p += sprintf(p, ",%d", mm->baro_rate);
-        } else {
-            p += sprintf(p, ",");
-        }
-    } else {
-        if (mm->baro_rate_valid) {
-            p += sprintf(p, ",%d", mm->baro_rate);
-        } else if (mm->geom_rate_valid) {
-            p += sprintf(p, ",%d", mm->geom_rate);
-        } else {
-            p += sprintf(p, ",");
-        }
-    }
+// Whether an extended squitter carries a position. Until the fields are
+// decoded this goes by the ME type alone.
+static int esPosition(struct modesMessage *mm) {
+    if (!mm->fields_pending)
+        return mm->cpr_valid;
 
-    // Field 18 is  the Squawk (if we have it)
-    if (mm->squawk_valid) {
-        p += sprintf(p, ",%04x", mm->squawk);
-    } else {
-        p += sprintf(p, ",");
-    }
+    return (mm->metype >= 5 && mm->metype <= 18) || (mm->metype >= 20 && mm->metype <= 22);
+}
 
-    // Field 19 is the Squawk Changing Alert flag (if we have it)
-    if (mm->alert_valid) {
-        if (mm->alert) {
-            p += sprintf(p, ",-1");
-        } else {
-            p += sprintf(p, ",0");
-        }
-    } else {
-        p += sprintf(p, ",");
-    }
+static shed_priority_t outputPriority(struct modesMessage *mm, struct aircraft *a) {
+    switch (mm->msgtype) {
+        case 32: // Mode A/C
+        case 11:
+            return SHED_LOW;
 
-    // Field 20 is the Squawk Emergency flag (if we have it)
-    if (mm->squawk_valid) {
-        if ((mm->squawk == 0x7500) || (mm->squawk == 0x7600) || (mm->squawk == 0x7700)) {
-            p += sprintf(p, ",-1");
-        } else {
-            p += sprintf(p, ",0");
-        }
-    } else {
-        p += sprintf(p, ",");
-    }
+        case 17:
+        case 18:
+            return esPosition(mm) ? SHED_HIGH : SHED_NORMAL;
 
-    // Field 21 is the Squawk Ident flag (if we have it)
-    if (mm->spi_valid) {
-        if (mm->spi) {
-            p += sprintf(p, ",-1");
-        } else {
-            p += sprintf(p, ",0");
+        case 0:
+        case 4:
+        case 5:
+        case 16:
+        case 20:
+        case 21: {
+            uint32_t hash = 2166136261u;
+            for (int i = 0; i < mm->msgbits / 8; ++i)
+                hash = (hash ^ mm->msg[i]) * 16777619u;
+
+            unsigned slot = (mm->addr * 2654435761u) >> 20;
+            int repeat = (surv_seen[slot].addr == mm->addr && surv_seen[slot].hash == hash);
+            surv_seen[slot].addr = mm->addr;
+            surv_seen[slot].hash = hash;
+
+            if (repeat)
+                return SHED_LOW;
+            // without an ADS-B position, these replies are what mlat works from
+            if (!a || a->position_valid.source <= SOURCE_MLAT)
+                return SHED_HIGH;
+            return SHED_NORMAL;
         }
-    } else {
-        p += sprintf(p, ",");
-    }
 
-    // Field 22 is the OnTheGround flag (if we have it)
-    switch (mm->airground) {
-        case AG_GROUND:
-            p += sprintf(p, ",-1");
-            break;
-        case AG_AIRBORNE:
-            p += sprintf(p, ",0");
-            break;
         default:
-            p += sprintf(p, ",");
-            break;
+            return SHED_NORMAL;
     }
+}
+
+//
+// Publish a frame on the shared memory bus, as it goes out on the Beast output
+//
+static void shmBusPublishFrame(struct modesMessage *mm) {
+    struct shm_bus_frame *f = shmBusReserve(shm_bus, SHM_BUS_FRAME, sizeof (*f));
+    int len = mm->msgbits / 8;
 
-    p += sprintf(p, "\r\n");
+    if (!f)
+        return;
 
-    completeWrite(&Modes.sbs_out, p);
+    memset(f, 0, sizeof (*f));
+    f->timestamp = mm->timestampMsg;
+    f->sys_timestamp = mm->sysTimestampMsg;
+    f->signal = mm->signalLevel;
+    f->len = len < (int) sizeof (f->msg) ? len : (int) sizeof (f->msg);
+    f->remote = mm->remote;
+    f->source = mm->source;
+    f->correctedbits = mm->correctedbits;
+    memcpy(f->msg, mm->msg, f->len);
+
+    shmBusCommit(shm_bus);
 }
 
-static void send_sbs_heartbeat(struct net_service *service) {
-    static char *heartbeat_message = "\r\n"; // is there a better one?
-    char *data;
-    int len = strlen(heartbeat_message);
+//
+// Publish the state of an aircraft a message just updated
+//
+static void shmBusPublishAircraft(struct aircraft *a) {
+    struct shm_bus_aircraft *s = shmBusReserve(shm_bus, SHM_BUS_AIRCRAFT, sizeof (*s));
 
-    if (!service->writer)
+    if (!s)
         return;
 
-    data = prepareWrite(service->writer, len);
-    if (!data)
-        return;
+    memset(s, 0, sizeof (*s));
+    s->addr = a->addr;
+    s->seen = a->seen;
+    s->messages = a->messages;
 
-    memcpy(data, heartbeat_message, len);
-    completeWrite(service->writer, data + len);
+    if (trackDataValid(&a->position_valid)) {
+        s->flags |= SHM_BUS_AIRCRAFT_POSITION;
+        s->lat = a->lat;
+        s->lon = a->lon;
+    }
+    if (trackDataValid(&a->altitude_baro_valid)) {
+        s->flags |= SHM_BUS_AIRCRAFT_ALTITUDE;
+        s->altitude_baro = a->altitude_baro;
+    }
+    if (trackDataValid(&a->baro_rate_valid)) {
+        s->flags |= SHM_BUS_AIRCRAFT_BARO_RATE;
+        s->baro_rate = a->baro_rate;
+    }
+    if (trackDataValid(&a->gs_valid)) {
+        s->flags |= SHM_BUS_AIRCRAFT_GS;
+        s->gs = a->gs;
+    }
+    if (trackDataValid(&a->track_valid)) {
+        s->flags |= SHM_BUS_AIRCRAFT_TRACK;
+        s->track = a->track;
+    }
+    if (trackDataValid(&a->callsign_valid)) {
+        s->flags |= SHM_BUS_AIRCRAFT_CALLSIGN;
+        memcpy(s->callsign, a->callsign, sizeof (s->callsign));
+        s->callsign[sizeof (s->callsign) - 1] = 0;
+    }
+    if (trackDataValid(&a->squawk_valid)) {
+        s->flags |= SHM_BUS_AIRCRAFT_SQUAWK;
+        s->squawk = a->squawk;
+    }
+
+    shmBusCommit(shm_bus);
 }
 
-//
-//=========================================================================
-//
 void modesQueueOutput(struct modesMessage *mm, struct aircraft *a) {
     int is_mlat = (mm->source == SOURCE_MLAT);
+    struct message_render render = { .mm = mm, .beast_len = -1, .raw_len = -1 };
+
+    write_priority = is_mlat ? SHED_HIGH : outputPriority(mm, a);
 
     if (a && !is_mlat && mm->correctedbits < 2) {
         // Don't ever forward 2-bit-corrected messages via SBS output.
@@ -1258,21 +1484,36 @@ void modesQueueOutput(struct modesMessage *mm, struct aircraft *a) {
     if (!is_mlat && (Modes.net_verbatim || mm->correctedbits < 2)) {
         // Forward 2-bit-corrected messages via raw output only if --net-verbatim is set
         // Don't ever forward mlat messages via raw output.
-        modesSendRawOutput(mm);
+        modesSendRawOutput(&render);
     }
 
     if ((!is_mlat || Modes.forward_mlat) && (Modes.net_verbatim || mm->correctedbits < 2)) {
         // Forward 2-bit-corrected messages via beast output only if --net-verbatim is set
         // Forward mlat messages via beast output only if --forward-mlat is set
-        modesSendBeastOutput(mm, &Modes.beast_out);
+        // unescaped frame size, for the BeastReduce compression stats
+        int frame_bytes = 2 + 6 + 1 + mm->msgbits / 8;
+
+        modesSendBeastOutput(&render, &Modes.beast_out);
+        modesSendBeastOutput(&render, &Modes.beast_udp_out);
+        if (shm_bus)
+            shmBusPublishFrame(mm);
+        Modes.stats_current.beast_full_frames++;
+        Modes.stats_current.beast_full_bytes += frame_bytes;
         if (mm->reduce_forward) {
-            modesSendBeastOutput(mm, &Modes.beast_reduce_out);
+            modesSendBeastOutput(&render, &Modes.beast_reduce_out);
+            Modes.stats_current.beast_reduce_frames++;
+            Modes.stats_current.beast_reduce_bytes += frame_bytes;
         }
     }
 
     if (a && !is_mlat) {
         writeFATSVEvent(mm, a);
     }
+
+    if (a && shm_bus)
+        shmBusPublishAircraft(a);
+
+    write_priority = SHED_HIGH;
 }
 
 // Decode a little-endian IEEE754 float (binary32)
@@ -1402,10 +1643,7 @@ static int decodeBinMessage(struct client *c, char *p, int remote) {
     int j;
     char ch;
     unsigned char msg[MODES_LONG_MSG_BYTES + 7];
-    static struct modesMessage zeroMessage;
     struct modesMessage mm;
-    MODES_NOTUSED(c);
-    memset(&mm, 0, sizeof (mm));
 
     ch = *p++; /// Get the message type
 
@@ -1445,7 +1683,7 @@ static int decodeBinMessage(struct client *c, char *p, int remote) {
     }
 
     if (msgLen) {
-        mm = zeroMessage;
+        resetModesMessage(&mm);
 
         /* Beast messages are marked depending on their source. From internet they are marked
          * remote so that we don't try to pass them off as being received by this instance
@@ -1464,7 +1702,9 @@ static int decodeBinMessage(struct client *c, char *p, int remote) {
         }
 
         // record reception time as the time we read it.
-        mm.sysTimestampMsg = mstime();
+        mm.sysTimestampMsg = clientReceiveTime(c);
+        if (remote && !c->udp)
+            clientClockUpdate(c, mm.timestampMsg);
 
         ch = *p++; // Grab the signal level
         mm.signalLevel = ((unsigned char) ch / 255.0);
@@ -1547,6 +1787,40 @@ static int hexDigitVal(int c) {
     else if (c >= 'a' && c <= 'f') return c - 'a' + 10;
     else return -1;
 }
+//
+//=========================================================================
+//
+// Two hex digits, looked up as one 16 bit value, to the byte they spell;
+// -1 for any pair that isn't two hex digits
+//
+static int16_t hex_pairs[65536];
+
+static void hexPairsInit(void) {
+    static const char digits[] = "0123456789ABCDEFabcdef";
+
+    for (int i = 0; i < 65536; i++)
+        hex_pairs[i] = -1;
+
+    for (const char *high = digits; *high; high++)
+        for (const char *low = digits; *low; low++)
+            hex_pairs[((uint8_t) *high << 8) | (uint8_t) *low] = (hexDigitVal(*high) << 4) | hexDigitVal(*low);
+}
+
+// Convert len hex digits (an even number) to len / 2 bytes.
+// Every pair is converted, invalid ones are only checked for at the end.
+// Returns 0 if there was anything but hex digits.
+static inline int hexToBytes(const char *hex, int len, unsigned char *msg) {
+    int bad = 0;
+
+    for (int j = 0; j < len; j += 2) {
+        int byte = hex_pairs[((uint8_t) hex[j] << 8) | (uint8_t) hex[j + 1]];
+        bad |= byte;
+        msg[j / 2] = byte;
+    }
+
+    return bad >= 0;
+}
+
 //
 //=========================================================================
 //
@@ -1562,14 +1836,18 @@ static int hexDigitVal(int c) {
 // case where we want broken messages here to close the client connection.
 //
 static int decodeHexMessage(struct client *c, char *hex, int remote) {
-    int l = strlen(hex), j;
+    int l = strlen(hex);
     unsigned char msg[MODES_LONG_MSG_BYTES];
     struct modesMessage mm;
-    static struct modesMessage zeroMessage;
+    static int hex_pairs_ready;
 
     MODES_NOTUSED(remote);
-    MODES_NOTUSED(c);
-    mm = zeroMessage;
+    resetModesMessage(&mm);
+
+    if (!hex_pairs_ready) {
+        hexPairsInit();
+        hex_pairs_ready = 1;
+    }
 
     // Mark messages received over the internet as remote so that we don't try to
     // pass them off as being received by this instance when forwarding them
@@ -1589,15 +1867,17 @@ static int decodeHexMessage(struct client *c, char *hex, int remote) {
     // Turn the message into binary.
     // Accept *-AVR raw @-AVR/BEAST timeS+raw %-AVR timeS+raw (CRC good) <-BEAST timeS+sigL+raw
     // and some AVR records that we can understand
-    if (hex[l - 1] != ';') {
+    if (l == 0 || hex[l - 1] != ';') {
         return (0);
     } // not complete - abort
 
     switch (hex[0]) {
         case '<':
         {
-            mm.signalLevel = ((hexDigitVal(hex[13]) << 4) | hexDigitVal(hex[14])) / 255.0;
-            mm.signalLevel = mm.signalLevel * mm.signalLevel;
+            if (l >= 16) {
+                mm.signalLevel = ((hexDigitVal(hex[13]) << 4) | hexDigitVal(hex[14])) / 255.0;
+                mm.signalLevel = mm.signalLevel * mm.signalLevel;
+            }
             hex += 15;
             l -= 16; // Skip <, timestamp and siglevel, and ;
             break;
@@ -1637,16 +1917,11 @@ static int decodeHexMessage(struct client *c, char *hex, int remote) {
         return (0);
     } // Right length for ModeA/C, but not enabled
 
-    for (j = 0; j < l; j += 2) {
-        int high = hexDigitVal(hex[j]);
-        int low = hexDigitVal(hex[j + 1]);
-
-        if (high == -1 || low == -1) return 0;
-        msg[j / 2] = (high << 4) | low;
-    }
+    if (!hexToBytes(hex, l, msg))
+        return 0;
 
     // record reception time as the time we read it.
-    mm.sysTimestampMsg = mstime();
+    mm.sysTimestampMsg = clientReceiveTime(c);
 
     if (l == (MODEAC_MSG_BYTES * 2)) { // ModeA or ModeC
         Modes.stats_current.remote_received_modeac++;
@@ -1711,69 +1986,71 @@ static const char *jsonEscapeString(const char *str) {
     return buf;
 }
 
-static char *append_flags(char *p, char *end, struct aircraft *a, datasource_t source) {
-    p = safe_snprintf(p, end, "[");
+// The fields whose value came from source, as listed under "mlat" and "tisb"
+static char *appendFlagsJson(char *p, struct aircraft *a, datasource_t source) {
+    char *start;
 
-    char *start = p;
+    *p++ = '[';
+    start = p;
     if (a->callsign_valid.source == source)
-        p = safe_snprintf(p, end, "\"callsign\",");
+        p = jsonLiteral(p, "\"callsign\",");
     if (a->altitude_baro_valid.source == source)
-        p = safe_snprintf(p, end, "\"altitude\",");
+        p = jsonLiteral(p, "\"altitude\",");
     if (a->altitude_geom_valid.source == source)
-        p = safe_snprintf(p, end, "\"alt_geom\",");
+        p = jsonLiteral(p, "\"alt_geom\",");
     if (a->gs_valid.source == source)
-        p = safe_snprintf(p, end, "\"gs\",");
+        p = jsonLiteral(p, "\"gs\",");
     if (a->ias_valid.source == source)
-        p = safe_snprintf(p, end, "\"ias\",");
+        p = jsonLiteral(p, "\"ias\",");
     if (a->tas_valid.source == source)
-        p = safe_snprintf(p, end, "\"tas\",");
+        p = jsonLiteral(p, "\"tas\",");
     if (a->mach_valid.source == source)
-        p = safe_snprintf(p, end, "\"mach\",");
+        p = jsonLiteral(p, "\"mach\",");
     if (a->track_valid.source == source)
-        p = safe_snprintf(p, end, "\"track\",");
+        p = jsonLiteral(p, "\"track\",");
     if (a->track_rate_valid.source == source)
-        p = safe_snprintf(p, end, "\"track_rate\",");
+        p = jsonLiteral(p, "\"track_rate\",");
     if (a->roll_valid.source == source)
-        p = safe_snprintf(p, end, "\"roll\",");
+        p = jsonLiteral(p, "\"roll\",");
     if (a->mag_heading_valid.source == source)
-        p = safe_snprintf(p, end, "\"mag_heading\",");
+        p = jsonLiteral(p, "\"mag_heading\",");
     if (a->true_heading_valid.source == source)
-        p = safe_snprintf(p, end, "\"true_heading\",");
+        p = jsonLiteral(p, "\"true_heading\",");
     if (a->baro_rate_valid.source == source)
-        p = safe_snprintf(p, end, "\"baro_rate\",");
+        p = jsonLiteral(p, "\"baro_rate\",");
     if (a->geom_rate_valid.source == source)
-        p = safe_snprintf(p, end, "\"geom_rate\",");
+        p = jsonLiteral(p, "\"geom_rate\",");
     if (a->squawk_valid.source == source)
-        p = safe_snprintf(p, end, "\"squawk\",");
+        p = jsonLiteral(p, "\"squawk\",");
     if (a->emergency_valid.source == source)
-        p = safe_snprintf(p, end, "\"emergency\",");
+        p = jsonLiteral(p, "\"emergency\",");
     if (a->nav_qnh_valid.source == source)
-        p = safe_snprintf(p, end, "\"nav_qnh\",");
+        p = jsonLiteral(p, "\"nav_qnh\",");
     if (a->nav_altitude_mcp_valid.source == source)
-        p = safe_snprintf(p, end, "\"nav_altitude_mcp\",");
+        p = jsonLiteral(p, "\"nav_altitude_mcp\",");
     if (a->nav_altitude_fms_valid.source == source)
-        p = safe_snprintf(p, end, "\"nav_altitude_fms\",");
+        p = jsonLiteral(p, "\"nav_altitude_fms\",");
     if (a->nav_heading_valid.source == source)
-        p = safe_snprintf(p, end, "\"nav_heading\",");
+        p = jsonLiteral(p, "\"nav_heading\",");
     if (a->nav_modes_valid.source == source)
-        p = safe_snprintf(p, end, "\"nav_modes\",");
+        p = jsonLiteral(p, "\"nav_modes\",");
     if (a->position_valid.source == source)
-        p = safe_snprintf(p, end, "\"lat\",\"lon\",\"nic\",\"rc\",");
+        p = jsonLiteral(p, "\"lat\",\"lon\",\"nic\",\"rc\",");
     if (a->nic_baro_valid.source == source)
-        p = safe_snprintf(p, end, "\"nic_baro\",");
+        p = jsonLiteral(p, "\"nic_baro\",");
     if (a->nac_p_valid.source == source)
-        p = safe_snprintf(p, end, "\"nac_p\",");
+        p = jsonLiteral(p, "\"nac_p\",");
     if (a->nac_v_valid.source == source)
-        p = safe_snprintf(p, end, "\"nac_v\",");
+        p = jsonLiteral(p, "\"nac_v\",");
     if (a->sil_valid.source == source)
-        p = safe_snprintf(p, end, "\"sil\",\"sil_type\",");
+        p = jsonLiteral(p, "\"sil\",\"sil_type\",");
     if (a->gva_valid.source == source)
-        p = safe_snprintf(p, end, "\"gva\",");
+        p = jsonLiteral(p, "\"gva\",");
     if (a->sda_valid.source == source)
-        p = safe_snprintf(p, end, "\"sda\",");
+        p = jsonLiteral(p, "\"sda\",");
     if (p != start)
         --p;
-    p = safe_snprintf(p, end, "]");
+    *p++ = ']';
     return p;
 }
 
@@ -1871,145 +2148,511 @@ static const char *nav_altitude_source_enum_string(nav_altitude_source_t src) {
     }
 }
 
-struct char_buffer generateAircraftJson(){
-    struct char_buffer cb;
-    uint64_t now = mstime();
-    struct aircraft *a;
-    int buflen = 256*1024; // The initial buffer is resized as needed
-    char *buf = (char *) malloc(buflen), *p = buf, *end = buf + buflen;
-    char *line_start;
-    int first = 1;
+// The longest object appendAircraftJson() writes: every field present at
+// its widest
+#define AIRCRAFT_JSON_FLAGS_MAX JSON_LEN("[\"callsign\",\"altitude\",\"alt_geom\",\"gs\",\"ias\",\"tas\",\"mach\"," \
+        "\"track\",\"track_rate\",\"roll\",\"mag_heading\",\"true_heading\",\"baro_rate\",\"geom_rate\",\"squawk\"," \
+        "\"emergency\",\"nav_qnh\",\"nav_altitude_mcp\",\"nav_altitude_fms\",\"nav_heading\",\"nav_modes\"," \
+        "\"lat\",\"lon\",\"nic\",\"rc\",\"nic_baro\",\"nac_p\",\"nac_v\",\"sil\",\"sil_type\",\"gva\",\"sda\"]")
+
+_Static_assert(JSON_LEN("{\"hex\":\"~ffffff\"")
+        + JSON_LEN(",\"type\":\"tisb_trackfile\"")
+        + JSON_LEN(",\"flight\":") + JSON_STRING_MAX(sizeof (((struct aircraft *) 0)->callsign) - 1)
+        + JSON_LEN(",\"alt_baro\":") + JSON_INT_MAX
+        + JSON_LEN(",\"alt_geom\":") + JSON_INT_MAX
+        + JSON_LEN(",\"gs\":") + JSON_FIXED_MAX(1)
+        + JSON_LEN(",\"ias\":") + JSON_INT_MAX
+        + JSON_LEN(",\"tas\":") + JSON_INT_MAX
+        + JSON_LEN(",\"mach\":") + JSON_FIXED_MAX(3)
+        + JSON_LEN(",\"track\":") + JSON_FIXED_MAX(1)
+        + JSON_LEN(",\"track_rate\":") + JSON_FIXED_MAX(2)
+        + JSON_LEN(",\"roll\":") + JSON_FIXED_MAX(1)
+        + JSON_LEN(",\"mag_heading\":") + JSON_FIXED_MAX(1)
+        + JSON_LEN(",\"true_heading\":") + JSON_FIXED_MAX(1)
+        + JSON_LEN(",\"baro_rate\":") + JSON_INT_MAX
+        + JSON_LEN(",\"geom_rate\":") + JSON_INT_MAX
+        + JSON_LEN(",\"squawk\":\"\"") + JSON_HEX_MAX
+        + JSON_LEN(",\"emergency\":\"lifeguard\"")
+        + JSON_LEN(",\"category\":\"\"") + JSON_HEX_MAX
+        + JSON_LEN(",\"nav_qnh\":") + JSON_FIXED_MAX(1)
+        + JSON_LEN(",\"nav_altitude_mcp\":") + JSON_INT_MAX
+        + JSON_LEN(",\"nav_altitude_fms\":") + JSON_INT_MAX
+        + JSON_LEN(",\"nav_heading\":") + JSON_FIXED_MAX(1)
+        + JSON_LEN(",\"nav_modes\":[\"autopilot\",\"vnav\",\"althold\",\"approach\",\"lnav\",\"tcas\"]")
+        + JSON_LEN(",\"lat\":") + JSON_FIXED_MAX(6)
+        + JSON_LEN(",\"lon\":") + JSON_FIXED_MAX(6)
+        + JSON_LEN(",\"nic\":") + JSON_INT_MAX
+        + JSON_LEN(",\"rc\":") + JSON_INT_MAX
+        + JSON_LEN(",\"seen_pos\":") + JSON_FIXED_MAX(1)
+        + JSON_LEN(",\"version\":") + JSON_INT_MAX
+        + JSON_LEN(",\"nic_baro\":1,\"nac_p\":15,\"nac_v\":7,\"sil\":3,\"sil_type\":\"persample\"")
+        + JSON_LEN(",\"gva\":3,\"sda\":3,\"alert\":1,\"spi\":1")
+        + JSON_LEN(",\"mlat\":") + AIRCRAFT_JSON_FLAGS_MAX
+        + JSON_LEN(",\"tisb\":") + AIRCRAFT_JSON_FLAGS_MAX
+        + JSON_LEN(",\"messages\":") + JSON_LONG_MAX
+        + JSON_LEN(",\"seen\":") + JSON_FIXED_MAX(1)
+        + JSON_LEN(",\"rssi\":") + JSON_FIXED_MAX(1)
+        + JSON_LEN("}") <= AIRCRAFT_JSON_MAX, "AIRCRAFT_JSON_MAX is too small");
 
-    _messageNow = now;
+//
+// One aircraft as a JSON object, as listed in aircraft.json. Writes at most
+// AIRCRAFT_JSON_MAX bytes.
+//
+char *appendAircraftJson(char *p, struct aircraft *a, uint64_t now) {
+    p = jsonLiteral(p, "{\"hex\":\"");
+    if (a->addr & MODES_NON_ICAO_ADDRESS)
+        *p++ = '~';
+    p = jsonHex(p, a->addr & 0xFFFFFF, 6, 0);
+    *p++ = '"';
+    if (a->addrtype != ADDR_ADSB_ICAO) {
+        p = jsonLiteral(p, ",\"type\":");
+        p = jsonString(p, addrtype_enum_string(a->addrtype), 16);
+    }
+    if (trackDataValid(&a->callsign_valid)) {
+        p = jsonLiteral(p, ",\"flight\":");
+        p = jsonString(p, a->callsign, sizeof (a->callsign) - 1);
+    }
+    if (trackDataValid(&a->airground_valid) && a->airground_valid.source >= SOURCE_MODE_S_CHECKED && a->airground == AG_GROUND)
+        p = jsonLiteral(p, ",\"alt_baro\":\"ground\"");
+    else {
+        if (trackDataValid(&a->altitude_baro_valid) && a->altitude_baro_reliable >= 3) {
+            p = jsonLiteral(p, ",\"alt_baro\":");
+            p = jsonInt(p, a->altitude_baro);
+        }
+        if (trackDataValid(&a->altitude_geom_valid)) {
+            p = jsonLiteral(p, ",\"alt_geom\":");
+            p = jsonInt(p, a->altitude_geom);
+        }
+    }
+    if (trackDataValid(&a->gs_valid)) {
+        p = jsonLiteral(p, ",\"gs\":");
+        p = jsonFixed(p, a->gs, 1);
+    }
+    if (trackDataValid(&a->ias_valid)) {
+        p = jsonLiteral(p, ",\"ias\":");
+        p = jsonUnsigned(p, a->ias);
+    }
+    if (trackDataValid(&a->tas_valid)) {
+        p = jsonLiteral(p, ",\"tas\":");
+        p = jsonUnsigned(p, a->tas);
+    }
+    if (trackDataValid(&a->mach_valid)) {
+        p = jsonLiteral(p, ",\"mach\":");
+        p = jsonFixed(p, a->mach, 3);
+    }
+    if (trackDataValid(&a->track_valid)) {
+        p = jsonLiteral(p, ",\"track\":");
+        p = jsonFixed(p, a->track, 1);
+    }
+    if (trackDataValid(&a->track_rate_valid)) {
+        p = jsonLiteral(p, ",\"track_rate\":");
+        p = jsonFixed(p, a->track_rate, 2);
+    }
+    if (trackDataValid(&a->roll_valid)) {
+        p = jsonLiteral(p, ",\"roll\":");
+        p = jsonFixed(p, a->roll, 1);
+    }
+    if (trackDataValid(&a->mag_heading_valid)) {
+        p = jsonLiteral(p, ",\"mag_heading\":");
+        p = jsonFixed(p, a->mag_heading, 1);
+    }
+    if (trackDataValid(&a->true_heading_valid)) {
+        p = jsonLiteral(p, ",\"true_heading\":");
+        p = jsonFixed(p, a->true_heading, 1);
+    }
+    if (trackDataValid(&a->baro_rate_valid)) {
+        p = jsonLiteral(p, ",\"baro_rate\":");
+        p = jsonInt(p, a->baro_rate);
+    }
+    if (trackDataValid(&a->geom_rate_valid)) {
+        p = jsonLiteral(p, ",\"geom_rate\":");
+        p = jsonInt(p, a->geom_rate);
+    }
+    if (trackDataValid(&a->squawk_valid)) {
+        p = jsonLiteral(p, ",\"squawk\":\"");
+        p = jsonHex(p, a->squawk, 4, 0);
+        *p++ = '"';
+    }
+    if (trackDataValid(&a->emergency_valid)) {
+        p = jsonLiteral(p, ",\"emergency\":");
+        p = jsonString(p, emergency_enum_string(a->emergency), 16);
+    }
+    if (a->category != 0) {
+        p = jsonLiteral(p, ",\"category\":\"");
+        p = jsonHex(p, a->category, 2, 1);
+        *p++ = '"';
+    }
+    if (trackDataValid(&a->nav_qnh_valid)) {
+        p = jsonLiteral(p, ",\"nav_qnh\":");
+        p = jsonFixed(p, a->nav_qnh, 1);
+    }
+    if (trackDataValid(&a->nav_altitude_mcp_valid)) {
+        p = jsonLiteral(p, ",\"nav_altitude_mcp\":");
+        p = jsonInt(p, (int) a->nav_altitude_mcp);
+    }
+    if (trackDataValid(&a->nav_altitude_fms_valid)) {
+        p = jsonLiteral(p, ",\"nav_altitude_fms\":");
+        p = jsonInt(p, (int) a->nav_altitude_fms);
+    }
+    if (trackDataValid(&a->nav_heading_valid)) {
+        p = jsonLiteral(p, ",\"nav_heading\":");
+        p = jsonFixed(p, a->nav_heading, 1);
+    }
+    if (trackDataValid(&a->nav_modes_valid)) {
+        char *start;
 
-    p = safe_snprintf(p, end,
-            "{ \"now\" : %.1f,\n"
-            "  \"messages\" : %u,\n"
-            "  \"aircraft\" : [",
-            now / 1000.0,
-            Modes.stats_current.messages_total + Modes.stats_alltime.messages_total);
+        p = jsonLiteral(p, ",\"nav_modes\":[");
+        start = p;
+        for (int i = 0; nav_modes_names[i].name; ++i) {
+            size_t len = strlen(nav_modes_names[i].name);
 
-    for (int j = 0; j < AIRCRAFTS_BUCKETS; j++) {
-        for (a = Modes.aircrafts[j]; a; a = a->next) {
-            if (a->messages < 2) { // basic filter for bad decodes
-                continue;
-            }
-            if ((now - a->seen) > 90E3) // don't include stale aircraft in the JSON
+            if (!(a->nav_modes & nav_modes_names[i].flag))
                 continue;
-
-            if (first)
-                first = 0;
-            else
+            if (p != start)
                 *p++ = ',';
-
-retry:
-            line_start = p;
-            p = safe_snprintf(p, end, "\n    {\"hex\":\"%s%06x\"", (a->addr & MODES_NON_ICAO_ADDRESS) ? "~" : "", a->addr & 0xFFFFFF);
-            if (a->addrtype != ADDR_ADSB_ICAO)
-                p = safe_snprintf(p, end, ",\"type\":\"%s\"", addrtype_enum_string(a->addrtype));
-            if (trackDataValid(&a->callsign_valid))
-                p = safe_snprintf(p, end, ",\"flight\":\"%s\"", jsonEscapeString(a->callsign));
-            if (trackDataValid(&a->airground_valid) && a->airground_valid.source >= SOURCE_MODE_S_CHECKED && a->airground == AG_GROUND)
-                p = safe_snprintf(p, end, ",\"alt_baro\":\"ground\"");
-            else {
-                if (trackDataValid(&a->altitude_baro_valid) && a->altitude_baro_reliable >= 3)
-                    p = safe_snprintf(p, end, ",\"alt_baro\":%d", a->altitude_baro);
-                if (trackDataValid(&a->altitude_geom_valid))
-                    p = safe_snprintf(p, end, ",\"alt_geom\":%d", a->altitude_geom);
-            }
-            if (trackDataValid(&a->gs_valid))
-                p = safe_snprintf(p, end, ",\"gs\":%.1f", a->gs);
-            if (trackDataValid(&a->ias_valid))
-                p = safe_snprintf(p, end, ",\"ias\":%u", a->ias);
-            if (trackDataValid(&a->tas_valid))
-                p = safe_snprintf(p, end, ",\"tas\":%u", a->tas);
-            if (trackDataValid(&a->mach_valid))
-                p = safe_snprintf(p, end, ",\"mach\":%.3f", a->mach);
-            if (trackDataValid(&a->track_valid))
-                p = safe_snprintf(p, end, ",\"track\":%.1f", a->track);
-            if (trackDataValid(&a->track_rate_valid))
-                p = safe_snprintf(p, end, ",\"track_rate\":%.2f", a->track_rate);
-            if (trackDataValid(&a->roll_valid))
-                p = safe_snprintf(p, end, ",\"roll\":%.1f", a->roll);
-            if (trackDataValid(&a->mag_heading_valid))
-                p = safe_snprintf(p, end, ",\"mag_heading\":%.1f", a->mag_heading);
-            if (trackDataValid(&a->true_heading_valid))
-                p = safe_snprintf(p, end, ",\"true_heading\":%.1f", a->true_heading);
-            if (trackDataValid(&a->baro_rate_valid))
-                p = safe_snprintf(p, end, ",\"baro_rate\":%d", a->baro_rate);
-            if (trackDataValid(&a->geom_rate_valid))
-                p = safe_snprintf(p, end, ",\"geom_rate\":%d", a->geom_rate);
-            if (trackDataValid(&a->squawk_valid))
-                p = safe_snprintf(p, end, ",\"squawk\":\"%04x\"", a->squawk);
-            if (trackDataValid(&a->emergency_valid))
-                p = safe_snprintf(p, end, ",\"emergency\":\"%s\"", emergency_enum_string(a->emergency));
-            if (a->category != 0)
-                p = safe_snprintf(p, end, ",\"category\":\"%02X\"", a->category);
-            if (trackDataValid(&a->nav_qnh_valid))
-                p = safe_snprintf(p, end, ",\"nav_qnh\":%.1f", a->nav_qnh);
-            if (trackDataValid(&a->nav_altitude_mcp_valid))
-                p = safe_snprintf(p, end, ",\"nav_altitude_mcp\":%d", a->nav_altitude_mcp);
-            if (trackDataValid(&a->nav_altitude_fms_valid))
-                p = safe_snprintf(p, end, ",\"nav_altitude_fms\":%d", a->nav_altitude_fms);
-            if (trackDataValid(&a->nav_heading_valid))
-                p = safe_snprintf(p, end, ",\"nav_heading\":%.1f", a->nav_heading);
-            if (trackDataValid(&a->nav_modes_valid)) {
-                p = safe_snprintf(p, end, ",\"nav_modes\":[");
-                p = append_nav_modes(p, end, a->nav_modes, "\"", ",");
-                p = safe_snprintf(p, end, "]");
-            }
-            if (trackDataValid(&a->position_valid))
-                p = safe_snprintf(p, end, ",\"lat\":%f,\"lon\":%f,\"nic\":%u,\"rc\":%u,\"seen_pos\":%.1f", a->lat, a->lon, a->pos_nic, a->pos_rc, (now - a->position_valid.updated) / 1000.0);
-            if (a->adsb_version >= 0)
-                p = safe_snprintf(p, end, ",\"version\":%d", a->adsb_version);
-            if (trackDataValid(&a->nic_baro_valid))
-                p = safe_snprintf(p, end, ",\"nic_baro\":%u", a->nic_baro);
-            if (trackDataValid(&a->nac_p_valid))
-                p = safe_snprintf(p, end, ",\"nac_p\":%u", a->nac_p);
-            if (trackDataValid(&a->nac_v_valid))
-                p = safe_snprintf(p, end, ",\"nac_v\":%u", a->nac_v);
-            if (trackDataValid(&a->sil_valid))
-                p = safe_snprintf(p, end, ",\"sil\":%u", a->sil);
-            if (a->sil_type != SIL_INVALID)
-                p = safe_snprintf(p, end, ",\"sil_type\":\"%s\"", sil_type_enum_string(a->sil_type));
-            if (trackDataValid(&a->gva_valid))
-                p = safe_snprintf(p, end, ",\"gva\":%u", a->gva);
-            if (trackDataValid(&a->sda_valid))
-                p = safe_snprintf(p, end, ",\"sda\":%u", a->sda);
-            if (trackDataValid(&a->alert_valid))
-                p = safe_snprintf(p, end, ",\"alert\":%u", a->alert);
-            if (trackDataValid(&a->spi_valid))
-                p = safe_snprintf(p, end, ",\"spi\":%u", a->spi);
-
-            p = safe_snprintf(p, end, ",\"mlat\":");
-            p = append_flags(p, end, a, SOURCE_MLAT);
-            p = safe_snprintf(p, end, ",\"tisb\":");
-            p = append_flags(p, end, a, SOURCE_TISB);
-
-            p = safe_snprintf(p, end, ",\"messages\":%ld,\"seen\":%.1f,\"rssi\":%.1f}",
-                    a->messages, (now - a->seen) / 1000.0,
-                    10 * log10((a->signalLevel[0] + a->signalLevel[1] + a->signalLevel[2] + a->signalLevel[3] +
-                            a->signalLevel[4] + a->signalLevel[5] + a->signalLevel[6] + a->signalLevel[7] + 1e-5) / 8));
-
-            if ((p + 10) >= end) { // +10 to leave some space for the final line
-                // overran the buffer
-                int used = line_start - buf;
-                buflen *= 2;
-                buf = (char *) realloc(buf, buflen);
-                p = buf + used;
-                end = buf + buflen;
-                goto retry;
-            }
+            *p++ = '"';
+            memcpy(p, nav_modes_names[i].name, len);
+            p += len;
+            *p++ = '"';
         }
+        *p++ = ']';
+    }
+    if (trackDataValid(&a->position_valid)) {
+        p = jsonLiteral(p, ",\"lat\":");
+        p = jsonFixed(p, a->lat, 6);
+        p = jsonLiteral(p, ",\"lon\":");
+        p = jsonFixed(p, a->lon, 6);
+        p = jsonLiteral(p, ",\"nic\":");
+        p = jsonUnsigned(p, a->pos_nic);
+        p = jsonLiteral(p, ",\"rc\":");
+        p = jsonUnsigned(p, a->pos_rc);
+        p = jsonLiteral(p, ",\"seen_pos\":");
+        p = jsonFixed(p, (now - a->position_valid.updated) / 1000.0, 1);
+    }
+    if (a->adsb_version >= 0) {
+        p = jsonLiteral(p, ",\"version\":");
+        p = jsonInt(p, a->adsb_version);
+    }
+    if (trackDataValid(&a->nic_baro_valid)) {
+        p = jsonLiteral(p, ",\"nic_baro\":");
+        p = jsonUnsigned(p, a->nic_baro);
+    }
+    if (trackDataValid(&a->nac_p_valid)) {
+        p = jsonLiteral(p, ",\"nac_p\":");
+        p = jsonUnsigned(p, a->nac_p);
+    }
+    if (trackDataValid(&a->nac_v_valid)) {
+        p = jsonLiteral(p, ",\"nac_v\":");
+        p = jsonUnsigned(p, a->nac_v);
+    }
+    if (trackDataValid(&a->sil_valid)) {
+        p = jsonLiteral(p, ",\"sil\":");
+        p = jsonUnsigned(p, a->sil);
+    }
+    if (a->sil_type != SIL_INVALID) {
+        p = jsonLiteral(p, ",\"sil_type\":");
+        p = jsonString(p, sil_type_enum_string(a->sil_type), 16);
+    }
+    if (trackDataValid(&a->gva_valid)) {
+        p = jsonLiteral(p, ",\"gva\":");
+        p = jsonUnsigned(p, a->gva);
+    }
+    if (trackDataValid(&a->sda_valid)) {
+        p = jsonLiteral(p, ",\"sda\":");
+        p = jsonUnsigned(p, a->sda);
+    }
+    if (trackDataValid(&a->alert_valid)) {
+        p = jsonLiteral(p, ",\"alert\":");
+        p = jsonUnsigned(p, a->alert);
+    }
+    if (trackDataValid(&a->spi_valid)) {
+        p = jsonLiteral(p, ",\"spi\":");
+        p = jsonUnsigned(p, a->spi);
     }
 
-    p = safe_snprintf(p, end, "\n  ]\n}\n");
+    p = jsonLiteral(p, ",\"mlat\":");
+    p = appendFlagsJson(p, a, SOURCE_MLAT);
+    p = jsonLiteral(p, ",\"tisb\":");
+    p = appendFlagsJson(p, a, SOURCE_TISB);
 
-    cb.len = p - buf;
-    cb.buffer = buf;
+    p = jsonLiteral(p, ",\"messages\":");
+    p = jsonInt(p, a->messages);
+    p = jsonLiteral(p, ",\"seen\":");
+    p = jsonFixed(p, (now - a->seen) / 1000.0, 1);
+    p = jsonLiteral(p, ",\"rssi\":");
+    p = jsonFixed(p, 10 * log10((a->signalLevel[0] + a->signalLevel[1] + a->signalLevel[2] + a->signalLevel[3] +
+            a->signalLevel[4] + a->signalLevel[5] + a->signalLevel[6] + a->signalLevel[7] + 1e-5) / 8), 1);
+    *p++ = '}';
+
+    return p;
+}
+
+// Is the aircraft listed in aircraft.json?
+int includeAircraftJson(struct aircraft *a, uint64_t now) {
+    if (a->messages < 2) // basic filter for bad decodes
+        return 0;
+    if ((now - a->seen) > 90E3) // don't include stale aircraft in the JSON
+        return 0;
+    return 1;
+}
+
+// Growing buffer for aircraft.json and its variants
+struct aircraft_json {
+    char *buf, *p, *end;
+    int buflen;
+    int first;
+};
+
+static void aircraftJsonStart(struct aircraft_json *j, int buflen, uint64_t now) {
+    j->buflen = buflen;
+    if (!(j->buf = j->p = (char *) malloc(buflen))) {
+        fprintf(stderr, "aircraft.json: out of memory\n");
+        exit(1);
+    }
+    j->end = j->buf + buflen;
+    j->first = 1;
+
+    j->p = safe_snprintf(j->p, j->end,
+            "{ \"now\" : %.1f,\n"
+            "  \"messages\" : %u,\n"
+            "  \"aircraft\" : [",
+            now / 1000.0,
+            Modes.stats_current.messages_total + Modes.stats_alltime.messages_total);
+}
+
+static void aircraftJsonAppend(struct aircraft_json *j, struct aircraft *a, uint64_t now) {
+    // Room for the separator, the object and the final line
+    if (j->end - j->p < AIRCRAFT_JSON_MAX + 16) {
+        int used = j->p - j->buf;
+        j->buflen *= 2;
+        if (!(j->buf = (char *) realloc(j->buf, j->buflen))) {
+            fprintf(stderr, "aircraft.json: out of memory\n");
+            exit(1);
+        }
+        j->p = j->buf + used;
+        j->end = j->buf + j->buflen;
+    }
+
+    if (j->first)
+        j->first = 0;
+    else
+        *j->p++ = ',';
+
+    j->p = jsonLiteral(j->p, "\n    ");
+    j->p = appendAircraftJson(j->p, a, now);
+}
+
+static struct char_buffer aircraftJsonFinish(struct aircraft_json *j) {
+    struct char_buffer cb;
+
+    j->p = safe_snprintf(j->p, j->end, "\n  ]\n}\n");
+
+    cb.len = j->p - j->buf;
+    cb.buffer = j->buf;
     return cb;
 }
 
+struct char_buffer generateAircraftJson(){
+    uint64_t now = mstime();
+    struct aircraft_json j;
+    struct aircraft *a;
+
+    _messageNow = now;
+
+    aircraftJsonStart(&j, 256*1024, now); // The initial buffer is resized as needed
+    for (int i = 0; i < AIRCRAFTS_BUCKETS; i++) {
+        for (a = Modes.aircrafts[i]; a; a = a->next) {
+            if (includeAircraftJson(a, now))
+                aircraftJsonAppend(&j, a, now);
+        }
+    }
+    return aircraftJsonFinish(&j);
+}
+
+// aircraft.json with only the aircraft positioned inside the box, see
+// trackQueryBox(). It costs about as much as the aircraft it lists.
+struct char_buffer generateAircraftJsonBox(double south, double west, double north, double east) {
+    uint64_t now = mstime();
+    struct aircraft_json j;
+    struct aircraft **list = NULL;
+    int n, max = 0;
+
+    _messageNow = now;
+
+    while ((n = trackQueryBox(south, west, north, east, list, max)) > max) {
+        max = n + 64;
+        free(list);
+        if (!(list = malloc(max * sizeof (*list)))) {
+            fprintf(stderr, "generateAircraftJsonBox: out of memory\n");
+            exit(1);
+        }
+    }
+
+    aircraftJsonStart(&j, 1024 + n * 512, now);
+    for (int i = 0; i < n; i++) {
+        if (includeAircraftJson(list[i], now))
+            aircraftJsonAppend(&j, list[i], now);
+    }
+    free(list);
+    return aircraftJsonFinish(&j);
+}
+
+//
+//=========================================================================
+//
+// json_dir/tiles: aircraft.json split by position into tiles of json_tiles
+// degrees, <south>_<west>.json, so a map only loads what is in view. A
+// tile is only rewritten when an aircraft in it was updated or came or
+// went; index.json lists the tiles that hold aircraft with the generation
+// they were last written in.
+//
+struct json_tile {
+    uint32_t count;
+    uint32_t version; // generation the tile was last written in
+    uint32_t visited; // generation it last held aircraft in
+    uint64_t sig; // which aircraft are in it
+    uint64_t seen; // latest message of any of them
+};
+
+struct tile_entry {
+    int tile;
+    struct aircraft *a;
+};
+
+static struct json_tile *json_tiles;
+static uint32_t tile_generation;
+
+static int compareTileEntries(const void *a, const void *b) {
+    const struct tile_entry *x = a, *y = b;
+    return (x->tile > y->tile) - (x->tile < y->tile);
+}
+
+static void tileName(char *buf, size_t size, int tile) {
+    int cols = 360 / Modes.json_tiles;
+    snprintf(buf, size, "%d_%d", tile / cols * Modes.json_tiles - 90, tile % cols * Modes.json_tiles - 180);
+}
+
+void writeJsonTiles(uint64_t now) {
+    int rows = 180 / Modes.json_tiles, cols = 360 / Modes.json_tiles;
+    struct tile_entry *entries;
+    struct aircraft *a;
+    struct char_buffer cb;
+    char name[32], file[64], path[PATH_MAX];
+    int n = 0, i, start;
+    char *buf, *p, *end;
+    size_t buflen;
+
+    _messageNow = now;
+
+    if (!json_tiles) {
+        struct dirent *e;
+        DIR *dir;
+
+        if (!(json_tiles = calloc(rows * cols, sizeof (*json_tiles)))) {
+            fprintf(stderr, "writeJsonTiles: out of memory\n");
+            exit(1);
+        }
+        snprintf(path, PATH_MAX, "%s/tiles", Modes.json_dir);
+        mkdir(path, 0755);
+
+        // Don't leave tiles of the last run around
+        if ((dir = opendir(path))) {
+            while ((e = readdir(dir))) {
+                if (strstr(e->d_name, ".json"))
+                    unlinkat(dirfd(dir), e->d_name, 0);
+            }
+            closedir(dir);
+        }
+    }
+    tile_generation++;
+
+    for (int j = 0; j < AIRCRAFTS_BUCKETS; j++)
+        for (a = Modes.aircrafts[j]; a; a = a->next)
+            n++;
+    if (!(entries = malloc((n ? n : 1) * sizeof (*entries)))) {
+        fprintf(stderr, "writeJsonTiles: out of memory\n");
+        exit(1);
+    }
+
+    n = 0;
+    for (int j = 0; j < AIRCRAFTS_BUCKETS; j++) {
+        for (a = Modes.aircrafts[j]; a; a = a->next) {
+            int row, col;
+
+            if (!includeAircraftJson(a, now) || !trackDataValid(&a->position_valid))
+                continue;
+            row = (int) floor((a->lat + 90) / Modes.json_tiles);
+            col = (int) floor((a->lon + 180) / Modes.json_tiles);
+            entries[n].tile = (row < 0 ? 0 : row >= rows ? rows - 1 : row) * cols + (col % cols + cols) % cols;
+            entries[n].a = a;
+            n++;
+        }
+    }
+    qsort(entries, n, sizeof (*entries), compareTileEntries);
+
+    for (start = 0; start < n; start = i) {
+        struct json_tile *t = &json_tiles[entries[start].tile];
+        uint64_t sig = 0, seen = 0;
+
+        for (i = start; i < n && entries[i].tile == entries[start].tile; i++) {
+            sig += entries[i].a->addr * 0x9E3779B97F4A7C15ULL;
+            if (entries[i].a->seen > seen)
+                seen = entries[i].a->seen;
+        }
+
+        t->visited = tile_generation;
+        if (t->count == (uint32_t) (i - start) && t->sig == sig && t->seen == seen)
+            continue;
+
+        struct aircraft_json j;
+        aircraftJsonStart(&j, 1024 + (i - start) * 512, now);
+        for (int k = start; k < i; k++)
+            aircraftJsonAppend(&j, entries[k].a, now);
+        tileName(name, sizeof (name), entries[start].tile);
+        snprintf(file, sizeof (file), "tiles/%s.json", name);
+        writeJsonToFile(file, aircraftJsonFinish(&j));
+
+        t->count = i - start;
+        t->sig = sig;
+        t->seen = seen;
+        t->version = tile_generation;
+    }
+    free(entries);
+
+    buflen = 1024 + (size_t) n * 32;
+    if (!(p = buf = malloc(buflen))) {
+        fprintf(stderr, "writeJsonTiles: out of memory\n");
+        exit(1);
+    }
+    end = buf + buflen;
+    p = safe_snprintf(p, end, "{ \"now\" : %.1f,\n  \"messages\" : %u,\n  \"size\" : %d,\n  \"tiles\" : {",
+            now / 1000.0, Modes.stats_current.messages_total + Modes.stats_alltime.messages_total, Modes.json_tiles);
+
+    for (i = 0; i < rows * cols; i++) {
+        struct json_tile *t = &json_tiles[i];
+
+        if (!t->count)
+            continue;
+
+        tileName(name, sizeof (name), i);
+
+        // Emptied since the last time
+        if (t->visited != tile_generation) {
+            snprintf(path, PATH_MAX, "%s/tiles/%s.json", Modes.json_dir, name);
+            unlink(path);
+            t->count = 0;
+            continue;
+        }
+
+        p = safe_snprintf(p, end, "%s\n    \"%s\" : %u", p[-1] == '{' ? "" : ",", name, t->version);
+    }
+    p = safe_snprintf(p, end, "\n  }\n}\n");
+
+    cb.len = p - buf;
+    cb.buffer = buf;
+    writeJsonToFile("tiles/index.json", cb);
+}
+
 static char * appendStatsJson(char *p,
         char *end,
         struct stats *st,
@@ -2070,7 +2713,41 @@ static char * appendStatsJson(char *p,
             else p = safe_snprintf(p, end, ",%u", st->remote_accepted[i]);
         }
 
-        p = safe_snprintf(p, end, "]}");
+        p = safe_snprintf(p, end, "]");
+
+        if (Modes.net_input_beast_udp) {
+            p = safe_snprintf(p, end,
+                    ",\"udp\":{\"datagrams\":%u"
+                    ",\"lost\":%u"
+                    ",\"reordered\":%u"
+                    ",\"late\":%u}",
+                    st->remote_udp_datagrams,
+                    st->remote_udp_lost,
+                    st->remote_udp_reordered,
+                    st->remote_udp_late);
+        }
+
+        p = safe_snprintf(p, end, "}");
+
+        p = safe_snprintf(p, end,
+                ",\"shed\":{\"low\":%u"
+                ",\"normal\":%u"
+                ",\"high\":%u}",
+                st->shed_low,
+                st->shed_normal,
+                st->shed_high);
+
+        p = safe_snprintf(p, end,
+                ",\"beast_reduce\":{\"frames\":%u"
+                ",\"full_frames\":%u"
+                ",\"bytes\":%u"
+                ",\"full_bytes\":%u"
+                ",\"compression\":%.2f}",
+                st->beast_reduce_frames,
+                st->beast_full_frames,
+                st->beast_reduce_bytes,
+                st->beast_full_bytes,
+                st->beast_reduce_bytes ? (double) st->beast_full_bytes / st->beast_reduce_bytes : 0.0);
     }
 
     {
@@ -2098,6 +2775,7 @@ static char * appendStatsJson(char *p,
                 ",\"tracks\":{\"all\":%u"
                 ",\"single_message\":%u}"
                 ",\"messages\":%u"
+                ",\"messages_header_only\":%u"
                 ",\"max_distance_in_metres\":%ld"
                 ",\"max_distance_in_nautical_miles\":%.1lf}",
                 st->cpr_surface,
@@ -2121,140 +2799,573 @@ static char * appendStatsJson(char *p,
                 st->unique_aircraft,
                 st->single_message_aircraft,
                 st->messages_total,
+                st->messages_header_only,
                 (long) st->longest_distance,
                 st->longest_distance / 1852.0);
     }
 
-    return p;
+    return p;
+}
+
+struct char_buffer generateStatsJson() {
+    struct char_buffer cb;
+    struct stats add;
+    struct net_service *s;
+    struct client *c;
+    int clients = 0;
+
+    for (s = Modes.services; s; s = s->next) {
+        if (s->writer || s->read_mode == READ_MODE_BEAST)
+            clients += s->connections;
+    }
+
+    int buflen = 8192 + clients * (256 + NI_MAXHOST);
+    char *buf = (char *) malloc(buflen), *p = buf, *end = buf + buflen;
+
+    p = safe_snprintf(p, end, "{\n");
+    p = appendStatsJson(p, end, &Modes.stats_periodic, "latest");
+    p = safe_snprintf(p, end, ",\n");
+
+    p = appendStatsJson(p, end, &Modes.stats_1min[Modes.stats_latest_1min], "last1min");
+    p = safe_snprintf(p, end, ",\n");
+
+    p = appendStatsJson(p, end, &Modes.stats_5min, "last5min");
+    p = safe_snprintf(p, end, ",\n");
+
+    p = appendStatsJson(p, end, &Modes.stats_15min, "last15min");
+    p = safe_snprintf(p, end, ",\n");
+
+    add_stats(&Modes.stats_alltime, &Modes.stats_current, &add);
+    p = appendStatsJson(p, end, &add, "total");
+
+    // per output client backpressure
+    if (Modes.net) {
+        const char *sep = "\n";
+        p = safe_snprintf(p, end, ",\n\"clients\":[");
+        for (s = Modes.services; s; s = s->next) {
+            if (!s->writer)
+                continue;
+            for (c = s->clients; c; c = c->next) {
+                if (!c->service)
+                    continue;
+                p = safe_snprintf(p, end, "%s{\"service\":\"%s\",\"host\":\"%s\",\"port\":\"%s\""
+                        ",\"sendq\":%d,\"shed\":{\"low\":%u,\"normal\":%u,\"high\":%u}}",
+                        sep, s->descr, jsonEscapeString(c->host), c->port, c->sendq_len,
+                        c->shed[SHED_LOW], c->shed[SHED_NORMAL], c->shed[SHED_HIGH]);
+                sep = ",\n";
+            }
+        }
+        p = safe_snprintf(p, end, "]");
+
+        // per Beast input receiver clock
+        sep = "\n";
+        p = safe_snprintf(p, end, ",\n\"inputs\":[");
+        for (s = Modes.services; s; s = s->next) {
+            if (s->read_mode != READ_MODE_BEAST)
+                continue;
+            for (c = s->clients; c; c = c->next) {
+                if (!c->service || !(c->clock.frames || c->clock.jumps))
+                    continue;
+                p = safe_snprintf(p, end, "%s{\"service\":\"%s\",\"host\":\"%s\",\"port\":\"%s\""
+                        ",\"kernel_timestamps\":%s,\"frames\":%u,\"clock_offset\":%.3f"
+                        ",\"clock_drift_ppm\":%.1f,\"jitter\":%.3f,\"clock_jumps\":%u}",
+                        sep, s->descr, jsonEscapeString(c->host), c->port,
+                        c->rx_timestamps ? "true" : "false", c->clock.frames, c->clock.offset,
+                        clientClockDrift(c), c->clock.jitter, c->clock.jumps);
+                sep = ",\n";
+            }
+        }
+        p = safe_snprintf(p, end, "]");
+    }
+
+    p = safe_snprintf(p, end, "\n}\n");
+
+    assert(p < end);
+
+    cb.len = p - buf;
+    cb.buffer = buf;
+    return cb;
+}
+
+//
+// Return a description of the receiver in json.
+//
+struct char_buffer generateReceiverJson() {
+    struct char_buffer cb;
+    char *buf = (char *) malloc(1024), *p = buf;
+
+    p += snprintf(p, 1024, "{ " \
+            "\"version\" : \"%s\", "
+            "\"refresh\" : %.0f, "
+            "\"history\" : %d",
+            MODES_READSB_VERSION, 1.0 * Modes.json_interval, historyCount());
+
+    if (Modes.json_tiles)
+        p += snprintf(p, 1024, ", \"tiles\" : %d", Modes.json_tiles);
+
+    if (Modes.json_location_accuracy && (Modes.fUserLat != 0.0 || Modes.fUserLon != 0.0)) {
+        if (Modes.json_location_accuracy == 1) {
+            p += snprintf(p, 1024, ", "                \
+                    "\"lat\" : %.2f, "
+                    "\"lon\" : %.2f",
+                    Modes.fUserLat, Modes.fUserLon); // round to 2dp - about 0.5-1km accuracy - for privacy reasons
+        } else {
+            p += snprintf(p, 1024, ", "                \
+                    "\"lat\" : %.6f, "
+                    "\"lon\" : %.6f",
+                    Modes.fUserLat, Modes.fUserLon); // exact location
+        }
+    }
+
+    p += snprintf(p, 1024, " }\n");
+
+    cb.len = p - buf;
+    cb.buffer = buf;
+    return cb;
+}
+
+// Write to json_dir/file, replacing it in one go
+static void writeFile (const char *file, const char *content, int len) {
+#ifndef _WIN32
+    char pathbuf[PATH_MAX];
+    char tmppath[PATH_MAX];
+    int fd;
+    mode_t mask;
+
+    if (!Modes.json_dir)
+        return;
+
+    snprintf(tmppath, PATH_MAX, "%s/%s.XXXXXX", Modes.json_dir, file);
+    tmppath[PATH_MAX - 1] = 0;
+    fd = mkstemp(tmppath);
+    if (fd < 0)
+        return;
+
+    mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0644 & ~mask);
+
+    if (write(fd, content, len) != len)
+        goto error_1;
+
+    if (close(fd) < 0)
+        goto error_2;
+
+    snprintf(pathbuf, PATH_MAX, "%s/%s", Modes.json_dir, file);
+    pathbuf[PATH_MAX - 1] = 0;
+    rename(tmppath, pathbuf);
+    return;
+
+error_1:
+    close(fd);
+error_2:
+    unlink(tmppath);
+    return;
+#else
+    MODES_NOTUSED(file);
+    MODES_NOTUSED(content);
+    MODES_NOTUSED(len);
+#endif
+}
+
+// Write JSON to file
+void writeJsonToFile (const char *file, struct char_buffer cb) {
+    writeFile(file, cb.buffer, cb.len);
+    free(cb.buffer);
+}
+
+//
+//=========================================================================
+//
+// receiver.json and stats.json, rendered when what they show changes and
+// shared by every reader in between
+//
+static struct {
+    const char *file;
+    struct char_buffer (*generate)(void);
+    struct json_cache cache;
+    int stale;
+} cached_json[JSON_CACHED] = {
+    { "receiver.json", generateReceiverJson, { { NULL, 0 }, 0 }, 1 },
+    { "stats.json", generateStatsJson, { { NULL, 0 }, 0 }, 1 },
+};
+
+static void renderCachedJson(json_cached_t which) {
+    free(cached_json[which].cache.cb.buffer);
+    cached_json[which].cache.cb = cached_json[which].generate();
+    cached_json[which].cache.version++;
+    cached_json[which].stale = 0;
+}
+
+// What the document shows changed. With a json dir it is rendered and
+// written out now, otherwise when it is next asked for.
+void updateCachedJson(json_cached_t which) {
+    if (!Modes.json_dir) {
+        cached_json[which].stale = 1;
+        return;
+    }
+
+    renderCachedJson(which);
+    writeFile(cached_json[which].file, cached_json[which].cache.cb.buffer, cached_json[which].cache.cb.len);
+}
+
+const struct json_cache *cachedJson(json_cached_t which) {
+    if (cached_json[which].stale)
+        renderCachedJson(which);
+    return &cached_json[which].cache;
+}
+
+static void periodicReadFromClient(struct client *c) {
+    int nread, err;
+    char buf[512];
+
+    /* FIXME:  Not Win32 safe networking */
+    nread = read(c->fd, buf, sizeof(buf));
+    err = errno;
+
+    if (nread < 0 && (err == EAGAIN || err == EWOULDBLOCK)) {
+	return;
+    }
+    if (nread <= 0) { // Other errors, or EOF
+        fprintf(stderr, "%s: Socket Error: %s: %s port %s (fd %d)\n",
+                c->service->descr, nread < 0 ? strerror(err) : "EOF", c->host, c->port,
+                c->fd);
+        modesCloseClient(c);
+        return;
+    }
+}
+
+//
+//=========================================================================
+//
+// Pass the complete Beast frames in [som, eod) to the client's handler.
+// Returns a pointer to the first unprocessed byte, or NULL if the
+// handler asked for the client to be closed (it has been).
+//
+static char *readBeastFrames(struct client *c, char *som, char *eod, int remote) {
+    char *p;
+
+    // This is the Beast Binary scanning case.
+    // If there is a complete message still in the buffer, there must be the separator 'sep'
+    // in the buffer, note that we full-scan the buffer at every read for simplicity.
+
+    while (som < eod && ((p = memchr(som, (char) 0x1a, eod - som)) != NULL)) { // The first byte of buffer 'should' be 0x1a
+
+        Modes.stats_current.remote_rejected_bad += ((p - som)/(8 + MODES_SHORT_MSG_BYTES));
+        som = p; // consume garbage up to the 0x1a
+        ++p; // skip 0x1a
+
+        if (p >= eod) {
+            // Incomplete message in buffer, retry later
+            break;
+        }
+
+        char *eom; // one byte past end of message
+        if (*p == '1') {
+            eom = p + MODEAC_MSG_BYTES + 8; // point past remainder of message
+        } else if (*p == '2') {
+            eom = p + MODES_SHORT_MSG_BYTES + 8;
+        } else if (*p == '3') {
+            eom = p + MODES_LONG_MSG_BYTES + 8;
+        } else if (*p == '4') {
+            eom = p + MODES_LONG_MSG_BYTES + 8;
+        } else if (*p == '5') {
+            eom = p + MODES_LONG_MSG_BYTES + 8;
+        } else {
+            // Not a valid beast message, skip 0x1a and try again
+            ++som;
+            continue;
+        }
+
+        // we need to be careful of double escape characters in the message body
+        for (p = som + 1; p < eod && p < eom; p++) {
+            if (0x1A == *p) {
+                p++;
+                eom++;
+            }
+        }
+
+        if (eom > eod) { // Incomplete message in buffer, retry later
+            break;
+        }
+
+
+        // Have a 0x1a followed by 1/2/3/4/5 - pass message to handler.
+        if (c->service->read_handler(c, som + 1, remote)) {
+            modesCloseClient(c);
+            return NULL;
+        }
+
+        // advance to next message
+        som = eom;
+    }
+
+    return som;
+}
+
+//
+//=========================================================================
+//
+// Beast UDP input. Datagrams from each sender are delivered in sequence
+// order; early ones are held back until the gap before them fills, the
+// window overflows, or BEAST_UDP_REORDER_TIMEOUT passes.
+//
+static void udpDeliver(struct client *c, char *data, int len) {
+    // datagrams carry whole frames, so nothing is carried over
+    readBeastFrames(c, data, data + len, 1);
+}
+
+// Deliver held datagrams that are next in sequence
+static void udpAdvance(struct client *c, struct udp_source *src, uint64_t now) {
+    int advanced = 0;
+
+    while (src->held_count && c->service) {
+        struct udp_held *h = &src->held[src->expected % BEAST_UDP_WINDOW];
+        if (!h->len)
+            break;
+
+        udpDeliver(c, h->data, h->len);
+        h->len = 0;
+        src->held_count--;
+        src->expected++;
+        advanced = 1;
+    }
+
+    if (advanced)
+        src->hold_since = now;
 }
 
-struct char_buffer generateStatsJson() {
-    struct char_buffer cb;
-    struct stats add;
-    char *buf = (char *) malloc(8192), *p = buf, *end = buf + 8192;
+// Give up on the next datagram in sequence, delivering it if held
+static void udpSkip(struct client *c, struct udp_source *src) {
+    struct udp_held *h = &src->held[src->expected % BEAST_UDP_WINDOW];
 
-    p = safe_snprintf(p, end, "{\n");
-    p = appendStatsJson(p, end, &Modes.stats_periodic, "latest");
-    p = safe_snprintf(p, end, ",\n");
+    if (h->len) {
+        udpDeliver(c, h->data, h->len);
+        h->len = 0;
+        src->held_count--;
+    } else {
+        Modes.stats_current.remote_udp_lost++;
+    }
+    src->expected++;
+}
 
-    p = appendStatsJson(p, end, &Modes.stats_1min[Modes.stats_latest_1min], "last1min");
-    p = safe_snprintf(p, end, ",\n");
+static void udpReceive(struct client *c, struct udp_source *src, uint32_t seq, char *data, int len, uint64_t now) {
+    int32_t d;
 
-    p = appendStatsJson(p, end, &Modes.stats_5min, "last5min");
-    p = safe_snprintf(p, end, ",\n");
+    if (!src->active) {
+        src->active = 1;
+        src->expected = seq;
+    }
 
-    p = appendStatsJson(p, end, &Modes.stats_15min, "last15min");
-    p = safe_snprintf(p, end, ",\n");
+    d = (int32_t) (seq - src->expected);
+    if (d <= -BEAST_UDP_RESYNC || d >= BEAST_UDP_RESYNC) {
+        // the sender restarted, or we were cut off for a long time
+        for (int i = 0; i < BEAST_UDP_WINDOW; ++i)
+            src->held[i].len = 0;
+        src->held_count = 0;
+        src->expected = seq;
+    } else if (d < 0) {
+        Modes.stats_current.remote_udp_late++;
+        return;
+    }
 
-    add_stats(&Modes.stats_alltime, &Modes.stats_current, &add);
-    p = appendStatsJson(p, end, &add, "total");
-    p = safe_snprintf(p, end, "\n}\n");
+    // no room to hold this one: stop waiting for the oldest gaps
+    if ((int32_t) (seq - src->expected) >= BEAST_UDP_WINDOW) {
+        while ((int32_t) (seq - src->expected) >= BEAST_UDP_WINDOW)
+            udpSkip(c, src);
+        udpAdvance(c, src, now);
+    }
 
-    assert(p < end);
+    if (seq == src->expected) {
+        udpDeliver(c, data, len);
+        src->expected++;
+        src->hold_since = now;
+        udpAdvance(c, src, now);
+        return;
+    }
 
-    cb.len = p - buf;
-    cb.buffer = buf;
-    return cb;
+    struct udp_held *h = &src->held[seq % BEAST_UDP_WINDOW];
+    if (h->len) {
+        // duplicate
+        Modes.stats_current.remote_udp_late++;
+        return;
+    }
+
+    if (!src->held_count)
+        src->hold_since = now;
+    memcpy(h->data, data, len);
+    h->len = len;
+    h->seq = seq;
+    src->held_count++;
+    Modes.stats_current.remote_udp_reordered++;
 }
 
-//
-// Return a description of the receiver in json.
-//
-struct char_buffer generateReceiverJson() {
-    struct char_buffer cb;
-    char *buf = (char *) malloc(1024), *p = buf;
+static struct udp_source *udpFindSource(struct udp_input *in, struct sockaddr_storage *addr, socklen_t addr_len) {
+    struct udp_source *victim = NULL;
 
-    p += snprintf(p, 1024, "{ " \
-            "\"version\" : \"%s\", "
-            "\"refresh\" : %.0f, "
-            "\"history\" : %d",
-            MODES_READSB_VERSION, 1.0 * Modes.json_interval, Modes.json_aircraft_history_next + 1 );
+    for (int i = 0; i < BEAST_UDP_MAX_SOURCES; ++i) {
+        struct udp_source *src = &in->sources[i];
+        if (src->active && src->addr_len == addr_len && !memcmp(&src->addr, addr, addr_len))
+            return src;
+        if (!victim || (victim->active && (!src->active || src->last_seen < victim->last_seen)))
+            victim = src;
+    }
 
-    if (Modes.json_location_accuracy && (Modes.fUserLat != 0.0 || Modes.fUserLon != 0.0)) {
-        if (Modes.json_location_accuracy == 1) {
-            p += snprintf(p, 1024, ", "                \
-                    "\"lat\" : %.2f, "
-                    "\"lon\" : %.2f",
-                    Modes.fUserLat, Modes.fUserLon); // round to 2dp - about 0.5-1km accuracy - for privacy reasons
-        } else {
-            p += snprintf(p, 1024, ", "                \
-                    "\"lat\" : %.6f, "
-                    "\"lon\" : %.6f",
-                    Modes.fUserLat, Modes.fUserLon); // exact location
+    // new sender: take a free slot, or the one heard from least recently
+    memset(victim, 0, sizeof (*victim));
+    memcpy(&victim->addr, addr, addr_len);
+    victim->addr_len = addr_len;
+    return victim;
+}
+
+static void modesReadDatagrams(struct client *c) {
+    char buf[BEAST_UDP_HEADER_LEN + BEAST_UDP_PAYLOAD + 1]; // +1 to notice oversized datagrams
+    unsigned char *header = (unsigned char *) buf;
+    uint64_t now = mstime();
+
+    for (int loop = 0; loop < 64 && c->service; ++loop) {
+        struct sockaddr_storage addr;
+        socklen_t addr_len = sizeof (addr);
+        ssize_t nread = recvfrom(c->fd, buf, sizeof (buf), 0, (struct sockaddr *) &addr, &addr_len);
+
+        if (nread < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                fprintf(stderr, "%s: Receive Error: %s\n", c->service->descr, strerror(errno));
+            }
+            break;
+        }
+
+        if (nread < BEAST_UDP_HEADER_LEN || nread > BEAST_UDP_HEADER_LEN + BEAST_UDP_PAYLOAD ||
+                header[0] != 0x1a || header[1] != 'U' || header[2] != BEAST_UDP_VERSION) {
+            Modes.stats_current.remote_rejected_bad++;
+            continue;
         }
+
+        Modes.stats_current.remote_udp_datagrams++;
+
+        struct udp_source *src = udpFindSource(c->udp, &addr, addr_len);
+        uint32_t seq = (uint32_t) header[4] << 24 | header[5] << 16 | header[6] << 8 | header[7];
+        src->last_seen = now;
+        udpReceive(c, src, seq, buf + BEAST_UDP_HEADER_LEN, nread - BEAST_UDP_HEADER_LEN, now);
     }
 
-    p += snprintf(p, 1024, " }\n");
+    // stop waiting for datagrams that aren't coming
+    for (int i = 0; i < BEAST_UDP_MAX_SOURCES && c->service; ++i) {
+        struct udp_source *src = &c->udp->sources[i];
+        if (!src->held_count || src->hold_since + BEAST_UDP_REORDER_TIMEOUT > now)
+            continue;
 
-    cb.len = p - buf;
-    cb.buffer = buf;
-    return cb;
+        while (src->held_count && !src->held[src->expected % BEAST_UDP_WINDOW].len) {
+            Modes.stats_current.remote_udp_lost++;
+            src->expected++;
+        }
+        udpAdvance(c, src, now);
+    }
 }
 
-// Write JSON to file
-void writeJsonToFile (const char *file, struct char_buffer cb) {
 #ifndef _WIN32
-    char pathbuf[PATH_MAX];
-    char tmppath[PATH_MAX];
-    int fd;
-    int len = cb.len;
-    mode_t mask;
-    char *content = cb.buffer;
+// read() that also picks up the kernel receive timestamp, if there is one
+static int readTimestamped(struct client *c, char *buf, int len) {
+    struct iovec iov = { buf, len };
+    char control[CMSG_SPACE(sizeof (struct timespec))];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int nread;
 
-    if (!Modes.json_dir) {
-        free(content);
-        return;
+    memset(&msg, 0, sizeof (msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof (control);
+
+    if ((nread = recvmsg(c->fd, &msg, 0)) <= 0)
+        return nread;
+
+    c->rx_time = 0;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+#ifdef SCM_TIMESTAMPNS
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof (ts));
+            c->rx_time = (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        }
+#endif
     }
+    return nread;
+}
+#endif
 
-    snprintf(tmppath, PATH_MAX, "%s/%s.XXXXXX", Modes.json_dir, file);
-    tmppath[PATH_MAX - 1] = 0;
-    fd = mkstemp(tmppath);
-    if (fd < 0) {
-        free(content);
-        return;
-    }
+// When the data being processed arrived, in milliseconds
+static uint64_t clientReceiveTime(struct client *c) {
+    return c->rx_time ? c->rx_time / 1000 : mstime();
+}
 
-    mask = umask(0);
-    umask(mask);
-    fchmod(fd, 0644 & ~mask);
+// How much more time passed for us than for the receiver between two
+// frames, in ms. The receiver clock is 48 bits and may have wrapped.
+static double clockSpan(uint64_t received, uint64_t received0, uint64_t timestamp, uint64_t timestamp0) {
+    int64_t ticks = (int64_t) ((timestamp - timestamp0) << 16) >> 16;
 
-    if (write(fd, content, len) != len)
-        goto error_1;
+    return (int64_t) (received - received0) / 1000.0 - ticks / 12000.0;
+}
 
-    if (close(fd) < 0)
-        goto error_2;
+// Compare a remote receiver's 12 MHz clock with when we got its frames.
+//
+// The jitter is the RFC 3550 interarrival jitter: how much the spacing of
+// arrivals differs from the spacing of the receiver timestamps. The offset
+// is how far our clock has moved against the receiver's since the estimate
+// started; divided by the time since then it gives the clock rate error.
+// A jump of more than a second (receiver restart, GPS midnight rollover,
+// bad clock) restarts the estimate.
+static void clientClockUpdate(struct client *c, uint64_t timestamp) {
+    struct input_clock *clk = &c->clock;
+    uint64_t received = c->rx_time ? c->rx_time : mstime() * 1000;
+
+    if (timestamp == 0 || timestamp == MAGIC_MLAT_TIMESTAMP)
+        return;
 
-    snprintf(pathbuf, PATH_MAX, "%s/%s", Modes.json_dir, file);
-    pathbuf[PATH_MAX - 1] = 0;
-    rename(tmppath, pathbuf);
-    free(content);
-    return;
+    if (clk->frames) {
+        double d = clockSpan(received, clk->last_received, timestamp, clk->last_timestamp);
 
-error_1:
-    close(fd);
-error_2:
-    unlink(tmppath);
-    free(content);
-    return;
-#endif
+        if (fabs(d) > 1000) {
+            clk->jumps++;
+            clk->frames = 0;
+        } else {
+            double offset = clockSpan(received, clk->base_received, timestamp, clk->base_timestamp);
+            clk->jitter += (fabs(d) - clk->jitter) / 16;
+            clk->offset += (offset - clk->offset) / 16;
+        }
+    }
+
+    if (!clk->frames) {
+        clk->base_timestamp = timestamp;
+        clk->base_received = received;
+        clk->offset = 0;
+    }
+
+    clk->last_timestamp = timestamp;
+    clk->last_received = received;
+    clk->frames++;
 }
-static void periodicReadFromClient(struct client *c) {
-    int nread, err;
-    char buf[512];
 
-    /* FIXME:  Not Win32 safe networking */
-    nread = read(c->fd, buf, sizeof(buf));
-    err = errno;
+// Clock rate error of a remote receiver in parts per million
+static double clientClockDrift(struct client *c) {
+    double span = (int64_t) (c->clock.last_received - c->clock.base_received) / 1000.0;
 
-    if (nread < 0 && (err == EAGAIN || err == EWOULDBLOCK)) {
-	return;
-    }
-    if (nread <= 0) { // Other errors, or EOF
-        fprintf(stderr, "%s: Socket Error: %s: %s port %s (fd %d)\n",
-                c->service->descr, nread < 0 ? strerror(err) : "EOF", c->host, c->port,
-                c->fd);
-        modesCloseClient(c);
-        return;
+    return (span > 0 ? c->clock.offset / span * 1e6 : 0);
+}
+
+// List the receiver clock estimates of the Beast inputs, for --stats
+void displayInputClocks(void) {
+    for (struct net_service *s = Modes.services; s; s = s->next) {
+        if (s->read_mode != READ_MODE_BEAST)
+            continue;
+        for (struct client *c = s->clients; c; c = c->next) {
+            if (!c->service || !(c->clock.frames || c->clock.jumps))
+                continue;
+            printf("  %s %s port %s: clock offset %+.1f ms (%+.1f ppm), jitter %.2f ms, %u clock jumps%s\n",
+                    s->descr, c->host, c->port, c->clock.offset, clientClockDrift(c),
+                    c->clock.jitter, c->clock.jumps, c->rx_timestamps ? "" : " (no kernel timestamps)");
+        }
     }
 }
 
@@ -2279,6 +3390,11 @@ static void modesReadFromClient(struct client *c) {
     int bContinue = 1;
     int loop = 0;
 
+    if (c->udp) {
+        modesReadDatagrams(c);
+        return;
+    }
+
     while (bContinue && loop++ < 10) {
         left = MODES_CLIENT_BUF_SIZE - c->buflen - 1; // leave 1 extra byte for NUL termination in the ASCII case
 
@@ -2289,7 +3405,10 @@ static void modesReadFromClient(struct client *c) {
             // If there is garbage, read more to discard it ASAP
         }
 #ifndef _WIN32
-        nread = read(c->fd, c->buf + c->buflen, left);
+        if (c->rx_timestamps)
+            nread = readTimestamped(c, c->buf + c->buflen, left);
+        else
+            nread = read(c->fd, c->buf + c->buflen, left);
         int err = errno;
 #else
         nread = recv(c->fd, c->buf + c->buflen, left, 0);
@@ -2350,60 +3469,8 @@ static void modesReadFromClient(struct client *c) {
                 break;
 
             case READ_MODE_BEAST:
-                // This is the Beast Binary scanning case.
-                // If there is a complete message still in the buffer, there must be the separator 'sep'
-                // in the buffer, note that we full-scan the buffer at every read for simplicity.
-
-                while (som < eod && ((p = memchr(som, (char) 0x1a, eod - som)) != NULL)) { // The first byte of buffer 'should' be 0x1a
-
-                    Modes.stats_current.remote_rejected_bad += ((p - som)/(8 + MODES_SHORT_MSG_BYTES));
-                    som = p; // consume garbage up to the 0x1a
-                    ++p; // skip 0x1a
-
-                    if (p >= eod) {
-                        // Incomplete message in buffer, retry later
-                        break;
-                    }
-
-                    char *eom; // one byte past end of message
-                    if (*p == '1') {
-                        eom = p + MODEAC_MSG_BYTES + 8; // point past remainder of message
-                    } else if (*p == '2') {
-                        eom = p + MODES_SHORT_MSG_BYTES + 8;
-                    } else if (*p == '3') {
-                        eom = p + MODES_LONG_MSG_BYTES + 8;
-                    } else if (*p == '4') {
-                        eom = p + MODES_LONG_MSG_BYTES + 8;
-                    } else if (*p == '5') {
-                        eom = p + MODES_LONG_MSG_BYTES + 8;
-                    } else {
-                        // Not a valid beast message, skip 0x1a and try again
-                        ++som;
-                        continue;
-                    }
-
-                    // we need to be careful of double escape characters in the message body
-                    for (p = som + 1; p < eod && p < eom; p++) {
-                        if (0x1A == *p) {
-                            p++;
-                            eom++;
-                        }
-                    }
-
-                    if (eom > eod) { // Incomplete message in buffer, retry later
-                        break;
-                    }
-
-
-                    // Have a 0x1a followed by 1/2/3/4/5 - pass message to handler.
-                    if (c->service->read_handler(c, som + 1, remote)) {
-                        modesCloseClient(c);
-                        return;
-                    }
-
-                    // advance to next message
-                    som = eom;
-                }
+                if (!(som = readBeastFrames(c, som, eod, remote)))
+                    return;
                 break;
 
             case READ_MODE_BEAST_COMMAND:
@@ -2564,6 +3631,8 @@ static void writeFATSVEvent(struct modesMessage *mm, struct aircraft *a) {
     if (a->messages < 2) // basic filter for bad decodes
         return;
 
+    decodeModesMessageFields(mm);
+
     switch (mm->msgtype) {
         case 20:
         case 21:
@@ -2935,7 +4004,7 @@ void modesNetSecondWork(void) {
     if (Modes.net_heartbeat_interval) {
         for (s = Modes.services; s; s = s->next) {
             if (s->writer &&
-                    s->connections &&
+                    (s->connections || s->udp_out) &&
                     s->writer->send_heartbeat &&
                     (s->writer->lastWrite + Modes.net_heartbeat_interval) <= now) {
                 s->writer->send_heartbeat(s);
@@ -2996,6 +4065,10 @@ void modesNetPeriodicWork(void) {
     // Generate FATSV output
     writeFATSV();
 
+    // Wake local consumers sleeping on the shared memory bus
+    if (shm_bus)
+        shmBusNotify(shm_bus);
+
     // supply JSON to vrs_out writer
     if (Modes.vrs_out.service && Modes.vrs_out.service->connections && now >= next_tcp_json) {
         static int part;
@@ -3016,6 +4089,9 @@ void modesNetPeriodicWork(void) {
         }
     }
 
+    // Send HTTP responses and event streams
+    httpPeriodicWork(now);
+
     serviceReconnectCallback(now);
 }
 
@@ -3032,6 +4108,8 @@ void writeJsonToNet(struct net_writer *writer, struct char_buffer cb) {
         return;
     }
 
+    // a document with holes in it is no use to anyone
+    write_priority = SHED_NEVER;
     pos = content;
 
     while (p && written < len) {
@@ -3048,24 +4126,45 @@ void writeJsonToNet(struct net_writer *writer, struct char_buffer cb) {
     }
 
     flushWrites(writer);
+    write_priority = SHED_HIGH;
     free(content);
 }
 
+// The longest object generateVRS() writes for one aircraft
+#define VRS_JSON_MAX (JSON_LEN("{\"Sig\":") + JSON_FIXED_MAX(0) \
+        + JSON_LEN(",\"Icao\":\"~FFFFFF\"") \
+        + JSON_LEN(",\"Alt\":") + JSON_INT_MAX \
+        + JSON_LEN(",\"GAlt\":") + JSON_INT_MAX \
+        + JSON_LEN(",\"InHg\":") + JSON_FIXED_MAX(2) \
+        + JSON_LEN(",\"TAlt\":") + JSON_INT_MAX \
+        + JSON_LEN(",\"Call\":") + JSON_STRING_MAX(sizeof (((struct aircraft *) 0)->callsign) - 1) \
+        + JSON_LEN(",\"Lat\":") + JSON_FIXED_MAX(6) \
+        + JSON_LEN(",\"Long\":") + JSON_FIXED_MAX(6) \
+        + JSON_LEN(",\"PosTime\":") + JSON_LONG_MAX \
+        + JSON_LEN(",\"Mlat\":false,\"Tisb\":false") \
+        + JSON_LEN(",\"Spd\":") + JSON_FIXED_MAX(1) + JSON_LEN(",\"SpdTyp\":0") \
+        + JSON_LEN(",\"Trak\":") + JSON_FIXED_MAX(1) + JSON_LEN(",\"TrkH\":false") \
+        + JSON_LEN(",\"TTrk\":") + JSON_FIXED_MAX(1) \
+        + JSON_LEN(",\"Sqk\":\"\"") + JSON_HEX_MAX \
+        + JSON_LEN(",\"Vsi\":") + JSON_INT_MAX + JSON_LEN(",\"VsiT\":1") \
+        + JSON_LEN(",\"Gnd\":false") \
+        + JSON_LEN(",\"Trt\":") + JSON_INT_MAX \
+        + JSON_LEN(",\"Cmsgs\":") + JSON_LONG_MAX \
+        + JSON_LEN("},"))
+
 struct char_buffer generateVRS(int part, int n_parts) {
     struct char_buffer cb;
     uint64_t now = mstime();
     struct aircraft *a;
     int buflen = 256*1024; // The initial buffer is resized as needed
     char *buf = (char *) malloc(buflen), *p = buf, *end = buf + buflen;
-    char *line_start;
     int first = 1;
     int part_len = AIRCRAFTS_BUCKETS / n_parts;
     int part_start = part * part_len;
 
     _messageNow = now;
 
-    p = safe_snprintf(p, end,
-            "{\"acList\":[");
+    p = jsonLiteral(p, "{\"acList\":[");
 
     for (int j = part_start; j < part_start + part_len; j++) {
         for (a = Modes.aircrafts[j]; a; a = a->next) {
@@ -3079,121 +4178,151 @@ struct char_buffer generateVRS(int part, int n_parts) {
             if (a->addr & MODES_NON_ICAO_ADDRESS)
                 continue;
 
+            // Room for the object and the final line
+            if (end - p < (int) VRS_JSON_MAX + 8) {
+                int used = p - buf;
+                buflen *= 2;
+                if (!(buf = (char *) realloc(buf, buflen))) {
+                    fprintf(stderr, "generateVRS: out of memory\n");
+                    exit(1);
+                }
+                p = buf + used;
+                end = buf + buflen;
+            }
+
             if (first)
                 first = 0;
             else
                 *p++ = ',';
 
-retry:
-            line_start = p;
-            p = safe_snprintf(p, end, "{\"Sig\":%.0f",
-                    255*((a->signalLevel[0] + a->signalLevel[1] + a->signalLevel[2] + a->signalLevel[3] +
-                            a->signalLevel[4] + a->signalLevel[5] + a->signalLevel[6] + a->signalLevel[7] + 1e-5) / 8));
+            p = jsonLiteral(p, "{\"Sig\":");
+            p = jsonFixed(p, 255*((a->signalLevel[0] + a->signalLevel[1] + a->signalLevel[2] + a->signalLevel[3] +
+                            a->signalLevel[4] + a->signalLevel[5] + a->signalLevel[6] + a->signalLevel[7] + 1e-5) / 8), 0);
 
-            p = safe_snprintf(p, end, ",\"Icao\":\"%s%06X\"", (a->addr & MODES_NON_ICAO_ADDRESS) ? "~" : "", a->addr & 0xFFFFFF);
+            p = jsonLiteral(p, ",\"Icao\":\"");
+            p = jsonHex(p, a->addr & 0xFFFFFF, 6, 1);
+            *p++ = '"';
 
-            if (trackDataValid(&a->altitude_baro_valid) && a->altitude_baro_reliable >= 3)
-                p = safe_snprintf(p, end, ",\"Alt\":%d", a->altitude_baro);
-            if (trackDataValid(&a->altitude_geom_valid))
-                p = safe_snprintf(p, end, ",\"GAlt\":%d", a->altitude_geom);
+            if (trackDataValid(&a->altitude_baro_valid) && a->altitude_baro_reliable >= 3) {
+                p = jsonLiteral(p, ",\"Alt\":");
+                p = jsonInt(p, a->altitude_baro);
+            }
+            if (trackDataValid(&a->altitude_geom_valid)) {
+                p = jsonLiteral(p, ",\"GAlt\":");
+                p = jsonInt(p, a->altitude_geom);
+            }
 
 
-            if (trackDataValid(&a->nav_qnh_valid))
-                p = safe_snprintf(p, end, ",\"InHg\":%.2f", a->nav_qnh * 0.02952998307);
+            if (trackDataValid(&a->nav_qnh_valid)) {
+                p = jsonLiteral(p, ",\"InHg\":");
+                p = jsonFixed(p, a->nav_qnh * 0.02952998307, 2);
+            }
 
-            //p = safe_snprintf(p, end, ",\"AltT\":%d", 0);
+            //p = jsonLiteral(p, ",\"AltT\":0");
 
             if (trackDataValid(&a->nav_altitude_mcp_valid)) {
-                p = safe_snprintf(p, end, ",\"TAlt\":%d", a->nav_altitude_mcp);
+                p = jsonLiteral(p, ",\"TAlt\":");
+                p = jsonInt(p, (int) a->nav_altitude_mcp);
             } else if (trackDataValid(&a->nav_altitude_fms_valid)) {
-                p = safe_snprintf(p, end, ",\"TAlt\":%d", a->nav_altitude_fms);
+                p = jsonLiteral(p, ",\"TAlt\":");
+                p = jsonInt(p, (int) a->nav_altitude_fms);
             }
 
             if (trackDataValid(&a->callsign_valid)) {
-                p = safe_snprintf(p, end, ",\"Call\":\"%s\"", jsonEscapeString(a->callsign));
-                //p = safe_snprintf(p, end, ",\"CallSus\":false");
+                p = jsonLiteral(p, ",\"Call\":");
+                p = jsonString(p, a->callsign, sizeof (a->callsign) - 1);
+                //p = jsonLiteral(p, ",\"CallSus\":false");
             }
 
             if (trackDataValid(&a->position_valid)) {
-                p = safe_snprintf(p, end, ",\"Lat\":%f,\"Long\":%f", a->lat, a->lon);
-                p = safe_snprintf(p, end, ",\"PosTime\":%"PRIu64, a->position_valid.updated);
+                p = jsonLiteral(p, ",\"Lat\":");
+                p = jsonFixed(p, a->lat, 6);
+                p = jsonLiteral(p, ",\"Long\":");
+                p = jsonFixed(p, a->lon, 6);
+                p = jsonLiteral(p, ",\"PosTime\":");
+                p = jsonUnsigned(p, a->position_valid.updated);
             }
 
             if (a->position_valid.source == SOURCE_MLAT)
-                p = safe_snprintf(p, end, ",\"Mlat\":true");
+                p = jsonLiteral(p, ",\"Mlat\":true");
             else
-                p = safe_snprintf(p, end, ",\"Mlat\":false");
+                p = jsonLiteral(p, ",\"Mlat\":false");
             if (a->position_valid.source == SOURCE_TISB)
-                p = safe_snprintf(p, end, ",\"Tisb\":true");
+                p = jsonLiteral(p, ",\"Tisb\":true");
             else
-                p = safe_snprintf(p, end, ",\"Tisb\":false");
+                p = jsonLiteral(p, ",\"Tisb\":false");
 
 
             if (trackDataValid(&a->gs_valid)) {
-                p = safe_snprintf(p, end, ",\"Spd\":%.1f", a->gs);
-                p = safe_snprintf(p, end, ",\"SpdTyp\":0");
+                p = jsonLiteral(p, ",\"Spd\":");
+                p = jsonFixed(p, a->gs, 1);
+                p = jsonLiteral(p, ",\"SpdTyp\":0");
             } else if (trackDataValid(&a->ias_valid)) {
-                p = safe_snprintf(p, end, ",\"Spd\":%u", a->ias);
-                p = safe_snprintf(p, end, ",\"SpdTyp\":2");
+                p = jsonLiteral(p, ",\"Spd\":");
+                p = jsonUnsigned(p, a->ias);
+                p = jsonLiteral(p, ",\"SpdTyp\":2");
             } else if (trackDataValid(&a->tas_valid)) {
-                p = safe_snprintf(p, end, ",\"Spd\":%u", a->tas);
-                p = safe_snprintf(p, end, ",\"SpdTyp\":3");
+                p = jsonLiteral(p, ",\"Spd\":");
+                p = jsonUnsigned(p, a->tas);
+                p = jsonLiteral(p, ",\"SpdTyp\":3");
             }
 
             if (trackDataValid(&a->track_valid)) {
-                p = safe_snprintf(p, end, ",\"Trak\":%.1f", a->track);
-                p = safe_snprintf(p, end, ",\"TrkH\":false");
+                p = jsonLiteral(p, ",\"Trak\":");
+                p = jsonFixed(p, a->track, 1);
+                p = jsonLiteral(p, ",\"TrkH\":false");
             } else if (trackDataValid(&a->mag_heading_valid)) {
-                p = safe_snprintf(p, end, ",\"Trak\":%.1f", a->mag_heading);
-                p = safe_snprintf(p, end, ",\"TrkH\":true");
+                p = jsonLiteral(p, ",\"Trak\":");
+                p = jsonFixed(p, a->mag_heading, 1);
+                p = jsonLiteral(p, ",\"TrkH\":true");
             } else if (trackDataValid(&a->true_heading_valid)) {
-                p = safe_snprintf(p, end, ",\"Trak\":%.1f", a->true_heading);
-                p = safe_snprintf(p, end, ",\"TrkH\":true");
+                p = jsonLiteral(p, ",\"Trak\":");
+                p = jsonFixed(p, a->true_heading, 1);
+                p = jsonLiteral(p, ",\"TrkH\":true");
             }
 
-            if (trackDataValid(&a->nav_heading_valid))
-                p = safe_snprintf(p, end, ",\"TTrk\":%.1f", a->nav_heading);
+            if (trackDataValid(&a->nav_heading_valid)) {
+                p = jsonLiteral(p, ",\"TTrk\":");
+                p = jsonFixed(p, a->nav_heading, 1);
+            }
 
-            if (trackDataValid(&a->squawk_valid))
-                p = safe_snprintf(p, end, ",\"Sqk\":\"%04x\"", a->squawk);
+            if (trackDataValid(&a->squawk_valid)) {
+                p = jsonLiteral(p, ",\"Sqk\":\"");
+                p = jsonHex(p, a->squawk, 4, 0);
+                *p++ = '"';
+            }
 
             if (trackDataValid(&a->geom_rate_valid)) {
-                p = safe_snprintf(p, end, ",\"Vsi\":%d", a->geom_rate);
-                p = safe_snprintf(p, end, ",\"VsiT\":1");
+                p = jsonLiteral(p, ",\"Vsi\":");
+                p = jsonInt(p, a->geom_rate);
+                p = jsonLiteral(p, ",\"VsiT\":1");
             } else if (trackDataValid(&a->baro_rate_valid)) {
-                p = safe_snprintf(p, end, ",\"Vsi\":%d", a->baro_rate);
-                p = safe_snprintf(p, end, ",\"VsiT\":0");
+                p = jsonLiteral(p, ",\"Vsi\":");
+                p = jsonInt(p, a->baro_rate);
+                p = jsonLiteral(p, ",\"VsiT\":0");
             }
 
 
             if (trackDataValid(&a->airground_valid) && a->airground_valid.source >= SOURCE_MODE_S_CHECKED && a->airground == AG_GROUND)
-                p = safe_snprintf(p, end, ",\"Gnd\":true");
+                p = jsonLiteral(p, ",\"Gnd\":true");
             else
-                p = safe_snprintf(p, end, ",\"Gnd\":false");
+                p = jsonLiteral(p, ",\"Gnd\":false");
 
+            p = jsonLiteral(p, ",\"Trt\":");
             if (a->adsb_version >= 0)
-                p = safe_snprintf(p, end, ",\"Trt\":%d", a->adsb_version + 3);
+                p = jsonInt(p, a->adsb_version + 3);
             else
-                p = safe_snprintf(p, end, ",\"Trt\":%d", 1);
-
+                p = jsonInt(p, 1);
 
-            p = safe_snprintf(p, end, ",\"Cmsgs\":%ld", a->messages);
 
-            p = safe_snprintf(p, end, "}");
+            p = jsonLiteral(p, ",\"Cmsgs\":");
+            p = jsonInt(p, a->messages);
 
-            if ((p + 10) >= end) { // +10 to leave some space for the final line
-                // overran the buffer
-                int used = line_start - buf;
-                buflen *= 2;
-                buf = (char *) realloc(buf, buflen);
-                p = buf + used;
-                end = buf + buflen;
-                goto retry;
-            }
+            *p++ = '}';
         }
     }
 
-    p = safe_snprintf(p, end, "]}\n");
+    p = jsonLiteral(p, "]}\n");
 
     cb.len = p - buf;
     cb.buffer = buf;
@@ -3204,27 +4333,168 @@ retry:
 // =============================== Network IO ===========================
 //
 
-static void *pthreadGetaddrinfo(void *param) {
-    struct net_connector *con = (struct net_connector *) param;
+// Name resolution for the connectors.
+//
+// getaddrinfo() blocks, so it runs on a small pool of threads shared by
+// all connectors. Requests are queued; the main thread checks now and then
+// whether its request is done. A request whose connector goes away is
+// left for the resolver thread to free.
+
+struct resolve_request {
+    struct resolve_request *next; // queue link
+    char *host;
+    char *port;
+    struct addrinfo *result;
+    int error;
+    int done;
+    int cancelled;
+    int padding;
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct resolve_request *head, *tail; // waiting to be picked up
+    int threads; // threads started
+} resolver = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0 };
+
+static void resolverFree(struct resolve_request *req) {
+    if (req->result)
+        freeaddrinfo(req->result);
+    free(req->host);
+    free(req->port);
+    free(req);
+}
 
+static void *resolverThread(void *arg) {
     struct addrinfo gai_hints;
 
+    MODES_NOTUSED(arg);
+
+    memset(&gai_hints, 0, sizeof (gai_hints));
     gai_hints.ai_family = AF_UNSPEC;
     gai_hints.ai_socktype = SOCK_STREAM;
-    gai_hints.ai_protocol = 0;
-    gai_hints.ai_flags = 0;
-    gai_hints.ai_addrlen = 0;
-    gai_hints.ai_addr = NULL;
-    gai_hints.ai_canonname = NULL;
-    gai_hints.ai_next = NULL;
 
-    con->gai_error = getaddrinfo(con->address, con->port, &gai_hints, &con->addr_info);
+    pthread_mutex_lock(&resolver.mutex);
+    while (1) {
+        struct resolve_request *req;
+        struct addrinfo *result = NULL;
+        int error;
+
+        while (!resolver.head)
+            pthread_cond_wait(&resolver.cond, &resolver.mutex);
+
+        req = resolver.head;
+        if (!(resolver.head = req->next))
+            resolver.tail = NULL;
+        pthread_mutex_unlock(&resolver.mutex);
 
-    pthread_mutex_unlock(con->mutex);
+        error = getaddrinfo(req->host, req->port, &gai_hints, &result);
+
+        pthread_mutex_lock(&resolver.mutex);
+        req->result = result;
+        req->error = error;
+        req->done = 1;
+        if (req->cancelled)
+            resolverFree(req);
+    }
     return NULL;
 }
 
+// Queue a lookup, starting the resolver threads on first use.
+// Returns NULL if that isn't possible.
+static struct resolve_request *resolverSubmit(const char *host, const char *port) {
+    struct resolve_request *req;
+
+    if (!(req = calloc(1, sizeof (*req))) || !(req->host = strdup(host)) || !(req->port = strdup(port))) {
+        fprintf(stderr, "Out of memory allocating name resolution request for %s\n", host);
+        if (req)
+            resolverFree(req);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&resolver.mutex);
+
+    while (resolver.threads < MODES_NET_RESOLVER_THREADS) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, resolverThread, NULL)) {
+            fprintf(stderr, "Name resolution: pthread_create ERROR: %s\n", strerror(errno));
+            break;
+        }
+        pthread_detach(thread);
+        resolver.threads++;
+    }
+
+    if (!resolver.threads) {
+        pthread_mutex_unlock(&resolver.mutex);
+        resolverFree(req);
+        return NULL;
+    }
+
+    if (resolver.tail)
+        resolver.tail->next = req;
+    else
+        resolver.head = req;
+    resolver.tail = req;
+    pthread_cond_signal(&resolver.cond);
+
+    pthread_mutex_unlock(&resolver.mutex);
+    return req;
+}
+
+// If the lookup is done, hand over its result and free the request.
+static int resolverFinished(struct resolve_request *req, struct addrinfo **result, int *error) {
+    pthread_mutex_lock(&resolver.mutex);
+    int done = req->done;
+    pthread_mutex_unlock(&resolver.mutex);
+
+    if (!done)
+        return 0;
+
+    *result = req->result;
+    *error = req->error;
+    req->result = NULL;
+    resolverFree(req);
+    return 1;
+}
+
+// Give up on a lookup. A queued one is dropped, one in progress is
+// freed by the resolver thread when it returns.
+static void resolverCancel(struct resolve_request *req) {
+    struct resolve_request *prev = NULL, *r;
+
+    pthread_mutex_lock(&resolver.mutex);
+    for (r = resolver.head; r && r != req; r = r->next)
+        prev = r;
+
+    if (req->done) {
+        resolverFree(req);
+    } else if (r) {
+        if (prev)
+            prev->next = req->next;
+        else
+            resolver.head = req->next;
+        if (resolver.tail == req)
+            resolver.tail = prev;
+        resolverFree(req);
+    } else {
+        req->cancelled = 1;
+    }
+    pthread_mutex_unlock(&resolver.mutex);
+}
+
 void cleanupNetwork(void) {
+    shmBusDestroy(shm_bus);
+    shm_bus = NULL;
+    httpCleanup();
+    free(json_tiles);
+    json_tiles = NULL;
+    for (int i = 0; i < JSON_CACHED; i++) {
+        free(cached_json[i].cache.cb.buffer);
+        cached_json[i].cache.cb.buffer = NULL;
+        cached_json[i].stale = 1;
+    }
+
     for (struct net_service *s = Modes.services; s; s = s->next) {
         struct client *c = s->clients, *nc;
         while (c) {
@@ -3236,6 +4506,9 @@ void cleanupNetwork(void) {
                 free(c->sendq);
                 c->sendq = NULL;
             }
+            free(c->udp);
+            if (c->http)
+                httpClientClosed(c);
             free(c);
 
             c = nc;
@@ -3246,9 +4519,18 @@ void cleanupNetwork(void) {
     while (s) {
         ns = s->next;
         free(s->listener_fds);
+        if (s->udp_out) {
+            anetCloseSocket(s->udp_out->fd);
+            free(s->udp_out->dests);
+            free(s->udp_out->dest_lens);
+            free(s->udp_out->msgs);
+            free(s->udp_out);
+        }
         if (s->writer && s->writer->data) {
             free(s->writer->data);
             s->writer->data = NULL;
+            free(s->writer->frames);
+            s->writer->frames = NULL;
         }
         if (s) free(s);
         s = ns;
@@ -3256,16 +4538,8 @@ void cleanupNetwork(void) {
 
     for (int i = 0; i < Modes.net_connectors_count; i++) {
         struct net_connector *con = Modes.net_connectors[i];
+        serviceConnectorCleanup(con);
         free(con->address);
-        if (con->addr_info) {
-            freeaddrinfo(con->addr_info);
-            con->addr_info = NULL;
-        }
-        if (con->mutex) {
-            pthread_mutex_unlock(con->mutex);
-            pthread_mutex_destroy(con->mutex);
-            free(con->mutex);
-        }
         free(con);
     }
     free(Modes.net_connectors);
@@ -32,6 +32,7 @@ struct aircraft;
 struct modesMessage;
 struct client;
 struct net_service;
+struct http_conn;
 typedef int (*read_fn)(struct client *, char *, int);
 typedef void (*heartbeat_fn)(struct net_service *);
 
@@ -43,6 +44,18 @@ typedef enum
   READ_MODE_ASCII
 } read_mode_t;
 
+// Output frames are shed lowest priority first when a client's SendQ
+// fills up; SHED_NEVER data can't be dropped without corrupting the
+// stream, so the client is dropped instead
+typedef enum
+{
+  SHED_LOW, // Mode A/C, DF11 all-call replies, repeated surveillance replies
+  SHED_NORMAL, // everything else
+  SHED_HIGH, // ES positions, mlat results, replies from aircraft mlat has to locate
+  SHED_NEVER,
+  SHED_LEVELS
+} shed_priority_t;
+
 /* Data mode to feed push server */
 typedef enum
 {
@@ -51,6 +64,55 @@ typedef enum
   PUSH_MODE_SBS,
 } push_mode_t;
 
+// Beast over UDP: each datagram is a header (0x1a 'U', version, flags,
+// 32-bit big-endian sequence number) followed by complete, escaped Beast
+// frames. Stream parsers skip the header as an unknown frame type.
+#define BEAST_UDP_VERSION 1
+#define BEAST_UDP_HEADER_LEN 8
+#define BEAST_UDP_PAYLOAD 1400 // keeps datagrams inside a 1500 byte MTU
+#define BEAST_UDP_WINDOW 16 // datagrams held back waiting for a gap to fill
+#define BEAST_UDP_REORDER_TIMEOUT 100 // ms to wait for a missing datagram
+#define BEAST_UDP_MAX_SOURCES 8
+#define BEAST_UDP_RESYNC 1024 // a sequence jump this large means the sender restarted
+
+// Datagram output state, shared by all destinations of a service
+struct udp_output
+{
+  int fd;
+  int ndests;
+  struct sockaddr_storage *dests;
+  socklen_t *dest_lens;
+  struct mmsghdr *msgs; // one per destination, for sendmmsg()
+  uint32_t seq; // sequence number of the next datagram
+  int failing; // last send failed; suppresses repeated error messages
+};
+
+struct udp_held
+{
+  uint32_t seq;
+  int len; // 0 if the slot is empty
+  char data[BEAST_UDP_PAYLOAD];
+};
+
+// Reordering state for one sender
+struct udp_source
+{
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  int active;
+  uint32_t expected; // next sequence number to deliver
+  unsigned held_count;
+  uint64_t last_seen;
+  uint64_t hold_since; // when delivery last stalled on a gap
+  struct udp_held held[BEAST_UDP_WINDOW]; // indexed by seq % BEAST_UDP_WINDOW
+};
+
+// Datagram input state, hung off the client that owns the socket
+struct udp_input
+{
+  struct udp_source sources[BEAST_UDP_MAX_SOURCES];
+};
+
 // Describes one network service (a group of clients with common behaviour)
 
 struct net_service
@@ -67,8 +129,11 @@ struct net_service
   int read_sep_len;
   const char *descr;
   struct client *clients; // linked list of clients connected to this service
+  struct udp_output *udp_out; // datagram destinations, or NULL
 };
 
+struct resolve_request;
+
 // Client connection
 struct net_connector
 {
@@ -79,15 +144,28 @@ struct net_connector
     int connected;
     int connecting;
     int fd;
+    int failures; // connection attempts failed in a row, for backoff
     uint64_t next_reconnect;
     uint64_t connect_timeout;
+    uint64_t established; // when the current connection was made
     char resolved_addr[NI_MAXHOST+3];
     struct addrinfo *addr_info;
     struct addrinfo *try_addr; // pointer walking addr_info list
-    int gai_error;
-    int gai_request_in_progress;
-    pthread_t thread;
-    pthread_mutex_t *mutex;
+    uint64_t addr_info_expires; // addr_info is reused until then
+    struct resolve_request *resolving; // name resolution in progress, or NULL
+};
+
+// How a remote receiver's 12 MHz clock compares to ours, see clientClockUpdate
+struct input_clock
+{
+  uint64_t base_timestamp; // receiver clock when the estimate started
+  uint64_t base_received; // our receive time then, microseconds
+  uint64_t last_timestamp; // receiver clock of the previous frame
+  uint64_t last_received; // our receive time of the previous frame, microseconds
+  double offset; // ms our clock gained on the receiver's since the start, smoothed
+  double jitter; // interarrival jitter (RFC 3550), ms
+  uint32_t frames; // frames the estimate is based on
+  uint32_t jumps; // receiver clock jumped and the estimate restarted
 };
 
 // Structure used to describe a networking client
@@ -109,6 +187,20 @@ struct client
   char host[NI_MAXHOST]; // For logging
   char port[NI_MAXSERV];
   struct net_connector *con;
+  struct udp_input *udp; // datagram input state, or NULL for streams
+  struct http_conn *http; // HTTP server state, or NULL
+  int shedding; // has shed output since connecting
+  uint32_t shed[SHED_NEVER]; // output frames shed, per priority
+  int rx_timestamps; // kernel receive timestamps are enabled
+  uint64_t rx_time; // kernel receive time of the data being processed, microseconds, or 0
+  struct input_clock clock;
+};
+
+// One frame in a writer's buffer
+struct write_frame
+{
+  uint16_t end; // offset one past the frame
+  uint8_t priority; // shed_priority_t
 };
 
 // Common writer state for all output sockets of one type
@@ -117,9 +209,8 @@ struct net_writer
 {
   void *data; // shared write buffer, sized MODES_OUT_BUF_SIZE
   int dataUsed; // number of bytes of write buffer currently used
-#if !defined(__arm__)
-  uint32_t padding;
-#endif
+  int nframes; // number of frames in the write buffer
+  struct write_frame *frames; // sized MODES_OUT_FRAMES
   struct net_service *service; // owning service
   heartbeat_fn send_heartbeat; // function that queues a heartbeat if needed
   uint64_t lastWrite; // time of last write to clients
@@ -129,9 +220,13 @@ struct net_service *serviceInit (const char *descr, struct net_writer *writer, h
 struct client *serviceConnect(struct net_connector *con);
 void serviceReconnectCallback(uint64_t now);
 struct client *checkServiceConnected(struct net_connector *con);
+void serviceConnectorCleanup(struct net_connector *con);
+void displayInputClocks(void);
 void serviceListen (struct net_service *service, char *bind_addr, char *bind_ports);
 struct client *createSocketClient (struct net_service *service, int fd);
 struct client *createGenericClient (struct net_service *service, int fd);
+void flushClient (struct client *c, uint64_t now);
+void modesCloseClient (struct client *c);
 
 // viewadsb want to create these itselves
 struct net_service *makeBeastInputService (void);
@@ -143,6 +238,19 @@ struct char_buffer
     size_t len;
 };
 
+// A document kept rendered in memory. The buffer belongs to the cache and
+// stays valid until the version changes.
+struct json_cache
+{
+    struct char_buffer cb;
+    uint64_t version; // bumped on every render
+};
+
+typedef enum
+{
+    JSON_RECEIVER, JSON_STATS, JSON_CACHED
+} json_cached_t;
+
 void sendBeastSettings (int fd, const char *settings);
 
 void modesInitNet (void);
@@ -153,10 +261,17 @@ void cleanupNetwork(void);
 
 // TODO: move these somewhere else
 struct char_buffer generateAircraftJson ();
+struct char_buffer generateAircraftJsonBox (double south, double west, double north, double east);
+#define AIRCRAFT_JSON_MAX 1684 // bytes appendAircraftJson writes at most
+char *appendAircraftJson (char *p, struct aircraft *a, uint64_t now);
+int includeAircraftJson (struct aircraft *a, uint64_t now);
 struct char_buffer generateStatsJson ();
 struct char_buffer generateReceiverJson ();
 struct char_buffer generateHistoryJson ();
 void writeJsonToFile (const char *file, struct char_buffer cb);
+void updateCachedJson (json_cached_t which);
+const struct json_cache *cachedJson (json_cached_t which);
+void writeJsonTiles (uint64_t now);
 struct char_buffer generateVRS(int part, int n_parts);
 void writeJsonToNet(struct net_writer *writer, struct char_buffer cb);
 
@@ -60,6 +60,17 @@ static uint16_t *outdata;
 // SC16Q11_TABLE_BITS=8:          5.77M samples/second
 // SC16Q11_TABLE_BITS=7:         10.23M samples/second
 
+// Sample results for the vector paths, DC filtered where the variant can:
+// (error is against a double-precision reference, in output LSBs)
+
+// x86_64 VM, AVX2
+// UC8, AVX2 path, no DC:       2772.93M samples/second, max error 0.509
+// UC8, AVX2 path:              1046.94M samples/second, max error 0.549
+// SC16Q11, AVX2 path:          1104.11M samples/second, max error 0.549
+// UC8, integer/table path:     1154.83M samples/second, max error 0.506
+// UC8, float path:              120.07M samples/second, max error 0.549
+// SC16Q11, float path:          143.28M samples/second, max error 0.554
+
 void prepare()
 {
     srand(1);
@@ -93,11 +104,81 @@ void prepare()
     }
 }
 
-void test(const char *what, input_format_t format, void **data, double sample_rate, bool filter_dc) {
+// Double-precision magnitude of sample i, scaled to the 0..65535 output range
+static double reference_sample(input_format_t format, void *data, unsigned i, bool filter_dc, double dc_a, double dc_b, double *z1_I, double *z1_Q) {
+    double fI, fQ;
+
+    if (format == INPUT_UC8) {
+        uint8_t *uc8 = data;
+        fI = (uc8[i*2] - 127.5) / 127.5;
+        fQ = (uc8[i*2+1] - 127.5) / 127.5;
+    } else {
+        uint16_t *sc16 = data;
+        double scale = (format == INPUT_SC16 ? 32768.0 : 2048.0);
+        fI = (int16_t) le16toh(sc16[i*2]) / scale;
+        fQ = (int16_t) le16toh(sc16[i*2+1]) / scale;
+    }
+
+    if (filter_dc) {
+        *z1_I = fI * dc_a + *z1_I * dc_b;
+        *z1_Q = fQ * dc_a + *z1_Q * dc_b;
+        fI -= *z1_I;
+        fQ -= *z1_Q;
+    }
+
+    double magsq = fI * fI + fQ * fQ;
+    if (magsq > 1)
+        magsq = 1;
+    return sqrt(magsq) * 65535.0;
+}
+
+// Compare one converter run against the double-precision reference.
+// An odd sample count makes sure any leftover-sample handling is covered.
+static void accuracy(input_format_t format, void **data, double sample_rate, bool filter_dc, iq_convert_fn converter, struct converter_state *state) {
+    const unsigned nsamples = MODES_MAG_BUF_SAMPLES - 3;
+    double dc_b = exp(-2.0 * M_PI * 1.0 / sample_rate);
+    double dc_a = 1.0 - dc_b;
+    double z1_I = 0, z1_Q = 0;
+    double mean_level, mean_power;
+    double ref_level = 0, ref_power = 0;
+    double max_error = 0, sum_sq_error = 0;
+
+    converter(data[0], outdata, nsamples, state, &mean_level, &mean_power);
+
+    for (unsigned i = 0; i < nsamples; ++i) {
+        double ref = reference_sample(format, data[0], i, filter_dc, dc_a, dc_b, &z1_I, &z1_Q);
+        double error = fabs(outdata[i] - ref);
+
+        if (error > max_error)
+            max_error = error;
+        sum_sq_error += error * error;
+        ref_level += ref / 65535.0;
+        ref_power += (ref / 65535.0) * (ref / 65535.0);
+    }
+
+    ref_level /= nsamples;
+    ref_power /= nsamples;
+
+    fprintf(stderr, "  error vs double: max %.3f LSB, rms %.3f LSB, mean level %+.2e, mean power %+.2e\n",
+            max_error, sqrt(sum_sq_error / nsamples),
+            (mean_level - ref_level) / ref_level, (mean_power - ref_power) / ref_power);
+}
+
+static void test(unsigned variant, void **data, double sample_rate) {
+    input_format_t format;
+    int filter_dc;
+    bool usable;
+    const char *what = converter_variant(variant, &format, &filter_dc, &usable);
+
+    if (!usable) {
+        fprintf(stderr, "Skipping: %s (not supported by this CPU)\n", what);
+        return;
+    }
+
     fprintf(stderr, "Benchmarking: %s ", what);
 
     struct converter_state *state;
-    iq_convert_fn converter = init_converter(format, sample_rate, filter_dc, &state);
+    iq_convert_fn converter = init_converter_variant(variant, sample_rate, filter_dc, &state);
     if (!converter) {
         fprintf(stderr, "Can't initialize converter\n");
         return;
@@ -132,6 +213,13 @@ void test(const char *what, input_format_t format, void **data, double sample_ra
             samples / 1e6, nanos / 1e9);
     fprintf(stderr, "  %.2fM samples/second\n",
             samples / nanos * 1e3);
+
+    // fresh filter state, so the reference starts from the same place
+    converter = init_converter_variant(variant, sample_rate, filter_dc, &state);
+    if (converter) {
+        accuracy(format, data, sample_rate, filter_dc, converter, state);
+        cleanup_converter(state);
+    }
 }
 
 int main(int argc, char **argv)
@@ -141,12 +229,12 @@ int main(int argc, char **argv)
 
     prepare();
 
-    test("SC16Q11, DC", INPUT_SC16Q11, testdata_sc16q11, 2400000, true);
-    test("SC16Q11, no DC", INPUT_SC16Q11, testdata_sc16q11, 2400000, false);
-
-    test("UC8, DC", INPUT_UC8, testdata_uc8, 2400000, true);
-    test("UC8, no DC", INPUT_UC8, testdata_uc8, 2400000, false);
-
-    test("SC16, DC", INPUT_SC16, testdata_sc16, 2400000, true);
-    test("SC16, no DC", INPUT_SC16, testdata_sc16, 2400000, false);
+    // Every variant built in, DC filtered if it can be
+    input_format_t format;
+    int filter_dc;
+    bool usable;
+    for (unsigned i = 0; converter_variant(i, &format, &filter_dc, &usable); ++i) {
+        void **data = (format == INPUT_UC8 ? testdata_uc8 : format == INPUT_SC16 ? testdata_sc16 : testdata_sc16q11);
+        test(i, data, 2400000);
+    }
 }
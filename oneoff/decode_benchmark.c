@@ -0,0 +1,213 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// decode_benchmark.c: benchmark for decodeModesMessage()
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "../readsb.h"
+
+// Fully decodes MESSAGES synthetic messages with a valid CRC, a mix of
+// DF17 types, DF11, DF4/5 and DF20/21, the way the demodulators do: once
+// clearing the whole struct modesMessage before each one, as they used to,
+// and once with resetModesMessage(). The decoded messages of the two are
+// compared first, header, set sections and the decoded values whose
+// valid bit is set. Last, the messages are decoded without their ES and
+// Comm-B fields, as decodeModesMessage() leaves them when nothing asks.
+//
+// Sample results, x86_64 VM:
+//   memset:             12.9M messages/second
+//   resetModesMessage:  14.0M messages/second
+//   header only:        19.4M messages/second
+
+#define MESSAGES 100000
+#define AIRCRAFT 500
+#define ROUNDS 20
+
+struct _Modes Modes;
+
+static unsigned char messages[MESSAGES][MODES_LONG_MSG_BYTES];
+static uint32_t addrs[AIRCRAFT];
+
+void receiverPositionChanged(float lat, float lon, float alt) {
+    MODES_NOTUSED(lat);
+    MODES_NOTUSED(lon);
+    MODES_NOTUSED(alt);
+}
+
+static void setCRC(unsigned char *msg, int bits, uint32_t overlay) {
+    uint32_t crc;
+
+    msg[bits / 8 - 3] = msg[bits / 8 - 2] = msg[bits / 8 - 1] = 0;
+    crc = modesChecksum(msg, bits) ^ overlay;
+    msg[bits / 8 - 3] = crc >> 16;
+    msg[bits / 8 - 2] = crc >> 8;
+    msg[bits / 8 - 1] = crc;
+}
+
+static void prepare() {
+    // DF17 type codes, weighted roughly as on air
+    static const int types[] = { 11, 11, 11, 12, 13, 19, 19, 19, 4, 29, 31, 28, 6, 0 };
+
+    for (int i = 0; i < AIRCRAFT; ++i) {
+        addrs[i] = rand() & 0xFFFFFF;
+        icaoFilterAdd(addrs[i]);
+    }
+
+    for (int i = 0; i < MESSAGES; ++i) {
+        unsigned char *msg = messages[i];
+        uint32_t addr = addrs[rand() % AIRCRAFT];
+        int kind = rand() % 10;
+
+        for (int j = 0; j < MODES_LONG_MSG_BYTES; ++j)
+            msg[j] = rand();
+
+        if (kind < 6) { // DF17
+            int type = types[rand() % (int) (sizeof (types) / sizeof (types[0]))];
+
+            msg[0] = (17 << 3) | 5;
+            msg[1] = addr >> 16;
+            msg[2] = addr >> 8;
+            msg[3] = addr;
+            msg[4] = (type << 3) | (type == 19 ? 1 : (type == 29 ? 2 : (type == 31 ? 0 : msg[4] & 7)));
+            if (type == 29 || type == 31) // version 2 status messages
+                msg[9] = (msg[9] & ~0xe0) | (2 << 5);
+            setCRC(msg, 112, 0);
+        } else if (kind < 7) { // DF11 all-call reply, interrogator 0
+            msg[0] = (11 << 3) | 5;
+            msg[1] = addr >> 16;
+            msg[2] = addr >> 8;
+            msg[3] = addr;
+            setCRC(msg, 56, 0);
+        } else if (kind < 9) { // DF4/5, address parity
+            msg[0] = ((kind == 7 ? 4 : 5) << 3) | (msg[0] & 7);
+            setCRC(msg, 56, addr);
+        } else { // DF20/21, address parity, a mix of Comm-B replies
+            msg[0] = ((rand() % 2 ? 20 : 21) << 3) | (msg[0] & 7);
+            setCRC(msg, 112, addr);
+        }
+    }
+}
+
+static int decodeAll(struct modesMessage *mm, int reset, int fields) {
+    int decoded = 0;
+
+    for (int i = 0; i < MESSAGES; ++i) {
+        if (reset)
+            resetModesMessage(mm);
+        else
+            memset(mm, 0, sizeof (*mm));
+        if (decodeModesMessage(mm, messages[i]) >= 0) {
+            if (fields)
+                decodeModesMessageFields(mm);
+            ++decoded;
+        }
+    }
+    return decoded;
+}
+
+// The parts of a message that hold data, see struct modesMessage
+static int sameMessage(const struct modesMessage *a, const struct modesMessage *b) {
+    if (memcmp(a, b, offsetof(struct modesMessage, sections) + sizeof (a->sections)))
+        return 0;
+
+#define S(v, f) if ((a->v) && memcmp(&a->f, &b->f, sizeof (a->f))) return 0
+    S(altitude_baro_valid, altitude_baro);
+    S(altitude_geom_valid, altitude_geom);
+    S(geom_delta_valid, geom_delta);
+    S(track_valid || a->heading_valid, heading);
+    S(track_rate_valid, track_rate);
+    S(roll_valid, roll);
+    S(gs_valid, gs);
+    S(ias_valid, ias);
+    S(tas_valid, tas);
+    S(mach_valid, mach);
+    S(baro_rate_valid, baro_rate);
+    S(geom_rate_valid, geom_rate);
+    S(squawk_valid, squawk);
+    S(category_valid, category);
+    S(emergency_valid, emergency);
+    S(cpr_valid, cpr_lat);
+    S(cpr_valid, cpr_lon);
+#undef S
+    if (a->callsign_valid && strcmp(a->callsign, b->callsign))
+        return 0;
+
+    if ((a->sections & MM_ACCURACY) && memcmp(&a->accuracy, &b->accuracy, sizeof (a->accuracy)))
+        return 0;
+    if ((a->sections & MM_OPSTATUS) && memcmp(&a->opstatus, &b->opstatus, sizeof (a->opstatus)))
+        return 0;
+    if ((a->sections & MM_NAV) && memcmp(&a->nav, &b->nav, sizeof (a->nav)))
+        return 0;
+    return 1;
+}
+
+static void compare() {
+    struct modesMessage *cleared = malloc(sizeof (*cleared));
+    struct modesMessage *reset = malloc(sizeof (*reset));
+    int mismatches = 0;
+
+    // Garbage in the reused struct is what resetModesMessage() must cope with
+    memset(reset, 0xa5, sizeof (*reset));
+
+    for (int i = 0; i < MESSAGES; ++i) {
+        memset(cleared, 0, sizeof (*cleared));
+        resetModesMessage(reset);
+        if (decodeModesMessage(cleared, messages[i]) != decodeModesMessage(reset, messages[i]))
+            ++mismatches;
+        decodeModesMessageFields(cleared);
+        decodeModesMessageFields(reset);
+        if (!sameMessage(cleared, reset))
+            ++mismatches;
+    }
+
+    fprintf(stderr, "%d messages compared, %d mismatches\n", MESSAGES, mismatches);
+    free(cleared);
+    free(reset);
+}
+
+static void run(const char *name, int reset, int fields) {
+    struct modesMessage *mm = malloc(sizeof (*mm));
+    struct timespec start, end = { 0, 0 };
+    int decoded = 0;
+
+    start_cpu_timing(&start);
+    for (int r = 0; r < ROUNDS; ++r)
+        decoded += decodeAll(mm, reset, fields);
+    end_cpu_timing(&start, &end);
+
+    double elapsed = end.tv_sec + end.tv_nsec / 1e9;
+    fprintf(stderr, "%-19s %.1fM messages/second (%d decoded)\n", name, MESSAGES * (double) ROUNDS / elapsed / 1e6, decoded / ROUNDS);
+    free(mm);
+}
+
+int main(int argc, char **argv) {
+    MODES_NOTUSED(argc);
+    MODES_NOTUSED(argv);
+
+    srand(1);
+    Modes.nfix_crc = 1;
+    modesChecksumInit(Modes.nfix_crc);
+    icaoFilterInit();
+    prepare();
+
+    fprintf(stderr, "struct modesMessage: %zu bytes, %zu cleared by resetModesMessage()\n",
+            sizeof (struct modesMessage), offsetof(struct modesMessage, sections) + sizeof (unsigned));
+    compare();
+    run("memset:", 0, 1);
+    run("resetModesMessage:", 1, 1);
+    run("header only:", 1, 0);
+    return 0;
+}
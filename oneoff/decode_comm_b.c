@@ -97,7 +97,7 @@ void process(double timestamp, const char *line, struct modesMessage *mm)
     }
     if (mm->ias_valid) {
         printf("\tias\t%d", mm->ias);
-        if ((timestamp - last_ias_ts) < 10.0 && abs(last_ias - mm->ias) > 50) {
+        if ((timestamp - last_ias_ts) < 10.0 && fabs(last_ias - mm->ias) > 50) {
             suspicious = 1;
         }
         last_ias = mm->ias;
@@ -105,7 +105,7 @@ void process(double timestamp, const char *line, struct modesMessage *mm)
     }
     if (mm->tas_valid) {
         printf("\ttas\t%d", mm->tas);
-        if ((timestamp - last_tas_ts) < 10.0 && abs(last_tas - mm->tas) > 50) {
+        if ((timestamp - last_tas_ts) < 10.0 && fabs(last_tas - mm->tas) > 50) {
             suspicious = 1;
         }
         last_tas = mm->tas;
@@ -113,13 +113,35 @@ void process(double timestamp, const char *line, struct modesMessage *mm)
     }
     if (mm->mach_valid) {
         printf("\tmach\t%.3f", mm->mach);
-        if ((timestamp - last_mach_ts) < 10.0 && abs(last_mach - mm->mach) > 0.1) {
+        if ((timestamp - last_mach_ts) < 10.0 && fabs(last_mach - mm->mach) > 0.1) {
             suspicious = 1;
         }
         last_mach = mm->mach;
         last_mach_ts = timestamp;
     }
 
+    if (mm->baro_rate_valid) {
+        printf("\tbaro_rate\t%d", mm->baro_rate);
+    }
+    if (mm->geom_rate_valid) {
+        printf("\tgeom_rate\t%d", mm->geom_rate);
+    }
+    if (mm->sections & MM_NAV) {
+        if (mm->nav.mcp_altitude_valid) {
+            printf("\tmcp\t%u", mm->nav.mcp_altitude);
+        }
+        if (mm->nav.fms_altitude_valid) {
+            printf("\tfms\t%u", mm->nav.fms_altitude);
+        }
+        if (mm->nav.qnh_valid) {
+            printf("\tqnh\t%.1f", mm->nav.qnh);
+        }
+        if (mm->nav.modes_valid) {
+            printf("\tmodes\t%d", (int) mm->nav.modes);
+        }
+        printf("\tsource\t%d", (int) mm->nav.altitude_source);
+    }
+
     if (suspicious) {
         printf("\tsuspicious\tyes!");
     }
@@ -0,0 +1,114 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// geo_benchmark.c: benchmark for position distance/range checks
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "../readsb.h"
+
+// Simulates the per-position work in track.c: a receiver range check
+// (doGlobalCPR), a speed check against the previous position (speed_check)
+// and the range histogram (update_range_histogram).
+//
+// Sample results, x86_64 VM:
+//   greatcircle:         7.00M positions/second
+//   cached geo_ref:     15.14M positions/second
+
+#define POSITIONS 4096
+
+static double pos_lat[POSITIONS];
+static double pos_lon[POSITIONS];
+static double receiver_lat = 52.0, receiver_lon = 8.0;
+
+static void prepare() {
+    srand(1);
+
+    // a track of positions 1-2km apart, spread around the receiver
+    double lat = receiver_lat + 2.0, lon = receiver_lon - 3.0;
+    for (int i = 0; i < POSITIONS; ++i) {
+        lat += 0.01 * (rand() / (RAND_MAX + 1.0) - 0.3);
+        lon += 0.02 * (rand() / (RAND_MAX + 1.0) - 0.3);
+        pos_lat[i] = lat;
+        pos_lon[i] = lon;
+    }
+}
+
+static unsigned run_greatcircle() {
+    unsigned ok = 0;
+    double sum = 0;
+    for (int i = 1; i < POSITIONS; ++i) {
+        ok += (greatcircle(receiver_lat, receiver_lon, pos_lat[i], pos_lon[i]) <= 1852 * 300);
+        ok += (greatcircle(pos_lat[i-1], pos_lon[i-1], pos_lat[i], pos_lon[i]) <= 5000);
+        sum += greatcircle(receiver_lat, receiver_lon, pos_lat[i], pos_lon[i]);
+    }
+    return ok + (sum > 0);
+}
+
+static unsigned run_cached() {
+    struct geo_ref receiver, last;
+    unsigned ok = 0;
+    double sum = 0;
+
+    geoSetRef(&receiver, receiver_lat, receiver_lon);
+    geoSetRef(&last, pos_lat[0], pos_lon[0]);
+    for (int i = 1; i < POSITIONS; ++i) {
+        ok += geoWithinRange(&receiver, pos_lat[i], pos_lon[i], 1852 * 300);
+        ok += geoWithinRange(&last, pos_lat[i], pos_lon[i], 5000);
+        sum += geoDistance(&receiver, pos_lat[i], pos_lon[i]);
+        geoSetRef(&last, pos_lat[i], pos_lon[i]); // position accepted
+    }
+    return ok + (sum > 0);
+}
+
+static void test(const char *what, unsigned (*fn)(void)) {
+    fprintf(stderr, "Benchmarking: %s ", what);
+
+    struct timespec total = { 0, 0 };
+    int iterations = 0;
+    unsigned result = 0;
+
+    while (total.tv_sec < 5) {
+        fprintf(stderr, ".");
+
+        struct timespec start;
+        start_cpu_timing(&start);
+
+        for (int i = 0; i < 100; ++i)
+            result += fn();
+
+        end_cpu_timing(&start, &total);
+        iterations++;
+    }
+
+    fprintf(stderr, "\n");
+
+    double positions = 100.0 * iterations * (POSITIONS - 1);
+    double nanos = total.tv_sec * 1e9 + total.tv_nsec;
+    fprintf(stderr, "  %.2fM positions in %.6f seconds (%u)\n",
+            positions / 1e6, nanos / 1e9, result);
+    fprintf(stderr, "  %.2fM positions/second\n",
+            positions / nanos * 1e3);
+}
+
+int main(int argc, char **argv) {
+    MODES_NOTUSED(argc);
+    MODES_NOTUSED(argv);
+
+    prepare();
+
+    test("greatcircle", run_greatcircle);
+    test("cached geo_ref", run_cached);
+}
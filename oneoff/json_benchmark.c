@@ -0,0 +1,523 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// json_benchmark.c: benchmark for the aircraft.json writer
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "../readsb.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+
+// Writes the objects of AIRCRAFT synthetic aircraft, most fields present,
+// a mix of sources, the way aircraft.json lists them: with the
+// snprintf-per-field writer appendAircraftJson() used to be and with the
+// current one. The output of the two is compared first, along with a
+// sweep of values through jsonFixed() against printf, and each object is
+// checked against AIRCRAFT_JSON_MAX.
+//
+// Sample results, x86_64 VM:
+//   snprintf writer:     0.18M aircraft/second
+//   appendAircraftJson:  1.54M aircraft/second
+
+#define AIRCRAFT 5000
+
+struct _Modes Modes;
+
+static struct aircraft aircraft[AIRCRAFT];
+static char *buffer;
+static uint64_t now = 1577836800000ULL;
+
+void receiverPositionChanged(float lat, float lon, float alt) {
+    MODES_NOTUSED(lat);
+    MODES_NOTUSED(lon);
+    MODES_NOTUSED(alt);
+}
+
+// The writer and its helpers as they were in net_io.c, for reference
+
+__attribute__ ((format(printf, 3, 4))) static char *safe_snprintf(char *p, char *end, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    p += vsnprintf(p < end ? p : NULL, p < end ? (size_t) (end - p) : 0, format, ap);
+    va_end(ap);
+    return p;
+}
+
+// usual caveats about function-returning-pointer-to-static-buffer apply
+static const char *jsonEscapeString(const char *str) {
+    static char buf[1024];
+    const char *in = str;
+    char *out = buf, *end = buf + sizeof (buf) - 10;
+
+    for (; *in && out < end; ++in) {
+        unsigned char ch = *in;
+        if (ch == '"' || ch == '\\') {
+            *out++ = '\\';
+            *out++ = ch;
+        } else if (ch < 32 || ch > 127) {
+            out = safe_snprintf(out, end, "\\u%04x", ch);
+        } else {
+            *out++ = ch;
+        }
+    }
+
+    *out++ = 0;
+    return buf;
+}
+
+
+static char *append_flags(char *p, char *end, struct aircraft *a, datasource_t source) {
+    p = safe_snprintf(p, end, "[");
+
+    char *start = p;
+    if (a->callsign_valid.source == source)
+        p = safe_snprintf(p, end, "\"callsign\",");
+    if (a->altitude_baro_valid.source == source)
+        p = safe_snprintf(p, end, "\"altitude\",");
+    if (a->altitude_geom_valid.source == source)
+        p = safe_snprintf(p, end, "\"alt_geom\",");
+    if (a->gs_valid.source == source)
+        p = safe_snprintf(p, end, "\"gs\",");
+    if (a->ias_valid.source == source)
+        p = safe_snprintf(p, end, "\"ias\",");
+    if (a->tas_valid.source == source)
+        p = safe_snprintf(p, end, "\"tas\",");
+    if (a->mach_valid.source == source)
+        p = safe_snprintf(p, end, "\"mach\",");
+    if (a->track_valid.source == source)
+        p = safe_snprintf(p, end, "\"track\",");
+    if (a->track_rate_valid.source == source)
+        p = safe_snprintf(p, end, "\"track_rate\",");
+    if (a->roll_valid.source == source)
+        p = safe_snprintf(p, end, "\"roll\",");
+    if (a->mag_heading_valid.source == source)
+        p = safe_snprintf(p, end, "\"mag_heading\",");
+    if (a->true_heading_valid.source == source)
+        p = safe_snprintf(p, end, "\"true_heading\",");
+    if (a->baro_rate_valid.source == source)
+        p = safe_snprintf(p, end, "\"baro_rate\",");
+    if (a->geom_rate_valid.source == source)
+        p = safe_snprintf(p, end, "\"geom_rate\",");
+    if (a->squawk_valid.source == source)
+        p = safe_snprintf(p, end, "\"squawk\",");
+    if (a->emergency_valid.source == source)
+        p = safe_snprintf(p, end, "\"emergency\",");
+    if (a->nav_qnh_valid.source == source)
+        p = safe_snprintf(p, end, "\"nav_qnh\",");
+    if (a->nav_altitude_mcp_valid.source == source)
+        p = safe_snprintf(p, end, "\"nav_altitude_mcp\",");
+    if (a->nav_altitude_fms_valid.source == source)
+        p = safe_snprintf(p, end, "\"nav_altitude_fms\",");
+    if (a->nav_heading_valid.source == source)
+        p = safe_snprintf(p, end, "\"nav_heading\",");
+    if (a->nav_modes_valid.source == source)
+        p = safe_snprintf(p, end, "\"nav_modes\",");
+    if (a->position_valid.source == source)
+        p = safe_snprintf(p, end, "\"lat\",\"lon\",\"nic\",\"rc\",");
+    if (a->nic_baro_valid.source == source)
+        p = safe_snprintf(p, end, "\"nic_baro\",");
+    if (a->nac_p_valid.source == source)
+        p = safe_snprintf(p, end, "\"nac_p\",");
+    if (a->nac_v_valid.source == source)
+        p = safe_snprintf(p, end, "\"nac_v\",");
+    if (a->sil_valid.source == source)
+        p = safe_snprintf(p, end, "\"sil\",\"sil_type\",");
+    if (a->gva_valid.source == source)
+        p = safe_snprintf(p, end, "\"gva\",");
+    if (a->sda_valid.source == source)
+        p = safe_snprintf(p, end, "\"sda\",");
+    if (p != start)
+        --p;
+    p = safe_snprintf(p, end, "]");
+    return p;
+}
+
+static struct {
+    nav_modes_t flag;
+    const char *name;
+} nav_modes_names[] = {
+    { NAV_MODE_AUTOPILOT, "autopilot"},
+    { NAV_MODE_VNAV, "vnav"},
+    { NAV_MODE_ALT_HOLD, "althold"},
+    { NAV_MODE_APPROACH, "approach"},
+    { NAV_MODE_LNAV, "lnav"},
+    { NAV_MODE_TCAS, "tcas"},
+    { 0, NULL}
+};
+
+static char *append_nav_modes(char *p, char *end, nav_modes_t flags, const char *quote, const char *sep) {
+    int first = 1;
+    for (int i = 0; nav_modes_names[i].name; ++i) {
+        if (!(flags & nav_modes_names[i].flag)) {
+            continue;
+        }
+
+        if (!first) {
+            p = safe_snprintf(p, end, "%s", sep);
+        }
+
+        first = 0;
+        p = safe_snprintf(p, end, "%s%s%s", quote, nav_modes_names[i].name, quote);
+    }
+
+    return p;
+}
+
+
+static const char *addrtype_enum_string(addrtype_t type) {
+    switch (type) {
+        case ADDR_ADSB_ICAO:
+            return "adsb_icao";
+        case ADDR_ADSB_ICAO_NT:
+            return "adsb_icao_nt";
+        case ADDR_ADSR_ICAO:
+            return "adsr_icao";
+        case ADDR_TISB_ICAO:
+            return "tisb_icao";
+        case ADDR_ADSB_OTHER:
+            return "adsb_other";
+        case ADDR_ADSR_OTHER:
+            return "adsr_other";
+        case ADDR_TISB_OTHER:
+            return "tisb_other";
+        case ADDR_TISB_TRACKFILE:
+            return "tisb_trackfile";
+        default:
+            return "unknown";
+    }
+}
+
+static const char *emergency_enum_string(emergency_t emergency) {
+    switch (emergency) {
+        case EMERGENCY_NONE: return "none";
+        case EMERGENCY_GENERAL: return "general";
+        case EMERGENCY_LIFEGUARD: return "lifeguard";
+        case EMERGENCY_MINFUEL: return "minfuel";
+        case EMERGENCY_NORDO: return "nordo";
+        case EMERGENCY_UNLAWFUL: return "unlawful";
+        case EMERGENCY_DOWNED: return "downed";
+        default: return "reserved";
+    }
+}
+
+static const char *sil_type_enum_string(sil_type_t type) {
+    switch (type) {
+        case SIL_UNKNOWN: return "unknown";
+        case SIL_PER_HOUR: return "perhour";
+        case SIL_PER_SAMPLE: return "persample";
+        default: return "invalid";
+    }
+}
+
+
+static char *sprintfAircraftJson(char *p, char *end, struct aircraft *a, uint64_t now) {
+    p = safe_snprintf(p, end, "{\"hex\":\"%s%06x\"", (a->addr & MODES_NON_ICAO_ADDRESS) ? "~" : "", a->addr & 0xFFFFFF);
+    if (a->addrtype != ADDR_ADSB_ICAO)
+        p = safe_snprintf(p, end, ",\"type\":\"%s\"", addrtype_enum_string(a->addrtype));
+    if (trackDataValid(&a->callsign_valid))
+        p = safe_snprintf(p, end, ",\"flight\":\"%s\"", jsonEscapeString(a->callsign));
+    if (trackDataValid(&a->airground_valid) && a->airground_valid.source >= SOURCE_MODE_S_CHECKED && a->airground == AG_GROUND)
+        p = safe_snprintf(p, end, ",\"alt_baro\":\"ground\"");
+    else {
+        if (trackDataValid(&a->altitude_baro_valid) && a->altitude_baro_reliable >= 3)
+            p = safe_snprintf(p, end, ",\"alt_baro\":%d", a->altitude_baro);
+        if (trackDataValid(&a->altitude_geom_valid))
+            p = safe_snprintf(p, end, ",\"alt_geom\":%d", a->altitude_geom);
+    }
+    if (trackDataValid(&a->gs_valid))
+        p = safe_snprintf(p, end, ",\"gs\":%.1f", a->gs);
+    if (trackDataValid(&a->ias_valid))
+        p = safe_snprintf(p, end, ",\"ias\":%u", a->ias);
+    if (trackDataValid(&a->tas_valid))
+        p = safe_snprintf(p, end, ",\"tas\":%u", a->tas);
+    if (trackDataValid(&a->mach_valid))
+        p = safe_snprintf(p, end, ",\"mach\":%.3f", a->mach);
+    if (trackDataValid(&a->track_valid))
+        p = safe_snprintf(p, end, ",\"track\":%.1f", a->track);
+    if (trackDataValid(&a->track_rate_valid))
+        p = safe_snprintf(p, end, ",\"track_rate\":%.2f", a->track_rate);
+    if (trackDataValid(&a->roll_valid))
+        p = safe_snprintf(p, end, ",\"roll\":%.1f", a->roll);
+    if (trackDataValid(&a->mag_heading_valid))
+        p = safe_snprintf(p, end, ",\"mag_heading\":%.1f", a->mag_heading);
+    if (trackDataValid(&a->true_heading_valid))
+        p = safe_snprintf(p, end, ",\"true_heading\":%.1f", a->true_heading);
+    if (trackDataValid(&a->baro_rate_valid))
+        p = safe_snprintf(p, end, ",\"baro_rate\":%d", a->baro_rate);
+    if (trackDataValid(&a->geom_rate_valid))
+        p = safe_snprintf(p, end, ",\"geom_rate\":%d", a->geom_rate);
+    if (trackDataValid(&a->squawk_valid))
+        p = safe_snprintf(p, end, ",\"squawk\":\"%04x\"", a->squawk);
+    if (trackDataValid(&a->emergency_valid))
+        p = safe_snprintf(p, end, ",\"emergency\":\"%s\"", emergency_enum_string(a->emergency));
+    if (a->category != 0)
+        p = safe_snprintf(p, end, ",\"category\":\"%02X\"", a->category);
+    if (trackDataValid(&a->nav_qnh_valid))
+        p = safe_snprintf(p, end, ",\"nav_qnh\":%.1f", a->nav_qnh);
+    if (trackDataValid(&a->nav_altitude_mcp_valid))
+        p = safe_snprintf(p, end, ",\"nav_altitude_mcp\":%d", a->nav_altitude_mcp);
+    if (trackDataValid(&a->nav_altitude_fms_valid))
+        p = safe_snprintf(p, end, ",\"nav_altitude_fms\":%d", a->nav_altitude_fms);
+    if (trackDataValid(&a->nav_heading_valid))
+        p = safe_snprintf(p, end, ",\"nav_heading\":%.1f", a->nav_heading);
+    if (trackDataValid(&a->nav_modes_valid)) {
+        p = safe_snprintf(p, end, ",\"nav_modes\":[");
+        p = append_nav_modes(p, end, a->nav_modes, "\"", ",");
+        p = safe_snprintf(p, end, "]");
+    }
+    if (trackDataValid(&a->position_valid))
+        p = safe_snprintf(p, end, ",\"lat\":%f,\"lon\":%f,\"nic\":%u,\"rc\":%u,\"seen_pos\":%.1f", a->lat, a->lon, a->pos_nic, a->pos_rc, (now - a->position_valid.updated) / 1000.0);
+    if (a->adsb_version >= 0)
+        p = safe_snprintf(p, end, ",\"version\":%d", a->adsb_version);
+    if (trackDataValid(&a->nic_baro_valid))
+        p = safe_snprintf(p, end, ",\"nic_baro\":%u", a->nic_baro);
+    if (trackDataValid(&a->nac_p_valid))
+        p = safe_snprintf(p, end, ",\"nac_p\":%u", a->nac_p);
+    if (trackDataValid(&a->nac_v_valid))
+        p = safe_snprintf(p, end, ",\"nac_v\":%u", a->nac_v);
+    if (trackDataValid(&a->sil_valid))
+        p = safe_snprintf(p, end, ",\"sil\":%u", a->sil);
+    if (a->sil_type != SIL_INVALID)
+        p = safe_snprintf(p, end, ",\"sil_type\":\"%s\"", sil_type_enum_string(a->sil_type));
+    if (trackDataValid(&a->gva_valid))
+        p = safe_snprintf(p, end, ",\"gva\":%u", a->gva);
+    if (trackDataValid(&a->sda_valid))
+        p = safe_snprintf(p, end, ",\"sda\":%u", a->sda);
+    if (trackDataValid(&a->alert_valid))
+        p = safe_snprintf(p, end, ",\"alert\":%u", a->alert);
+    if (trackDataValid(&a->spi_valid))
+        p = safe_snprintf(p, end, ",\"spi\":%u", a->spi);
+
+    p = safe_snprintf(p, end, ",\"mlat\":");
+    p = append_flags(p, end, a, SOURCE_MLAT);
+    p = safe_snprintf(p, end, ",\"tisb\":");
+    p = append_flags(p, end, a, SOURCE_TISB);
+
+    p = safe_snprintf(p, end, ",\"messages\":%ld,\"seen\":%.1f,\"rssi\":%.1f}",
+            a->messages, (now - a->seen) / 1000.0,
+            10 * log10((a->signalLevel[0] + a->signalLevel[1] + a->signalLevel[2] + a->signalLevel[3] +
+                    a->signalLevel[4] + a->signalLevel[5] + a->signalLevel[6] + a->signalLevel[7] + 1e-5) / 8));
+
+    return p;
+}
+
+static double frand(double lo, double hi) {
+    return lo + (hi - lo) * (rand() / (RAND_MAX + 1.0));
+}
+
+static void validity(data_validity *v) {
+    static const datasource_t sources[] = { SOURCE_ADSB, SOURCE_ADSB, SOURCE_ADSB, SOURCE_MLAT, SOURCE_TISB, SOURCE_MODE_S_CHECKED };
+
+    if (rand() % 10 < 2) {
+        v->source = SOURCE_INVALID;
+        return;
+    }
+    v->source = sources[rand() % 6];
+    v->updated = now - rand() % 30000;
+    v->expires = now + 60000;
+}
+
+static void prepare() {
+    static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 ";
+
+    for (int i = 0; i < AIRCRAFT; ++i) {
+        struct aircraft *a = &aircraft[i];
+
+        a->addr = (rand() & 0xFFFFFF) | (i % 50 == 0 ? MODES_NON_ICAO_ADDRESS : 0);
+        a->addrtype = (i % 10 == 0) ? (addrtype_t) (rand() % (ADDR_UNKNOWN + 1)) : ADDR_ADSB_ICAO;
+
+        validity(&a->callsign_valid);
+        for (int j = 0; j < 8; ++j)
+            a->callsign[j] = chars[rand() % (sizeof (chars) - 1)];
+        a->callsign[8] = 0;
+        if (i % 500 == 0) // something to escape
+            a->callsign[rand() % 8] = (i % 1000) ? '"' : (char) 0xe9;
+
+        validity(&a->airground_valid);
+        a->airground = (i % 20 == 0) ? AG_GROUND : AG_AIRBORNE;
+        validity(&a->altitude_baro_valid);
+        a->altitude_baro = 25 * (rand() % 1800) - 1000;
+        a->altitude_baro_reliable = rand() % 5;
+        validity(&a->altitude_geom_valid);
+        a->altitude_geom = a->altitude_baro + 25 * (rand() % 40);
+        validity(&a->gs_valid);
+        a->gs = frand(0, 600);
+        validity(&a->ias_valid);
+        a->ias = rand() % 400;
+        validity(&a->tas_valid);
+        a->tas = rand() % 500;
+        validity(&a->mach_valid);
+        a->mach = frand(0, 0.9);
+        validity(&a->track_valid);
+        a->track = frand(0, 360);
+        validity(&a->track_rate_valid);
+        a->track_rate = frand(-3, 3);
+        validity(&a->roll_valid);
+        a->roll = frand(-30, 30);
+        validity(&a->mag_heading_valid);
+        a->mag_heading = frand(0, 360);
+        validity(&a->true_heading_valid);
+        a->true_heading = frand(0, 360);
+        validity(&a->baro_rate_valid);
+        a->baro_rate = 64 * (rand() % 100 - 50);
+        validity(&a->geom_rate_valid);
+        a->geom_rate = 64 * (rand() % 100 - 50);
+        validity(&a->squawk_valid);
+        a->squawk = rand() & 0x7777;
+        validity(&a->emergency_valid);
+        a->emergency = rand() % (EMERGENCY_RESERVED + 1);
+        a->category = (i % 4) ? 0xA0 + rand() % 0x38 : 0;
+        validity(&a->nav_qnh_valid);
+        a->nav_qnh = frand(950, 1050);
+        validity(&a->nav_altitude_mcp_valid);
+        a->nav_altitude_mcp = 100 * (rand() % 400);
+        validity(&a->nav_altitude_fms_valid);
+        a->nav_altitude_fms = 100 * (rand() % 400);
+        validity(&a->nav_heading_valid);
+        a->nav_heading = frand(0, 360);
+        validity(&a->nav_modes_valid);
+        a->nav_modes = rand() % 64;
+        validity(&a->position_valid);
+        a->lat = frand(-90, 90);
+        a->lon = frand(-180, 180);
+        a->pos_nic = rand() % 12;
+        a->pos_rc = rand() % 40000;
+        a->adsb_version = rand() % 4 - 1;
+        validity(&a->nic_baro_valid);
+        a->nic_baro = rand() % 2;
+        validity(&a->nac_p_valid);
+        a->nac_p = rand() % 16;
+        validity(&a->nac_v_valid);
+        a->nac_v = rand() % 8;
+        validity(&a->sil_valid);
+        a->sil = rand() % 4;
+        a->sil_type = rand() % 4;
+        validity(&a->gva_valid);
+        a->gva = rand() % 4;
+        validity(&a->sda_valid);
+        a->sda = rand() % 4;
+        validity(&a->alert_valid);
+        a->alert = rand() % 2;
+        validity(&a->spi_valid);
+        a->spi = rand() % 2;
+
+        a->messages = rand();
+        a->seen = now - rand() % 60000;
+        for (int j = 0; j < 8; ++j)
+            a->signalLevel[j] = frand(0, 1);
+    }
+}
+
+static void verify() {
+    char ref[AIRCRAFT_JSON_MAX * 2], out[AIRCRAFT_JSON_MAX];
+    unsigned mismatches = 0, values = 0, longest = 0;
+
+    for (int i = 0; i < AIRCRAFT; ++i) {
+        char *end_ref = sprintfAircraftJson(ref, ref + sizeof (ref), &aircraft[i], now);
+        char *end = appendAircraftJson(out, &aircraft[i], now);
+
+        if (end - out > (int) longest)
+            longest = end - out;
+        if (end - out != end_ref - ref || memcmp(out, ref, end - out)) {
+            if (!mismatches)
+                fprintf(stderr, "  mismatch:\n    %.*s\n    %.*s\n", (int) (end_ref - ref), ref, (int) (end - out), out);
+            mismatches++;
+        }
+    }
+
+    // numbers, including ones at or next to a rounding boundary
+    for (int i = 0; i < 1000000; ++i) {
+        int decimals = i % 7;
+        double v = (rand() % 2000001 - 1000000) / 1e5 + (i % 3 - 1) * 0.000005;
+        char *end_ref;
+        char *end;
+
+        if (i & 1)
+            v = nextafter(v, 0);
+        if (i % 1000 == 0)
+            v *= 1e6;
+        end_ref = ref + sprintf(ref, "%.*f", decimals, v);
+        end = jsonFixed(out, v, decimals);
+        values++;
+        if (end - out != end_ref - ref || memcmp(out, ref, end - out)) {
+            if (!mismatches)
+                fprintf(stderr, "  mismatch: %.*s %.*s\n", (int) (end_ref - ref), ref, (int) (end - out), out);
+            mismatches++;
+        }
+    }
+
+    fprintf(stderr, "Verified %u aircraft and %u values, %u mismatches, longest object %u of %u bytes\n",
+            AIRCRAFT, values, mismatches, longest, AIRCRAFT_JSON_MAX);
+}
+
+static char *sprintfWrite(char *p, struct aircraft *a) {
+    return sprintfAircraftJson(p, p + AIRCRAFT_JSON_MAX, a, now);
+}
+
+static char *fastWrite(char *p, struct aircraft *a) {
+    return appendAircraftJson(p, a, now);
+}
+
+static void test(const char *what, char *(*write)(char *, struct aircraft *)) {
+    fprintf(stderr, "Benchmarking: %s ", what);
+
+    struct timespec total = { 0, 0 };
+    int iterations = 0;
+    uint64_t bytes = 0;
+
+    while (total.tv_sec < 5) {
+        fprintf(stderr, ".");
+
+        struct timespec start;
+        start_cpu_timing(&start);
+
+        char *p = buffer;
+        for (int i = 0; i < AIRCRAFT; ++i) {
+            p = write(p, &aircraft[i]);
+            *p++ = ',';
+        }
+        bytes += p - buffer;
+
+        end_cpu_timing(&start, &total);
+        iterations++;
+    }
+
+    fprintf(stderr, "\n");
+
+    double written = 1.0 * iterations * AIRCRAFT;
+    double nanos = total.tv_sec * 1e9 + total.tv_nsec;
+    fprintf(stderr, "  %.2fM aircraft in %.6f seconds (%" PRIu64 " bytes)\n",
+            written / 1e6, nanos / 1e9, bytes);
+    fprintf(stderr, "  %.2fM aircraft/second, %.0f aircraft.json/second\n",
+            written / nanos * 1e3, iterations / (nanos / 1e9));
+}
+
+int main(int argc, char **argv) {
+    MODES_NOTUSED(argc);
+    MODES_NOTUSED(argv);
+
+    _messageNow = now;
+    buffer = malloc((size_t) AIRCRAFT * (AIRCRAFT_JSON_MAX + 1));
+
+    prepare();
+    verify();
+
+    test("snprintf writer", sprintfWrite);
+    test("appendAircraftJson", fastWrite);
+
+    free(buffer);
+}
@@ -0,0 +1,525 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// sbs_benchmark.c: benchmark for the SBS output encoder
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "../readsb.h"
+
+#include <inttypes.h>
+
+// Encodes a mix of DF4/5/11/17/20/21 messages, arriving a few milliseconds
+// apart, with the sprintf/localtime_r encoder modesSendSBSOutput() used to
+// have and with sbsEncode(). Both get the current time per message, as
+// modesSendSBSOutput() does. The output of the two is compared first,
+// along with a sweep of coordinates through the fixed-point formatter.
+//
+// Then parses the resulting lines, plus mlat-client style ones, with the
+// strsep/strtod parser decodeSbsLine() used to have and with sbsDecode(),
+// after checking they agree on the fields both understand.
+//
+// Sample results, x86_64 VM:
+//   sprintf encoder:     0.73M messages/second
+//   sbsEncode:           7.12M messages/second
+//   strsep parser:       1.72M lines/second
+//   sbsDecode:           3.25M lines/second
+
+#define MESSAGES 4096
+
+static struct modesMessage messages[MESSAGES];
+static struct aircraft aircraft;
+static char line[SBS_MAX_LINE * 2];
+static char input[MESSAGES][SBS_MAX_LINE];
+
+// The encoder as it was in net_io.c, for reference
+static char *sprintfEncode(char *p, struct modesMessage *mm, struct aircraft *a, uint64_t now_ms, int use_gnss) {
+    struct tm stTime_receive, stTime_now;
+    int msgType;
+
+    switch (mm->msgtype) {
+        case 4:
+        case 20:
+            msgType = 5;
+            break;
+        case 5:
+        case 21:
+            msgType = 6;
+            break;
+        case 0:
+        case 16:
+            msgType = 7;
+            break;
+        case 11:
+            msgType = 8;
+            break;
+        case 17:
+        case 18:
+            if (mm->metype >= 1 && mm->metype <= 4) {
+                msgType = 1;
+            } else if (mm->metype >= 5 && mm->metype <= 8) {
+                msgType = 2;
+            } else if (mm->metype >= 9 && mm->metype <= 18) {
+                msgType = 3;
+            } else if (mm->metype == 19) {
+                msgType = 4;
+            } else {
+                return NULL;
+            }
+            break;
+        default:
+            return NULL;
+    }
+
+    p += sprintf(p, "MSG,%d,1,1,%06X,1,", msgType, mm->addr);
+
+    time_t now = (time_t) (now_ms / 1000);
+    localtime_r(&now, &stTime_now);
+    time_t received = (time_t) (mm->sysTimestampMsg / 1000);
+    localtime_r(&received, &stTime_receive);
+
+    p += sprintf(p, "%04d/%02d/%02d,", (stTime_receive.tm_year + 1900), (stTime_receive.tm_mon + 1), stTime_receive.tm_mday);
+    p += sprintf(p, "%02d:%02d:%02d.%03u,", stTime_receive.tm_hour, stTime_receive.tm_min, stTime_receive.tm_sec, (unsigned) (mm->sysTimestampMsg % 1000));
+    p += sprintf(p, "%04d/%02d/%02d,", (stTime_now.tm_year + 1900), (stTime_now.tm_mon + 1), stTime_now.tm_mday);
+    p += sprintf(p, "%02d:%02d:%02d.%03u", stTime_now.tm_hour, stTime_now.tm_min, stTime_now.tm_sec, (unsigned) (now_ms % 1000));
+
+    if (mm->callsign_valid)
+        p += sprintf(p, ",%s", mm->callsign);
+    else
+        p += sprintf(p, ",");
+
+    if (use_gnss) {
+        if (mm->altitude_geom_valid)
+            p += sprintf(p, ",%dH", mm->altitude_geom);
+        else if (mm->altitude_baro_valid && trackDataValid(&a->geom_delta_valid))
+            p += sprintf(p, ",%dH", mm->altitude_baro + a->geom_delta);
+        else if (mm->altitude_baro_valid)
+            p += sprintf(p, ",%d", mm->altitude_baro);
+        else
+            p += sprintf(p, ",");
+    } else {
+        if (mm->altitude_baro_valid)
+            p += sprintf(p, ",%d", mm->altitude_baro);
+        else if (mm->altitude_geom_valid && trackDataValid(&a->geom_delta_valid))
+            p += sprintf(p, ",%d", mm->altitude_geom - a->geom_delta);
+        else
+            p += sprintf(p, ",");
+    }
+
+    if (mm->gs_valid)
+        p += sprintf(p, ",%.0f", mm->gs.selected);
+    else
+        p += sprintf(p, ",");
+
+    if (mm->heading_valid && mm->heading_type == HEADING_GROUND_TRACK)
+        p += sprintf(p, ",%.0f", mm->heading);
+    else
+        p += sprintf(p, ",");
+
+    if (mm->cpr_decoded)
+        p += sprintf(p, ",%1.5f,%1.5f", mm->decoded_lat, mm->decoded_lon);
+    else
+        p += sprintf(p, ",,");
+
+    if (use_gnss) {
+        if (mm->geom_rate_valid)
+            p += sprintf(p, ",%dH", mm->geom_rate);
+        else if (mm->baro_rate_valid)
+            p += sprintf(p, ",%d", mm->baro_rate);
+        else
+            p += sprintf(p, ",");
+    } else {
+        if (mm->baro_rate_valid)
+            p += sprintf(p, ",%d", mm->baro_rate);
+        else if (mm->geom_rate_valid)
+            p += sprintf(p, ",%d", mm->geom_rate);
+        else
+            p += sprintf(p, ",");
+    }
+
+    if (mm->squawk_valid)
+        p += sprintf(p, ",%04x", mm->squawk);
+    else
+        p += sprintf(p, ",");
+
+    if (mm->alert_valid)
+        p += sprintf(p, mm->alert ? ",-1" : ",0");
+    else
+        p += sprintf(p, ",");
+
+    if (mm->squawk_valid) {
+        if ((mm->squawk == 0x7500) || (mm->squawk == 0x7600) || (mm->squawk == 0x7700))
+            p += sprintf(p, ",-1");
+        else
+            p += sprintf(p, ",0");
+    } else {
+        p += sprintf(p, ",");
+    }
+
+    if (mm->spi_valid)
+        p += sprintf(p, mm->spi ? ",-1" : ",0");
+    else
+        p += sprintf(p, ",");
+
+    switch (mm->airground) {
+        case AG_GROUND:
+            p += sprintf(p, ",-1");
+            break;
+        case AG_AIRBORNE:
+            p += sprintf(p, ",0");
+            break;
+        default:
+            p += sprintf(p, ",");
+            break;
+    }
+
+    p += sprintf(p, "\r\n");
+    return p;
+}
+
+static double frand(double lo, double hi) {
+    return lo + (hi - lo) * (rand() / (RAND_MAX + 1.0));
+}
+
+static void prepare() {
+    static const int types[] = { 4, 5, 11, 17, 17, 17, 17, 17, 20, 21 };
+    static const unsigned squawks[] = { 0x1000, 0x7000, 0x7700, 0x0421, 0x2000 };
+    uint64_t received = 1571500000000ULL; // mid October 2019
+
+    srand(1);
+
+    aircraft.geom_delta = -125;
+    aircraft.geom_delta_valid.source = SOURCE_ADSB;
+    aircraft.geom_delta_valid.expires = ~(uint64_t) 0;
+
+    for (int i = 0; i < MESSAGES; ++i) {
+        struct modesMessage *mm = &messages[i];
+
+        received += rand() % 5;
+        mm->sysTimestampMsg = received;
+        mm->msgtype = types[rand() % 10];
+        mm->metype = 1 + rand() % 22;
+        mm->addr = rand() & 0xFFFFFF;
+
+        if ((mm->callsign_valid = (mm->metype <= 4)))
+            snprintf(mm->callsign, sizeof (mm->callsign), "%c%c%c%d", 'A' + rand() % 26, 'A' + rand() % 26, 'A' + rand() % 26, rand() % 10000);
+        mm->altitude_baro_valid = rand() % 2;
+        mm->altitude_baro = (rand() % 1800 - 40) * 25;
+        mm->altitude_geom_valid = rand() % 4 == 0;
+        mm->altitude_geom = mm->altitude_baro + 150;
+        mm->gs_valid = rand() % 2;
+        mm->gs.selected = frand(0, 600);
+        mm->heading_valid = rand() % 2;
+        mm->heading_type = HEADING_GROUND_TRACK;
+        mm->heading = frand(0, 360);
+        if ((mm->cpr_decoded = rand() % 2)) {
+            mm->decoded_lat = frand(-90, 90);
+            mm->decoded_lon = frand(-180, 180);
+        }
+        mm->baro_rate_valid = rand() % 3 == 0;
+        mm->baro_rate = (rand() % 129 - 64) * 64;
+        mm->geom_rate_valid = rand() % 3 == 0;
+        mm->geom_rate = (rand() % 129 - 64) * 64;
+        mm->squawk_valid = rand() % 2;
+        mm->squawk = squawks[rand() % 5];
+        mm->alert_valid = rand() % 2;
+        mm->alert = rand() % 2;
+        mm->spi_valid = rand() % 2;
+        mm->spi = rand() % 2;
+        mm->airground = rand() % 4;
+    }
+}
+
+static uint64_t now_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Everything sbsEncode() writes has to match what sprintf wrote
+static void verify() {
+    char ref[SBS_MAX_LINE * 2];
+    unsigned mismatches = 0, lines = 0;
+
+    for (int use_gnss = 0; use_gnss <= 1; ++use_gnss) {
+        for (int i = 0; i < MESSAGES; ++i) {
+            uint64_t now = messages[i].sysTimestampMsg + (i % 7) * 997;
+            char *end_ref = sprintfEncode(ref, &messages[i], &aircraft, now, use_gnss);
+            char *end = sbsEncode(line, &messages[i], &aircraft, now, use_gnss);
+
+            if (!end_ref || !end) {
+                mismatches += (end_ref != end);
+                continue;
+            }
+
+            lines++;
+            if (end - line != end_ref - ref || memcmp(line, ref, end - line)) {
+                if (!mismatches)
+                    fprintf(stderr, "  mismatch:\n    %.*s    %.*s", (int) (end_ref - ref), ref, (int) (end - line), line);
+                mismatches++;
+            }
+        }
+    }
+
+    // coordinates, including ones at or next to a rounding boundary
+    struct modesMessage mm = messages[0];
+    mm.msgtype = 17;
+    mm.metype = 11;
+    mm.cpr_decoded = 1;
+    for (int i = 0; i < 1000000; ++i) {
+        char ref[SBS_MAX_LINE * 2];
+        double lat = (rand() % 18000001 - 9000000) / 1e5 + (i % 3 - 1) * 0.000005;
+
+        mm.decoded_lat = (i & 1) ? lat : nextafter(lat, 0);
+        mm.decoded_lon = frand(-180, 180);
+        char *end_ref = sprintfEncode(ref, &mm, &aircraft, mm.sysTimestampMsg, 0);
+        char *end = sbsEncode(line, &mm, &aircraft, mm.sysTimestampMsg, 0);
+        lines++;
+        if (end - line != end_ref - ref || memcmp(line, ref, end - line)) {
+            if (!mismatches)
+                fprintf(stderr, "  mismatch:\n    %.*s    %.*s", (int) (end_ref - ref), ref, (int) (end - line), line);
+            mismatches++;
+        }
+    }
+
+    fprintf(stderr, "Verified %u lines, %u mismatches\n", lines, mismatches);
+}
+
+static void test(const char *what, char *(*encode)(char *, struct modesMessage *, struct aircraft *, uint64_t, int)) {
+    fprintf(stderr, "Benchmarking: %s ", what);
+
+    struct timespec total = { 0, 0 };
+    int iterations = 0;
+    uint64_t bytes = 0;
+
+    while (total.tv_sec < 5) {
+        fprintf(stderr, ".");
+
+        struct timespec start;
+        start_cpu_timing(&start);
+
+        for (int i = 0; i < MESSAGES; ++i) {
+            char *end = encode(line, &messages[i], &aircraft, now_ms(), 0);
+            if (end)
+                bytes += end - line;
+        }
+
+        end_cpu_timing(&start, &total);
+        iterations++;
+    }
+
+    fprintf(stderr, "\n");
+
+    double encoded = 1.0 * iterations * MESSAGES;
+    double nanos = total.tv_sec * 1e9 + total.tv_nsec;
+    fprintf(stderr, "  %.2fM messages in %.6f seconds (%" PRIu64 " bytes)\n",
+            encoded / 1e6, nanos / 1e9, bytes);
+    fprintf(stderr, "  %.2fM messages/second\n",
+            encoded / nanos * 1e3);
+}
+
+static int hexDigitVal(int c) {
+    c = tolower(c);
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    else if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    else
+        return -1;
+}
+
+// The parser as it was in net_io.c, for reference
+static int strsepDecode(char *line, struct modesMessage *mm) {
+    char *p = line;
+    char *t[23];
+
+    mm->remote = 1;
+    mm->signalLevel = 0;
+    mm->sbs_in = 1;
+
+    for (int i = 1; i < 23; i++) {
+        t[i] = strsep(&p, ",");
+        if (!p && i < 22)
+            return -1;
+    }
+
+    if (!t[1] || strcmp(t[1], "MSG") != 0)
+        return -1;
+    if (!t[2] || strlen(t[2]) != 1)
+        return -1;
+    if (!t[5] || strlen(t[5]) != 6)
+        return -1;
+
+    char *icao = t[5];
+    unsigned char *chars = (unsigned char *) &(mm->addr);
+    for (int j = 0; j < 6; j += 2) {
+        int high = hexDigitVal(icao[j]);
+        int low = hexDigitVal(icao[j + 1]);
+
+        if (high == -1 || low == -1) return -1;
+        chars[2 - j / 2] = (high << 4) | low;
+    }
+    if (mm->addr == 0)
+        return -1;
+
+    if (t[11] && strlen(t[11]) > 0) {
+        strncpy(mm->callsign, t[11], 9);
+        mm->callsign_valid = 1;
+    }
+    if (t[12] && strlen(t[12]) > 0) {
+        mm->altitude_baro = atoi(t[12]);
+        if (mm->altitude_baro < -5000 || mm->altitude_baro > 100000)
+            return -1;
+        mm->altitude_baro_valid = 1;
+        mm->altitude_baro_unit = UNIT_FEET;
+    }
+    if (t[13] && strlen(t[13]) > 0) {
+        mm->gs.v0 = strtod(t[13], NULL);
+        if (mm->gs.v0 > 0)
+            mm->gs_valid = 1;
+    }
+    if (t[14] && strlen(t[14]) > 0) {
+        mm->heading_valid = 1;
+        mm->heading = strtod(t[14], NULL);
+        mm->heading_type = HEADING_GROUND_TRACK;
+    }
+    if (t[15] && strlen(t[15]) && t[16] && strlen(t[16])) {
+        mm->decoded_lat = strtod(t[15], NULL);
+        mm->decoded_lon = strtod(t[16], NULL);
+    }
+    if (t[17] && strlen(t[17]) > 0) {
+        mm->baro_rate = atoi(t[17]);
+        mm->baro_rate_valid = 1;
+    }
+    if (t[18] && strlen(t[18]) > 0) {
+        long int tmp = strtol(t[18], NULL, 10);
+        if (tmp > 0) {
+            mm->squawk = (tmp / 1000) * 16 * 16 * 16 + (tmp / 100 % 10) * 16 * 16 + (tmp / 10 % 10) * 16 + (tmp % 10);
+            mm->squawk_valid = 1;
+        }
+    }
+    if (t[22] && strlen(t[22]) > 0 && atoi(t[22]) > 0)
+        mm->airground = AG_GROUND;
+
+    return 0;
+}
+
+static int fastDecode(char *line, struct modesMessage *mm) {
+    return sbsDecode(line, mm);
+}
+
+// SBS lines as our own output writes them, and as mlat-client does
+static void prepareInput() {
+    for (int i = 0; i < MESSAGES; ++i) {
+        char *end = sbsEncode(input[i], &messages[i], &aircraft, messages[i].sysTimestampMsg + 3, 0);
+
+        if (!end || i % 4 == 0) {
+            snprintf(input[i], sizeof (input[i]),
+                    "MSG,3,1,1,%06X,1,2019/12/10,19:10:46.320,2019/12/10,19:10:47.789,,%d,,,%.4f,%.4f,,,,,,\r\n",
+                    messages[i].addr, messages[i].altitude_baro, frand(-90, 90), frand(-180, 180));
+        } else {
+            *end = 0;
+        }
+        // the line handler gets it without the \n
+        input[i][strcspn(input[i], "\n")] = 0;
+    }
+}
+
+// The old parser only knew some of the fields and never took -1 as "on the
+// ground"; compare what both know.
+static void verifyDecode() {
+    unsigned mismatches = 0;
+
+    for (int i = 0; i < MESSAGES; ++i) {
+        struct modesMessage ref, mm;
+        char scratch[SBS_MAX_LINE];
+        int ret_ref, ret;
+
+        memset(&ref, 0, sizeof (ref));
+        memset(&mm, 0, sizeof (mm));
+        strcpy(scratch, input[i]);
+        ret_ref = strsepDecode(scratch, &ref);
+        ret = sbsDecode(input[i], &mm);
+
+        if (ret_ref != ret || (ret == 0 && (ref.addr != mm.addr
+                || ref.callsign_valid != mm.callsign_valid || strcmp(ref.callsign, mm.callsign)
+                || ref.altitude_baro_valid != mm.altitude_baro_valid || ref.altitude_baro != mm.altitude_baro
+                || ref.gs_valid != mm.gs_valid || ref.gs.v0 != mm.gs.v0
+                || ref.heading_valid != mm.heading_valid || ref.heading != mm.heading
+                || ref.decoded_lat != mm.decoded_lat || ref.decoded_lon != mm.decoded_lon
+                || ref.baro_rate_valid != mm.baro_rate_valid || ref.baro_rate != mm.baro_rate
+                || ref.squawk_valid != mm.squawk_valid || ref.squawk != mm.squawk))) {
+            if (!mismatches)
+                fprintf(stderr, "  mismatch: %s\n", input[i]);
+            mismatches++;
+        }
+    }
+
+    fprintf(stderr, "Verified parsing %u lines, %u mismatches\n", MESSAGES, mismatches);
+}
+
+static void testDecode(const char *what, int (*decode)(char *, struct modesMessage *)) {
+    static struct modesMessage zeroMessage;
+
+    fprintf(stderr, "Benchmarking: %s ", what);
+
+    struct timespec total = { 0, 0 };
+    int iterations = 0;
+    unsigned accepted = 0;
+
+    while (total.tv_sec < 5) {
+        fprintf(stderr, ".");
+
+        struct timespec start;
+        start_cpu_timing(&start);
+
+        for (int i = 0; i < MESSAGES; ++i) {
+            // decodeSbsLine() gets a line it may modify in the client buffer
+            struct modesMessage mm = zeroMessage;
+            char scratch[SBS_MAX_LINE];
+            strcpy(scratch, input[i]);
+            accepted += (decode(scratch, &mm) == 0 && mm.addr);
+        }
+
+        end_cpu_timing(&start, &total);
+        iterations++;
+    }
+
+    fprintf(stderr, "\n");
+
+    double parsed = 1.0 * iterations * MESSAGES;
+    double nanos = total.tv_sec * 1e9 + total.tv_nsec;
+    fprintf(stderr, "  %.2fM lines in %.6f seconds (%u accepted)\n",
+            parsed / 1e6, nanos / 1e9, accepted);
+    fprintf(stderr, "  %.2fM lines/second\n",
+            parsed / nanos * 1e3);
+}
+
+int main(int argc, char **argv) {
+    MODES_NOTUSED(argc);
+    MODES_NOTUSED(argv);
+
+    prepare();
+    verify();
+
+    test("sprintf encoder", sprintfEncode);
+    test("sbsEncode", sbsEncode);
+
+    prepareInput();
+    verifyDecode();
+
+    testDecode("strsep parser", strsepDecode);
+    testDecode("sbsDecode", fastDecode);
+}
@@ -0,0 +1,163 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// sbs_fuzz.c: fuzz target for the SBS input parser
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "../readsb.h"
+
+// Feeds arbitrary lines to sbsDecode() and aborts if what it accepts is
+// out of range. oneoff/sbs_corpus holds one seed line per file.
+//
+// With libFuzzer:
+//   clang -g -O1 -fsanitize=fuzzer,address -DSBS_FUZZ_LIBFUZZER -D_GNU_SOURCE
+//       oneoff/sbs_fuzz.c sbs.c util.c -lm -o sbs_fuzz
+//   ./sbs_fuzz oneoff/sbs_corpus
+//
+// Without, `make oneoff/sbs_fuzz` builds a driver that runs the seeds and
+// then random mutations of them:
+//   oneoff/sbs_fuzz [--iterations N] oneoff/sbs_corpus/*
+
+#define MAX_LINE 1024
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static struct modesMessage zeroMessage;
+    struct modesMessage mm = zeroMessage;
+    char line[MAX_LINE + 1];
+
+    if (size > MAX_LINE)
+        size = MAX_LINE;
+    memcpy(line, data, size);
+    line[size] = 0;
+
+    if (sbsDecode(line, &mm) < 0)
+        return 0;
+
+    if (!mm.addr || mm.addr > 0xFFFFFF || !mm.sbs_in || !mm.remote)
+        abort();
+    if (mm.callsign_valid && strnlen(mm.callsign, sizeof (mm.callsign)) > 8)
+        abort();
+    if (mm.altitude_baro_valid && (mm.altitude_baro < -5000 || mm.altitude_baro > 100000))
+        abort();
+    if (mm.gs_valid && !(mm.gs.v0 > 0 && mm.gs.v0 < 10000))
+        abort();
+    if (mm.heading_valid && !(mm.heading >= 0 && mm.heading <= 360))
+        abort();
+    if (!(fabs(mm.decoded_lat) <= 90) || !(fabs(mm.decoded_lon) <= 180))
+        abort();
+    if (mm.squawk_valid && (mm.squawk == 0 || (mm.squawk & 0x8888)))
+        abort();
+
+    return 0;
+}
+
+#ifndef SBS_FUZZ_LIBFUZZER
+
+static char seeds[256][MAX_LINE + 1];
+static size_t seed_len[256];
+static int nseeds;
+
+static void mutate(char *buf, size_t *len) {
+    static const char interesting[] = ",,-.0123456789eE+\r\n\0 MSGx";
+    int rounds = 1 + rand() % 4;
+
+    while (rounds--) {
+        size_t pos = *len ? rand() % *len : 0;
+
+        switch (rand() % 6) {
+            case 0: // flip a bit
+                if (*len)
+                    buf[pos] ^= 1 << (rand() % 8);
+                break;
+            case 1: // overwrite with something a parser cares about
+                if (*len)
+                    buf[pos] = interesting[rand() % (sizeof (interesting) - 1)];
+                break;
+            case 2: // insert
+                if (*len < MAX_LINE) {
+                    memmove(buf + pos + 1, buf + pos, *len - pos);
+                    buf[pos] = interesting[rand() % (sizeof (interesting) - 1)];
+                    (*len)++;
+                }
+                break;
+            case 3: // delete a run
+            {
+                size_t n = 1 + rand() % 8;
+                if (pos + n > *len)
+                    n = *len - pos;
+                memmove(buf + pos, buf + pos + n, *len - pos - n);
+                *len -= n;
+                break;
+            }
+            case 4: // truncate
+                *len = pos;
+                break;
+            case 5: // a run of digits, for the number parser
+            {
+                size_t n = 1 + rand() % 24;
+                for (size_t i = 0; i < n && pos + i < *len; i++)
+                    buf[pos + i] = '0' + rand() % 10;
+                break;
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    long iterations = 1000000;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+            iterations = atol(argv[++i]);
+            continue;
+        }
+
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            return 1;
+        }
+        if (nseeds < 256) {
+            seed_len[nseeds] = fread(seeds[nseeds], 1, MAX_LINE, f);
+            LLVMFuzzerTestOneInput((const uint8_t *) seeds[nseeds], seed_len[nseeds]);
+            nseeds++;
+        }
+        fclose(f);
+    }
+
+    if (!nseeds) {
+        fprintf(stderr, "usage: %s [--iterations N] <seed files>\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    for (long i = 0; i < iterations; i++) {
+        char buf[MAX_LINE + 1];
+        int s = rand() % nseeds;
+        size_t len = seed_len[s];
+
+        memcpy(buf, seeds[s], len);
+        mutate(buf, &len);
+        LLVMFuzzerTestOneInput((const uint8_t *) buf, len);
+    }
+
+    fprintf(stderr, "%d seeds, %ld mutations, no failures\n", nseeds, iterations);
+    return 0;
+}
+
+#endif
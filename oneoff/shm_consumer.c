@@ -0,0 +1,137 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// shm_consumer.c: example consumer of the shared memory message bus
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Attaches to the bus readsb publishes with --net-shm-bus <name> and
+// prints what comes by: frames in AVR format, aircraft as one line each.
+//
+//   oneoff/shm_consumer <name> [--quiet] [--slow <us>]
+//
+// --quiet only counts records, --slow sleeps after every record to
+// provoke overruns. The counters are printed on exit.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../shm_bus.h"
+
+static volatile sig_atomic_t exit_requested;
+
+static void sigintHandler(int sig) {
+    (void) sig;
+    exit_requested = 1;
+}
+
+static void printFrame(const struct shm_bus_frame *f) {
+    printf("*");
+    for (int i = 0; i < f->len; i++)
+        printf("%02X", f->msg[i]);
+    printf("; ts %012" PRIx64 " sig %.1f dBFS%s\n", f->timestamp,
+            f->signal > 0 ? 10 * log10(f->signal) : -99.9,
+            f->remote ? " remote" : "");
+}
+
+static void printAircraft(const struct shm_bus_aircraft *s) {
+    printf("%s%06X", (s->addr & 0x1000000) ? "~" : "", s->addr & 0xffffff);
+    if (s->flags & SHM_BUS_AIRCRAFT_CALLSIGN)
+        printf(" %-8s", s->callsign);
+    if (s->flags & SHM_BUS_AIRCRAFT_SQUAWK)
+        printf(" sq %04x", s->squawk);
+    if (s->flags & SHM_BUS_AIRCRAFT_POSITION)
+        printf(" %.5f,%.5f", s->lat, s->lon);
+    if (s->flags & SHM_BUS_AIRCRAFT_ALTITUDE)
+        printf(" %d ft", s->altitude_baro);
+    if (s->flags & SHM_BUS_AIRCRAFT_BARO_RATE)
+        printf(" %+d fpm", s->baro_rate);
+    if (s->flags & SHM_BUS_AIRCRAFT_GS)
+        printf(" %.0f kt", s->gs);
+    if (s->flags & SHM_BUS_AIRCRAFT_TRACK)
+        printf(" %.1f deg", s->track);
+    printf(" (%u msgs)\n", s->messages);
+}
+
+int main(int argc, char **argv) {
+    struct shm_bus_reader r;
+    uint64_t frames = 0, aircraft = 0;
+    int quiet = 0;
+    unsigned slow = 0;
+    union {
+        struct shm_bus_frame frame;
+        struct shm_bus_aircraft aircraft;
+        unsigned char bytes[256];
+    } buf;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <name> [--quiet] [--slow <us>]\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--quiet"))
+            quiet = 1;
+        else if (!strcmp(argv[i], "--slow") && i + 1 < argc)
+            slow = atoi(argv[++i]);
+    }
+
+    if (shmBusOpen(&r, argv[1]) < 0) {
+        fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    signal(SIGINT, sigintHandler);
+    signal(SIGTERM, sigintHandler);
+
+    while (!exit_requested) {
+        shm_bus_type_t type;
+        int len = shmBusRead(&r, &buf, sizeof (buf), &type, 1000);
+
+        if (len < 0) {
+            fprintf(stderr, "readsb closed the bus\n");
+            break;
+        }
+        if (len == 0)
+            continue;
+
+        if (type == SHM_BUS_FRAME && len >= (int) sizeof (buf.frame)) {
+            frames++;
+            if (!quiet)
+                printFrame(&buf.frame);
+        } else if (type == SHM_BUS_AIRCRAFT && len >= (int) sizeof (buf.aircraft)) {
+            aircraft++;
+            if (!quiet)
+                printAircraft(&buf.aircraft);
+        }
+
+        if (slow)
+            usleep(slow);
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "%" PRIu64 " records: %" PRIu64 " frames, %" PRIu64 " aircraft updates\n",
+            r.records, frames, aircraft);
+    fprintf(stderr, "%" PRIu64 " records lost in %" PRIu64 " overruns\n", r.lost, r.overruns);
+
+    shmBusClose(&r);
+    return 0;
+}
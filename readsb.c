@@ -139,8 +139,9 @@ static void sigtermHandler(int dummy) {
 }
 
 void receiverPositionChanged(float lat, float lon, float alt) {
+    geoSetRef(&Modes.user_ref, lat, lon);
     log_with_timestamp("Autodetected receiver location: %.5f, %.5f at %.0fm AMSL", lat, lon, alt);
-    writeJsonToFile("receiver.json", generateReceiverJson()); // location changed
+    updateCachedJson(JSON_RECEIVER); // location changed
 }
 
 
@@ -165,6 +166,7 @@ static void modesInitConfig(void) {
     Modes.net_output_beast_reduce_ports = strdup("0");
     Modes.net_output_beast_reduce_interval = 125;
     Modes.net_output_vrs_ports = strdup("0");
+    Modes.net_http_ports = strdup("0");
     Modes.net_connector_delay = 30 * 1000;
     Modes.interactive_display_ttl = MODES_INTERACTIVE_DISPLAY_TTL;
     Modes.json_interval = 1000;
@@ -178,6 +180,7 @@ static void modesInitConfig(void) {
     Modes.net_output_flush_size = 1200; // Default to 1200 Bytes
     Modes.net_output_flush_interval = 50; // Default to 50 ms
     Modes.basestation_is_mlat = 1;
+    Modes.sample_rate = 2400000.0;
 
     sdrInitConfig();
 }
@@ -190,8 +193,6 @@ static void modesInit(void) {
     pthread_mutex_init(&Modes.data_mutex, NULL);
     pthread_cond_init(&Modes.data_cond, NULL);
 
-    Modes.sample_rate = (double)2400000.0;
-
     // Allocate the various buffers used by Modes
     Modes.trailing_samples = (MODES_PREAMBLE_US + MODES_LONG_MSG_BITS + 16) * 1e-6 * Modes.sample_rate;
 
@@ -204,6 +205,19 @@ static void modesInit(void) {
         Modes.mag_buffers[i].length = 0;
         Modes.mag_buffers[i].dropped = 0;
         Modes.mag_buffers[i].sampleTimestamp = 0;
+        Modes.mag_buffers[i].stats = &Modes.stats_current;
+        Modes.mag_buffers[i].batch = NULL;
+    }
+
+    if (Modes.sample_rate != 2400000.0) {
+        if (Modes.mode_ac) {
+            fprintf(stderr, "Mode A/C decoding is only supported at 2.4MHz, disabling it.\n");
+        }
+        Modes.mode_ac = 0;
+        Modes.mode_ac_auto = 0;
+
+        if (!demodHiRateInit())
+            exit(1);
     }
 
     // Validate the users Lat/Lon home location inputs
@@ -223,6 +237,7 @@ static void modesInit(void) {
     Modes.bUserFlags &= ~MODES_USER_LATLON_VALID;
     if ((Modes.fUserLat != 0.0) || (Modes.fUserLon != 0.0)) {
         Modes.bUserFlags |= MODES_USER_LATLON_VALID;
+        geoSetRef(&Modes.user_ref, Modes.fUserLat, Modes.fUserLon);
     }
 
     // Limit the maximum requested raw output size to less than one Ethernet Block
@@ -237,6 +252,13 @@ static void modesInit(void) {
         Modes.net_sndbuf_size = MODES_NET_SNDBUF_MAX;
     }
 
+    // BeastReduce sends velocity and identity less often unless told otherwise
+    if (!Modes.net_output_beast_reduce_intervals) {
+        Modes.net_output_beast_reduce_alt_interval = Modes.net_output_beast_reduce_interval;
+        Modes.net_output_beast_reduce_vel_interval = Modes.net_output_beast_reduce_interval * 4;
+        Modes.net_output_beast_reduce_ident_interval = Modes.net_output_beast_reduce_interval * 4;
+    }
+
     if((Modes.net_connector_delay <= 0) || (Modes.net_connector_delay > 86400 * 1000)) {
         Modes.net_connector_delay = 30 * 1000;
     }
@@ -329,7 +351,8 @@ static void display_total_stats(void) {
 static void backgroundTasks(void) {
     static uint64_t next_stats_display;
     static uint64_t next_stats_update;
-    static uint64_t next_json, next_history;
+    static uint64_t next_json, next_history, next_trace;
+    static uint64_t next_state;
     static uint64_t last_second;
 
     uint64_t now = mstime();
@@ -377,8 +400,7 @@ static void backgroundTasks(void) {
             reset_stats(&Modes.stats_current);
             Modes.stats_current.start = Modes.stats_current.end = now;
 
-            if (Modes.json_dir)
-                writeJsonToFile("stats.json", generateStatsJson());
+            updateCachedJson(JSON_STATS);
 
             next_stats_update += 60000;
         }
@@ -402,24 +424,32 @@ static void backgroundTasks(void) {
 
     if (Modes.json_dir && now >= next_json) {
         writeJsonToFile("aircraft.json", generateAircraftJson());
+        if (Modes.json_tiles)
+            writeJsonTiles(now);
         next_json = now + Modes.json_interval;
         //writeJsonToFile("vrs.json", generateVRS(0, 1));
     }
 
     if (Modes.json_dir && now >= next_history) {
-        char filebuf[PATH_MAX];
-        snprintf(filebuf, PATH_MAX, "history_%d.json", Modes.json_aircraft_history_next);
-        writeJsonToFile(filebuf, generateAircraftJson());
-
-        if (!Modes.json_aircraft_history_full) {
-            writeJsonToFile("receiver.json", generateReceiverJson()); // number of history entries changed
-            if (Modes.json_aircraft_history_next == HISTORY_SIZE - 1)
-                Modes.json_aircraft_history_full = 1;
-        }
+        int full = (historyCount() == HISTORY_SIZE);
+
+        historyUpdate(now);
+        if (!full)
+            updateCachedJson(JSON_RECEIVER); // number of history entries changed
 
-        Modes.json_aircraft_history_next = (Modes.json_aircraft_history_next + 1) % HISTORY_SIZE;
         next_history = now + HISTORY_INTERVAL;
     }
+
+    if (Modes.json_dir && now >= next_trace) {
+        traceWriteFiles(now);
+        next_trace = now + TRACE_WRITE_INTERVAL;
+    }
+
+    if (Modes.state_file && now >= next_state) {
+        if (next_state != 0)
+            trackSaveState(Modes.state_file);
+        next_state = now + TRACK_STATE_INTERVAL;
+    }
 }
 
 //=========================================================================
@@ -427,17 +457,25 @@ static void backgroundTasks(void) {
 static void cleanup_and_exit(int code) {
     // Free any used memory
     interactiveCleanup();
+    historyCleanup();
+    traceCleanup();
     free(Modes.dev_name);
     free(Modes.filename);
     /* Free only when pointing to string in heap (strdup allocated when given as run parameter)
      * otherwise points to const string
      */
     free(Modes.json_dir);
+    free(Modes.state_file);
     free(Modes.net_bind_address);
     free(Modes.net_input_beast_ports);
     free(Modes.net_output_beast_ports);
+    free(Modes.net_output_beast_udp);
+    free(Modes.net_input_beast_udp);
+    free(Modes.net_shm_bus);
     free(Modes.net_output_beast_reduce_ports);
     free(Modes.net_output_vrs_ports);
+    free(Modes.net_http_ports);
+    free(Modes.net_http_root);
     free(Modes.net_input_raw_ports);
     free(Modes.net_output_raw_ports);
     free(Modes.net_output_sbs_ports);
@@ -457,6 +495,7 @@ static void cleanup_and_exit(int code) {
     for (i = 0; i < MODES_MAG_BUFFERS; ++i) {
         free(Modes.mag_buffers[i].data);
     }
+    demodHiRateCleanup();
     crcCleanupTables();
 
     /* Cleanup network setup */
@@ -579,6 +618,15 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case OptJsonLocAcc:
             Modes.json_location_accuracy = atoi(arg);
             break;
+        case OptJsonTiles:
+            Modes.json_tiles = atoi(arg);
+            if (Modes.json_tiles < 0 || (Modes.json_tiles && 180 % Modes.json_tiles))
+                argp_error(state, "--write-json-tiles: %s does not divide 180", arg);
+            break;
+        case OptStateFile:
+            free(Modes.state_file);
+            Modes.state_file = strdup(arg);
+            break;
 #endif
         case OptNetHeartbeat:
             Modes.net_heartbeat_interval = (uint64_t) (1000 * atof(arg));
@@ -608,6 +656,18 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
             free(Modes.net_input_beast_ports);
             Modes.net_input_beast_ports = strdup(arg);
             break;
+        case OptNetBoUdp:
+            free(Modes.net_output_beast_udp);
+            Modes.net_output_beast_udp = strdup(arg);
+            break;
+        case OptNetBiUdp:
+            free(Modes.net_input_beast_udp);
+            Modes.net_input_beast_udp = strdup(arg);
+            break;
+        case OptNetShmBus:
+            free(Modes.net_shm_bus);
+            Modes.net_shm_bus = strdup(arg);
+            break;
         case OptNetBeastReducePorts:
             free(Modes.net_output_beast_reduce_ports);
             Modes.net_output_beast_reduce_ports = strdup(arg);
@@ -618,6 +678,29 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
             if (Modes.net_output_beast_reduce_interval > 15000)
                 Modes.net_output_beast_reduce_interval = 15000;
             break;
+        case OptNetBeastReduceIntervals:
+        {
+            uint64_t *fields[4] = {
+                &Modes.net_output_beast_reduce_interval,
+                &Modes.net_output_beast_reduce_alt_interval,
+                &Modes.net_output_beast_reduce_vel_interval,
+                &Modes.net_output_beast_reduce_ident_interval
+            };
+            char *p = arg;
+            for (int i = 0; i < 4; i++) {
+                char *end;
+                double seconds = strtod(p, &end);
+                if (end == p || seconds < 0 || seconds > 15 || *end != (i < 3 ? ',' : '\0')) {
+                    fprintf(stderr, "--net-beast-reduce-intervals: Wrong format: %s\n", arg);
+                    fprintf(stderr, "Correct syntax: --net-beast-reduce-intervals=pos,alt,vel,ident (seconds, 0 - 15)\n");
+                    return 1;
+                }
+                *fields[i] = (uint64_t) (1000 * seconds);
+                p = end + 1;
+            }
+            Modes.net_output_beast_reduce_intervals = 1;
+            break;
+        }
         case OptNetBindAddr:
             free(Modes.net_bind_address);
             Modes.net_bind_address = strdup(arg);
@@ -634,6 +717,14 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
             free(Modes.net_output_vrs_ports);
             Modes.net_output_vrs_ports = strdup(arg);
             break;
+        case OptNetHttpPorts:
+            free(Modes.net_http_ports);
+            Modes.net_http_ports = strdup(arg);
+            break;
+        case OptNetHttpRoot:
+            free(Modes.net_http_root);
+            Modes.net_http_root = strdup(arg);
+            break;
         case OptNetBuffer:
             Modes.net_sndbuf_size = atoi(arg);
             break;
@@ -724,6 +815,7 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case OptIfileName:
         case OptIfileFormat:
         case OptIfileThrottle:
+        case OptIfileThreads:
 #ifdef ENABLE_BLADERF
         case OptBladeFpgaDir:
         case OptBladeDecim:
@@ -733,6 +825,7 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case OptPlutoUri:
         case OptPlutoNetwork:
 #endif
+        case OptSampleRate:
         case OptDeviceType:
             /* Forward interface option to the specific device handler */
             if (sdrHandleOption(key, arg) == false)
@@ -793,6 +886,11 @@ int main(int argc, char **argv) {
         cleanup_and_exit(1);
     }
 
+    // Pick up where we left off before a restart
+    if (Modes.state_file) {
+        trackLoadState(Modes.state_file);
+    }
+
     if (Modes.net) {
         modesInitNet();
     }
@@ -808,8 +906,12 @@ int main(int argc, char **argv) {
         Modes.stats_1min[j].start = Modes.stats_1min[j].end = Modes.stats_current.start;
 
     // write initial json files so they're not missing
-    writeJsonToFile("receiver.json", generateReceiverJson());
-    writeJsonToFile("stats.json", generateStatsJson());
+    if (Modes.json_dir)
+        historyInit();
+    if (Modes.json_dir || (Modes.net && strcmp(Modes.net_http_ports, "0")))
+        traceInit();
+    updateCachedJson(JSON_RECEIVER);
+    updateCachedJson(JSON_STATS);
     writeJsonToFile("aircraft.json", generateAircraftJson());
 
     interactiveInit();
@@ -880,9 +982,11 @@ int main(int argc, char **argv) {
                 // stuff at the same time.
                 pthread_mutex_unlock(&Modes.data_mutex);
 
-                demodulate2400(buf);
-                if (Modes.mode_ac) {
-                    demodulate2400AC(buf);
+                if (buf->batch) {
+                    // already demodulated by the reader
+                    demodUseBatch(buf);
+                } else {
+                    demodulateBuffer(buf);
                 }
 
                 Modes.stats_current.samples_processed += buf->length;
@@ -923,6 +1027,9 @@ int main(int argc, char **argv) {
         display_total_stats();
     }
     sdrClose();
+    if (Modes.state_file) {
+        trackSaveState(Modes.state_file);
+    }
     if (Modes.exit != 1) {
         log_with_timestamp("Abnormal exit.");
         cleanup_and_exit(1);
@@ -83,6 +83,7 @@
 #include <sys/ioctl.h>
 #include <time.h>
 #include <limits.h>
+#include <stddef.h>
 #else
 #include "winstubs.h" //Put everything Windows specific in here
 #endif
@@ -100,6 +101,11 @@
 #define MODES_MAX_GAIN          999999                     // Use max available gain
 #define MODEAC_MSG_BYTES        2
 
+/* A timestamp that indicates the data is synthetic, created from a
+ * multilateration result
+ */
+#define MAGIC_MLAT_TIMESTAMP 0xFF004D4C4154ULL
+
 #define MODES_PREAMBLE_US       8   // microseconds = bits
 #define MODES_PREAMBLE_SAMPLES  (MODES_PREAMBLE_US       * 2)
 #define MODES_PREAMBLE_SIZE     (MODES_PREAMBLE_SAMPLES  * sizeof(uint16_t))
@@ -122,6 +128,7 @@
 #define MODES_OUT_BUF_SIZE         (16*1024)
 #define MODES_OUT_FLUSH_SIZE       (15*1024)
 #define MODES_OUT_FLUSH_INTERVAL   (60000)
+#define MODES_OUT_FRAMES           (MODES_OUT_BUF_SIZE / 4)
 
 #define MODES_USER_LATLON_VALID (1<<0)
 
@@ -262,7 +269,12 @@ typedef enum {
 
 #define MODES_CLIENT_BUF_SIZE (64*1024)
 #define MODES_NET_SNDBUF_SIZE (64*1024)
+#define MODES_NET_STALL_TIMEOUT (30000) // drop output clients that accept no data for this long
 #define MODES_NET_SNDBUF_MAX  (7)
+#define MODES_NET_RESOLVER_THREADS (2) // name resolution threads shared by all connectors
+#define MODES_NET_RESOLVE_TTL (300000) // reuse resolved connector addresses for this long
+#define MODES_NET_CONNECT_TIMEOUT (10000)
+#define MODES_SHM_BUS_SIZE (4*1024*1024) // shared memory bus ring, power of two
 
 #define NET_MAX_CONNECTORS 256
 
@@ -280,8 +292,10 @@ typedef enum {
 #include "net_io.h"
 #include "crc.h"
 #include "demod_2400.h"
+#include "demod_hirate.h"
 #include "stats.h"
 #include "cpr.h"
+#include "geo.h"
 #include "icao_filter.h"
 #include "convert.h"
 #include "sdr.h"
@@ -304,12 +318,52 @@ struct mag_buf
   unsigned length; // Number of valid samples _after_ overlap. Total buffer length is buf->length + Modes.trailing_samples.
   uint64_t sysTimestamp; // Estimated system time at start of block
   uint16_t *data; // Magnitude data. Starts with Modes.trailing_samples worth of overlap from the previous block
+  struct stats *stats; // Where demodulator statistics are accumulated, normally &Modes.stats_current
+  struct demod_batch *batch; // If set, messages are collected here rather than used (see demodPassMessage)
 #if defined(__arm__)
   /*padding 4 bytes*/
   uint32_t padding;
 #endif
 };
 
+// One bit phase of a demod_candidate
+struct demod_phase
+{
+  unsigned char msg[MODES_LONG_MSG_BYTES];
+  uint32_t addr; // See scoreModesMessageUnfiltered
+  int known_score;
+  int unknown_score;
+  uint64_t timestampMsg;
+  uint64_t scaled_signal_power; // Only measured if the phase can score >= 0
+  unsigned signal_len;
+  uint32_t reject_next; // Sample to continue from if the message does not decode
+  uint32_t accept_next; // Sample to continue from if it does
+};
+
+// A possible Mode S message found by a demodulator running ahead of time
+// on a reader thread. Scoring its phases and decoding the best one depend
+// on the ICAO filter, so that is left to the main thread (see demodUseBatch)
+struct demod_candidate
+{
+  uint32_t pos; // Sample where the demodulator looked for a preamble
+  uint32_t reject_next; // Sample to continue from if no phase scores well enough
+  unsigned nphases; // 0 if the preamble was rejected without trying any phase
+  struct demod_phase phases[5];
+};
+
+// Demodulator output produced ahead of time on a reader thread, waiting
+// for the main thread to use it (see sdr_ifile.c)
+struct demod_batch
+{
+  struct demod_candidate *candidates; // Mode S, in sample order
+  unsigned ncandidates;
+  unsigned candidates_size;
+  struct modesMessage *msgs; // Mode A/C, used after the Mode S candidates
+  unsigned count;
+  unsigned size;
+  struct stats stats; // Demodulator statistics that do not depend on the ICAO filter
+};
+
 // Program global state
 
 struct _Modes
@@ -339,8 +393,10 @@ struct _Modes
   struct net_writer raw_out; // Raw output
   struct net_writer beast_out; // Beast-format output
   struct net_writer beast_reduce_out; // Reduced data Beast-format output
+  struct net_writer beast_udp_out; // Beast-format datagram output
   struct net_writer sbs_out; // SBS-format output
   struct net_writer vrs_out; // SBS-format output
+  struct net_writer http_out; // HTTP server, only for the client SendQs
   struct net_writer fatsv_out; // FATSV-format output
 
 #ifdef _WIN32
@@ -363,6 +419,7 @@ struct _Modes
   uint64_t net_output_flush_interval; // Maximum interval (in milliseconds) between outputwrites
   double fUserLat; // Users receiver/antenna lat/lon needed for initial surface location
   double fUserLon; // Users receiver/antenna lat/lon needed for initial surface location
+  struct geo_ref user_ref; // Receiver position with precomputed trig, valid if MODES_USER_LATLON_VALID
   double maxRange; // Absolute maximum decoding range, in *metres*
   double sample_rate; // actual sample rate in use (in hz)
   uint64_t interactive_display_ttl; // Interactive mode: TTL display
@@ -375,8 +432,17 @@ struct _Modes
   char *net_input_beast_ports; // List of Beast input TCP ports
   char *net_output_beast_ports; // List of Beast output TCP ports
   char *net_output_beast_reduce_ports; // List of Beast output TCP ports
+  char *net_output_beast_udp; // List of Beast UDP output destinations
+  char *net_input_beast_udp; // Beast UDP input address/port
+  char *net_shm_bus; // Shared memory bus name, under /dev/shm
   uint64_t net_output_beast_reduce_interval; // Position update interval for data reduction
+  uint64_t net_output_beast_reduce_alt_interval; // Altitude update interval for data reduction
+  uint64_t net_output_beast_reduce_vel_interval; // Velocity update interval for data reduction
+  uint64_t net_output_beast_reduce_ident_interval; // Callsign/squawk update interval for data reduction
+  int net_output_beast_reduce_intervals; // Per-field intervals given, don't derive them
   char *net_output_vrs_ports; // List of VRS output TCP ports
+  char *net_http_ports; // List of HTTP server TCP ports
+  char *net_http_root; // Directory the HTTP server serves the web interface from
   int basestation_is_mlat; // Basestation input is from MLAT
   struct net_connector **net_connectors; // client connectors
   int net_connectors_count;
@@ -384,6 +450,7 @@ struct _Modes
   char *filename; // Input form file, --ifile option
   char *net_bind_address; // Bind address
   char *json_dir; // Path to json base directory, or NULL not to write json.
+  char *state_file; // Path to tracker state snapshot, or NULL not to save/restore state.
   char *beast_serial; // Modes-S Beast device path
 #if defined(__arm__)
   uint32_t padding;
@@ -399,8 +466,7 @@ struct _Modes
   int use_gnss; // Use GNSS altitudes with H suffix ("HAE", though it isn't always) when available
   int mlat; // Use Beast ascii format for raw data output, i.e. @...; iso *...;
   int json_location_accuracy; // Accuracy of location metadata: 0=none, 1=approx, 2=exact
-  int json_aircraft_history_next;
-  int json_aircraft_history_full;
+  int json_tiles; // Size in degrees of the tiles written to json_dir/tiles, 0 for none
   int stats_latest_1min;
   int bUserFlags; // Flags relating to the user details
   int biastee;
@@ -417,6 +483,29 @@ struct _Modes
 extern struct _Modes Modes;
 
 // The struct we use to store information about a decoded message.
+//
+// It has three parts:
+//
+//   the header, up to and including 'sections', which every message
+//   starts from cleared, see resetModesMessage()
+//
+//   decoded values, from altitude_baro to decoded_rc, which are never
+//   cleared and only hold data when their _valid bit in the header is set
+//
+//   the sections accuracy, opstatus and nav, each only holding data when
+//   its MM_* bit is set in 'sections'. A decoder calls
+//   modesMessageSections() before writing to one, which clears it the
+//   first time.
+//
+// decodeModesMessage() only fills in what routing, filtering and output
+// need: the CRC checks, address, source and the fixed fields of each DF.
+// The extended squitter and Comm-B fields are left for
+// decodeModesMessageFields(), which the tracker and the outputs that show
+// them call when they need them.
+
+#define MM_ACCURACY 1
+#define MM_OPSTATUS 2
+#define MM_NAV 4
 
 struct modesMessage
 {
@@ -481,6 +570,7 @@ struct modesMessage
   unsigned cpr_odd : 1;
   unsigned cpr_decoded : 1;
   unsigned cpr_relative : 1;
+  unsigned cpr_filtered : 1; // CPR data looked bogus and was ignored
   unsigned category_valid : 1;
   unsigned geom_delta_valid : 1;
   unsigned from_mlat : 1;
@@ -490,7 +580,12 @@ struct modesMessage
   unsigned alert_valid : 1;
   unsigned alert : 1;
   unsigned emergency_valid : 1;
-  unsigned padding : 13;
+  unsigned fields_pending : 1; // ES / Comm-B fields not decoded yet
+  unsigned padding : 11;
+
+  airground_t airground; // air/ground state
+  commb_format_t commb_format; // Inferred format of a comm-b message
+  unsigned sections; // MM_* sections below that hold data
 
   // valid if altitude_baro_valid:
   int altitude_baro; // Altitude in either feet or meters
@@ -524,7 +619,7 @@ struct modesMessage
   int baro_rate; // Rate of change of barometric altitude, feet/minute
   int geom_rate; // Rate of change of geometric (GNSS / INS) altitude, feet/minute
   unsigned squawk; // 13 bits identity (Squawk), encoded as 4 hex digits
-  char callsign[16]; // 8 chars flight number, NUL-terminated
+  char callsign[16]; // 8 chars flight number, NUL-terminated, nothing after the NUL is cleared
   unsigned category; // A0 - D7 encoded as a single hex byte
   emergency_t emergency; // emergency/priority status
 
@@ -534,17 +629,13 @@ struct modesMessage
   unsigned cpr_lon; // Non decoded longitude.
   unsigned cpr_nucp; // NUCp/NIC value implied by message type
 
-  airground_t airground; // air/ground state
-
   // valid if cpr_decoded:
   double decoded_lat;
   double decoded_lon;
   unsigned decoded_nic;
   unsigned decoded_rc;
 
-  commb_format_t commb_format; // Inferred format of a comm-b message
-
-  // various integrity/accuracy things
+  // various integrity/accuracy things, valid if MM_ACCURACY
 
   struct
   {
@@ -574,7 +665,7 @@ struct modesMessage
     sil_type_t sil_type;
   } accuracy;
 
-  // Operational Status
+  // Operational Status, valid if MM_OPSTATUS
 
   struct
   {
@@ -610,7 +701,7 @@ struct modesMessage
     unsigned padding: 13;
   } opstatus;
 
-  // combined:
+  // combined, valid if MM_NAV:
   //   Target State & Status (ADS-B V2 only)
   //   Comm-B BDS4,0 Vertical Intent
 
@@ -634,6 +725,41 @@ struct modesMessage
   } nav;
 };
 
+// Start a message: clear its header
+static inline void
+resetModesMessage (struct modesMessage *mm)
+{
+  memset (mm, 0, offsetof (struct modesMessage, sections) + sizeof (mm->sections));
+}
+
+// Get sections of mm ready for writing, clearing the ones not written yet
+static inline void
+modesMessageSections (struct modesMessage *mm, unsigned sections)
+{
+  unsigned clear = sections & ~mm->sections;
+
+  if (clear & MM_ACCURACY)
+    memset (&mm->accuracy, 0, sizeof (mm->accuracy));
+  if (clear & MM_OPSTATUS)
+    memset (&mm->opstatus, 0, sizeof (mm->opstatus));
+  if (clear & MM_NAV)
+    memset (&mm->nav, 0, sizeof (mm->nav));
+  mm->sections |= sections;
+}
+
+// Copy a message, leaving out what doesn't hold data
+static inline void
+copyModesMessage (struct modesMessage *to, const struct modesMessage *from)
+{
+  memcpy (to, from, offsetof (struct modesMessage, accuracy));
+  if (from->sections & MM_ACCURACY)
+    to->accuracy = from->accuracy;
+  if (from->sections & MM_OPSTATUS)
+    to->opstatus = from->opstatus;
+  if (from->sections & MM_NAV)
+    to->nav = from->nav;
+}
+
 /* All the program options */
 enum {
   OptDeviceType = 700,
@@ -668,6 +794,8 @@ enum {
   OptJsonDir,
   OptJsonTime,
   OptJsonLocAcc,
+  OptJsonTiles,
+  OptStateFile,
   OptDcFilter,
   OptBiasTee,
   OptNet,
@@ -679,9 +807,15 @@ enum {
   OptNetSbsInPorts,
   OptNetBiPorts,
   OptNetBoPorts,
+  OptNetBoUdp,
+  OptNetBiUdp,
+  OptNetShmBus,
   OptNetBeastReducePorts,
   OptNetBeastReduceInterval,
+  OptNetBeastReduceIntervals,
   OptNetVRSPorts,
+  OptNetHttpPorts,
+  OptNetHttpRoot,
   OptNetRoSize,
   OptNetRoRate,
   OptNetRoIntervall,
@@ -702,17 +836,24 @@ enum {
   OptIfileName,
   OptIfileFormat,
   OptIfileThrottle,
+  OptIfileThreads,
   OptBladeFpgaDir,
   OptBladeDecim,
   OptBladeBw,
   OptPlutoUri,
   OptPlutoNetwork,
+  OptSampleRate,
 };
 
 // This one needs modesMessage:
 #include "track.h"
 #include "mode_s.h"
 #include "comm_b.h"
+#include "sbs.h"
+#include "history.h"
+#include "http.h"
+#include "trace.h"
+#include "json.h"
 
 // ======================== function declarations =========================
 
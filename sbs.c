@@ -0,0 +1,517 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// sbs.c: BaseStation (SBS) output encoder and input parser
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This code is based on a detached fork of dump1090-fa.
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "readsb.h"
+
+//
+// SBS BS style output checked against the following reference
+// http://www.homepages.mcb.net/bones/SBS/Article/Barebones42_Socket_Data.htm - seems comprehensive
+//
+
+// "YYYY/MM/DD,HH:MM:SS.mmm" in local time, rebuilt when the millisecond
+// changes; localtime_r() only runs when the second does
+struct sbs_time {
+    uint64_t ms;
+    uint64_t second;
+    int valid;
+    int len;
+    char text[32];
+};
+
+static struct sbs_time received_time; // fields 7 & 8
+static struct sbs_time current_time; // fields 9 & 10
+
+static const char hex_upper[16] = "0123456789ABCDEF";
+static const char hex_lower[16] = "0123456789abcdef";
+
+static const struct sbs_time *sbsTime(struct sbs_time *t, uint64_t ms) {
+    if (t->valid && t->ms == ms)
+        return t;
+
+    if (!t->valid || t->second != ms / 1000) {
+        time_t second = (time_t) (ms / 1000);
+        struct tm tm;
+
+        localtime_r(&second, &tm);
+        t->len = snprintf(t->text, sizeof (t->text), "%04d/%02d/%02d,%02d:%02d:%02d.000",
+                (tm.tm_year + 1900), (tm.tm_mon + 1), tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+        t->second = ms / 1000;
+        t->valid = 1;
+    }
+
+    unsigned millis = ms % 1000;
+    t->text[t->len - 3] = '0' + millis / 100;
+    t->text[t->len - 2] = '0' + millis / 10 % 10;
+    t->text[t->len - 1] = '0' + millis % 10;
+    t->ms = ms;
+    return t;
+}
+
+static inline char *sbsUnsigned(char *p, unsigned v) {
+    char digits[10];
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+// %d
+static inline char *sbsInt(char *p, int v) {
+    if (v < 0) {
+        *p++ = '-';
+        return sbsUnsigned(p, 0U - (unsigned) v);
+    }
+    return sbsUnsigned(p, v);
+}
+
+// %.0f; rounding to nearest even, like printf
+static inline char *sbsRounded(char *p, double v) {
+    if (!isfinite(v) || fabs(v) >= 1e9)
+        return p + sprintf(p, "%.0f", v);
+
+    if (signbit(v))
+        *p++ = '-';
+    return sbsUnsigned(p, (unsigned) nearbyint(fabs(v)));
+}
+
+// %1.5f for coordinates. printf rounds the exact binary value, scaling by
+// 1e5 first can be off by a fraction of an ulp, so values that land too
+// close to a rounding boundary go through printf.
+static inline char *sbsCoordinate(char *p, double v) {
+    double scaled = fabs(v) * 1e5;
+    double fraction = scaled - floor(scaled);
+
+    if (!isfinite(v) || fabs(v) >= 1000 || fabs(fraction - 0.5) < 1e-6)
+        return p + sprintf(p, "%1.5f", v);
+
+    uint64_t fixed = (uint64_t) nearbyint(scaled);
+    unsigned decimals = fixed % 100000;
+
+    if (signbit(v))
+        *p++ = '-';
+    p = sbsUnsigned(p, fixed / 100000);
+    *p++ = '.';
+    for (int i = 4; i >= 0; i--, decimals /= 10)
+        p[i] = '0' + decimals % 10;
+    return p + 5;
+}
+
+// ",-1" when set, ",0" when clear, "," when unknown
+static inline char *sbsFlag(char *p, int valid, int set) {
+    *p++ = ',';
+    if (valid) {
+        if (set)
+            *p++ = '-';
+        *p++ = set ? '1' : '0';
+    }
+    return p;
+}
+
+char *sbsEncode(char *p, struct modesMessage *mm, struct aircraft *a, uint64_t now, int use_gnss) {
+    const struct sbs_time *t;
+    int msgType;
+
+    // Decide on the basic SBS Message Type
+    switch (mm->msgtype) {
+        case 4:
+        case 20:
+            msgType = 5;
+            break;
+
+        case 5:
+        case 21:
+            msgType = 6;
+            break;
+
+        case 0:
+        case 16:
+            msgType = 7;
+            break;
+
+        case 11:
+            msgType = 8;
+            break;
+
+        case 17:
+        case 18:
+            if (mm->metype >= 1 && mm->metype <= 4) {
+                msgType = 1;
+            } else if (mm->metype >= 5 && mm->metype <= 8) {
+                msgType = 2;
+            } else if (mm->metype >= 9 && mm->metype <= 18) {
+                msgType = 3;
+            } else if (mm->metype == 19) {
+                msgType = 4;
+            } else {
+                return NULL;
+            }
+            break;
+
+        default:
+            return NULL;
+    }
+
+    // Fields 1 to 6 : SBS message type and ICAO address of the aircraft and some other stuff
+    memcpy(p, "MSG,", 4);
+    p += 4;
+    *p++ = '0' + msgType;
+    memcpy(p, ",1,1,", 5);
+    p += 5;
+    if (mm->addr > 0xFFFFFF) {
+        p += sprintf(p, "%06X", mm->addr);
+    } else {
+        for (int i = 5; i >= 0; i--)
+            *p++ = hex_upper[(mm->addr >> (4 * i)) & 0xF];
+    }
+    memcpy(p, ",1,", 3);
+    p += 3;
+
+    // Fields 7 & 8 are the message reception time and date
+    t = sbsTime(&received_time, mm->sysTimestampMsg);
+    memcpy(p, t->text, t->len);
+    p += t->len;
+    *p++ = ',';
+
+    // Fields 9 & 10 are the current time and date
+    t = sbsTime(&current_time, now);
+    memcpy(p, t->text, t->len);
+    p += t->len;
+
+    // Field 11 is the callsign (if we have it)
+    *p++ = ',';
+    if (mm->callsign_valid) {
+        size_t len = strnlen(mm->callsign, sizeof (mm->callsign));
+        memcpy(p, mm->callsign, len);
+        p += len;
+    }
+
+    // Field 12 is the altitude (if we have it)
+    *p++ = ',';
+    if (use_gnss) {
+        if (mm->altitude_geom_valid) {
+            p = sbsInt(p, mm->altitude_geom);
+            *p++ = 'H';
+        } else if (mm->altitude_baro_valid && trackDataValid(&a->geom_delta_valid)) {
+            p = sbsInt(p, mm->altitude_baro + a->geom_delta);
+            *p++ = 'H';
+        } else if (mm->altitude_baro_valid) {
+            p = sbsInt(p, mm->altitude_baro);
+        }
+    } else {
+        if (mm->altitude_baro_valid) {
+            p = sbsInt(p, mm->altitude_baro);
+        } else if (mm->altitude_geom_valid && trackDataValid(&a->geom_delta_valid)) {
+            p = sbsInt(p, mm->altitude_geom - a->geom_delta);
+        }
+    }
+
+    // Field 13 is the ground Speed (if we have it)
+    *p++ = ',';
+    if (mm->gs_valid)
+        p = sbsRounded(p, mm->gs.selected);
+
+    // Field 14 is the ground Heading (if we have it)
+    *p++ = ',';
+    if (mm->heading_valid && mm->heading_type == HEADING_GROUND_TRACK)
+        p = sbsRounded(p, mm->heading);
+
+    // Fields 15 and 16 are the Lat/Lon (if we have it)
+    *p++ = ',';
+    if (mm->cpr_decoded)
+        p = sbsCoordinate(p, mm->decoded_lat);
+    *p++ = ',';
+    if (mm->cpr_decoded)
+        p = sbsCoordinate(p, mm->decoded_lon);
+
+    // Field 17 is the VerticalRate (if we have it)
+    *p++ = ',';
+    if (use_gnss) {
+        if (mm->geom_rate_valid) {
+            p = sbsInt(p, mm->geom_rate);
+            *p++ = 'H';
+        } else if (mm->baro_rate_valid) {
+            p = sbsInt(p, mm->baro_rate);
+        }
+    } else {
+        if (mm->baro_rate_valid) {
+            p = sbsInt(p, mm->baro_rate);
+        } else if (mm->geom_rate_valid) {
+            p = sbsInt(p, mm->geom_rate);
+        }
+    }
+
+    // Field 18 is  the Squawk (if we have it)
+    *p++ = ',';
+    if (mm->squawk_valid) {
+        if (mm->squawk > 0xFFFF) {
+            p += sprintf(p, "%04x", mm->squawk);
+        } else {
+            for (int i = 3; i >= 0; i--)
+                *p++ = hex_lower[(mm->squawk >> (4 * i)) & 0xF];
+        }
+    }
+
+    // Field 19 is the Squawk Changing Alert flag (if we have it)
+    p = sbsFlag(p, mm->alert_valid, mm->alert);
+
+    // Field 20 is the Squawk Emergency flag (if we have it)
+    p = sbsFlag(p, mm->squawk_valid,
+            (mm->squawk == 0x7500) || (mm->squawk == 0x7600) || (mm->squawk == 0x7700));
+
+    // Field 21 is the Squawk Ident flag (if we have it)
+    p = sbsFlag(p, mm->spi_valid, mm->spi);
+
+    // Field 22 is the OnTheGround flag (if we have it)
+    p = sbsFlag(p, mm->airground == AG_GROUND || mm->airground == AG_AIRBORNE, mm->airground == AG_GROUND);
+
+    *p++ = '\r';
+    *p++ = '\n';
+    return p;
+}
+
+//
+// Input
+//
+
+// ',' ends a field, NUL, \r or \n the line
+static const unsigned char sbs_separator[256] = {
+    [','] = 1, ['\0'] = 1, ['\r'] = 1, ['\n'] = 1
+};
+
+static const double sbs_pow10[16] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+// A decimal number filling the whole field. Up to 15 digits are exact in
+// a double and so is the power of ten, the one division rounds the same
+// way strtod() does. Longer numbers and exponents go through strtod().
+static int sbsNumber(const char *s, int len, double *out) {
+    uint64_t mantissa = 0;
+    int digits = 0, decimals = -1;
+    int negative = 0;
+    int i = 0;
+
+    if (len > 0 && (s[0] == '-' || s[0] == '+')) {
+        negative = (s[0] == '-');
+        i++;
+    }
+
+    for (; i < len; i++) {
+        if (s[i] >= '0' && s[i] <= '9') {
+            mantissa = mantissa * 10 + (s[i] - '0');
+            if (++digits > 15)
+                break;
+            if (decimals >= 0)
+                decimals++;
+        } else if (s[i] == '.' && decimals < 0) {
+            decimals = 0;
+        } else {
+            break;
+        }
+    }
+
+    if (i == len) {
+        if (!digits)
+            return -1;
+        *out = (decimals > 0) ? mantissa / sbs_pow10[decimals] : (double) mantissa;
+        if (negative)
+            *out = -*out;
+        return 0;
+    }
+
+    char buf[64];
+    char *end;
+    if (len >= (int) sizeof (buf))
+        return -1;
+    memcpy(buf, s, len);
+    buf[len] = 0;
+    *out = strtod(buf, &end);
+    if (end != buf + len || !isfinite(*out))
+        return -1;
+    return 0;
+}
+
+static inline int sbsHexDigit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// A number that has to fit an int, fractions are dropped like atoi() does
+static int sbsInteger(const char *s, int len, int *out) {
+    double v;
+
+    if (sbsNumber(s, len, &v) < 0 || fabs(v) >= 1e9)
+        return -1;
+    *out = (int) v;
+    return 0;
+}
+
+// SBS flags are -1 when set and 0 when clear; take any non-zero as set
+static int sbsBoolean(const char *s, int len, int *out) {
+    int v;
+
+    if (sbsInteger(s, len, &v) < 0)
+        return -1;
+    *out = (v != 0);
+    return 0;
+}
+
+int sbsDecode(const char *line, struct modesMessage *mm) {
+    // fields 1 to 22, with index 0 unused; missing trailing fields stay empty
+    const char *field[23];
+    int len[23] = { 0 };
+    const char *start = line;
+    int n = 0;
+    int v;
+    double d;
+
+    // sample message from mlat-client basestation output
+    //MSG,3,1,1,4AC8B3,1,2019/12/10,19:10:46.320,2019/12/10,19:10:47.789,,36017,,,51.1001,10.1915,,,,,,
+    //
+    for (const char *p = line; ; p++) {
+        if (!sbs_separator[(unsigned char) *p])
+            continue;
+
+        field[++n] = start;
+        len[n] = p - start;
+        if (*p != ',' || n == 22)
+            break;
+        start = p + 1;
+    }
+    for (int i = n + 1; i <= 22; i++)
+        field[i] = start;
+
+    // Mark messages received over the internet as remote so that we don't try to
+    // pass them off as being received by this instance when forwarding them
+    mm->remote = 1;
+    mm->signalLevel = 0;
+    mm->sbs_in = 1;
+    // SBS input carries mlat results; without a source nothing would be
+    // taken from it as valid
+    mm->source = SOURCE_MLAT;
+
+    // field 1, message type, and 2, the MSG subtype
+    if (len[1] != 3 || memcmp(field[1], "MSG", 3) != 0)
+        return -1;
+    if (len[2] != 1 || field[2][0] < '1' || field[2][0] > '8')
+        return -1;
+
+    // field 5, icao must be 6 hex digits
+    if (len[5] != 6)
+        return -1;
+    for (int j = 0; j < 6; j++) {
+        int digit = sbsHexDigit(field[5][j]);
+        if (digit < 0)
+            return -1;
+        mm->addr = (mm->addr << 4) | digit;
+    }
+    if (mm->addr == 0)
+        return -1;
+
+    // field 11, callsign
+    if (len[11] > 0) {
+        int l = len[11] < 8 ? len[11] : 8;
+        memcpy(mm->callsign, field[11], l);
+        mm->callsign[l] = 0;
+        mm->callsign_valid = 1;
+    }
+
+    // field 12, altitude
+    if (len[12] > 0 && sbsInteger(field[12], len[12], &v) == 0) {
+        if (v < -5000 || v > 100000)
+            return -1;
+        mm->altitude_baro = v;
+        mm->altitude_baro_valid = 1;
+        mm->altitude_baro_unit = UNIT_FEET;
+    }
+
+    // field 13, groundspeed
+    if (len[13] > 0 && sbsNumber(field[13], len[13], &d) == 0 && d > 0 && d < 10000) {
+        mm->gs.v0 = d;
+        mm->gs_valid = 1;
+    }
+
+    // field 14, track
+    if (len[14] > 0 && sbsNumber(field[14], len[14], &d) == 0 && d >= 0 && d <= 360) {
+        mm->heading = d;
+        mm->heading_valid = 1;
+        mm->heading_type = HEADING_GROUND_TRACK;
+    }
+
+    // field 15 and 16, position
+    if (len[15] > 0 && len[16] > 0) {
+        double lat, lon;
+        if (sbsNumber(field[15], len[15], &lat) == 0 && sbsNumber(field[16], len[16], &lon) == 0
+                && fabs(lat) <= 90 && fabs(lon) <= 180) {
+            mm->decoded_lat = lat;
+            mm->decoded_lon = lon;
+        }
+    }
+
+    // field 17, vertical rate, assume baro
+    if (len[17] > 0 && sbsInteger(field[17], len[17], &v) == 0) {
+        mm->baro_rate = v;
+        mm->baro_rate_valid = 1;
+    }
+
+    // field 18, squawk, four octal digits written as decimal
+    if (len[18] > 0 && len[18] <= 4) {
+        unsigned squawk = 0;
+        int j;
+        for (j = 0; j < len[18] && field[18][j] >= '0' && field[18][j] <= '7'; j++)
+            squawk = (squawk << 4) | (field[18][j] - '0');
+        if (j == len[18] && squawk > 0) {
+            mm->squawk = squawk;
+            mm->squawk_valid = 1;
+        }
+    }
+
+    // field 19, squawk changing alert
+    if (len[19] > 0 && sbsBoolean(field[19], len[19], &v) == 0) {
+        mm->alert = v;
+        mm->alert_valid = 1;
+    }
+
+    // field 20, the emergency flag, follows from the squawk
+
+    // field 21, ident / SPI
+    if (len[21] > 0 && sbsBoolean(field[21], len[21], &v) == 0) {
+        mm->spi = v;
+        mm->spi_valid = 1;
+    }
+
+    // field 22, on the ground
+    if (len[22] > 0 && sbsBoolean(field[22], len[22], &v) == 0 && v)
+        mm->airground = AG_GROUND;
+
+    return 0;
+}
@@ -0,0 +1,43 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// sbs.h: BaseStation (SBS) output encoder and input parser
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SBS_H
+#define SBS_H
+
+// Longest line sbsEncode() writes, including the trailing \r\n
+#define SBS_MAX_LINE 200
+
+// Encode mm as one SBS "MSG" line at p, stamped with the current time now
+// (milliseconds since the epoch). use_gnss selects geometric altitude and
+// vertical rate as in --gnss. Returns the end of the line, or NULL if the
+// message has no SBS equivalent and nothing was written.
+//
+// Byte for byte the same as formatting every field with sprintf, but the
+// date/time fields are only rebuilt when the millisecond changes and
+// numbers are formatted by hand.
+char *sbsEncode(char *p, struct modesMessage *mm, struct aircraft *a, uint64_t now, int use_gnss);
+
+// Parse one SBS line (NUL terminated, a trailing \r is fine) into a zeroed
+// mm. Any MSG subtype (1-8) is accepted and every field it carries is used;
+// fields that aren't numbers where one is expected are ignored. Returns 0,
+// or -1 if the line isn't an MSG line or is unusable (bad address or
+// altitude), leaving mm partly filled in.
+int sbsDecode(const char *line, struct modesMessage *mm);
+
+#endif
@@ -64,6 +64,8 @@ bool bladeRFHandleOption(int argc, char *argv) {
                 BladeRF.lpf_bandwidth = atoi(argv);
             }
             break;
+        case OptSampleRate:
+            return demodSetSampleRate(argv);
     }
     return true;
 }
@@ -55,6 +55,10 @@
 #include "readsb.h"
 #include "sdr_ifile.h"
 
+#include <sys/mman.h>
+
+#define IFILE_MAX_THREADS 32
+
 static struct {
     input_format_t input_format;
     int fd;
@@ -62,19 +66,55 @@ static struct {
     bool throttle;
     uint8_t padding1;
     uint16_t padding2;
+    unsigned threads;
     void *readbuf;
+    uint8_t *map; // whole file mapped read-only, or NULL to read() it
+    size_t map_size;
     iq_convert_fn converter;
     struct converter_state *converter_state;
     const char *filename;
 } ifile;
 
+// Chunked mode (--ifile-threads): the file is cut into buffer-sized
+// chunks that workers convert and demodulate independently, each with
+// the trailing samples of the previous chunk as overlap. Chunk c lives in
+// slot c % nslots until the reader thread has handed it to the main
+// thread, so at most nslots chunks are in flight. Workers never touch the
+// ICAO filter: what depends on it is done by the main thread, in file
+// order, when it uses the chunk (see demodUseBatch).
+struct ifile_chunk {
+    enum { CHUNK_FREE, CHUNK_BUSY, CHUNK_DONE } state;
+    struct mag_buf mag;
+    struct demod_batch *batch;
+};
+
+struct ifile_worker {
+    pthread_t thread;
+    struct converter_state *converter_state;
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint64_t chunks;
+    uint64_t next_chunk; // next chunk a worker will pick up
+    bool stop;
+    unsigned nslots;
+    struct ifile_chunk *slots;
+    struct ifile_worker *workers;
+    struct demod_batch *fifo_batches[MODES_MAG_BUFFERS];
+} chunked;
+
 void ifileInitConfig(void) {
     ifile.filename = NULL;
     ifile.input_format = INPUT_UC8;
     ifile.throttle = false;
+    ifile.threads = 1;
     ifile.fd = -1;
     ifile.bytes_per_sample = 0;
     ifile.readbuf = NULL;
+    ifile.map = NULL;
+    ifile.map_size = 0;
     ifile.converter = NULL;
     ifile.converter_state = NULL;
 }
@@ -101,6 +141,15 @@ bool ifileHandleOption(int argc, char *argv) {
         case OptIfileThrottle:
             ifile.throttle = true;
             break;
+        case OptIfileThreads:
+            ifile.threads = atoi(argv);
+            if (ifile.threads < 1 || ifile.threads > IFILE_MAX_THREADS) {
+                fprintf(stderr, "ifile: --ifile-threads must be between 1 and %d\n", IFILE_MAX_THREADS);
+                return false;
+            }
+            break;
+        case OptSampleRate:
+            return demodSetSampleRate(argv);
     }
     return true;
 }
@@ -113,6 +162,8 @@ bool ifileHandleOption(int argc, char *argv) {
 //
 
 bool ifileOpen(void) {
+    struct stat st;
+
     if (!ifile.filename) {
         fprintf(stderr, "SDR type 'ifile' requires an --ifile argument\n");
         return false;
@@ -140,7 +191,27 @@ bool ifileOpen(void) {
             return false;
     }
 
-    if (!(ifile.readbuf = malloc(MODES_MAG_BUF_SAMPLES * ifile.bytes_per_sample))) {
+    // Regular files are mapped so the converter can read straight from
+    // the page cache; pipes, or a mapping that doesn't fit, use read()
+    if (ifile.fd != STDIN_FILENO && fstat(ifile.fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, ifile.fd, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "ifile: can't map %s (%s), reading it instead\n",
+                    ifile.filename, strerror(errno));
+        } else {
+            ifile.map = map;
+            ifile.map_size = st.st_size;
+            madvise(ifile.map, ifile.map_size, MADV_SEQUENTIAL);
+        }
+    }
+
+    if (ifile.threads > 1 && (!ifile.map || ifile.throttle || Modes.interactive || Modes.dc_filter)) {
+        fprintf(stderr, "ifile: --ifile-threads needs a regular file and can't be used with "
+                "--throttle, --interactive or --dcfilter; using one thread\n");
+        ifile.threads = 1;
+    }
+
+    if (!ifile.map && !(ifile.readbuf = malloc(MODES_MAG_BUF_SAMPLES * ifile.bytes_per_sample))) {
         fprintf(stderr, "ifile: failed to allocate read buffer\n");
         ifileClose();
         return false;
@@ -159,10 +230,252 @@ bool ifileOpen(void) {
     return true;
 }
 
+//
+// Convert and demodulate one chunk into its slot
+//
+static void ifileProcessChunk(uint64_t c, struct ifile_chunk *slot, struct converter_state *state) {
+    struct mag_buf *mag = &slot->mag;
+    struct demod_batch *batch = slot->batch;
+    uint64_t total = ifile.map_size / ifile.bytes_per_sample;
+    uint64_t first = c * MODES_MAG_BUF_SAMPLES;
+    unsigned slen = (total - first < MODES_MAG_BUF_SAMPLES) ? total - first : MODES_MAG_BUF_SAMPLES;
+    struct timespec cpu;
+
+    start_cpu_timing(&cpu);
+
+    batch->ncandidates = 0;
+    batch->count = 0;
+    memset(&batch->stats, 0, sizeof (batch->stats));
+
+    // The overlap is what the serial path would have carried over from
+    // the previous buffer: the last samples before this chunk
+    if (first >= Modes.trailing_samples) {
+        ifile.converter(ifile.map + (first - Modes.trailing_samples) * ifile.bytes_per_sample,
+                mag->data, Modes.trailing_samples, state, NULL, NULL);
+    } else {
+        memset(mag->data, 0, Modes.trailing_samples * sizeof (uint16_t));
+    }
+
+    ifile.converter(ifile.map + first * ifile.bytes_per_sample,
+            &mag->data[Modes.trailing_samples], slen, state, &mag->mean_level, &mag->mean_power);
+
+    mag->length = slen;
+    mag->sampleTimestamp = first * 12e6 / Modes.sample_rate;
+    mag->sysTimestamp = mstime();
+    mag->dropped = 0;
+    mag->stats = &batch->stats;
+    mag->batch = batch;
+
+    demodulateBuffer(mag);
+
+    end_cpu_timing(&cpu, &batch->stats.demod_cpu);
+}
+
+static void *ifileWorker(void *arg) {
+    struct ifile_worker *worker = arg;
+
+    pthread_mutex_lock(&chunked.mutex);
+    for (;;) {
+        while (!chunked.stop && chunked.next_chunk < chunked.chunks &&
+                chunked.slots[chunked.next_chunk % chunked.nslots].state != CHUNK_FREE)
+            pthread_cond_wait(&chunked.cond, &chunked.mutex);
+
+        if (chunked.stop || chunked.next_chunk >= chunked.chunks)
+            break;
+
+        uint64_t c = chunked.next_chunk++;
+        struct ifile_chunk *slot = &chunked.slots[c % chunked.nslots];
+        slot->state = CHUNK_BUSY;
+        pthread_mutex_unlock(&chunked.mutex);
+
+        ifileProcessChunk(c, slot, worker->converter_state);
+
+        pthread_mutex_lock(&chunked.mutex);
+        slot->state = CHUNK_DONE;
+        pthread_cond_broadcast(&chunked.cond);
+    }
+    pthread_mutex_unlock(&chunked.mutex);
+
+    demodHiRateCleanup();
+    return NULL;
+}
+
+static void ifileFreeChunked(void) {
+    for (unsigned i = 0; i < MODES_MAG_BUFFERS; ++i) {
+        Modes.mag_buffers[i].batch = NULL;
+        if (chunked.fifo_batches[i]) {
+            free(chunked.fifo_batches[i]->candidates);
+            free(chunked.fifo_batches[i]->msgs);
+            free(chunked.fifo_batches[i]);
+            chunked.fifo_batches[i] = NULL;
+        }
+    }
+
+    if (chunked.slots) {
+        for (unsigned i = 0; i < chunked.nslots; ++i) {
+            free(chunked.slots[i].mag.data);
+            if (chunked.slots[i].batch) {
+                free(chunked.slots[i].batch->candidates);
+                free(chunked.slots[i].batch->msgs);
+                free(chunked.slots[i].batch);
+            }
+        }
+        free(chunked.slots);
+        chunked.slots = NULL;
+    }
+
+    if (chunked.workers) {
+        for (unsigned i = 0; i < ifile.threads; ++i) {
+            if (chunked.workers[i].converter_state)
+                cleanup_converter(chunked.workers[i].converter_state);
+        }
+        free(chunked.workers);
+        chunked.workers = NULL;
+    }
+}
+
+static bool ifileAllocChunked(void) {
+    chunked.nslots = 2 * ifile.threads;
+    chunked.slots = calloc(chunked.nslots, sizeof (struct ifile_chunk));
+    chunked.workers = calloc(ifile.threads, sizeof (struct ifile_worker));
+    if (!chunked.slots || !chunked.workers)
+        return false;
+
+    for (unsigned i = 0; i < chunked.nslots; ++i) {
+        chunked.slots[i].state = CHUNK_FREE;
+        chunked.slots[i].mag.data = calloc(MODES_MAG_BUF_SAMPLES + Modes.trailing_samples, sizeof (uint16_t));
+        chunked.slots[i].batch = calloc(1, sizeof (struct demod_batch));
+        if (!chunked.slots[i].mag.data || !chunked.slots[i].batch)
+            return false;
+    }
+
+    // The main thread's buffers get batches of their own, swapped with
+    // the slot's on delivery, so a slot can be reused at once
+    for (unsigned i = 0; i < MODES_MAG_BUFFERS; ++i) {
+        if (!(chunked.fifo_batches[i] = calloc(1, sizeof (struct demod_batch))))
+            return false;
+    }
+
+    // set up converters here rather than in the workers, as the
+    // lookup tables are shared
+    for (unsigned i = 0; i < ifile.threads; ++i) {
+        if (!init_converter(ifile.input_format, Modes.sample_rate, 0, &chunked.workers[i].converter_state))
+            return false;
+    }
+
+    return true;
+}
+
+//
+// Chunked replay: workers demodulate chunks out of order, the reader
+// thread delivers them to the main thread in file order. Chunks are
+// disjoint and each chunk's messages are in sample order, so delivering
+// the chunks in order merges the messages by timestamp.
+//
+static void ifileRunChunked() {
+    struct timespec thread_cpu;
+    unsigned started = 0;
+
+    chunked.chunks = (ifile.map_size / ifile.bytes_per_sample + MODES_MAG_BUF_SAMPLES - 1) / MODES_MAG_BUF_SAMPLES;
+    chunked.next_chunk = 0;
+    chunked.stop = false;
+    pthread_mutex_init(&chunked.mutex, NULL);
+    pthread_cond_init(&chunked.cond, NULL);
+
+    if (!ifileAllocChunked()) {
+        fprintf(stderr, "ifile: failed to allocate chunk buffers\n");
+        Modes.exit = 1;
+        goto out;
+    }
+
+    for (; started < ifile.threads; ++started) {
+        if (pthread_create(&chunked.workers[started].thread, NULL, ifileWorker, &chunked.workers[started])) {
+            fprintf(stderr, "ifile: can't start worker thread: %s\n", strerror(errno));
+            Modes.exit = 1;
+            break;
+        }
+    }
+
+    start_cpu_timing(&thread_cpu);
+
+    pthread_mutex_lock(&Modes.data_mutex);
+    uint64_t c = 0;
+    while (!Modes.exit && c < chunked.chunks) {
+        unsigned next_free_buffer = (Modes.first_free_buffer + 1) % MODES_MAG_BUFFERS;
+        if (next_free_buffer == Modes.first_filled_buffer) {
+            // no space for output yet
+            pthread_cond_wait(&Modes.data_cond, &Modes.data_mutex);
+            continue;
+        }
+
+        unsigned index = Modes.first_free_buffer;
+        struct mag_buf *outbuf = &Modes.mag_buffers[index];
+        pthread_mutex_unlock(&Modes.data_mutex);
+
+        pthread_mutex_lock(&chunked.mutex);
+        struct ifile_chunk *slot = &chunked.slots[c % chunked.nslots];
+        while (slot->state != CHUNK_DONE)
+            pthread_cond_wait(&chunked.cond, &chunked.mutex);
+
+        struct demod_batch *batch = slot->batch;
+        slot->batch = chunked.fifo_batches[index];
+        chunked.fifo_batches[index] = batch;
+
+        outbuf->length = slot->mag.length;
+        outbuf->sampleTimestamp = slot->mag.sampleTimestamp;
+        outbuf->mean_level = slot->mag.mean_level;
+        outbuf->mean_power = slot->mag.mean_power;
+        outbuf->dropped = 0;
+        outbuf->sysTimestamp = mstime();
+        outbuf->batch = batch;
+
+        slot->state = CHUNK_FREE;
+        pthread_cond_broadcast(&chunked.cond);
+        pthread_mutex_unlock(&chunked.mutex);
+        ++c;
+
+        // Push the new data to the main thread
+        pthread_mutex_lock(&Modes.data_mutex);
+        Modes.first_free_buffer = next_free_buffer;
+        // accumulate CPU while holding the mutex, and restart measurement
+        end_cpu_timing(&thread_cpu, &Modes.reader_cpu_accumulator);
+        start_cpu_timing(&thread_cpu);
+        pthread_cond_signal(&Modes.data_cond);
+    }
+
+    // Wait for the main thread to consume all data
+    while (!Modes.exit && Modes.first_filled_buffer != Modes.first_free_buffer)
+        pthread_cond_wait(&Modes.data_cond, &Modes.data_mutex);
+
+    pthread_mutex_unlock(&Modes.data_mutex);
+
+    pthread_mutex_lock(&chunked.mutex);
+    chunked.stop = true;
+    pthread_cond_broadcast(&chunked.cond);
+    pthread_mutex_unlock(&chunked.mutex);
+
+    for (unsigned i = 0; i < started; ++i)
+        pthread_join(chunked.workers[i].thread, NULL);
+
+out:
+    // the main thread may still be looking at a buffer after an exit
+    pthread_mutex_lock(&Modes.data_mutex);
+    ifileFreeChunked();
+    pthread_mutex_unlock(&Modes.data_mutex);
+
+    pthread_cond_destroy(&chunked.cond);
+    pthread_mutex_destroy(&chunked.mutex);
+}
+
 void ifileRun() {
     if (ifile.fd < 0)
         return;
 
+    if (ifile.threads > 1) {
+        ifileRunChunked();
+        return;
+    }
+
     int eof = 0;
     struct timespec next_buffer_delivery;
 
@@ -170,13 +483,14 @@ void ifileRun() {
     start_cpu_timing(&thread_cpu);
 
     uint64_t sampleCounter = 0;
+    size_t map_offset = 0;
 
     clock_gettime(CLOCK_MONOTONIC, &next_buffer_delivery);
 
     pthread_mutex_lock(&Modes.data_mutex);
     while (!Modes.exit && !eof) {
         ssize_t nread, toread;
-        void *r;
+        void *r, *data;
         struct mag_buf *outbuf, *lastbuf;
         unsigned next_free_buffer;
         unsigned slen;
@@ -206,26 +520,38 @@ void ifileRun() {
         // Get the system time for the start of this block
         outbuf->sysTimestamp = mstime();
 
-        toread = MODES_MAG_BUF_SAMPLES * ifile.bytes_per_sample;
-        r = ifile.readbuf;
-        while (toread) {
-            nread = read(ifile.fd, r, toread);
-            if (nread <= 0) {
-                if (nread < 0) {
-                    fprintf(stderr, "ifile: error reading input file: %s\n", strerror(errno));
-                }
-                // Done.
+        if (ifile.map) {
+            // Convert straight from the mapping
+            size_t len = MODES_MAG_BUF_SAMPLES * ifile.bytes_per_sample;
+            if (ifile.map_size - map_offset <= len) {
+                len = ifile.map_size - map_offset;
                 eof = 1;
-                break;
             }
-            r += nread;
-            toread -= nread;
-        }
+            data = ifile.map + map_offset;
+            map_offset += len;
+            slen = outbuf->length = len / ifile.bytes_per_sample;
+        } else {
+            toread = MODES_MAG_BUF_SAMPLES * ifile.bytes_per_sample;
+            r = data = ifile.readbuf;
+            while (toread) {
+                nread = read(ifile.fd, r, toread);
+                if (nread <= 0) {
+                    if (nread < 0) {
+                        fprintf(stderr, "ifile: error reading input file: %s\n", strerror(errno));
+                    }
+                    // Done.
+                    eof = 1;
+                    break;
+                }
+                r += nread;
+                toread -= nread;
+            }
 
-        slen = outbuf->length = MODES_MAG_BUF_SAMPLES - toread / ifile.bytes_per_sample;
+            slen = outbuf->length = MODES_MAG_BUF_SAMPLES - toread / ifile.bytes_per_sample;
+        }
 
         // Convert the new data
-        ifile.converter(ifile.readbuf, &outbuf->data[Modes.trailing_samples], slen, ifile.converter_state, &outbuf->mean_level, &outbuf->mean_power);
+        ifile.converter(data, &outbuf->data[Modes.trailing_samples], slen, ifile.converter_state, &outbuf->mean_level, &outbuf->mean_power);
 
         if (ifile.throttle || Modes.interactive) {
             // Wait until we are allowed to release this buffer to the main thread
@@ -265,6 +591,12 @@ void ifileClose() {
         ifile.readbuf = NULL;
     }
 
+    if (ifile.map) {
+        munmap(ifile.map, ifile.map_size);
+        ifile.map = NULL;
+        ifile.map_size = 0;
+    }
+
     if (ifile.fd >= 0 && ifile.fd != STDIN_FILENO) {
         close(ifile.fd);
         ifile.fd = -1;
@@ -57,6 +57,8 @@ bool plutosdrHandleOption(int argc, char *argv)
         case OptPlutoNetwork:
             PLUTOSDR.network = strdup(argv);
             break;
+        case OptSampleRate:
+            return demodSetSampleRate(argv);
     }
     return true;
 }
@@ -107,7 +109,8 @@ bool plutosdrOpen()
 
     struct iio_channel* phy_chn = iio_device_find_channel(iio_context_find_device(PLUTOSDR.ctx, "ad9361-phy"), "voltage0", false);
     iio_channel_attr_write(phy_chn, "rf_port_select", "A_BALANCED");
-    iio_channel_attr_write_longlong(phy_chn, "rf_bandwidth", (long long)1750000);
+    // open up the filter when oversampling, sharper pulse edges give better timing
+    iio_channel_attr_write_longlong(phy_chn, "rf_bandwidth", (long long)(Modes.sample_rate > 2400000 ? Modes.sample_rate / 2 : 1750000));
     iio_channel_attr_write_longlong(phy_chn, "sampling_frequency", (long long)Modes.sample_rate);
 
     if (Modes.gain == MODES_AUTO_GAIN) {
@@ -0,0 +1,340 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// shm_bus.c: shared memory message bus for local consumers
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "shm_bus.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#define RECORD_HEADER_LEN (sizeof (struct shm_bus_record))
+#define RECORD_SPACE(len) (RECORD_HEADER_LEN + (((len) + 15) & ~15U))
+
+struct shm_bus_writer {
+    struct shm_bus_header *header;
+    unsigned char *data;
+    size_t map_size;
+    uint64_t head; // where the next record goes
+    uint64_t seq; // number of the next record
+    unsigned char *pending; // reserved, not yet committed record
+    int published; // since the last shmBusNotify
+    char name[NAME_MAX];
+};
+
+#ifdef __linux__
+
+static long futex(_Atomic uint32_t *word, int op, uint32_t val, const struct timespec *timeout) {
+    return syscall(SYS_futex, (uint32_t *) word, op, val, timeout, NULL, 0);
+}
+
+// Wake all readers sleeping on the notify word
+static void notifyWake(_Atomic uint32_t *word) {
+    futex(word, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+// Sleep while the notify word is still val, for at most timeout_ms
+// (no limit if negative). Returns 0 on timeout.
+static int notifyWait(_Atomic uint32_t *word, uint32_t val, int timeout_ms) {
+    struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+
+    if (futex(word, FUTEX_WAIT, val, timeout_ms < 0 ? NULL : &ts) < 0 && errno == ETIMEDOUT)
+        return 0;
+    return 1;
+}
+
+#else
+
+// No futexes here, readers poll the notify word instead
+
+#define NOTIFY_POLL_MS 10
+
+static void notifyWake(_Atomic uint32_t *word) {
+    (void) word;
+}
+
+static int notifyWait(_Atomic uint32_t *word, uint32_t val, int timeout_ms) {
+    struct timespec ts = { 0, NOTIFY_POLL_MS * 1000000L };
+    int waited = 0;
+
+    while (atomic_load(word) == val) {
+        if (timeout_ms >= 0 && waited >= timeout_ms)
+            return 0;
+        nanosleep(&ts, NULL);
+        waited += NOTIFY_POLL_MS;
+    }
+    return 1;
+}
+
+#endif
+
+// shm_open() wants a single leading slash
+static void shmName(char *buf, size_t buflen, const char *name) {
+    snprintf(buf, buflen, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+//
+// Writer
+//
+
+struct shm_bus_writer *shmBusCreate(const char *name, size_t size) {
+    struct shm_bus_writer *w;
+    void *map;
+    int fd;
+
+    if (size < 4096 || (size & (size - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!(w = calloc(1, sizeof (*w))))
+        return NULL;
+
+    shmName(w->name, sizeof (w->name), name);
+    w->map_size = SHM_BUS_DATA_OFFSET + size;
+
+    // replace whatever a previous run left behind; readers still
+    // attached to that see it closed
+    shm_unlink(w->name);
+
+    if ((fd = shm_open(w->name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+        free(w);
+        return NULL;
+    }
+
+    if (ftruncate(fd, w->map_size) < 0
+            || (map = mmap(NULL, w->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        shm_unlink(w->name);
+        free(w);
+        errno = err;
+        return NULL;
+    }
+    close(fd);
+
+    w->header = map;
+    w->data = (unsigned char *) map + SHM_BUS_DATA_OFFSET;
+    w->header->size = size;
+    w->header->version = SHM_BUS_VERSION;
+    atomic_store(&w->header->head, 0);
+    atomic_store(&w->header->reserve, 0);
+    // magic last, readers check it before anything else
+    atomic_thread_fence(memory_order_release);
+    w->header->magic = SHM_BUS_MAGIC;
+
+    return w;
+}
+
+// Announce that we're about to overwrite up to 'end', before doing so
+static void shmBusClaim(struct shm_bus_writer *w, uint64_t end) {
+    atomic_store_explicit(&w->header->reserve, end, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void *shmBusReserve(struct shm_bus_writer *w, shm_bus_type_t type, uint32_t len) {
+    uint64_t size = w->header->size;
+    uint64_t need = RECORD_SPACE(len);
+    uint64_t pos = w->head & (size - 1);
+    struct shm_bus_record *rec;
+
+    if (need > size / 2)
+        return NULL;
+
+    if (size - pos < need) {
+        // no room before the end of the ring, skip to the start
+        shmBusClaim(w, w->head + (size - pos));
+        rec = (struct shm_bus_record *) (w->data + pos);
+        rec->len = size - pos - RECORD_HEADER_LEN;
+        rec->type = SHM_BUS_PAD;
+        rec->reserved = 0;
+        rec->seq = w->seq;
+        w->head += size - pos;
+        pos = 0;
+    }
+
+    shmBusClaim(w, w->head + need);
+    rec = (struct shm_bus_record *) (w->data + pos);
+    rec->len = len;
+    rec->type = type;
+    rec->reserved = 0;
+    rec->seq = w->seq;
+
+    w->pending = (unsigned char *) rec;
+    return w->pending + RECORD_HEADER_LEN;
+}
+
+void shmBusCommit(struct shm_bus_writer *w) {
+    struct shm_bus_record *rec = (struct shm_bus_record *) w->pending;
+
+    if (!rec)
+        return;
+
+    w->head += RECORD_SPACE(rec->len);
+    w->seq++;
+    w->pending = NULL;
+    w->published = 1;
+    atomic_store_explicit(&w->header->head, w->head, memory_order_release);
+}
+
+void shmBusNotify(struct shm_bus_writer *w) {
+    if (!w->published)
+        return;
+
+    w->published = 0;
+    atomic_fetch_add(&w->header->notify, 1);
+    notifyWake(&w->header->notify);
+}
+
+void shmBusDestroy(struct shm_bus_writer *w) {
+    if (!w)
+        return;
+
+    atomic_store(&w->header->closed, 1);
+    w->published = 1;
+    shmBusNotify(w);
+
+    munmap(w->header, w->map_size);
+    shm_unlink(w->name);
+    free(w);
+}
+
+//
+// Reader
+//
+
+int shmBusOpen(struct shm_bus_reader *r, const char *name) {
+    char path[NAME_MAX];
+    struct shm_bus_header header;
+    struct stat st;
+    void *map;
+    int fd;
+
+    memset(r, 0, sizeof (*r));
+    shmName(path, sizeof (path), name);
+
+    if ((fd = shm_open(path, O_RDONLY, 0)) < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < SHM_BUS_DATA_OFFSET
+            || pread(fd, &header, sizeof (header), 0) != sizeof (header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (header.magic != SHM_BUS_MAGIC || header.version != SHM_BUS_VERSION
+            || header.size < 4096 || header.size & (header.size - 1)
+            || (uint64_t) st.st_size != SHM_BUS_DATA_OFFSET + header.size) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+
+    r->map_size = st.st_size;
+    map = mmap(NULL, r->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    r->header = map;
+    r->data = (const unsigned char *) map + SHM_BUS_DATA_OFFSET;
+    r->cursor = atomic_load(&r->header->head);
+    return 0;
+}
+
+// Sleep until the writer publishes something, or the timeout runs out.
+// Returns 0 on timeout.
+static int shmBusWait(struct shm_bus_reader *r, int timeout_ms) {
+    uint32_t notify = atomic_load(&r->header->notify);
+
+    if (atomic_load(&r->header->head) != r->cursor || atomic_load(&r->header->closed))
+        return 1;
+
+    return notifyWait(&r->header->notify, notify, timeout_ms);
+}
+
+int shmBusRead(struct shm_bus_reader *r, void *buf, size_t buflen, shm_bus_type_t *type, int timeout_ms) {
+    uint64_t size = r->header->size;
+
+    while (1) {
+        uint64_t head = atomic_load_explicit(&r->header->head, memory_order_acquire);
+        struct shm_bus_record rec;
+        uint64_t pos;
+
+        if (head == r->cursor) {
+            if (atomic_load(&r->header->closed))
+                return -1;
+            if (!shmBusWait(r, timeout_ms))
+                return 0;
+            continue;
+        }
+
+        if (head - r->cursor > size) {
+            // lapped by the writer, pick up at the newest record;
+            // its sequence number tells how many we missed
+            r->overruns++;
+            r->cursor = head;
+            continue;
+        }
+
+        pos = r->cursor & (size - 1);
+        memcpy(&rec, r->data + pos, sizeof (rec));
+        if (rec.len <= size - pos - RECORD_HEADER_LEN && rec.type != SHM_BUS_PAD)
+            memcpy(buf, r->data + pos + RECORD_HEADER_LEN, rec.len < buflen ? rec.len : buflen);
+
+        // did the writer get to what we copied in the meantime?
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&r->header->reserve, memory_order_relaxed) - r->cursor > size
+                || rec.len > size - pos - RECORD_HEADER_LEN) {
+            r->overruns++;
+            r->cursor = atomic_load_explicit(&r->header->head, memory_order_acquire);
+            continue;
+        }
+
+        r->cursor += RECORD_SPACE(rec.len);
+        if (rec.type == SHM_BUS_PAD)
+            continue;
+
+        if (r->records && rec.seq > r->next_seq)
+            r->lost += rec.seq - r->next_seq;
+        r->next_seq = rec.seq + 1;
+        r->records++;
+
+        *type = rec.type;
+        return rec.len;
+    }
+}
+
+void shmBusClose(struct shm_bus_reader *r) {
+    if (r->header)
+        munmap(r->header, r->map_size);
+    r->header = NULL;
+    r->data = NULL;
+}
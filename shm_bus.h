@@ -0,0 +1,152 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// shm_bus.h: shared memory message bus for local consumers
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef READSB_SHM_BUS_H
+#define READSB_SHM_BUS_H
+
+// readsb publishes every frame it forwards, and the aircraft state it
+// updated, once into a ring buffer in POSIX shared memory (/dev/shm/<name>).
+// Any number of local consumers read the ring with their own cursor, so
+// nothing is encoded or copied per consumer. Consumers that fall more than
+// a ring behind notice it and are told how many records they missed.
+//
+// The ring holds records of a 16 byte header and a payload padded to 16
+// bytes. Records never wrap around the end of the ring; the writer fills
+// the end with a SHM_BUS_PAD record instead. Before writing, the writer
+// announces how far it is about to overwrite, so a reader can tell
+// whether what it just copied is still intact. Readers sleep on a futex
+// that the writer bumps when it has published something (elsewhere than
+// on Linux they poll it every few milliseconds). Readers map the
+// bus read-only, a misbehaving consumer can't disturb the others.
+//
+// This file and shm_bus.c only depend on the C library, consumers can
+// build them into their own programs. See oneoff/shm_consumer.c.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define SHM_BUS_MAGIC 0x42425352 // "RSBB"
+#define SHM_BUS_VERSION 1
+#define SHM_BUS_DATA_OFFSET 4096 // ring data starts one page in
+
+typedef enum {
+    SHM_BUS_PAD = 0, // skip to the start of the ring
+    SHM_BUS_FRAME = 1, // struct shm_bus_frame
+    SHM_BUS_AIRCRAFT = 2 // struct shm_bus_aircraft
+} shm_bus_type_t;
+
+struct shm_bus_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size; // ring data bytes, a power of two
+    _Atomic uint32_t closed; // the writer has gone away
+    _Atomic uint32_t notify; // futex word, bumped after publishing
+    _Atomic uint64_t head; // bytes published since the bus was created
+    _Atomic uint64_t reserve; // bytes the writer may be overwriting up to
+};
+
+struct shm_bus_record {
+    uint32_t len; // payload bytes
+    uint16_t type; // shm_bus_type_t
+    uint16_t reserved;
+    uint64_t seq; // record number, gaps mean records were missed
+};
+
+// A Mode S or Mode A/C frame, as forwarded on the Beast output
+struct shm_bus_frame {
+    uint64_t timestamp; // 12 MHz receiver clock
+    uint64_t sys_timestamp; // milliseconds since the epoch
+    float signal; // signal power, 0 - 1
+    uint8_t len; // bytes of msg used: 2, 7 or 14
+    uint8_t remote; // received from the network
+    uint8_t source; // datasource_t
+    uint8_t correctedbits;
+    uint8_t msg[14];
+    uint8_t padding[2];
+};
+
+#define SHM_BUS_AIRCRAFT_POSITION (1 << 0)
+#define SHM_BUS_AIRCRAFT_ALTITUDE (1 << 1)
+#define SHM_BUS_AIRCRAFT_GS (1 << 2)
+#define SHM_BUS_AIRCRAFT_TRACK (1 << 3)
+#define SHM_BUS_AIRCRAFT_BARO_RATE (1 << 4)
+#define SHM_BUS_AIRCRAFT_CALLSIGN (1 << 5)
+#define SHM_BUS_AIRCRAFT_SQUAWK (1 << 6)
+
+// Aircraft state after a message updated it; flags say which fields are valid
+struct shm_bus_aircraft {
+    uint32_t addr; // ICAO address, with the non-ICAO bit
+    uint32_t flags; // SHM_BUS_AIRCRAFT_*
+    uint64_t seen; // milliseconds since the epoch
+    double lat;
+    double lon;
+    int32_t altitude_baro; // feet
+    int32_t baro_rate; // feet/minute
+    float gs; // knots
+    float track; // degrees
+    uint32_t squawk; // as four hex digits, 0x7700 etc
+    uint32_t messages;
+    char callsign[12]; // NUL terminated
+};
+
+// Writer side, used by readsb
+
+struct shm_bus_writer;
+
+// Create (or replace) /dev/shm/<name> with a ring of size bytes, a power of two.
+// Returns NULL with errno set on failure.
+struct shm_bus_writer *shmBusCreate(const char *name, size_t size);
+
+// Room for a record of len payload bytes; fill it in, then shmBusCommit()
+void *shmBusReserve(struct shm_bus_writer *w, shm_bus_type_t type, uint32_t len);
+void shmBusCommit(struct shm_bus_writer *w);
+
+// Wake sleeping readers if anything was published since the last call
+void shmBusNotify(struct shm_bus_writer *w);
+
+// Tell readers we're gone, unmap and remove the bus
+void shmBusDestroy(struct shm_bus_writer *w);
+
+// Reader side
+
+struct shm_bus_reader {
+    struct shm_bus_header *header;
+    const unsigned char *data;
+    size_t map_size;
+    uint64_t cursor; // position in the ring, in bytes since creation
+    uint64_t next_seq; // record we expect next
+    uint64_t records; // records read
+    uint64_t lost; // records missed because we fell behind
+    uint64_t overruns; // times we fell behind
+};
+
+// Attach to /dev/shm/<name>, starting with the records published from now on.
+// Returns 0, or -1 with errno set.
+int shmBusOpen(struct shm_bus_reader *r, const char *name);
+
+// Copy the next record's payload into buf, waiting up to timeout_ms
+// (-1: forever) for one. Returns the payload length and sets *type,
+// 0 on timeout, or -1 once the writer has gone away.
+// Payloads longer than buflen are truncated.
+int shmBusRead(struct shm_bus_reader *r, void *buf, size_t buflen, shm_bus_type_t *type, int timeout_ms);
+
+void shmBusClose(struct shm_bus_reader *r);
+
+#endif
@@ -120,10 +120,28 @@ void display_stats(struct stats *st) {
         printf("    %u accepted with correct CRC\n", st->remote_accepted[0]);
         for (j = 1; j <= Modes.nfix_crc; ++j)
             printf("    %u accepted with %d-bit error repaired\n", st->remote_accepted[j], j);
+        if (Modes.net_input_beast_udp) {
+            printf("  %u Beast UDP datagrams received\n", st->remote_udp_datagrams);
+            printf("    %u lost\n", st->remote_udp_lost);
+            printf("    %u reordered\n", st->remote_udp_reordered);
+            printf("    %u late or duplicated\n", st->remote_udp_late);
+        }
+        displayInputClocks();
+        printf("Output shed under backpressure:\n");
+        printf("  %u low priority frames\n", st->shed_low);
+        printf("  %u normal priority frames\n", st->shed_normal);
+        printf("  %u high priority frames\n", st->shed_high);
+        printf("BeastReduce output:\n");
+        printf("  %u of %u Beast frames forwarded\n", st->beast_reduce_frames, st->beast_full_frames);
+        if (st->beast_reduce_bytes)
+            printf("  %.1f:1 compression against full Beast output\n",
+                    (double) st->beast_full_bytes / st->beast_reduce_bytes);
     }
 
-    printf("%u total usable messages\n",
-            st->messages_total);
+    printf("%u total usable messages\n"
+            "  %u used without decoding their ES / Comm-B fields\n",
+            st->messages_total,
+            st->messages_header_only);
 
     printf("%u surface position messages received\n"
             "%u airborne position messages received\n"
@@ -302,9 +320,21 @@ void add_stats(const struct stats *st1, const struct stats *st2, struct stats *t
     target->remote_rejected_unknown_icao = st1->remote_rejected_unknown_icao + st2->remote_rejected_unknown_icao;
     for (i = 0; i < MODES_MAX_BITERRORS + 1; ++i)
         target->remote_accepted[i] = st1->remote_accepted[i] + st2->remote_accepted[i];
+    target->remote_udp_datagrams = st1->remote_udp_datagrams + st2->remote_udp_datagrams;
+    target->remote_udp_lost = st1->remote_udp_lost + st2->remote_udp_lost;
+    target->remote_udp_reordered = st1->remote_udp_reordered + st2->remote_udp_reordered;
+    target->remote_udp_late = st1->remote_udp_late + st2->remote_udp_late;
+    target->shed_low = st1->shed_low + st2->shed_low;
+    target->shed_normal = st1->shed_normal + st2->shed_normal;
+    target->shed_high = st1->shed_high + st2->shed_high;
+    target->beast_full_frames = st1->beast_full_frames + st2->beast_full_frames;
+    target->beast_full_bytes = st1->beast_full_bytes + st2->beast_full_bytes;
+    target->beast_reduce_frames = st1->beast_reduce_frames + st2->beast_reduce_frames;
+    target->beast_reduce_bytes = st1->beast_reduce_bytes + st2->beast_reduce_bytes;
 
     // total messages:
     target->messages_total = st1->messages_total + st2->messages_total;
+    target->messages_header_only = st1->messages_header_only + st2->messages_header_only;
 
     // CPR decoding:
     target->cpr_surface = st1->cpr_surface + st2->cpr_surface;
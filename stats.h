@@ -87,8 +87,24 @@ struct stats
   uint32_t remote_rejected_bad;
   uint32_t remote_rejected_unknown_icao;
   uint32_t remote_accepted[MODES_MAX_BITERRORS + 1];
+  // Beast UDP input:
+  uint32_t remote_udp_datagrams;
+  uint32_t remote_udp_lost; // never arrived, or gave up waiting
+  uint32_t remote_udp_reordered; // arrived early and were held back
+  uint32_t remote_udp_late; // duplicates, or arrived after being given up on
+  // output frames shed under backpressure, all clients:
+  uint32_t shed_low;
+  uint32_t shed_normal;
+  uint32_t shed_high;
+  // BeastReduce output compared to full Beast output:
+  uint32_t beast_full_frames;
+  uint32_t beast_full_bytes;
+  uint32_t beast_reduce_frames;
+  uint32_t beast_reduce_bytes;
   // total messages:
   uint32_t messages_total;
+  // used without decoding their ES / Comm-B fields
+  uint32_t messages_header_only;
   // CPR decoding:
   unsigned int cpr_surface;
   unsigned int cpr_airborne;
@@ -0,0 +1,348 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// trace.c: per aircraft position traces
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "readsb.h"
+
+#include <dirent.h>
+#include <stddef.h>
+
+union trace_slot {
+    struct {
+        int16_t lat;
+        int16_t lon;
+        int16_t alt;
+        uint16_t dt; // seconds and flags
+    } d;
+    struct {
+        int32_t lat;
+        int32_t lon;
+    } k; // the slot after a TRACE_KEY point
+};
+
+struct trace {
+    struct trace *next_free;
+    uint64_t base_time; // seconds, the values before the oldest point
+    int32_t base_lat;
+    int32_t base_lon;
+    int32_t base_alt;
+    uint64_t last_time; // seconds, the values of the newest point
+    int32_t last_lat;
+    int32_t last_lon;
+    int32_t last_alt;
+    uint16_t last_flags;
+    float last_track;
+    uint64_t last_ms; // when the newest point was recorded
+    int start; // oldest slot
+    int used;
+    int changed; // points were added since the file was written
+    int written; // json_dir/traces holds a file for it
+    union trace_slot slots[TRACE_SLOTS];
+};
+
+struct trace_slab {
+    struct trace_slab *next;
+    struct trace traces[TRACE_SLAB];
+};
+
+static int enabled;
+static struct trace_slab *slabs;
+static struct trace *free_traces;
+
+//
+//=========================================================================
+//
+// Slabs
+//
+static struct trace *traceAlloc(uint64_t sec) {
+    struct trace *t;
+
+    if (!free_traces) {
+        struct trace_slab *slab = malloc(sizeof (*slab));
+
+        if (!slab) {
+            fprintf(stderr, "trace: out of memory\n");
+            exit(1);
+        }
+        slab->next = slabs;
+        slabs = slab;
+        for (int i = TRACE_SLAB - 1; i >= 0; i--) {
+            slab->traces[i].next_free = free_traces;
+            free_traces = &slab->traces[i];
+        }
+    }
+
+    t = free_traces;
+    free_traces = t->next_free;
+
+    memset(t, 0, offsetof(struct trace, slots));
+    t->base_time = t->last_time = sec;
+    return t;
+}
+
+static void tracePath(char *path, size_t size, struct aircraft *a) {
+    snprintf(path, size, "%s/%s%06x.json", TRACE_DIR,
+            (a->addr & MODES_NON_ICAO_ADDRESS) ? "~" : "", a->addr & 0xFFFFFF);
+}
+
+//
+//=========================================================================
+//
+// Ring
+//
+
+// Fold the oldest point into the base values
+static void dropOldest(struct trace *t) {
+    union trace_slot *s = &t->slots[t->start];
+    int n = 1;
+
+    t->base_time += s->d.dt & TRACE_DT_MASK;
+    t->base_alt += s->d.alt;
+    if (s->d.dt & TRACE_KEY) {
+        union trace_slot *k = &t->slots[(t->start + 1) % TRACE_SLOTS];
+        t->base_lat = k->k.lat;
+        t->base_lon = k->k.lon;
+        n = 2;
+    } else {
+        t->base_lat += s->d.lat;
+        t->base_lon += s->d.lon;
+    }
+
+    t->start = (t->start + n) % TRACE_SLOTS;
+    t->used -= n;
+}
+
+static void addPoint(struct trace *t, uint64_t sec, int32_t lat, int32_t lon, int32_t alt, uint16_t flags) {
+    int32_t dlat = lat - t->last_lat;
+    int32_t dlon = lon - t->last_lon;
+    union trace_slot *s;
+
+    if (dlat < INT16_MIN || dlat > INT16_MAX || dlon < INT16_MIN || dlon > INT16_MAX)
+        flags |= TRACE_KEY;
+
+    while (t->used + ((flags & TRACE_KEY) ? 2 : 1) > TRACE_SLOTS)
+        dropOldest(t);
+
+    s = &t->slots[(t->start + t->used++) % TRACE_SLOTS];
+    s->d.lat = (flags & TRACE_KEY) ? 0 : dlat;
+    s->d.lon = (flags & TRACE_KEY) ? 0 : dlon;
+    s->d.alt = alt - t->last_alt;
+    s->d.dt = (sec - t->last_time) | flags;
+    if (flags & TRACE_KEY) {
+        s = &t->slots[(t->start + t->used++) % TRACE_SLOTS];
+        s->k.lat = lat;
+        s->k.lon = lon;
+    }
+
+    t->last_time = sec;
+    t->last_lat = lat;
+    t->last_lon = lon;
+    t->last_alt = alt;
+    t->changed = 1;
+}
+
+//
+//=========================================================================
+//
+void traceInit(void) {
+    char path[PATH_MAX];
+    struct dirent *e;
+    DIR *dir;
+
+    enabled = 1;
+    if (!Modes.json_dir)
+        return;
+
+    snprintf(path, PATH_MAX, "%s/%s", Modes.json_dir, TRACE_DIR);
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "trace: can't create %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    // Traces left over from the last run are of aircraft we don't track
+    if ((dir = opendir(path))) {
+        while ((e = readdir(dir))) {
+            size_t len = strlen(e->d_name);
+
+            if (len > 5 && !strcmp(e->d_name + len - 5, ".json"))
+                unlinkat(dirfd(dir), e->d_name, 0);
+        }
+        closedir(dir);
+    }
+}
+
+void traceAdd(struct aircraft *a, uint64_t now) {
+    struct trace *t = a->trace;
+    uint64_t sec = now / 1000;
+    int32_t lat, lon, alt;
+    uint16_t flags = 0;
+
+    if (!enabled)
+        return;
+
+    lat = lrint(a->lat * 1e5);
+    lon = lrint(a->lon * 1e5);
+
+    if (trackDataValid(&a->airground_valid) && a->airground_valid.source >= SOURCE_MODE_S_CHECKED && a->airground == AG_GROUND)
+        flags |= TRACE_GROUND;
+    else if (!trackDataValid(&a->altitude_baro_valid) || a->altitude_baro_reliable < 3)
+        flags |= TRACE_NO_ALT;
+
+    if (!t) {
+        t = a->trace = traceAlloc(sec);
+        alt = flags ? 0 : lrint(a->altitude_baro / 25.0);
+    } else {
+        uint64_t elapsed = now - t->last_ms;
+        int turned = 0;
+
+        alt = flags ? t->last_alt : lrint(a->altitude_baro / 25.0);
+
+        if (now < t->last_ms || elapsed < TRACE_MIN_INTERVAL)
+            return;
+        if (lat == t->last_lat && lon == t->last_lon && alt == t->last_alt && flags == t->last_flags)
+            return;
+
+        if (trackDataValid(&a->track_valid)) {
+            float diff = fabsf(a->track - t->last_track);
+            turned = (diff > 180 ? 360 - diff : diff) >= TRACE_TURN;
+        }
+
+        if (elapsed < TRACE_MAX_INTERVAL && !turned && flags == t->last_flags && abs(alt - t->last_alt) < TRACE_CLIMB)
+            return;
+
+        // Too long without a position for the time delta, start over
+        if (sec - t->last_time > TRACE_DT_MASK) {
+            t->start = t->used = 0;
+            t->base_time = t->last_time = sec;
+            t->base_lat = t->base_lon = t->base_alt = 0;
+            t->last_lat = t->last_lon = t->last_alt = 0;
+        }
+    }
+
+    addPoint(t, sec, lat, lon, alt, flags);
+    t->last_flags = flags;
+    t->last_ms = now;
+    if (trackDataValid(&a->track_valid))
+        t->last_track = a->track;
+}
+
+void traceFree(struct aircraft *a) {
+    struct trace *t = a->trace;
+
+    if (!t)
+        return;
+
+    if (t->written && Modes.json_dir) {
+        char file[32], path[PATH_MAX];
+
+        tracePath(file, sizeof (file), a);
+        snprintf(path, PATH_MAX, "%s/%s", Modes.json_dir, file);
+        unlink(path);
+    }
+
+    t->next_free = free_traces;
+    free_traces = t;
+    a->trace = NULL;
+}
+
+struct char_buffer traceJson(struct aircraft *a, uint64_t now) {
+    struct trace *t = a->trace;
+    struct char_buffer cb = { NULL, 0 };
+    uint64_t time;
+    int32_t lat, lon, alt;
+    char *p, *end;
+    int i;
+
+    if (!t)
+        return cb;
+
+    // "[-90.00000,-180.00000,\"ground\",1,18446744073709551615]," fits
+    cb.buffer = malloc(128 + (size_t) t->used * 64);
+    if (!cb.buffer) {
+        fprintf(stderr, "trace: out of memory\n");
+        exit(1);
+    }
+    p = cb.buffer;
+    end = cb.buffer + 128 + (size_t) t->used * 64;
+
+    p += snprintf(p, end - p, "{\"hex\":\"%s%06x\",\"now\":%.1f,\"trace\":[",
+            (a->addr & MODES_NON_ICAO_ADDRESS) ? "~" : "", a->addr & 0xFFFFFF, now / 1000.0);
+
+    time = t->base_time;
+    lat = t->base_lat;
+    lon = t->base_lon;
+    alt = t->base_alt;
+    for (i = 0; i < t->used; i++) {
+        union trace_slot *s = &t->slots[(t->start + i) % TRACE_SLOTS];
+        uint16_t dt = s->d.dt;
+
+        time += dt & TRACE_DT_MASK;
+        alt += s->d.alt;
+        if (dt & TRACE_KEY) {
+            union trace_slot *k = &t->slots[(t->start + ++i) % TRACE_SLOTS];
+            lat = k->k.lat;
+            lon = k->k.lon;
+        } else {
+            lat += s->d.lat;
+            lon += s->d.lon;
+        }
+
+        p += snprintf(p, end - p, "%s[%.5f,%.5f,", p[-1] == '[' ? "" : ",", lat / 1e5, lon / 1e5);
+        if (dt & TRACE_GROUND)
+            p += snprintf(p, end - p, "\"ground\",");
+        else if (dt & TRACE_NO_ALT)
+            p += snprintf(p, end - p, "null,");
+        else
+            p += snprintf(p, end - p, "%d,", alt * 25);
+        p += snprintf(p, end - p, "%d,%llu]", (dt & TRACE_DT_MASK) > TRACE_GAP ? 1 : 0, (unsigned long long) time);
+    }
+    p += snprintf(p, end - p, "]}\n");
+
+    cb.len = p - cb.buffer;
+    return cb;
+}
+
+void traceWriteFiles(uint64_t now) {
+    struct aircraft *a;
+    char file[32];
+
+    if (!enabled || !Modes.json_dir)
+        return;
+
+    for (int j = 0; j < AIRCRAFTS_BUCKETS; j++) {
+        for (a = Modes.aircrafts[j]; a; a = a->next) {
+            if (!a->trace || !a->trace->changed)
+                continue;
+
+            tracePath(file, sizeof (file), a);
+            writeJsonToFile(file, traceJson(a, now));
+            a->trace->changed = 0;
+            a->trace->written = 1;
+        }
+    }
+}
+
+void traceCleanup(void) {
+    while (slabs) {
+        struct trace_slab *next = slabs->next;
+        free(slabs);
+        slabs = next;
+    }
+    free_traces = NULL;
+    enabled = 0;
+}
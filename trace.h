@@ -0,0 +1,82 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// trace.h: per aircraft position traces
+//
+// Copyright (c) 2019 Michael Wolf <michael@mictronics.de>
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef READSB_TRACE_H
+#define READSB_TRACE_H
+
+// Every aircraft with a position gets a trace: a ring of TRACE_SLOTS
+// eight byte slots, allocated from slabs and returned there when the
+// aircraft is removed. A point is stored as the change from the previous
+// one:
+//
+//   lat, lon  int16, 1e-5 degrees
+//   alt       int16, 25 ft; 0 when TRACE_GROUND or TRACE_NO_ALT is set
+//   dt        13 bits of seconds, plus the flags in the top 3 bits
+//
+// A point that moved too far for 16 bits sets TRACE_KEY and is followed by
+// a second slot with its absolute int32 lat and lon. When the ring is full
+// the oldest point is folded into the ring's base values and dropped.
+//
+// A point is recorded once TRACE_MIN_INTERVAL has passed since the last
+// one and the aircraft turned, climbed or landed, and at least every
+// TRACE_MAX_INTERVAL while it keeps sending positions.
+//
+// A trace is rendered as
+//
+//   {"hex":"..","now":..,"trace":[[lat,lon,alt,gap,time],..]}
+//
+// where alt is feet, "ground" or null, gap is 1 if no position was seen
+// for TRACE_GAP seconds before the point, and time is in seconds. The HTTP
+// server renders it on request as /data/traces/<hex>.json; with a json
+// dir, traces that changed are also written there every
+// TRACE_WRITE_INTERVAL.
+
+#define TRACE_SLOTS 512
+#define TRACE_SLAB 32 // traces per allocation
+#define TRACE_MIN_INTERVAL 4000
+#define TRACE_MAX_INTERVAL 30000
+#define TRACE_TURN 3.0 // degrees of track change worth a point
+#define TRACE_CLIMB 4 // 25 ft units of altitude change worth a point
+#define TRACE_GAP 45
+#define TRACE_WRITE_INTERVAL 10000
+#define TRACE_DIR "traces"
+
+#define TRACE_KEY 0x8000 // absolute lat and lon in the next slot
+#define TRACE_GROUND 0x4000
+#define TRACE_NO_ALT 0x2000
+#define TRACE_DT_MASK 0x1fff
+
+// Start recording traces, and with a json dir clear out json_dir/traces
+void traceInit(void);
+
+// Record the aircraft's new position if it is worth a point
+void traceAdd(struct aircraft *a, uint64_t now);
+
+// Give back the trace of an aircraft that is being removed
+void traceFree(struct aircraft *a);
+
+// Render the trace of an aircraft, an empty buffer if there is none
+struct char_buffer traceJson(struct aircraft *a, uint64_t now);
+
+// Write the traces that changed to json_dir/traces
+void traceWriteFiles(uint64_t now);
+
+void traceCleanup(void);
+
+#endif
@@ -53,6 +53,7 @@
 
 #include "readsb.h"
 #include <inttypes.h>
+#include <stddef.h>
 
 /* #define DEBUG_CPR_CHECKS */
 
@@ -99,7 +100,7 @@ static struct aircraft *trackCreateAircraft(struct modesMessage *mm) {
     a->fatsv_last_emitted = a->fatsv_last_force_emit = messageNow();
 
     // Copy the first message so we can emit it later when a second message arrives.
-    a->first_message = *mm;
+    copyModesMessage(&a->first_message, mm);
 
     // initialize data validity ages
 #define F(f,s,e) do { a->f##_valid.stale_interval = (s) * 1000; a->f##_valid.expire_interval = (e) * 1000; } while (0)
@@ -151,7 +152,7 @@ static struct aircraft *trackCreateAircraft(struct modesMessage *mm) {
 // exists with this address.
 //
 
-static struct aircraft *trackFindAircraft(uint32_t addr) {
+struct aircraft *trackFindAircraft(uint32_t addr) {
     struct aircraft *a = Modes.aircrafts[addr % AIRCRAFTS_BUCKETS];
 
     while (a) {
@@ -161,10 +162,137 @@ static struct aircraft *trackFindAircraft(uint32_t addr) {
     return (NULL);
 }
 
+//
+//=========================================================================
+//
+// Grid of aircraft positions
+//
+
+static struct aircraft *grid[TRACK_GRID_LAT * TRACK_GRID_LON];
+
+static int gridRow(double lat) {
+    int row = (int) floor(lat + 90);
+    return row < 0 ? 0 : row >= TRACK_GRID_LAT ? TRACK_GRID_LAT - 1 : row;
+}
+
+static int gridColumn(double lon) {
+    int col = (int) floor(lon + 180) % TRACK_GRID_LON;
+    return col < 0 ? col + TRACK_GRID_LON : col;
+}
+
+static void gridRemove(struct aircraft *a) {
+    if (!a->grid_cell)
+        return;
+    if (a->grid_next)
+        a->grid_next->grid_pprev = a->grid_pprev;
+    *a->grid_pprev = a->grid_next;
+    a->grid_cell = 0;
+}
+
+// Move the aircraft to the cell of its current position
+static void gridUpdate(struct aircraft *a) {
+    int cell = gridRow(a->lat) * TRACK_GRID_LON + gridColumn(a->lon);
+
+    if (a->grid_cell == cell + 1)
+        return;
+
+    gridRemove(a);
+    a->grid_next = grid[cell];
+    if (a->grid_next)
+        a->grid_next->grid_pprev = &a->grid_next;
+    a->grid_pprev = &grid[cell];
+    grid[cell] = a;
+    a->grid_cell = cell + 1;
+}
+
+// Is lon between west and east, going east from west?
+static int lonInside(double lon, double west, double east) {
+    if (west <= east)
+        return lon >= west && lon <= east;
+    return lon >= west || lon <= east;
+}
+
+// Call match on every aircraft with a valid position in the cells
+// covering the box. Returns the number of aircraft it accepted.
+static int gridScan(double south, double west, double north, double east, int all_lon,
+        int (*match)(struct aircraft *, void *), void *arg, struct aircraft **out, int max) {
+    int row0 = gridRow(south), row1 = gridRow(north);
+    int col0 = all_lon ? 0 : gridColumn(west);
+    int cols = all_lon ? TRACK_GRID_LON : (gridColumn(east) - col0 + TRACK_GRID_LON) % TRACK_GRID_LON + 1;
+    int n = 0;
+
+    // A box going all the way around ends in the cell it started in
+    if (!all_lon && west > east && cols == 1)
+        cols = TRACK_GRID_LON;
+
+    for (int row = row0; row <= row1; row++) {
+        for (int i = 0; i < cols; i++) {
+            struct aircraft *a = grid[row * TRACK_GRID_LON + (col0 + i) % TRACK_GRID_LON];
+
+            for (; a; a = a->grid_next) {
+                if (!trackDataValid(&a->position_valid) || !match(a, arg))
+                    continue;
+                if (n < max)
+                    out[n] = a;
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+struct query_box {
+    double south, west, north, east;
+};
+
+static int matchBox(struct aircraft *a, void *arg) {
+    struct query_box *q = arg;
+    return a->lat >= q->south && a->lat <= q->north && lonInside(a->lon, q->west, q->east);
+}
+
+int trackQueryBox(double south, double west, double north, double east, struct aircraft **out, int max) {
+    struct query_box q = { south, west, north, east };
+
+    if (south > north)
+        return 0;
+    return gridScan(south, west, north, east, east - west >= 360, matchBox, &q, out, max);
+}
+
+struct query_radius {
+    struct geo_ref ref;
+    double range;
+};
+
+static int matchRadius(struct aircraft *a, void *arg) {
+    struct query_radius *q = arg;
+    return geoWithinRange(&q->ref, a->lat, a->lon, q->range);
+}
+
+int trackQueryRadius(double lat, double lon, double range, struct aircraft **out, int max) {
+    struct query_radius q;
+    double dlat = range / GEO_EARTH_RADIUS * 180 / M_PI;
+    double south = lat - dlat, north = lat + dlat;
+    double dlon = 180;
+
+    geoSetRef(&q.ref, lat, lon);
+    q.range = range;
+
+    // Close to a pole the range covers every longitude
+    if (south > -90 && north < 90)
+        dlon = dlat / cos(fmax(fabs(south), fabs(north)) * M_PI / 180);
+
+    return gridScan(south, lon - dlon, north, lon + dlon, dlon >= 180, matchRadius, &q, out, max);
+}
+
+// Data accepted from the message being processed, see updated_now().
+// More than any one message can carry.
+static const data_validity *accepted_now[64];
+static unsigned accepted_now_count;
+
 // Should we accept some new data from the given source?
 // If so, update the validity and return 1
 
-static int accept_data(data_validity *d, datasource_t source, struct modesMessage *mm, int reduce_often) {
+static int accept_data(data_validity *d, datasource_t source) {
     if (messageNow() < d->updated)
         return 0;
 
@@ -176,20 +304,73 @@ static int accept_data(data_validity *d, datasource_t source, struct modesMessag
     d->stale = messageNow() + (d->stale_interval ? d->stale_interval : 60000);
     d->expires = messageNow() + (d->expire_interval ? d->expire_interval : 70000);
 
-    if (messageNow() > d->next_reduce_forward && !mm->sbs_in) {
-        if (mm->msgtype == 17 || reduce_often) {
-            d->next_reduce_forward = messageNow() + Modes.net_output_beast_reduce_interval;
-        } else {
-            d->next_reduce_forward = messageNow() + Modes.net_output_beast_reduce_interval * 4;
+    if (accepted_now_count < sizeof (accepted_now) / sizeof (accepted_now[0]))
+        accepted_now[accepted_now_count++] = d;
+
+    return 1;
+}
+
+// Would accept_data() turn the source down?
+static int reject_data(const data_validity *d, datasource_t source) {
+    return source < d->source && messageNow() < d->stale;
+}
+
+// Position and velocity messages carry nothing but data that goes through
+// accept_data(). When all of it would be turned down, e.g. mlat results or
+// TIS-B for an aircraft with current ADS-B, their fields needn't be
+// decoded. Which data a message carries is read off the ME the same way
+// the decoders in mode_s.c do.
+static int fields_wanted(struct aircraft *a, struct modesMessage *mm) {
+    datasource_t s = mm->source;
+    unsigned char *me = mm->ME;
+
+    if (mm->msgtype != 17 && mm->msgtype != 18)
+        return 1;
+
+    switch (mm->metype) {
+        case 5: case 6: case 7: case 8: { // surface position
+            unsigned movement = getbits(me, 6, 12);
+
+            if (!reject_data(getbit(me, 22) ? &a->cpr_odd_valid : &a->cpr_even_valid, s)
+                    || !reject_data(&a->airground_valid, s))
+                return 1;
+            if (movement > 0 && movement < 125 && !reject_data(&a->gs_valid, s))
+                return 1;
+            if (getbit(me, 13) && !(reject_data(&a->track_valid, s) && reject_data(&a->mag_heading_valid, s)
+                    && reject_data(&a->true_heading_valid, s)))
+                return 1;
+            return 0;
         }
-        // make sure global CPR stays possible even at high interval:
-        if (Modes.net_output_beast_reduce_interval > 7000 && mm->cpr_valid) {
-            d->next_reduce_forward = messageNow() + 7000;
+
+        case 9: case 10: case 11: case 12: case 13: case 14: case 15: case 16: case 17: case 18:
+        case 20: case 21: case 22: // airborne position
+            if (!reject_data(getbit(me, 22) ? &a->cpr_odd_valid : &a->cpr_even_valid, s)
+                    || !reject_data(&a->alert_valid, s) || !reject_data(&a->spi_valid, s))
+                return 1;
+            if (getbits(me, 9, 20))
+                return !reject_data(mm->metype >= 20 ? &a->altitude_geom_valid : &a->altitude_baro_valid, s);
+            return 0;
+
+        case 19: { // velocity
+            unsigned mesub = getbits(me, 6, 8);
+
+            if (mesub < 1 || mesub > 4 || !reject_data(&a->nac_v_valid, s))
+                return 1;
+            if (mesub <= 2 && !(reject_data(&a->gs_valid, s) && reject_data(&a->track_valid, s)))
+                return 1;
+            if (mesub >= 3 && !(reject_data(&a->mag_heading_valid, s) && reject_data(&a->true_heading_valid, s)
+                    && reject_data(getbit(me, 25) ? &a->tas_valid : &a->ias_valid, s)))
+                return 1;
+            if (getbits(me, 38, 46) && !reject_data(getbit(me, 36) ? &a->baro_rate_valid : &a->geom_rate_valid, s))
+                return 1;
+            if (getbits(me, 50, 56) && !reject_data(&a->geom_delta_valid, s))
+                return 1;
+            return 0;
         }
-        mm->reduce_forward = 1;
-    }
 
-    return 1;
+        default:
+            return 1;
+    }
 }
 
 // Given two datasources, produce a third datasource for data combined from them.
@@ -228,31 +409,6 @@ static int compare_validity(const data_validity *lhs, const data_validity *rhs)
 // CPR position updating
 //
 
-// Distance between points on a spherical earth.
-// This has up to 0.5% error because the earth isn't actually spherical
-// (but we don't use it in situations where that matters)
-
-static double greatcircle(double lat0, double lon0, double lat1, double lon1) {
-    double dlat, dlon;
-
-    lat0 = lat0 * M_PI / 180.0;
-    lon0 = lon0 * M_PI / 180.0;
-    lat1 = lat1 * M_PI / 180.0;
-    lon1 = lon1 * M_PI / 180.0;
-
-    dlat = fabs(lat1 - lat0);
-    dlon = fabs(lon1 - lon0);
-
-    // use haversine for small distances for better numerical stability
-    if (dlat < 0.001 && dlon < 0.001) {
-        double a = sin(dlat / 2) * sin(dlat / 2) + cos(lat0) * cos(lat1) * sin(dlon / 2) * sin(dlon / 2);
-        return 6371e3 * 2 * atan2(sqrt(a), sqrt(1.0 - a));
-    }
-
-    // spherical law of cosines
-    return 6371e3 * acos(sin(lat0) * sin(lat1) + cos(lat0) * cos(lat1) * cos(dlon));
-}
-
 static void update_range_histogram(double lat, double lon) {
     double range = 0;
     int valid_latlon = Modes.bUserFlags & MODES_USER_LATLON_VALID;
@@ -260,7 +416,7 @@ static void update_range_histogram(double lat, double lon) {
     if (!valid_latlon)
         return;
 
-    range = greatcircle(Modes.fUserLat, Modes.fUserLon, lat, lon);
+    range = geoDistance(&Modes.user_ref, lat, lon);
 
     if ((range <= Modes.maxRange || Modes.maxRange == 0) && range > Modes.stats_current.longest_distance) {
         Modes.stats_current.longest_distance = range;
@@ -283,7 +439,6 @@ static void update_range_histogram(double lat, double lon) {
 
 static int speed_check(struct aircraft *a, double lat, double lon, int surface) {
     uint64_t elapsed;
-    double distance;
     double range;
     int speed;
     int inrange;
@@ -325,12 +480,11 @@ static int speed_check(struct aircraft *a, double lat, double lon, int surface)
     // plus distance covered at the given speed for the elapsed time + 1 second.
     range = (surface ? 0.1e3 : 0.5e3) + ((elapsed + 1000.0) / 1000.0) * (speed * 1852.0 / 3600.0);
 
-    // find actual distance
-    distance = greatcircle(a->lat, a->lon, lat, lon);
-
-    inrange = (distance <= range);
+    // compare against the actual distance, exact only when close to the limit
+    inrange = geoWithinRange(&a->pos_ref, lat, lon, range);
 #ifdef DEBUG_CPR_CHECKS
     if (!inrange) {
+        double distance = geoDistance(&a->pos_ref, lat, lon);
         fprintf(stderr, "Speed check failed: %06x: %.3f,%.3f -> %.3f,%.3f in %.1f seconds, max speed %d kt, range %.1fkm, actual %.1fkm\n",
                 a->addr, a->lat, a->lon, lat, lon, elapsed / 1000.0, speed, range / 1000.0, distance / 1000.0);
     }
@@ -391,11 +545,10 @@ static int doGlobalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
 
     // check max range
     if (Modes.maxRange > 0 && (Modes.bUserFlags & MODES_USER_LATLON_VALID)) {
-        double range = greatcircle(Modes.fUserLat, Modes.fUserLon, *lat, *lon);
-        if (range > Modes.maxRange) {
+        if (!geoWithinRange(&Modes.user_ref, *lat, *lon, Modes.maxRange)) {
 #ifdef DEBUG_CPR_CHECKS
             fprintf(stderr, "Global range check failed: %06x: %.3f,%.3f, max range %.1fkm, actual %.1fkm\n",
-                    a->addr, *lat, *lon, Modes.maxRange / 1000.0, range / 1000.0);
+                    a->addr, *lat, *lon, Modes.maxRange / 1000.0, geoDistance(&Modes.user_ref, *lat, *lon) / 1000.0);
 #endif
 
             Modes.stats_current.cpr_global_range_checks++;
@@ -420,6 +573,7 @@ static int doLocalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
     // relative CPR
     // find reference location
     double reflat, reflon;
+    const struct geo_ref *ref;
     double range_limit = 0;
     int result;
     int fflag = mm->cpr_odd;
@@ -437,6 +591,7 @@ static int doLocalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
     if (messageNow() - a->position_valid.updated < (10*60*1000)) {
         reflat = a->lat;
         reflon = a->lon;
+        ref = &a->pos_ref;
 
         if (a->pos_nic < *nic)
             *nic = a->pos_nic;
@@ -457,6 +612,7 @@ static int doLocalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
     } else if (!surface && (Modes.bUserFlags & MODES_USER_LATLON_VALID)) {
         reflat = Modes.fUserLat;
         reflon = Modes.fUserLon;
+        ref = &Modes.user_ref;
 
         // The cell size is at least 360NM, giving a nominal
         // max range of 180NM (half a cell).
@@ -493,8 +649,7 @@ static int doLocalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
 
     // check range limit
     if (range_limit > 0) {
-        double range = greatcircle(reflat, reflon, *lat, *lon);
-        if (range > range_limit) {
+        if (!geoWithinRange(ref, *lat, *lon, range_limit)) {
             Modes.stats_current.cpr_local_range_checks++;
             return (-1);
         }
@@ -585,7 +740,7 @@ static void updatePosition(struct aircraft *a, struct modesMessage *mm) {
             // Nonfatal, try again later.
             Modes.stats_current.cpr_global_skipped++;
         } else {
-            if (accept_data(&a->position_valid, mm->source, mm, 1)) {
+            if (accept_data(&a->position_valid, mm->source)) {
                 Modes.stats_current.cpr_global_ok++;
 
                 if (a->pos_reliable_odd <= 0 || a->pos_reliable_even <=0) {
@@ -611,7 +766,7 @@ static void updatePosition(struct aircraft *a, struct modesMessage *mm) {
     if (location_result == -1) {
         location_result = doLocalCPR(a, mm, &new_lat, &new_lon, &new_nic, &new_rc);
 
-        if (location_result >= 0 && accept_data(&a->position_valid, mm->source, mm, 1)) {
+        if (location_result >= 0 && accept_data(&a->position_valid, mm->source)) {
             Modes.stats_current.cpr_local_ok++;
             mm->cpr_relative = 1;
 
@@ -641,12 +796,16 @@ static void updatePosition(struct aircraft *a, struct modesMessage *mm) {
         // Update aircraft state
         a->lat = new_lat;
         a->lon = new_lon;
+        geoSetRef(&a->pos_ref, new_lat, new_lon);
         a->pos_nic = new_nic;
         a->pos_rc = new_rc;
 
         if (a->pos_reliable_odd >= 2 && a->pos_reliable_even >= 2 && mm->source == SOURCE_ADSB) {
             update_range_histogram(new_lat, new_lon);
         }
+
+        gridUpdate(a);
+        traceAdd(a, messageNow());
     }
 }
 
@@ -931,7 +1090,7 @@ static int compute_v0_sil(struct modesMessage *mm)
 
 static void compute_nic_rc_from_message(struct modesMessage *mm, struct aircraft *a, unsigned *nic, unsigned *rc) {
     int nic_a = (trackDataValid(&a->nic_a_valid) && a->nic_a);
-    int nic_b = (mm->accuracy.nic_b_valid && mm->accuracy.nic_b);
+    int nic_b = ((mm->sections & MM_ACCURACY) && mm->accuracy.nic_b_valid && mm->accuracy.nic_b);
     int nic_c = (trackDataValid(&a->nic_c_valid) && a->nic_c);
 
     *nic = compute_nic(mm->metype, a->adsb_version, nic_a, nic_b, nic_c);
@@ -955,6 +1114,138 @@ static int altitude_to_feet(int raw, altitude_unit_t unit) {
 // Receive new messages and update tracked aircraft state
 //
 
+// Did the message being processed update this data? Not the same as
+// d->updated == messageNow(): several messages can share a timestamp.
+static int updated_now(const data_validity *d) {
+    for (unsigned i = 0; i < accepted_now_count; ++i) {
+        if (accepted_now[i] == d)
+            return 1;
+    }
+    return 0;
+}
+
+// Difference between two angles in degrees, 0 - 180
+static float angle_between(float a1, float a2) {
+    float diff = fabsf(a1 - a2);
+    return (diff > 180 ? 360 - diff : diff);
+}
+
+// Decide whether this message goes out on the reduced Beast output.
+//
+// We keep track of what the BeastReduce consumers have already been sent
+// for each aircraft and only forward a frame if some data it carries is due.
+// Position, altitude, velocity and identity each have their own interval.
+// Changing data is sent early: positions while turning, altitude while
+// climbing or descending, velocity when speed, track or rate change.
+// Both CPR parities go out close together so global decoding stays
+// possible at long intervals.
+static void reduceForward(struct aircraft *a, struct modesMessage *mm) {
+    uint64_t now = messageNow();
+    uint64_t pos_interval = Modes.net_output_beast_reduce_interval;
+    uint64_t alt_interval = Modes.net_output_beast_reduce_alt_interval;
+    uint64_t vel_interval = Modes.net_output_beast_reduce_vel_interval;
+    uint64_t ident_interval = Modes.net_output_beast_reduce_ident_interval;
+    int pos = 0, alt, alt_baro, alt_geom, vel, ident, other;
+    int odd = mm->cpr_odd;
+    int due = 0;
+
+    if (mm->sbs_in)
+        return;
+
+    if (mm->cpr_valid)
+        pos = updated_now(odd ? &a->cpr_odd_valid : &a->cpr_even_valid);
+    alt_baro = updated_now(&a->altitude_baro_valid);
+    alt_geom = updated_now(&a->altitude_geom_valid);
+    alt = alt_baro || alt_geom;
+    vel = updated_now(&a->gs_valid) || updated_now(&a->track_valid)
+        || updated_now(&a->baro_rate_valid) || updated_now(&a->geom_rate_valid);
+    ident = updated_now(&a->callsign_valid) || updated_now(&a->squawk_valid);
+    other = updated_now(&a->emergency_valid) || updated_now(&a->airground_valid)
+        || updated_now(&a->ias_valid) || updated_now(&a->tas_valid) || updated_now(&a->mach_valid)
+        || updated_now(&a->mag_heading_valid) || updated_now(&a->true_heading_valid)
+        || updated_now(&a->roll_valid) || updated_now(&a->track_rate_valid)
+        || updated_now(&a->nav_altitude_mcp_valid) || updated_now(&a->nav_altitude_fms_valid)
+        || updated_now(&a->nav_heading_valid) || updated_now(&a->nav_modes_valid)
+        || updated_now(&a->nav_qnh_valid) || updated_now(&a->nac_p_valid)
+        || updated_now(&a->nac_v_valid) || updated_now(&a->sil_valid);
+
+    if (pos) {
+        uint64_t last = a->reduce_pos_forwarded[!odd] > a->reduce_pos_forwarded[odd]
+            ? a->reduce_pos_forwarded[!odd] : a->reduce_pos_forwarded[odd];
+        int turning = trackDataValid(&a->track_valid) && angle_between(a->track, a->reduce_pos_track) >= 10;
+
+        if (time_between(now, last) >= pos_interval
+                || (turning && time_between(now, last) >= pos_interval / 4)
+                || (time_between(now, a->reduce_pos_forwarded[odd]) > 8000
+                    && time_between(now, a->reduce_pos_forwarded[!odd]) <= 8000)) {
+            due = 1;
+        }
+    }
+
+    if (alt) {
+        uint64_t age = time_between(now, a->reduce_alt_forwarded);
+        int changed = (alt_baro && abs(a->altitude_baro - a->reduce_altitude) >= 200)
+            || (alt_geom && abs(a->altitude_geom - a->reduce_altitude_geom) >= 200);
+
+        if (age >= alt_interval || (changed && age >= alt_interval / 4))
+            due = 1;
+    }
+
+    if (vel) {
+        uint64_t age = time_between(now, a->reduce_vel_forwarded);
+        int changed = fabsf(a->gs - a->reduce_gs) >= 10
+            || angle_between(a->track, a->reduce_track) >= 5
+            || abs(a->baro_rate - a->reduce_baro_rate) >= 500;
+
+        if (age >= vel_interval || (changed && age >= vel_interval / 4))
+            due = 1;
+    }
+
+    if (ident) {
+        if (time_between(now, a->reduce_ident_forwarded) >= ident_interval
+                || a->squawk != a->reduce_squawk
+                || memcmp(a->callsign, a->reduce_callsign, sizeof (a->callsign)) != 0) {
+            due = 1;
+        }
+    }
+
+    // Slower changing data and all-call replies only keep the aircraft
+    // alive for the consumers when nothing else has gone out lately.
+    if ((other || (mm->msgtype == 11 && mm->IID == 0 && mm->correctedbits == 0))
+            && time_between(now, a->reduce_forwarded) >= ident_interval) {
+        due = 1;
+    }
+
+    if (!due)
+        return;
+
+    mm->reduce_forward = 1;
+    a->reduce_forwarded = now;
+
+    if (pos) {
+        a->reduce_pos_forwarded[odd] = now;
+        a->reduce_pos_track = a->track;
+    }
+    if (alt) {
+        a->reduce_alt_forwarded = now;
+        if (alt_baro)
+            a->reduce_altitude = a->altitude_baro;
+        if (alt_geom)
+            a->reduce_altitude_geom = a->altitude_geom;
+    }
+    if (vel) {
+        a->reduce_vel_forwarded = now;
+        a->reduce_gs = a->gs;
+        a->reduce_track = a->track;
+        a->reduce_baro_rate = a->baro_rate;
+    }
+    if (ident) {
+        a->reduce_ident_forwarded = now;
+        a->reduce_squawk = a->squawk;
+        memcpy(a->reduce_callsign, a->callsign, sizeof (a->callsign));
+    }
+}
+
 struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
     struct aircraft *a;
     unsigned int cpr_new = 0;
@@ -971,6 +1262,7 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
     }
 
     _messageNow = mm->sysTimestampMsg;
+    accepted_now_count = 0;
 
     // Lookup our aircraft or create a new one
     a = trackFindAircraft(mm->addr);
@@ -992,6 +1284,9 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
         a->addrtype = mm->addrtype;
     }
 
+    if (mm->fields_pending && fields_wanted(a, mm))
+        decodeModesMessageFields(mm);
+
     // decide on where to stash the version
     int dummy_version = -1; // used for non-adsb/adsr/tisb messages
     int *message_version;
@@ -1023,7 +1318,7 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
 
     // operational status message
     // done early to update version / HRD / TAH
-    if (mm->opstatus.valid) {
+    if ((mm->sections & MM_OPSTATUS) && mm->opstatus.valid) {
         *message_version = mm->opstatus.version;
         
         if (mm->opstatus.hrd != HEADING_INVALID) {
@@ -1035,6 +1330,9 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
     }
 
     // fill in ADS-B v0 NACp, SIL from position message type
+    if (*message_version == 0)
+        modesMessageSections(mm, MM_ACCURACY);
+
     if (*message_version == 0 && !mm->accuracy.nac_p_valid) {
         int computed_nacp = compute_v0_nacp(mm);
         if (computed_nacp != -1) {
@@ -1093,7 +1391,7 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
                 || (fpm < max_fpm && fpm > min_fpm)
                 || (good_crc && a->altitude_baro_reliable <= (ALTITUDE_BARO_RELIABLE_MAX/2 + 2))
            ) {
-            if (accept_data(&a->altitude_baro_valid, mm->source, mm, 1)) {
+            if (accept_data(&a->altitude_baro_valid, mm->source)) {
                 a->altitude_baro_reliable = min(ALTITUDE_BARO_RELIABLE_MAX , a->altitude_baro_reliable + (good_crc+1));
                 /*if (abs(delta) > 2000 && delta != alt) {
                     fprintf(stderr, "Alt change B: %06x: %d   %d -> %d, min %.1f kfpm, max %.1f kfpm, actual %.1f kfpm\n",
@@ -1113,7 +1411,7 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
         }
     }
 
-    if (mm->squawk_valid && accept_data(&a->squawk_valid, mm->source, mm, 0)) {
+    if (mm->squawk_valid && accept_data(&a->squawk_valid, mm->source)) {
         if (mm->squawk != a->squawk) {
             a->modeA_hit = 0;
         }
@@ -1138,22 +1436,22 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
                     break;
             }
 
-            if (squawk_emergency != EMERGENCY_NONE && accept_data(&a->emergency_valid, mm->source, mm, 0)) {
+            if (squawk_emergency != EMERGENCY_NONE && accept_data(&a->emergency_valid, mm->source)) {
                 a->emergency = squawk_emergency;
             }
         }
 #endif
     }
 
-    if (mm->emergency_valid && accept_data(&a->emergency_valid, mm->source, mm, 0)) {
+    if (mm->emergency_valid && accept_data(&a->emergency_valid, mm->source)) {
         a->emergency = mm->emergency;
     }
 
-    if (mm->altitude_geom_valid && accept_data(&a->altitude_geom_valid, mm->source, mm, 1)) {
+    if (mm->altitude_geom_valid && accept_data(&a->altitude_geom_valid, mm->source)) {
         a->altitude_geom = altitude_to_feet(mm->altitude_geom, mm->altitude_geom_unit);
     }
 
-    if (mm->geom_delta_valid && accept_data(&a->geom_delta_valid, mm->source, mm, 1)) {
+    if (mm->geom_delta_valid && accept_data(&a->geom_delta_valid, mm->source)) {
         a->geom_delta = mm->geom_delta;
     }
 
@@ -1165,47 +1463,47 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
             htype = a->adsb_tah;
         }
 
-        if (htype == HEADING_GROUND_TRACK && accept_data(&a->track_valid, mm->source, mm, 1)) {
+        if (htype == HEADING_GROUND_TRACK && accept_data(&a->track_valid, mm->source)) {
             a->track = mm->heading;
-        } else if (htype == HEADING_MAGNETIC && accept_data(&a->mag_heading_valid, mm->source, mm, 1)) {
+        } else if (htype == HEADING_MAGNETIC && accept_data(&a->mag_heading_valid, mm->source)) {
             a->mag_heading = mm->heading;
-        } else if (htype == HEADING_TRUE && accept_data(&a->true_heading_valid, mm->source, mm, 1)) {
+        } else if (htype == HEADING_TRUE && accept_data(&a->true_heading_valid, mm->source)) {
             a->true_heading = mm->heading;
         }
     }
 
-    if (mm->track_rate_valid && accept_data(&a->track_rate_valid, mm->source, mm, 1)) {
+    if (mm->track_rate_valid && accept_data(&a->track_rate_valid, mm->source)) {
         a->track_rate = mm->track_rate;
     }
 
-    if (mm->roll_valid && accept_data(&a->roll_valid, mm->source, mm, 1)) {
+    if (mm->roll_valid && accept_data(&a->roll_valid, mm->source)) {
         a->roll = mm->roll;
     }
 
     if (mm->gs_valid) {
         mm->gs.selected = (*message_version == 2 ? mm->gs.v2 : mm->gs.v0);
-        if (accept_data(&a->gs_valid, mm->source, mm, 1)) {
+        if (accept_data(&a->gs_valid, mm->source)) {
             a->gs = mm->gs.selected;
         }
     }
 
-    if (mm->ias_valid && accept_data(&a->ias_valid, mm->source, mm, 0)) {
+    if (mm->ias_valid && accept_data(&a->ias_valid, mm->source)) {
         a->ias = mm->ias;
     }
 
-    if (mm->tas_valid && accept_data(&a->tas_valid, mm->source, mm, 0)) {
+    if (mm->tas_valid && accept_data(&a->tas_valid, mm->source)) {
         a->tas = mm->tas;
     }
 
-    if (mm->mach_valid && accept_data(&a->mach_valid, mm->source, mm, 0)) {
+    if (mm->mach_valid && accept_data(&a->mach_valid, mm->source)) {
         a->mach = mm->mach;
     }
 
-    if (mm->baro_rate_valid && accept_data(&a->baro_rate_valid, mm->source, mm, 1)) {
+    if (mm->baro_rate_valid && accept_data(&a->baro_rate_valid, mm->source)) {
         a->baro_rate = mm->baro_rate;
     }
 
-    if (mm->geom_rate_valid && accept_data(&a->geom_rate_valid, mm->source, mm, 1)) {
+    if (mm->geom_rate_valid && accept_data(&a->geom_rate_valid, mm->source)) {
         a->geom_rate = mm->geom_rate;
     }
 
@@ -1214,50 +1512,54 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
         // If our current state is certain but new data is not, only accept the uncertain state if the certain data has gone stale
         if (mm->airground != AG_UNCERTAIN ||
                 (mm->airground == AG_UNCERTAIN && !trackDataFresh(&a->airground_valid))) {
-            if (accept_data(&a->airground_valid, mm->source, mm, 0)) {
+            if (accept_data(&a->airground_valid, mm->source)) {
                 a->airground = mm->airground;
             }
         }
     }
 
-    if (mm->callsign_valid && accept_data(&a->callsign_valid, mm->source, mm, 0)) {
-        memcpy(a->callsign, mm->callsign, sizeof (a->callsign));
+    if (mm->callsign_valid && accept_data(&a->callsign_valid, mm->source)) {
+        // only up to the NUL holds data, see struct modesMessage
+        memset(a->callsign, 0, sizeof (a->callsign));
+        memcpy(a->callsign, mm->callsign, strnlen(mm->callsign, sizeof (a->callsign) - 1));
     }
 
-    if (mm->nav.mcp_altitude_valid && accept_data(&a->nav_altitude_mcp_valid, mm->source, mm, 0)) {
-        a->nav_altitude_mcp = mm->nav.mcp_altitude;
-    }
+    if (mm->sections & MM_NAV) {
+        if (mm->nav.mcp_altitude_valid && accept_data(&a->nav_altitude_mcp_valid, mm->source)) {
+            a->nav_altitude_mcp = mm->nav.mcp_altitude;
+        }
 
-    if (mm->nav.fms_altitude_valid && accept_data(&a->nav_altitude_fms_valid, mm->source, mm, 0)) {
-        a->nav_altitude_fms = mm->nav.fms_altitude;
-    }
+        if (mm->nav.fms_altitude_valid && accept_data(&a->nav_altitude_fms_valid, mm->source)) {
+            a->nav_altitude_fms = mm->nav.fms_altitude;
+        }
 
-    if (mm->nav.altitude_source != NAV_ALT_INVALID && accept_data(&a->nav_altitude_src_valid, mm->source, mm, 0)) {
-        a->nav_altitude_src = mm->nav.altitude_source;
-    }
+        if (mm->nav.altitude_source != NAV_ALT_INVALID && accept_data(&a->nav_altitude_src_valid, mm->source)) {
+            a->nav_altitude_src = mm->nav.altitude_source;
+        }
 
-    if (mm->nav.heading_valid && accept_data(&a->nav_heading_valid, mm->source, mm, 0)) {
-        a->nav_heading = mm->nav.heading;
-    }
+        if (mm->nav.heading_valid && accept_data(&a->nav_heading_valid, mm->source)) {
+            a->nav_heading = mm->nav.heading;
+        }
 
-    if (mm->nav.modes_valid && accept_data(&a->nav_modes_valid, mm->source, mm, 0)) {
-        a->nav_modes = mm->nav.modes;
-    }
+        if (mm->nav.modes_valid && accept_data(&a->nav_modes_valid, mm->source)) {
+            a->nav_modes = mm->nav.modes;
+        }
 
-    if (mm->nav.qnh_valid && accept_data(&a->nav_qnh_valid, mm->source, mm, 0)) {
-        a->nav_qnh = mm->nav.qnh;
+        if (mm->nav.qnh_valid && accept_data(&a->nav_qnh_valid, mm->source)) {
+            a->nav_qnh = mm->nav.qnh;
+        }
     }
 
-    if (mm->alert_valid && accept_data(&a->alert_valid, mm->source, mm, 0)) {
+    if (mm->alert_valid && accept_data(&a->alert_valid, mm->source)) {
         a->alert = mm->alert;
     }
 
-    if (mm->spi_valid && accept_data(&a->spi_valid, mm->source, mm, 0)) {
+    if (mm->spi_valid && accept_data(&a->spi_valid, mm->source)) {
         a->spi = mm->spi;
     }
 
     // CPR, even
-    if (mm->cpr_valid && !mm->cpr_odd && accept_data(&a->cpr_even_valid, mm->source, mm, 1)) {
+    if (mm->cpr_valid && !mm->cpr_odd && accept_data(&a->cpr_even_valid, mm->source)) {
         a->cpr_even_type = mm->cpr_type;
         a->cpr_even_lat = mm->cpr_lat;
         a->cpr_even_lon = mm->cpr_lon;
@@ -1266,7 +1568,7 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
     }
 
     // CPR, odd
-    if (mm->cpr_valid && mm->cpr_odd && accept_data(&a->cpr_odd_valid, mm->source, mm, 1)) {
+    if (mm->cpr_valid && mm->cpr_odd && accept_data(&a->cpr_odd_valid, mm->source)) {
         a->cpr_odd_type = mm->cpr_type;
         a->cpr_odd_lat = mm->cpr_lat;
         a->cpr_odd_lon = mm->cpr_lon;
@@ -1274,43 +1576,45 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
         cpr_new = 1;
     }
 
-    if (mm->accuracy.sda_valid && accept_data(&a->sda_valid, mm->source, mm, 0)) {
-        a->sda = mm->accuracy.sda;
-    }
+    if (mm->sections & MM_ACCURACY) {
+        if (mm->accuracy.sda_valid && accept_data(&a->sda_valid, mm->source)) {
+            a->sda = mm->accuracy.sda;
+        }
 
-    if (mm->accuracy.nic_a_valid && accept_data(&a->nic_a_valid, mm->source, mm, 0)) {
-        a->nic_a = mm->accuracy.nic_a;
-    }
+        if (mm->accuracy.nic_a_valid && accept_data(&a->nic_a_valid, mm->source)) {
+            a->nic_a = mm->accuracy.nic_a;
+        }
 
-    if (mm->accuracy.nic_c_valid && accept_data(&a->nic_c_valid, mm->source, mm, 0)) {
-        a->nic_c = mm->accuracy.nic_c;
-    }
+        if (mm->accuracy.nic_c_valid && accept_data(&a->nic_c_valid, mm->source)) {
+            a->nic_c = mm->accuracy.nic_c;
+        }
 
-    if (mm->accuracy.nic_baro_valid && accept_data(&a->nic_baro_valid, mm->source, mm, 0)) {
-        a->nic_baro = mm->accuracy.nic_baro;
-    }
+        if (mm->accuracy.nic_baro_valid && accept_data(&a->nic_baro_valid, mm->source)) {
+            a->nic_baro = mm->accuracy.nic_baro;
+        }
 
-    if (mm->accuracy.nac_p_valid && accept_data(&a->nac_p_valid, mm->source, mm, 0)) {
-        a->nac_p = mm->accuracy.nac_p;
-    }
+        if (mm->accuracy.nac_p_valid && accept_data(&a->nac_p_valid, mm->source)) {
+            a->nac_p = mm->accuracy.nac_p;
+        }
 
-    if (mm->accuracy.nac_v_valid && accept_data(&a->nac_v_valid, mm->source, mm, 0)) {
-        a->nac_v = mm->accuracy.nac_v;
-    }
+        if (mm->accuracy.nac_v_valid && accept_data(&a->nac_v_valid, mm->source)) {
+            a->nac_v = mm->accuracy.nac_v;
+        }
 
-    if (mm->accuracy.sil_type != SIL_INVALID && accept_data(&a->sil_valid, mm->source, mm, 0)) {
-        a->sil = mm->accuracy.sil;
-        if (a->sil_type == SIL_INVALID || mm->accuracy.sil_type != SIL_UNKNOWN) {
-            a->sil_type = mm->accuracy.sil_type;
+        if (mm->accuracy.sil_type != SIL_INVALID && accept_data(&a->sil_valid, mm->source)) {
+            a->sil = mm->accuracy.sil;
+            if (a->sil_type == SIL_INVALID || mm->accuracy.sil_type != SIL_UNKNOWN) {
+                a->sil_type = mm->accuracy.sil_type;
+            }
         }
-    }
 
-    if (mm->accuracy.gva_valid && accept_data(&a->gva_valid, mm->source, mm, 0)) {
-        a->gva = mm->accuracy.gva;
-    }
+        if (mm->accuracy.gva_valid && accept_data(&a->gva_valid, mm->source)) {
+            a->gva = mm->accuracy.gva;
+        }
 
-    if (mm->accuracy.sda_valid && accept_data(&a->sda_valid, mm->source, mm, 0)) {
-        a->sda = mm->accuracy.sda;
+        if (mm->accuracy.sda_valid && accept_data(&a->sda_valid, mm->source)) {
+            a->sda = mm->accuracy.sda;
+        }
     }
 
     // Now handle derived data
@@ -1329,21 +1633,20 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
     }
 
     if (mm->sbs_in && mm->decoded_lat != 0 && mm->decoded_lon != 0) {
-        if (accept_data(&a->position_valid, mm->source, mm, 0)) {
+        if (accept_data(&a->position_valid, mm->source)) {
             a->lat = mm->decoded_lat;
             a->lon = mm->decoded_lon;
+            geoSetRef(&a->pos_ref, a->lat, a->lon);
 
             a->pos_reliable_odd = 2;
             a->pos_reliable_even = 2;
+
+            gridUpdate(a);
+            traceAdd(a, messageNow());
         }
     }
 
-
-    if (mm->msgtype == 11 && mm->IID == 0 && mm->correctedbits == 0 && messageNow() > a->next_reduce_forward_DF11) {
-
-        a->next_reduce_forward_DF11 = messageNow() + Modes.net_output_beast_reduce_interval * 4;
-        mm->reduce_forward = 1;
-    }
+    reduceForward(a, mm);
 
     return (a);
 }
@@ -1452,6 +1755,8 @@ static void trackRemoveStaleAircraft(uint64_t now) {
 
                 // Remove the element from the linked list, with care
                 // if we are removing the first element
+                gridRemove(a);
+                traceFree(a);
                 if (!prev) {
                     Modes.aircrafts[j] = a->next;
                     free(a);
@@ -1531,3 +1836,148 @@ void trackPeriodicUpdate() {
         trackMatchAC(now);
     }
 }
+
+//
+//=========================================================================
+//
+// Tracker state snapshots.
+//
+// The file holds a header, the aircraft records and the ICAO filter
+// addresses. Each aircraft record is the leading part of struct aircraft up
+// to first_message, so a file is only accepted by the build that wrote it.
+// All timestamps in struct aircraft are wall clock milliseconds, so the
+// restored data ages across the restart just as if we had kept running.
+//
+
+#define TRACK_STATE_MAGIC 0x53425352 // "RSBS"
+#define TRACK_STATE_VERSION 3
+#define TRACK_STATE_RECORD_SIZE offsetof(struct aircraft, first_message)
+
+struct track_state_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t aircraft_count;
+    uint32_t filter_count;
+    uint32_t padding;
+    uint64_t saved; // mstime() when written
+};
+
+void trackSaveState(const char *path) {
+    char tmppath[PATH_MAX];
+    struct track_state_header header;
+    uint32_t *filter;
+    FILE *f;
+    int fd;
+
+    memset(&header, 0, sizeof (header));
+    header.magic = TRACK_STATE_MAGIC;
+    header.version = TRACK_STATE_VERSION;
+    header.record_size = TRACK_STATE_RECORD_SIZE;
+    header.saved = mstime();
+
+    for (int j = 0; j < AIRCRAFTS_BUCKETS; j++) {
+        for (struct aircraft *a = Modes.aircrafts[j]; a; a = a->next) {
+            if (a->messages >= 2)
+                header.aircraft_count++;
+        }
+    }
+
+    if (!(filter = malloc(2 * ICAO_FILTER_SIZE * sizeof (uint32_t))))
+        return;
+    header.filter_count = icaoFilterCollect(filter);
+
+    snprintf(tmppath, PATH_MAX, "%s.XXXXXX", path);
+    tmppath[PATH_MAX - 1] = 0;
+    if ((fd = mkstemp(tmppath)) < 0 || !(f = fdopen(fd, "wb"))) {
+        fprintf(stderr, "Failed to write state file %s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        free(filter);
+        return;
+    }
+
+    int ok = (fwrite(&header, sizeof (header), 1, f) == 1);
+    for (int j = 0; ok && j < AIRCRAFTS_BUCKETS; j++) {
+        for (struct aircraft *a = Modes.aircrafts[j]; ok && a; a = a->next) {
+            // single message aircraft are likely bad decodes,
+            // and can't be output without their first message
+            if (a->messages >= 2)
+                ok = (fwrite(a, TRACK_STATE_RECORD_SIZE, 1, f) == 1);
+        }
+    }
+    if (ok && header.filter_count)
+        ok = (fwrite(filter, sizeof (uint32_t), header.filter_count, f) == header.filter_count);
+    free(filter);
+
+    if (fclose(f) != 0 || !ok) {
+        fprintf(stderr, "Failed to write state file %s\n", path);
+        unlink(tmppath);
+        return;
+    }
+    rename(tmppath, path);
+}
+
+void trackLoadState(const char *path) {
+    struct track_state_header header;
+    unsigned restored = 0;
+    uint64_t now = mstime();
+    uint64_t age;
+    FILE *f;
+
+    if (!(f = fopen(path, "rb"))) {
+        if (errno != ENOENT)
+            fprintf(stderr, "Failed to read state file %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    if (fread(&header, sizeof (header), 1, f) != 1
+            || header.magic != TRACK_STATE_MAGIC
+            || header.version != TRACK_STATE_VERSION
+            || header.record_size != TRACK_STATE_RECORD_SIZE
+            || header.filter_count > 2 * ICAO_FILTER_SIZE
+            || header.saved > now) {
+        fprintf(stderr, "Ignoring incompatible or invalid state file %s\n", path);
+        fclose(f);
+        return;
+    }
+
+    age = now - header.saved;
+
+    for (uint32_t i = 0; i < header.aircraft_count; ++i) {
+        struct aircraft *a = calloc(1, sizeof (*a));
+
+        if (!a || fread(a, TRACK_STATE_RECORD_SIZE, 1, f) != 1) {
+            free(a);
+            break;
+        }
+
+        // anything not seen since before the TTL would have been removed by now
+        if (a->seen > now || now - a->seen > TRACK_AIRCRAFT_TTL || a->messages < 2 || trackFindAircraft(a->addr)) {
+            free(a);
+            continue;
+        }
+
+        a->next = Modes.aircrafts[a->addr % AIRCRAFTS_BUCKETS];
+        Modes.aircrafts[a->addr % AIRCRAFTS_BUCKETS] = a;
+        if (a->position_valid.source != SOURCE_INVALID)
+            gridUpdate(a);
+        restored++;
+    }
+
+    if (header.filter_count) {
+        uint32_t *filter = malloc(header.filter_count * sizeof (uint32_t));
+
+        if (filter && fread(filter, sizeof (uint32_t), header.filter_count, f) == header.filter_count)
+            icaoFilterRestore(filter, header.filter_count, age);
+        free(filter);
+    }
+
+    fclose(f);
+
+    // expire individual fields that went stale while we were down
+    trackRemoveStaleAircraft(now);
+
+    fprintf(stderr, "Restored %u aircraft from state file %s (%.1f seconds old)\n",
+            restored, path, age / 1000.0);
+}
@@ -65,6 +65,15 @@
  */
 #define TRACK_MODEAC_MIN_MESSAGES 4
 
+/* Interval between tracker state snapshots, in milliseconds */
+#define TRACK_STATE_INTERVAL 60000
+
+/* Aircraft with a position are kept in a grid of 1 degree cells for
+ * region queries.
+ */
+#define TRACK_GRID_LAT 180
+#define TRACK_GRID_LON 360
+
 /* Special value for Rc unknown */
 #define RC_UNKNOWN 0
 
@@ -82,11 +91,12 @@ typedef struct
   uint64_t updated; /* when it arrived */
   uint64_t stale; /* when it goes stale */
   uint64_t expires; /* when it expires */
-  uint64_t next_reduce_forward; /* when to next forward the data for reduced beast output */
   datasource_t source; /* where the data came from */
   uint32_t padding;
 } data_validity;
 
+struct trace;
+
 /* Structure used to describe the state of one tracked aircraft */
 struct aircraft
 {
@@ -129,7 +139,6 @@ struct aircraft
   float mag_heading; // Magnetic heading
   float true_heading; // True heading
 
-  uint64_t next_reduce_forward_DF11;
   data_validity callsign_valid;
   data_validity altitude_baro_valid;
   data_validity altitude_geom_valid;
@@ -178,6 +187,7 @@ struct aircraft
   nav_altitude_source_t nav_altitude_src;  // source of altitude used by automation
 
   double lat, lon; // Coordinates obtained from CPR encoded data
+  struct geo_ref pos_ref; // lat, lon with precomputed trig for speed/range checks
   unsigned pos_nic; // NIC of last computed position
   unsigned pos_rc; // Rc of last computed position
   int pos_reliable_odd; // Number of good global CPRs, indicates position reliability
@@ -240,8 +250,26 @@ struct aircraft
   sil_type_t fatsv_emitted_sil_type; //      -"-         SIL supplement
   unsigned fatsv_emitted_nic_baro; //      -"-         NICbaro
   emergency_t fatsv_emitted_emergency; //      -"-         emergency/priority status
+
+  uint64_t reduce_pos_forwarded[2]; // time an even/odd CPR was last forwarded to BeastReduce
+  uint64_t reduce_alt_forwarded; //      -"-         altitude
+  uint64_t reduce_vel_forwarded; //      -"-         velocity (speed, track, vertical rate)
+  uint64_t reduce_ident_forwarded; //      -"-         callsign or squawk
+  uint64_t reduce_forwarded; //      -"-         any frame
+  int reduce_altitude; // last barometric altitude forwarded to BeastReduce
+  int reduce_altitude_geom; //      -"-         GNSS altitude
+  int reduce_baro_rate; //      -"-         vertical rate
+  float reduce_gs; //      -"-         groundspeed
+  float reduce_track; //      -"-         track
+  float reduce_pos_track; // track when a position was last forwarded
+  unsigned reduce_squawk; // last squawk forwarded to BeastReduce
+  char reduce_callsign[12]; //      -"-         callsign
   uint32_t padding2;
   struct modesMessage first_message; // A copy of the first message we received for this aircraft.
+  struct trace *trace; // Recent positions, see trace.h
+  struct aircraft *grid_next; // Next aircraft in the same grid cell
+  struct aircraft **grid_pprev; // The pointer to us in the cell's list
+  int grid_cell; // Grid cell + 1, 0 if not in the grid
   struct aircraft *next; // Next aircraft in our linked list
 };
 
@@ -278,6 +306,20 @@ trackDataAge (const data_validity *v)
   return (messageNow () - v->updated);
 }
 
+/* Return the aircraft with the specified address, or NULL if no aircraft
+ * exists with this address.
+ */
+struct aircraft *trackFindAircraft (uint32_t addr);
+
+/* Find the aircraft with a valid position inside a box; west > east
+ * crosses the antimeridian. Stores up to max of them in out and returns
+ * how many there are, which can be more than max.
+ */
+int trackQueryBox (double south, double west, double north, double east, struct aircraft **out, int max);
+
+/* Same for the aircraft within range metres of a position */
+int trackQueryRadius (double lat, double lon, double range, struct aircraft **out, int max);
+
 /* Update aircraft state from data in the provided mesage.
  * Return the tracked aircraft.
  */
@@ -287,6 +329,16 @@ struct aircraft *trackUpdateFromMessage (struct modesMessage *mm);
 /* Call periodically */
 void trackPeriodicUpdate ();
 
+/* Save tracked aircraft and the ICAO filter to a file,
+ * so they can be restored after a restart.
+ */
+void trackSaveState (const char *path);
+
+/* Restore a state file written by trackSaveState, dropping anything
+ * that would have expired while we were not running.
+ */
+void trackLoadState (const char *path);
+
 /* Convert from a (hex) mode A value to a 0-4095 index */
 static inline unsigned
 modeAToIndex (unsigned modeA)
@@ -83,10 +83,8 @@ void sigintHandler(int dummy) {
 }
 
 void receiverPositionChanged(float lat, float lon, float alt) {
-    /* nothing */
-    (void) lat;
-    (void) lon;
     (void) alt;
+    geoSetRef(&Modes.user_ref, lat, lon);
 }
 
 //
@@ -140,6 +138,7 @@ static void view1090Init(void) {
     Modes.bUserFlags &= ~MODES_USER_LATLON_VALID;
     if ((Modes.fUserLat != 0.0) || (Modes.fUserLon != 0.0)) {
         Modes.bUserFlags |= MODES_USER_LATLON_VALID;
+        geoSetRef(&Modes.user_ref, Modes.fUserLat, Modes.fUserLon);
     }
 
     // Prepare error correction tables
@@ -242,13 +241,6 @@ int main(int argc, char **argv) {
     con->port = bo_connect_port;
     con->service = s;
 
-    con->mutex = malloc(sizeof(pthread_mutex_t));
-    if (!con->mutex || pthread_mutex_init(con->mutex, NULL)) {
-        fprintf(stderr, "Unable to initialize connector mutex!\n");
-        exit(1);
-    }
-    pthread_mutex_lock(con->mutex);
-
     serviceConnect(con);
     uint64_t timeout = mstime() + 10 * 1000;
     int counter = 0;
@@ -310,13 +302,7 @@ int main(int argc, char **argv) {
     }
     // Free local service and client
     if (s) free(s);
-    if (con->addr_info) {
-        freeaddrinfo(con->addr_info);
-        con->addr_info = NULL;
-    }
-    pthread_mutex_unlock(con->mutex);
-    pthread_mutex_destroy(con->mutex);
-    free(con->mutex);
+    serviceConnectorCleanup(con);
     free(con);
 
 exit:
@@ -21,7 +21,7 @@ var READSB;
             this.selectedAircraft = value;
             if (this.selectedAircraft !== null) {
                 this.aircraftCollection.get(this.selectedAircraft).Selected = true;
-                this.aircraftTraceCollector.postMessage({ type: "Get", data: this.aircraftCollection.get(this.selectedAircraft).Icao });
+                this.aircraftTraceCollector.postMessage({ type: "Load", data: this.aircraftCollection.get(this.selectedAircraft).Icao });
                 this.aircraftCollection.get(this.selectedAircraft).UpdateMarker(false);
                 this.aircraftCollection.get(this.selectedAircraft).TableRow.classList.add("selected");
             }
@@ -62,8 +62,8 @@ namespace READSB {
             this.selectedAircraft = value;
             if (this.selectedAircraft !== null) {
                 this.aircraftCollection.get(this.selectedAircraft).Selected = true;
-                // Immediately show track when selected
-                this.aircraftTraceCollector.postMessage({ type: "Get", data: this.aircraftCollection.get(this.selectedAircraft).Icao });
+                // Immediately show the full track kept by readsb when selected
+                this.aircraftTraceCollector.postMessage({ type: "Load", data: this.aircraftCollection.get(this.selectedAircraft).Icao });
                 this.aircraftCollection.get(this.selectedAircraft).UpdateMarker(false);
                 (this.aircraftCollection.get(this.selectedAircraft).TableRow as HTMLTableRowElement).classList.add("selected");
             }
@@ -20,53 +20,126 @@ var READSB;
         }
     };
     function StartLoadHistory(historySize) {
-        let loaded = 0;
         if (historySize > 0) {
-            for (let i = 0; i < historySize; i++) {
-                fetch(`../../data/history_${i}.json`, {
-                    cache: "no-cache",
-                    method: "GET",
-                    mode: "cors",
-                })
-                    .then((res) => {
-                    if (res.status >= 200 && res.status < 300) {
-                        return Promise.resolve(res);
-                    }
-                    else {
-                        return Promise.reject(new Error(res.statusText));
-                    }
-                })
-                    .then((res) => {
-                    return res.json();
-                })
-                    .then((data) => {
-                    if (loaded < 0) {
-                        return;
-                    }
-                    PositionHistoryBuffer.push(data);
-                    loaded++;
-                    if (loaded >= historySize) {
-                        loaded = -1;
-                        DoneLoadHistory();
-                    }
-                })
-                    .catch((error) => {
-                    if (loaded < 0) {
-                        return;
-                    }
-                    console.error(`Failed to load history chunk: ${error.message}`);
-                    loaded = -1;
-                    DoneLoadHistory();
-                });
+            fetch("../../data/history.bin", {
+                cache: "no-cache",
+                method: "GET",
+                mode: "cors",
+            })
+                .then((res) => {
+                if (res.status >= 200 && res.status < 300) {
+                    return Promise.resolve(res);
+                }
+                else {
+                    return Promise.reject(new Error(res.statusText));
+                }
+            })
+                .then((res) => {
+                return res.arrayBuffer();
+            })
+                .then((data) => {
+                DecodeHistory(data);
+                DoneLoadHistory();
+            })
+                .catch((error) => {
+                console.error(`Failed to load history: ${error.message}`);
+                DoneLoadHistory();
+            });
+        }
+    }
+    function DecodeHistory(buffer) {
+        const view = new DataView(buffer);
+        const bytes = new Uint8Array(buffer);
+        const last = new Map();
+        let offset = 16;
+        const varint = () => {
+            let v = 0;
+            let shift = 0;
+            let b;
+            do {
+                b = bytes[offset++];
+                v += (b & 0x7f) * Math.pow(2, shift);
+                shift += 7;
+            } while (b & 0x80);
+            return v;
+        };
+        const signed = () => {
+            const v = varint();
+            return (v % 2) ? -(v + 1) / 2 : v / 2;
+        };
+        if (buffer.byteLength < 16 || String.fromCharCode(bytes[0], bytes[1], bytes[2], bytes[3]) !== "RSBH" || bytes[4] !== 1) {
+            throw new Error("Unknown history format");
+        }
+        const use = view.getUint32(12, true);
+        while (offset + 4 <= buffer.byteLength) {
+            const end = offset + 4 + view.getUint32(offset, true);
+            if (end > buffer.byteLength) {
+                break;
+            }
+            const now = view.getUint32(offset + 4, true) + view.getUint32(offset + 8, true) * 4294967296;
+            const n = view.getUint32(offset + 12, true);
+            offset += 16;
+            const addrs = [];
+            let addr = 0;
+            for (let i = 0; i < n; i++) {
+                addr += varint();
+                addrs.push(addr);
+            }
+            const flags = bytes.subarray(offset, offset + n);
+            offset += n;
+            const state = [];
+            for (let i = 0; i < n; i++) {
+                if ((flags[i] & 1) || !last.has(addrs[i])) {
+                    last.set(addrs[i], [0, 0, 0, 0]);
+                }
+                state.push(last.get(addrs[i]));
+            }
+            for (const column of [0, 1]) {
+                for (let i = 0; i < n; i++) {
+                    state[i][column] += signed();
+                }
+            }
+            for (let i = 0; i < n; i++) {
+                if (flags[i] & 2) {
+                    state[i][2] += signed();
+                }
             }
+            for (let i = 0; i < n; i++) {
+                if (flags[i] & 8) {
+                    state[i][3] += signed();
+                }
+            }
+            offset = end;
+            const aircraft = [];
+            for (let i = 0; i < n; i++) {
+                const hex = ("000000" + (addrs[i] & 0xffffff).toString(16)).slice(-6);
+                const ac = {
+                    hex: (addrs[i] & 0x1000000) ? `~${hex}` : hex,
+                    lat: state[i][0] / 1e5,
+                    lon: state[i][1] / 1e5,
+                };
+                if (flags[i] & 4) {
+                    ac.alt_baro = "ground";
+                }
+                else if (flags[i] & 2) {
+                    ac.alt_baro = state[i][2];
+                }
+                if (flags[i] & 8) {
+                    ac.gs = state[i][3] / 10;
+                }
+                aircraft.push(ac);
+            }
+            PositionHistoryBuffer.push({ now: now / 1000, aircraft });
+        }
+        if (PositionHistoryBuffer.length > use) {
+            PositionHistoryBuffer.splice(0, PositionHistoryBuffer.length - use);
         }
     }
     function DoneLoadHistory() {
         if (PositionHistoryBuffer.length > 0) {
-            PositionHistoryBuffer.sort((x, y) => x.now - y.now);
             for (const h of PositionHistoryBuffer) {
                 h.aircraft.forEach((ac, i) => {
-                    if (("lat" in ac) && ("lon" in ac) && ("alt_baro" in ac)) {
+                    if ("alt_baro" in ac) {
                         const pos = new Array(ac.lat, ac.lon, ac.alt_baro);
                         const msg = { type: "Update", data: [ac.hex, pos, h.now] };
                         AircraftTraceCollector.postMessage(msg);
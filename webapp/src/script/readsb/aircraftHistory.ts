@@ -43,61 +43,149 @@ namespace READSB {
 
     /**
      * Start loading aircraft history from readsb backend.
-     * @param historySize Size of aircraft history.
+     * @param historySize Number of history chunks available.
      */
     function StartLoadHistory(historySize: number) {
-        let loaded = 0;
         if (historySize > 0) {
-            for (let i = 0; i < historySize; i++) {
-                fetch(`../../data/history_${i}.json`, {
-                    cache: "no-cache",
-                    method: "GET",
-                    mode: "cors",
+            fetch("../../data/history.bin", {
+                cache: "no-cache",
+                method: "GET",
+                mode: "cors",
+            })
+                .then((res: Response) => {
+                    if (res.status >= 200 && res.status < 300) {
+                        return Promise.resolve(res);
+                    } else {
+                        return Promise.reject(new Error(res.statusText));
+                    }
+                })
+                .then((res: Response) => {
+                    return res.arrayBuffer();
                 })
-                    .then((res: Response) => {
-                        if (res.status >= 200 && res.status < 300) {
-                            return Promise.resolve(res);
-                        } else {
-                            return Promise.reject(new Error(res.statusText));
-                        }
-                    })
-                    .then((res: Response) => {
-                        return res.json();
-                    })
-                    .then((data: IHistoryData) => {
-                        if (loaded < 0) {
-                            return;
-                        }
-                        PositionHistoryBuffer.push(data); // don't care for order, will sort later
-                        loaded++;
-                        if (loaded >= historySize) {
-                            loaded = -1;
-                            DoneLoadHistory();
-                        }
-                    })
-                    .catch((error) => {
-                        if (loaded < 0) {
-                            return;
-                        }
-                        console.error(`Failed to load history chunk: ${error.message}`);
-                        loaded = -1;
-                        DoneLoadHistory();
-                    });
+                .then((data: ArrayBuffer) => {
+                    DecodeHistory(data);
+                    DoneLoadHistory();
+                })
+                .catch((error) => {
+                    console.error(`Failed to load history: ${error.message}`);
+                    DoneLoadHistory();
+                });
+        }
+    }
+
+    /**
+     * Decode history.bin into PositionHistoryBuffer, see history.h in readsb
+     * for the format. Positions, altitudes and speeds are stored as deltas
+     * from the aircraft's previous sample in the file.
+     * @param buffer Content of history.bin.
+     */
+    // tslint:disable: no-bitwise
+    function DecodeHistory(buffer: ArrayBuffer) {
+        const view = new DataView(buffer);
+        const bytes = new Uint8Array(buffer);
+        const last = new Map<number, number[]>(); // lat, lon, alt, gs per address
+        let offset = 16;
+
+        const varint = () => {
+            let v = 0;
+            let shift = 0;
+            let b;
+            do {
+                b = bytes[offset++];
+                v += (b & 0x7f) * Math.pow(2, shift);
+                shift += 7;
+            } while (b & 0x80);
+            return v;
+        };
+        const signed = () => {
+            const v = varint();
+            return (v % 2) ? -(v + 1) / 2 : v / 2;
+        };
+
+        if (buffer.byteLength < 16 || String.fromCharCode(bytes[0], bytes[1], bytes[2], bytes[3]) !== "RSBH" || bytes[4] !== 1) {
+            throw new Error("Unknown history format");
+        }
+        const use = view.getUint32(12, true);
+
+        while (offset + 4 <= buffer.byteLength) {
+            const end = offset + 4 + view.getUint32(offset, true);
+            if (end > buffer.byteLength) {
+                break; // chunk still being written
             }
+            const now = view.getUint32(offset + 4, true) + view.getUint32(offset + 8, true) * 4294967296;
+            const n = view.getUint32(offset + 12, true);
+            offset += 16;
+
+            const addrs: number[] = [];
+            let addr = 0;
+            for (let i = 0; i < n; i++) {
+                addr += varint();
+                addrs.push(addr);
+            }
+
+            const flags = bytes.subarray(offset, offset + n);
+            offset += n;
+            const state: number[][] = [];
+            for (let i = 0; i < n; i++) {
+                if ((flags[i] & 1) || !last.has(addrs[i])) {
+                    last.set(addrs[i], [0, 0, 0, 0]);
+                }
+                state.push(last.get(addrs[i]));
+            }
+            for (const column of [0, 1]) {
+                for (let i = 0; i < n; i++) {
+                    state[i][column] += signed();
+                }
+            }
+            for (let i = 0; i < n; i++) {
+                if (flags[i] & 2) {
+                    state[i][2] += signed();
+                }
+            }
+            for (let i = 0; i < n; i++) {
+                if (flags[i] & 8) {
+                    state[i][3] += signed();
+                }
+            }
+            offset = end;
+
+            const aircraft: IHistoryPosition[] = [];
+            for (let i = 0; i < n; i++) {
+                const hex = ("000000" + (addrs[i] & 0xffffff).toString(16)).slice(-6);
+                const ac: IHistoryPosition = {
+                    hex: (addrs[i] & 0x1000000) ? `~${hex}` : hex,
+                    lat: state[i][0] / 1e5,
+                    lon: state[i][1] / 1e5,
+                };
+                if (flags[i] & 4) {
+                    ac.alt_baro = "ground";
+                } else if (flags[i] & 2) {
+                    ac.alt_baro = state[i][2];
+                }
+                if (flags[i] & 8) {
+                    ac.gs = state[i][3] / 10;
+                }
+                aircraft.push(ac);
+            }
+            PositionHistoryBuffer.push({ now: now / 1000, aircraft });
+        }
+
+        // Older chunks only carried deltas forward
+        if (PositionHistoryBuffer.length > use) {
+            PositionHistoryBuffer.splice(0, PositionHistoryBuffer.length - use);
         }
     }
+    // tslint:enable: no-bitwise
 
     /**
      * Forward history data to aircraft trace collector.
      */
     function DoneLoadHistory() {
         if (PositionHistoryBuffer.length > 0) {
-            // Sort history by timestamp
-            PositionHistoryBuffer.sort((x, y) => x.now - y.now);
-            // Process history
+            // Process history, oldest first
             for (const h of PositionHistoryBuffer) {
-                h.aircraft.forEach((ac: IJsonData, i: number) => {
-                    if (("lat" in ac) && ("lon" in ac) && ("alt_baro" in ac)) {
+                h.aircraft.forEach((ac: IHistoryPosition, i: number) => {
+                    if ("alt_baro" in ac) {
                         const pos = new Array(ac.lat, ac.lon, ac.alt_baro);
                         const msg = {type: "Update", data: [ac.hex, pos, h.now] };
                         AircraftTraceCollector.postMessage(msg);
@@ -71,6 +71,19 @@ var READSB;
             this.TracePositions.push(newseg);
             this.PrevAltitude = pos[2];
         }
+        Merge(trace) {
+            if (trace.length === 0) {
+                return;
+            }
+            const last = trace[trace.length - 1];
+            const newer = this.TracePositions.filter((p) => p[4] > last[4]);
+            this.TracePositions = trace.concat(newer);
+            if (this.PrevPosition === null) {
+                this.PrevPosition = last;
+                this.PrevAltitude = last[2];
+                this.PrevPositionTime = last[4];
+            }
+        }
         get Trace() {
             return this.TracePositions;
         }
@@ -111,6 +124,9 @@ var READSB;
             case "Get":
                 GetTrace(msg.data);
                 break;
+            case "Load":
+                LoadTrace(msg.data);
+                break;
             default:
                 break;
         }
@@ -140,6 +156,31 @@ var READSB;
             }
         }
     }
+    function LoadTrace(icao) {
+        fetch(`../../data/traces/${icao}.json`, {
+            cache: "no-cache",
+            method: "GET",
+            mode: "cors",
+        })
+            .then((res) => {
+            if (res.status >= 200 && res.status < 300) {
+                return res.json();
+            }
+            else {
+                return Promise.reject(new Error(res.statusText));
+            }
+        })
+            .then((data) => {
+            if (!AircraftTraceCollection.has(icao)) {
+                AircraftTraceCollection.set(icao, new AircraftTrace());
+            }
+            AircraftTraceCollection.get(icao).Merge(data.trace);
+            GetTrace(icao);
+        })
+            .catch(() => {
+            GetTrace(icao);
+        });
+    }
     function GetTrace(icao) {
         if (AircraftTraceCollection.has(icao)) {
             Worker.postMessage({ type: "Trace", data: [icao, AircraftTraceCollection.get(icao).Trace] });
@@ -139,6 +139,24 @@ namespace READSB {
             this.PrevAltitude = pos[2];
         }
 
+        /**
+         * Replace everything up to the end of the trace kept by readsb with it.
+         * @param trace Trace from readsb, positions as [lat, lng, alt, estimated, timestamp].
+         */
+        public Merge(trace: number[][]) {
+            if (trace.length === 0) {
+                return;
+            }
+            const last = trace[trace.length - 1];
+            const newer = this.TracePositions.filter((p) => p[4] > last[4]);
+            this.TracePositions = trace.concat(newer);
+            if (this.PrevPosition === null) {
+                this.PrevPosition = last;
+                this.PrevAltitude = last[2];
+                this.PrevPositionTime = last[4];
+            }
+        }
+
         /**
          * Get trace data for this aircraft.
          */
@@ -199,6 +217,9 @@ namespace READSB {
             case "Get":
                 GetTrace(msg.data);
                 break;
+            case "Load":
+                LoadTrace(msg.data);
+                break;
             default:
                 break;
         }
@@ -246,6 +267,36 @@ namespace READSB {
         }
     }
 
+    /**
+     * Load the full trace of specific aircraft from readsb and send it.
+     * Falls back to what was collected here if readsb has none.
+     * @param icao Aircraft address.
+     */
+    function LoadTrace(icao: string) {
+        fetch(`../../data/traces/${icao}.json`, {
+            cache: "no-cache",
+            method: "GET",
+            mode: "cors",
+        })
+            .then((res: Response) => {
+                if (res.status >= 200 && res.status < 300) {
+                    return res.json();
+                } else {
+                    return Promise.reject(new Error(res.statusText));
+                }
+            })
+            .then((data: any) => {
+                if (!AircraftTraceCollection.has(icao)) {
+                    AircraftTraceCollection.set(icao, new AircraftTrace());
+                }
+                AircraftTraceCollection.get(icao).Merge(data.trace);
+                GetTrace(icao);
+            })
+            .catch(() => {
+                GetTrace(icao);
+            });
+    }
+
     /**
      * Get trace data for specific aircraft.
      * @param icao Aircraft address.
@@ -54,9 +54,13 @@ var READSB;
                 READSB.Body.RefreshSelectedAircraft();
                 READSB.AircraftCollection.Clean();
                 console.info("Completing init");
-                window.setInterval(Main.FetchData.bind(Main), Main.DataRefreshInterval);
                 window.setInterval(READSB.AircraftCollection.Clean.bind(READSB.AircraftCollection), 60000);
-                Main.FetchData();
+                if (data.tiles) {
+                    Main.StartTilePolling(data.tiles);
+                }
+                else {
+                    Main.StartDataStream();
+                }
             });
         }
         static SetLanguage(lng) {
@@ -102,32 +106,7 @@ var READSB;
                 return res.json();
             })
                 .then((data) => {
-                const now = data.now;
-                if (this.messageCountHistory.length > 0 && this.messageCountHistory[this.messageCountHistory.length - 1].messages > data.messages) {
-                    this.messageCountHistory = [{
-                            messages: 0,
-                            time: this.messageCountHistory[this.messageCountHistory.length - 1].time,
-                        }];
-                }
-                this.messageCountHistory.push({ time: now, messages: data.messages });
-                if ((now - this.messageCountHistory[0].time) > 30) {
-                    this.messageCountHistory.shift();
-                }
-                READSB.AircraftCollection.Update(data, now, this.lastReceiverTimestamp);
-                this.RefreshAircraftListTable();
-                READSB.Body.RefreshInfoBlock(this.readsbVersion, this.GetMessageRate());
-                READSB.Body.RefreshSelectedAircraft();
-                if (this.lastReceiverTimestamp === now) {
-                    this.staleReceiverCount++;
-                    if (this.staleReceiverCount > 5) {
-                        READSB.Body.UpdateErrorToast(i18next.t("error.dataTimeOut"), true);
-                    }
-                }
-                else {
-                    this.staleReceiverCount = 0;
-                    this.lastReceiverTimestamp = now;
-                    READSB.Body.UpdateErrorToast("", false);
-                }
+                this.ProcessAircraftData(data);
                 this.fetchPending = false;
             })
                 .catch((error) => {
@@ -147,6 +126,171 @@ var READSB;
             READSB.AircraftCollection.Refresh();
             READSB.AircraftCollection.ResortList();
         }
+        static StartDataStream() {
+            if (typeof EventSource === "undefined") {
+                this.StartPolling();
+                return;
+            }
+            const source = new EventSource("data/aircraft.sse");
+            source.addEventListener("snapshot", (ev) => {
+                const data = JSON.parse(ev.data);
+                this.streamAircraft.clear();
+                for (const ac of data.aircraft) {
+                    this.streamAircraft.set(ac.hex, ac);
+                }
+                this.ProcessAircraftData(data);
+            });
+            source.addEventListener("delta", (ev) => {
+                const data = JSON.parse(ev.data);
+                for (const ac of data.aircraft) {
+                    const known = this.streamAircraft.get(ac.hex);
+                    if (known === undefined) {
+                        this.streamAircraft.set(ac.hex, ac);
+                        continue;
+                    }
+                    for (const key of Object.keys(ac)) {
+                        if (ac[key] === null) {
+                            delete known[key];
+                        }
+                        else {
+                            known[key] = ac[key];
+                        }
+                    }
+                }
+                for (const hex of data.gone) {
+                    this.streamAircraft.delete(hex);
+                }
+                this.ProcessAircraftData({
+                    aircraft: Array.from(this.streamAircraft.values()),
+                    messages: data.messages,
+                    now: data.now,
+                });
+            });
+            source.onerror = () => {
+                if (source.readyState === EventSource.CLOSED) {
+                    this.StartPolling();
+                }
+            };
+        }
+        static StartPolling() {
+            window.setInterval(Main.FetchData.bind(Main), Main.DataRefreshInterval);
+            Main.FetchData();
+        }
+        static StartTilePolling(size) {
+            this.tileSize = size;
+            window.setInterval(Main.FetchTiles.bind(Main), Main.DataRefreshInterval);
+            Main.FetchTiles();
+        }
+        static FetchTiles() {
+            if (this.fetchPending) {
+                return;
+            }
+            this.fetchPending = true;
+            this.FetchJson("data/tiles/index.json")
+                .then((index) => {
+                const names = this.VisibleTiles().filter((name) => index.tiles[name] !== undefined);
+                const inView = new Set(names);
+                for (const name of Array.from(this.tileCache.keys())) {
+                    if (!inView.has(name)) {
+                        this.tileCache.delete(name);
+                    }
+                }
+                return Promise.all(names.map((name) => {
+                    const cached = this.tileCache.get(name);
+                    if (cached !== undefined && cached.version === index.tiles[name]) {
+                        return Promise.resolve(cached.data);
+                    }
+                    return this.FetchJson(`data/tiles/${name}.json`)
+                        .then((data) => {
+                        this.tileCache.set(name, { version: index.tiles[name], data });
+                        return data;
+                    });
+                }))
+                    .then((tiles) => {
+                    const aircraft = [];
+                    for (const tile of tiles) {
+                        const age = index.now - tile.now;
+                        for (const ac of tile.aircraft) {
+                            const copy = Object.assign({}, ac);
+                            copy.seen += age;
+                            if (copy.seen_pos !== undefined) {
+                                copy.seen_pos += age;
+                            }
+                            aircraft.push(copy);
+                        }
+                    }
+                    this.ProcessAircraftData({ aircraft, messages: index.messages, now: index.now });
+                    this.fetchPending = false;
+                });
+            })
+                .catch((error) => {
+                this.fetchPending = false;
+                READSB.Body.UpdateErrorToast(i18next.t("error.fetchingData", { msg: error }), true);
+                console.error(error);
+            });
+        }
+        static VisibleTiles() {
+            const size = this.tileSize;
+            const bounds = READSB.LMap.MapViewBounds;
+            const names = [];
+            const south = bounds ? Math.max(-90, Math.floor(bounds.getSouth() / size) * size) : -90;
+            const north = bounds ? Math.min(90, bounds.getNorth()) : 90;
+            let west = bounds ? Math.floor(bounds.getWest() / size) * size : -180;
+            let east = bounds ? bounds.getEast() : 180;
+            if (east - west >= 360) {
+                west = -180;
+                east = 180;
+            }
+            for (let lat = south; lat < north; lat += size) {
+                for (let lon = west; lon < east; lon += size) {
+                    names.push(`${lat}_${((lon + 180) % 360 + 360) % 360 - 180}`);
+                }
+            }
+            return names;
+        }
+        static FetchJson(url) {
+            return fetch(url, {
+                cache: "no-cache",
+                method: "GET",
+                mode: "cors",
+            })
+                .then((res) => {
+                if (res.status >= 200 && res.status < 300) {
+                    return res.json();
+                }
+                else {
+                    return Promise.reject(new Error(res.statusText));
+                }
+            });
+        }
+        static ProcessAircraftData(data) {
+            const now = data.now;
+            if (this.messageCountHistory.length > 0 && this.messageCountHistory[this.messageCountHistory.length - 1].messages > data.messages) {
+                this.messageCountHistory = [{
+                        messages: 0,
+                        time: this.messageCountHistory[this.messageCountHistory.length - 1].time,
+                    }];
+            }
+            this.messageCountHistory.push({ time: now, messages: data.messages });
+            if ((now - this.messageCountHistory[0].time) > 30) {
+                this.messageCountHistory.shift();
+            }
+            READSB.AircraftCollection.Update(data, now, this.lastReceiverTimestamp);
+            this.RefreshAircraftListTable();
+            READSB.Body.RefreshInfoBlock(this.readsbVersion, this.GetMessageRate());
+            READSB.Body.RefreshSelectedAircraft();
+            if (this.lastReceiverTimestamp === now) {
+                this.staleReceiverCount++;
+                if (this.staleReceiverCount > 5) {
+                    READSB.Body.UpdateErrorToast(i18next.t("error.dataTimeOut"), true);
+                }
+            }
+            else {
+                this.staleReceiverCount = 0;
+                this.lastReceiverTimestamp = now;
+                READSB.Body.UpdateErrorToast("", false);
+            }
+        }
         static GetMessageRate() {
             let messageRate = null;
             if (this.messageCountHistory.length > 1) {
@@ -167,6 +311,9 @@ var READSB;
     Main.staleReceiverCount = 0;
     Main.lastReceiverTimestamp = 0;
     Main.messageCountHistory = [];
+    Main.streamAircraft = new Map();
+    Main.tileSize = 0;
+    Main.tileCache = new Map();
     READSB.Main = Main;
 })(READSB || (READSB = {}));
 //# sourceMappingURL=readsb.js.map
\ No newline at end of file
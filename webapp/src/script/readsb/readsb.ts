@@ -90,12 +90,14 @@ namespace READSB {
                     AircraftCollection.Clean();
                     console.info("Completing init");
 
-                    // Setup our timer to poll from the server.
-                    window.setInterval(Main.FetchData.bind(Main), Main.DataRefreshInterval);
                     window.setInterval(AircraftCollection.Clean.bind(AircraftCollection), 60000);
 
-                    // And kick off one refresh immediately.
-                    Main.FetchData();
+                    // Receive aircraft data from the server.
+                    if (data.tiles) {
+                        Main.StartTilePolling(data.tiles);
+                    } else {
+                        Main.StartDataStream();
+                    }
                 });
         }
 
@@ -156,40 +158,7 @@ namespace READSB {
                     return res.json();
                 })
                 .then((data: IAircraftData) => {
-                    const now = data.now;
-                    // Detect stats reset
-                    if (this.messageCountHistory.length > 0 && this.messageCountHistory[this.messageCountHistory.length - 1].messages > data.messages) {
-                        this.messageCountHistory = [{
-                            messages: 0,
-                            time: this.messageCountHistory[this.messageCountHistory.length - 1].time,
-                        }];
-                    }
-
-                    // Note the message count in the history
-                    this.messageCountHistory.push({ time: now, messages: data.messages });
-                    // and clean up any old values
-                    if ((now - this.messageCountHistory[0].time) > 30) {
-                        this.messageCountHistory.shift();
-                    }
-
-                    // Update aircraft data, timestamps, visibility, history track for all aircrafts.
-                    AircraftCollection.Update(data, now, this.lastReceiverTimestamp);
-
-                    this.RefreshAircraftListTable();
-                    Body.RefreshInfoBlock(this.readsbVersion, this.GetMessageRate());
-                    Body.RefreshSelectedAircraft();
-
-                    // Check for stale receiver data
-                    if (this.lastReceiverTimestamp === now) {
-                        this.staleReceiverCount++;
-                        if (this.staleReceiverCount > 5) {
-                            Body.UpdateErrorToast(i18next.t("error.dataTimeOut"), true);
-                        }
-                    } else {
-                        this.staleReceiverCount = 0;
-                        this.lastReceiverTimestamp = now;
-                        Body.UpdateErrorToast("", false);
-                    }
+                    this.ProcessAircraftData(data);
                     this.fetchPending = false;
                 })
                 .catch((error) => {
@@ -208,6 +177,9 @@ namespace READSB {
         private static staleReceiverCount: number = 0;
         private static lastReceiverTimestamp: number = 0;
         private static messageCountHistory: IMessageCountHistory[] = [];
+        private static streamAircraft: Map<string, { [key: string]: any }> = new Map();
+        private static tileSize: number = 0;
+        private static tileCache: Map<string, { version: number, data: IAircraftData }> = new Map();
 
         /**
          * Refreshes the aircraft list table in GUI.
@@ -221,6 +193,224 @@ namespace READSB {
             AircraftCollection.ResortList();
         }
 
+        /**
+         * Receive aircraft data as a stream of changes from the readsb HTTP
+         * server. Falls back to polling aircraft.json when the browser or
+         * the web server doesn't do event streams.
+         */
+        private static StartDataStream() {
+            if (typeof EventSource === "undefined") {
+                this.StartPolling();
+                return;
+            }
+
+            const source = new EventSource("data/aircraft.sse");
+            source.addEventListener("snapshot", (ev: MessageEvent) => {
+                const data: IAircraftData = JSON.parse(ev.data);
+                this.streamAircraft.clear();
+                for (const ac of data.aircraft) {
+                    this.streamAircraft.set(ac.hex, ac);
+                }
+                this.ProcessAircraftData(data);
+            });
+            source.addEventListener("delta", (ev: MessageEvent) => {
+                const data: IAircraftDelta = JSON.parse(ev.data);
+                for (const ac of data.aircraft) {
+                    const known = this.streamAircraft.get(ac.hex);
+                    if (known === undefined) {
+                        this.streamAircraft.set(ac.hex, ac);
+                        continue;
+                    }
+                    for (const key of Object.keys(ac)) {
+                        if (ac[key] === null) {
+                            delete known[key];
+                        } else {
+                            known[key] = ac[key];
+                        }
+                    }
+                }
+                for (const hex of data.gone) {
+                    this.streamAircraft.delete(hex);
+                }
+                this.ProcessAircraftData({
+                    aircraft: Array.from(this.streamAircraft.values()) as IJsonData[],
+                    messages: data.messages,
+                    now: data.now,
+                });
+            });
+            source.onerror = () => {
+                // The browser reconnects a stream that broke off, but gives
+                // up on one that was refused.
+                if (source.readyState === EventSource.CLOSED) {
+                    this.StartPolling();
+                }
+            };
+        }
+
+        /**
+         * Poll aircraft.json every refresh interval.
+         */
+        private static StartPolling() {
+            window.setInterval(Main.FetchData.bind(Main), Main.DataRefreshInterval);
+
+            // And kick off one refresh immediately.
+            Main.FetchData();
+        }
+
+        /**
+         * Poll only the tiles of aircraft.json in the map view, when readsb
+         * writes them (--write-json-tiles).
+         * @param size Tile size in degrees.
+         */
+        private static StartTilePolling(size: number) {
+            this.tileSize = size;
+            window.setInterval(Main.FetchTiles.bind(Main), Main.DataRefreshInterval);
+
+            // And kick off one refresh immediately.
+            Main.FetchTiles();
+        }
+
+        /**
+         * Fetch the tile index, then those tiles in view that were written
+         * since they were fetched last.
+         */
+        private static FetchTiles() {
+            if (this.fetchPending) {
+                return;
+            }
+
+            this.fetchPending = true;
+            this.FetchJson("data/tiles/index.json")
+                .then((index: ITileIndex) => {
+                    const names = this.VisibleTiles().filter((name) => index.tiles[name] !== undefined);
+                    const inView = new Set(names);
+                    for (const name of Array.from(this.tileCache.keys())) {
+                        if (!inView.has(name)) {
+                            this.tileCache.delete(name);
+                        }
+                    }
+
+                    return Promise.all(names.map((name) => {
+                        const cached = this.tileCache.get(name);
+                        if (cached !== undefined && cached.version === index.tiles[name]) {
+                            return Promise.resolve(cached.data);
+                        }
+                        return this.FetchJson(`data/tiles/${name}.json`)
+                            .then((data: IAircraftData) => {
+                                this.tileCache.set(name, { version: index.tiles[name], data });
+                                return data;
+                            });
+                    }))
+                        .then((tiles: IAircraftData[]) => {
+                            const aircraft: IJsonData[] = [];
+                            for (const tile of tiles) {
+                                // Tiles are only written when they change, age
+                                // their aircraft to the time of the index.
+                                const age = index.now - tile.now;
+                                for (const ac of tile.aircraft) {
+                                    const copy = Object.assign({}, ac);
+                                    copy.seen += age;
+                                    if (copy.seen_pos !== undefined) {
+                                        copy.seen_pos += age;
+                                    }
+                                    aircraft.push(copy);
+                                }
+                            }
+                            this.ProcessAircraftData({ aircraft, messages: index.messages, now: index.now });
+                            this.fetchPending = false;
+                        });
+                })
+                .catch((error) => {
+                    this.fetchPending = false;
+                    Body.UpdateErrorToast(i18next.t("error.fetchingData", { msg: error }), true);
+                    console.error(error);
+                });
+        }
+
+        /**
+         * Names of the tiles covering the map view.
+         */
+        private static VisibleTiles(): string[] {
+            const size = this.tileSize;
+            const bounds = LMap.MapViewBounds;
+            const names: string[] = [];
+            const south = bounds ? Math.max(-90, Math.floor(bounds.getSouth() / size) * size) : -90;
+            const north = bounds ? Math.min(90, bounds.getNorth()) : 90;
+            let west = bounds ? Math.floor(bounds.getWest() / size) * size : -180;
+            let east = bounds ? bounds.getEast() : 180;
+            if (east - west >= 360) {
+                west = -180;
+                east = 180;
+            }
+
+            for (let lat = south; lat < north; lat += size) {
+                for (let lon = west; lon < east; lon += size) {
+                    // The view runs past 180 degrees when the map wraps around.
+                    names.push(`${lat}_${((lon + 180) % 360 + 360) % 360 - 180}`);
+                }
+            }
+            return names;
+        }
+
+        /**
+         * Fetch and parse a JSON document.
+         * @param url Document to fetch.
+         */
+        private static FetchJson(url: string): Promise<any> {
+            return fetch(url, {
+                cache: "no-cache",
+                method: "GET",
+                mode: "cors",
+            })
+                .then((res: Response) => {
+                    if (res.status >= 200 && res.status < 300) {
+                        return res.json();
+                    } else {
+                        return Promise.reject(new Error(res.statusText));
+                    }
+                });
+        }
+
+        /**
+         * Update everything from a new aircraft.json record.
+         */
+        private static ProcessAircraftData(data: IAircraftData) {
+            const now = data.now;
+            // Detect stats reset
+            if (this.messageCountHistory.length > 0 && this.messageCountHistory[this.messageCountHistory.length - 1].messages > data.messages) {
+                this.messageCountHistory = [{
+                    messages: 0,
+                    time: this.messageCountHistory[this.messageCountHistory.length - 1].time,
+                }];
+            }
+
+            // Note the message count in the history
+            this.messageCountHistory.push({ time: now, messages: data.messages });
+            // and clean up any old values
+            if ((now - this.messageCountHistory[0].time) > 30) {
+                this.messageCountHistory.shift();
+            }
+
+            // Update aircraft data, timestamps, visibility, history track for all aircrafts.
+            AircraftCollection.Update(data, now, this.lastReceiverTimestamp);
+
+            this.RefreshAircraftListTable();
+            Body.RefreshInfoBlock(this.readsbVersion, this.GetMessageRate());
+            Body.RefreshSelectedAircraft();
+
+            // Check for stale receiver data
+            if (this.lastReceiverTimestamp === now) {
+                this.staleReceiverCount++;
+                if (this.staleReceiverCount > 5) {
+                    Body.UpdateErrorToast(i18next.t("error.dataTimeOut"), true);
+                }
+            } else {
+                this.staleReceiverCount = 0;
+                this.lastReceiverTimestamp = now;
+                Body.UpdateErrorToast("", false);
+            }
+        }
+
         private static GetMessageRate(): number {
             let messageRate: number = null;
             if (this.messageCountHistory.length > 1) {
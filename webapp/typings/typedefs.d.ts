@@ -319,12 +319,22 @@ declare namespace READSB {
     }
 
     /**
-     * A JSON record of aircraft history data.
+     * One sample of aircraft history data, as decoded from history.bin.
      */
     export interface IHistoryData {
         now: number;
-        messages: number;
-        aircraft: IJsonData[];
+        aircraft: IHistoryPosition[];
+    }
+
+    /**
+     * Position of one aircraft in a history sample.
+     */
+    export interface IHistoryPosition {
+        hex: string;
+        lat: number;
+        lon: number;
+        alt_baro?: number | string;
+        gs?: number;
     }
 
     /**
@@ -336,6 +346,18 @@ declare namespace READSB {
         aircraft: IJsonData[];
     }
 
+    /**
+     * Changes to the aircraft data, from the event stream of the readsb
+     * HTTP server. New aircraft come as complete records, others as hex
+     * and the fields that changed, with null for fields that went away.
+     */
+    export interface IAircraftDelta {
+        now: number;
+        messages: number;
+        aircraft: Array<{ [key: string]: any }>;
+        gone: string[];
+    }
+
     /**
      * Aircraft message count history.
      */
@@ -408,5 +430,16 @@ declare namespace READSB {
         history: number;
         lat: number;
         lon: number;
+        tiles?: number;
+    }
+
+    /**
+     * Index of the aircraft.json tiles, tiles/index.json.
+     */
+    export interface ITileIndex {
+        now: number;
+        messages: number;
+        size: number;
+        tiles: { [name: string]: number };
     }
 }